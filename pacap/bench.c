@@ -0,0 +1,221 @@
+/*************************************************************************
+ Description: Callback latency/jitter benchmark, see bench.h.
+
+              A deadline miss for output means the callback returned (mapped
+              onto the stream clock via currentTime) later than
+              outputBufferDacTime. Input buffers have no such deadline, and
+              neither do hosts which report no buffer times, a miss then
+              means the callback took longer than its buffer lasts.
+ ************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+static const char *output_names[] = {"text", "json", "csv"};
+
+void bench_init(struct Bench *bench, double rate, int is_output)
+{
+    memset(bench, 0, sizeof(*bench));
+    hist_reset(&bench->period);
+    hist_reset(&bench->jitter);
+    hist_reset(&bench->processing);
+    hist_reset(&bench->buffer_lead);
+    bench->rate = rate;
+    bench->is_output = is_output;
+}
+
+int bench_output_from_name(const char *name, enum Bench_output *output)
+{
+    unsigned i;
+    for (i = 0; i < sizeof(output_names)/sizeof(output_names[0]); ++i)
+    {
+        if (!strcmp(name, output_names[i]))
+        {
+            *output = (enum Bench_output)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void bench_record(struct Bench *bench, uint64_t entry_ns, uint64_t exit_ns, unsigned long frames,
+                  const PaStreamCallbackTimeInfo *time_info)
+{
+    uint64_t processing = exit_ns - entry_ns;
+    double budget = frames / bench->rate;
+
+    hist_record(&bench->processing, processing);
+
+    if (bench->callbacks > 0)
+    {
+        int64_t period = entry_ns - bench->last_entry_ns;
+        int64_t expected = (int64_t)(bench->last_frames / bench->rate * 1e9);
+        hist_record(&bench->period, period);
+        hist_record(&bench->jitter, llabs(period - expected));
+    }
+    bench->last_entry_ns = entry_ns;
+    bench->last_frames = frames;
+    bench->callbacks++;
+    bench->frames += frames;
+
+    if (processing > budget * 1e9)
+        bench->budget_overruns++;
+
+    PaTime buffer_time = 0;
+    if (time_info)
+        buffer_time = bench->is_output ? time_info->outputBufferDacTime : time_info->inputBufferAdcTime;
+
+    if (time_info == NULL || buffer_time == 0)
+    {
+        bench->untimed++;
+        if (processing > budget * 1e9)
+            bench->deadline_misses++;
+        return;
+    }
+
+    double lead = bench->is_output ? buffer_time - time_info->currentTime : time_info->currentTime - buffer_time;
+    if (lead < 0)
+        bench->negative_leads++;
+    else
+        hist_record(&bench->buffer_lead, (uint64_t)(lead * 1e9));
+
+    if (bench->is_output)
+    {
+        if (time_info->currentTime + processing / 1e9 > buffer_time)
+            bench->deadline_misses++;
+    }
+    else if (processing > budget * 1e9)
+        bench->deadline_misses++;
+}
+
+/*******************************************************
+ * Report
+ *
+ * All formats print the same flat list of named fields.
+ *******************************************************/
+
+struct Field
+{
+    const char *name;
+    const char *str;    // string value, or NULL for numeric one
+    double num;
+};
+
+#define MAX_FIELDS 64
+
+struct Fields
+{
+    struct Field f[MAX_FIELDS];
+    int n;
+};
+
+static void add_num(struct Fields *fields, const char *name, double num)
+{
+    if (fields->n < MAX_FIELDS)
+    {
+        fields->f[fields->n].name = name;
+        fields->f[fields->n].str = NULL;
+        fields->f[fields->n].num = num;
+        fields->n++;
+    }
+}
+
+static void add_str(struct Fields *fields, const char *name, const char *str)
+{
+    add_num(fields, name, 0);
+    fields->f[fields->n - 1].str = str;
+}
+
+static void add_hist(struct Fields *fields, const char **names, const struct Histogram *hist)
+{
+    add_num(fields, names[0], hist->total ? hist->min / 1e3 : 0);
+    add_num(fields, names[1], hist_mean(hist) / 1e3);
+    add_num(fields, names[2], hist_stddev(hist) / 1e3);
+    add_num(fields, names[3], hist_percentile(hist, 50) / 1e3);
+    add_num(fields, names[4], hist_percentile(hist, 99) / 1e3);
+    add_num(fields, names[5], hist_percentile(hist, 99.9) / 1e3);
+    add_num(fields, names[6], hist->max / 1e3);
+}
+
+#define HIST_FIELD_NAMES(prefix) \
+    { prefix "_min_us", prefix "_mean_us", prefix "_stddev_us", prefix "_p50_us", \
+      prefix "_p99_us", prefix "_p999_us", prefix "_max_us" }
+
+void bench_report(struct Bench *bench, const struct Bench_config *config, struct Telemetry *telemetry,
+                  enum Bench_output output, FILE *fp)
+{
+    static const char *period_names[] = HIST_FIELD_NAMES("period");
+    static const char *jitter_names[] = HIST_FIELD_NAMES("jitter");
+    static const char *processing_names[] = HIST_FIELD_NAMES("processing");
+    static const char *lead_names[] = HIST_FIELD_NAMES("buffer_lead");
+
+    struct Fields fields;
+    fields.n = 0;
+
+    double callbacks = bench->callbacks ? bench->callbacks : 1;
+
+    add_num(&fields, "device", config->device);
+    add_str(&fields, "direction", config->is_output ? "output" : "input");
+    add_str(&fields, "format", config->format);
+    add_num(&fields, "channel", config->channel);
+    add_num(&fields, "rate", config->rate);
+    add_num(&fields, "latency", config->latency);
+    add_num(&fields, "frames_per_buffer", config->frames_per_buffer);
+    add_num(&fields, "callbacks", bench->callbacks);
+    add_num(&fields, "mean_frames_per_callback", bench->frames / callbacks);
+    add_num(&fields, "nominal_period_us", bench->frames / callbacks / config->rate * 1e6);
+    add_hist(&fields, period_names, &bench->period);
+    add_hist(&fields, jitter_names, &bench->jitter);
+    add_hist(&fields, processing_names, &bench->processing);
+    add_hist(&fields, lead_names, &bench->buffer_lead);
+    add_num(&fields, "negative_leads", bench->negative_leads);
+    add_num(&fields, "untimed_callbacks", bench->untimed);
+    add_num(&fields, "deadline_misses", bench->deadline_misses);
+    add_num(&fields, "deadline_miss_rate", bench->deadline_misses / callbacks);
+    add_num(&fields, "budget_overruns", bench->budget_overruns);
+    add_num(&fields, "budget_overrun_rate", bench->budget_overruns / callbacks);
+    add_num(&fields, "output_underflows", telemetry_get(telemetry, TM_OUTPUT_UNDERFLOW));
+    add_num(&fields, "output_overflows", telemetry_get(telemetry, TM_OUTPUT_OVERFLOW));
+    add_num(&fields, "input_underflows", telemetry_get(telemetry, TM_INPUT_UNDERFLOW));
+    add_num(&fields, "input_overflows", telemetry_get(telemetry, TM_INPUT_OVERFLOW));
+
+    int i;
+    switch (output)
+    {
+        case BENCH_TEXT:
+            for (i = 0; i < fields.n; ++i)
+            {
+                if (fields.f[i].str)
+                    fprintf(fp, "%-28s: %s\n", fields.f[i].name, fields.f[i].str);
+                else
+                    fprintf(fp, "%-28s: %.6g\n", fields.f[i].name, fields.f[i].num);
+            }
+            break;
+        case BENCH_JSON:
+            fprintf(fp, "{");
+            for (i = 0; i < fields.n; ++i)
+            {
+                if (fields.f[i].str)
+                    fprintf(fp, "%s\"%s\": \"%s\"", i ? ", " : "", fields.f[i].name, fields.f[i].str);
+                else
+                    fprintf(fp, "%s\"%s\": %.9g", i ? ", " : "", fields.f[i].name, fields.f[i].num);
+            }
+            fprintf(fp, "}\n");
+            break;
+        case BENCH_CSV:
+            for (i = 0; i < fields.n; ++i)
+                fprintf(fp, "%s%s", i ? "," : "", fields.f[i].name);
+            fprintf(fp, "\n");
+            for (i = 0; i < fields.n; ++i)
+            {
+                if (fields.f[i].str)
+                    fprintf(fp, "%s%s", i ? "," : "", fields.f[i].str);
+                else
+                    fprintf(fp, "%s%.9g", i ? "," : "", fields.f[i].num);
+            }
+            fprintf(fp, "\n");
+            break;
+    }
+}
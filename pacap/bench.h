@@ -0,0 +1,73 @@
+/*************************************************************************
+ Description: Callback latency/jitter benchmark.
+
+              The audio callback timestamps its own entry and exit with the
+              monotonic clock and records the derived intervals into
+              histograms. Once the stream is stopped the results are written
+              as text, JSON or CSV, so runs can be compared by scripts.
+ ************************************************************************/
+
+#ifndef PACAP_BENCH_H
+#define PACAP_BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "portaudio.h"
+#include "histogram.h"
+#include "telemetry.h"
+
+enum Bench_output
+{
+    BENCH_TEXT,
+    BENCH_JSON,
+    BENCH_CSV
+};
+
+/* stream parameters echoed in the report, so that results are self-describing */
+struct Bench_config
+{
+    int device;
+    const char *format;
+    int channel;
+    double rate;
+    double latency;
+    unsigned long frames_per_buffer;    // as requested, 0 means unspecified
+    int is_output;
+};
+
+struct Bench
+{
+    struct Histogram period;        // ns between entries of consecutive callbacks
+    struct Histogram jitter;        // ns between actual period and duration of the previous buffer
+    struct Histogram processing;    // ns between entry and exit of one callback
+    struct Histogram buffer_lead;   // ns between currentTime and the DAC time (ADC time for input)
+
+    double rate;
+    int is_output;
+
+    uint64_t last_entry_ns;
+    unsigned long last_frames;
+
+    uint64_t callbacks;
+    uint64_t frames;
+    uint64_t deadline_misses;   // callback returned after its buffer was due
+    uint64_t budget_overruns;   // callback took longer than its buffer lasts
+    uint64_t negative_leads;    // host reported a buffer time before currentTime
+    uint64_t untimed;           // host reported no buffer time at all
+};
+
+void bench_init(struct Bench *bench, double rate, int is_output);
+
+// called at the end of the audio callback, timestamps from telemetry_now_ns()
+void bench_record(struct Bench *bench, uint64_t entry_ns, uint64_t exit_ns, unsigned long frames,
+                  const PaStreamCallbackTimeInfo *time_info);
+
+// return 0 on success, -1 if name is unknown
+int bench_output_from_name(const char *name, enum Bench_output *output);
+
+// write results, xrun counts are taken from `telemetry`
+void bench_report(struct Bench *bench, const struct Bench_config *config, struct Telemetry *telemetry,
+                  enum Bench_output output, FILE *fp);
+
+#endif
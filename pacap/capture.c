@@ -0,0 +1,157 @@
+/*************************************************************************
+ Description: Capture sink, see capture.h.
+ ************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "capture.h"
+#include "wav.h"
+
+/* the writer waits until at least this much is buffered, to keep writes large */
+#define WRITE_CHUNK_BYTES (256 * 1024)
+
+/* how long the writer sleeps when there is not enough to write */
+#define WRITER_POLL_MS 10
+
+static int has_suffix(const char *s, const char *suffix)
+{
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && !strcasecmp(s + n - m, suffix);
+}
+
+int capture_open(struct Capture *capture, const char *path, PaSampleFormat format, int channel,
+                 double rate, double ring_seconds)
+{
+    memset(capture, 0, sizeof(*capture));
+    capture->format = format & ~paNonInterleaved;
+    capture->channel = channel;
+    capture->rate = rate;
+    capture->bytes_per_frame = Pa_GetSampleSize(capture->format) * channel;
+    capture->is_wav = has_suffix(path, ".wav");
+
+    if (capture->is_wav && wav_format_supported(capture->format) != 0)
+    {
+        printf("This format can't be stored in WAV, use a raw file instead\n");
+        return -1;
+    }
+
+    size_t ring_bytes = ring_seconds * rate * capture->bytes_per_frame;
+    if (ring_bytes < capture->bytes_per_frame)
+        ring_bytes = capture->bytes_per_frame;
+    if (ring_init(&capture->ring, ring_bytes) != 0)
+    {
+        printf("Failed to allocate %zu bytes for capture ring\n", ring_bytes);
+        return -1;
+    }
+
+    capture->fp = fopen(path, "wb");
+    if (capture->fp == NULL)
+    {
+        perror(path);
+        ring_free(&capture->ring);
+        return -1;
+    }
+
+    if (capture->is_wav && wav_write_header(capture->fp, capture->format, channel, rate, 0) != 0)
+    {
+        printf("Failed to write WAV header\n");
+        fclose(capture->fp);
+        ring_free(&capture->ring);
+        return -1;
+    }
+    return 0;
+}
+
+void capture_push(struct Capture *capture, const void *input_buf, unsigned long frames)
+{
+    size_t bytes = frames * capture->bytes_per_frame;
+    if (input_buf == NULL || ring_write(&capture->ring, input_buf, bytes) != bytes)
+    {
+        atomic_fetch_add_explicit(&capture->overruns, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&capture->frames_dropped, frames, memory_order_relaxed);
+    }
+}
+
+// write out whatever is in the ring if there is at least `min_bytes` of it
+static void drain(struct Capture *capture, size_t min_bytes)
+{
+    const void *part1, *part2;
+    size_t len1, len2;
+
+    size_t avail = ring_peek(&capture->ring, &part1, &len1, &part2, &len2);
+    if (avail == 0 || avail < min_bytes)
+        return;
+
+    // once writing failed keep draining so the callback sees no overruns, but drop the data
+    if (!atomic_load(&capture->write_error))
+    {
+        if (fwrite(part1, 1, len1, capture->fp) != len1 ||
+            (len2 && fwrite(part2, 1, len2, capture->fp) != len2))
+            atomic_store(&capture->write_error, 1);
+        else
+            atomic_fetch_add(&capture->bytes_written, avail);
+    }
+
+    ring_consume(&capture->ring, avail);
+}
+
+static void *writer_main(void *arg)
+{
+    struct Capture *capture = (struct Capture*)arg;
+    const struct timespec poll = {0, WRITER_POLL_MS * 1000 * 1000};
+
+    size_t chunk = WRITE_CHUNK_BYTES;
+    if (chunk > capture->ring.size / 2)
+        chunk = capture->ring.size / 2;
+
+    while (!atomic_load(&capture->is_stopping))
+    {
+        drain(capture, chunk);
+        nanosleep(&poll, NULL);
+    }
+
+    // the stream is stopped already, write out the rest
+    drain(capture, 0);
+    return NULL;
+}
+
+int capture_start(struct Capture *capture)
+{
+    if (pthread_create(&capture->writer, NULL, writer_main, capture) != 0)
+    {
+        printf("Failed to create capture writer thread\n");
+        return -1;
+    }
+    return 0;
+}
+
+void capture_get_stats(struct Capture *capture, struct Capture_stats *stats)
+{
+    stats->frames_written = atomic_load(&capture->bytes_written) / capture->bytes_per_frame;
+    stats->overruns = atomic_load(&capture->overruns);
+    stats->frames_dropped = atomic_load(&capture->frames_dropped);
+    stats->write_error = atomic_load(&capture->write_error);
+}
+
+int capture_close(struct Capture *capture)
+{
+    int ret = 0;
+
+    atomic_store(&capture->is_stopping, 1);
+    pthread_join(capture->writer, NULL);
+
+    if (capture->is_wav &&
+        wav_finalize(capture->fp, capture->format, capture->channel, capture->rate, atomic_load(&capture->bytes_written)) != 0)
+        ret = -1;
+    if (atomic_load(&capture->write_error))
+        ret = -1;
+
+    if (fclose(capture->fp) != 0)
+        ret = -1;
+
+    ring_free(&capture->ring);
+    return ret;
+}
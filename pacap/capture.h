@@ -0,0 +1,67 @@
+/*************************************************************************
+ Description: Capture sink.
+
+              The audio callback only copies captured frames into a ring
+              buffer, a writer thread drains the ring into a WAV or raw file
+              in large sequential writes. Ring overruns are counted, never
+              printed from the audio thread.
+ ************************************************************************/
+
+#ifndef PACAP_CAPTURE_H
+#define PACAP_CAPTURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "portaudio.h"
+#include "ring.h"
+
+struct Capture_stats
+{
+    uint64_t frames_written;    // frames written to file
+    unsigned long overruns;     // callbacks whose frames didn't fit in the ring
+    unsigned long frames_dropped;
+    int write_error;            // non-zero if writing the file failed
+};
+
+struct Capture
+{
+    struct Ring ring;
+    FILE *fp;
+    int is_wav;
+    PaSampleFormat format;
+    int channel;
+    double rate;
+    size_t bytes_per_frame;
+
+    pthread_t writer;
+    atomic_int is_stopping;
+
+    /* written by the callback */
+    atomic_ulong overruns;
+    atomic_ulong frames_dropped;
+
+    /* written by the writer thread */
+    _Atomic uint64_t bytes_written;
+    atomic_int write_error;
+};
+
+/* open `path` and allocate a ring holding `ring_seconds` of audio,
+ * a ".wav" suffix selects WAV, anything else is stored raw. return 0 on success */
+int capture_open(struct Capture *capture, const char *path, PaSampleFormat format, int channel,
+                 double rate, double ring_seconds);
+
+// start the writer thread
+int capture_start(struct Capture *capture);
+
+// called from the audio callback: copy `frames` interleaved frames into the ring, never blocks
+void capture_push(struct Capture *capture, const void *input_buf, unsigned long frames);
+
+void capture_get_stats(struct Capture *capture, struct Capture_stats *stats);
+
+// stop the writer after draining the ring, finalize and close the file
+int capture_close(struct Capture *capture);
+
+#endif
@@ -0,0 +1,37 @@
+# Description: Render a WAV file and check that its data chunk covers exactly the bytes
+#              in the file, and as many as expected. Run by ctest as
+#              cmake -DPACAP=... -DWAV=... -DEXPECT_BYTES=... -DARGS="render;..." -P check_wav.cmake
+
+execute_process(COMMAND ${PACAP} ${ARGS} --out=${WAV} RESULT_VARIABLE ret OUTPUT_QUIET)
+if(NOT ret EQUAL 0)
+    message(FATAL_ERROR "pacap ${ARGS} failed: ${ret}")
+endif()
+
+file(READ ${WAV} header LIMIT 256 HEX)
+string(FIND ${header} "64617461" pos)
+if(pos LESS 0)
+    message(FATAL_ERROR "${WAV} has no data chunk in its first 256 bytes")
+endif()
+
+# the chunk size is little-endian behind its id
+math(EXPR size_pos "${pos} + 8")
+string(SUBSTRING ${header} ${size_pos} 8 le)
+set(be "")
+foreach(i 6 4 2 0)
+    string(SUBSTRING ${le} ${i} 2 byte)
+    set(be "${be}${byte}")
+endforeach()
+math(EXPR data_bytes "0x${be}")
+math(EXPR data_offset "${pos} / 2 + 8")
+
+file(SIZE ${WAV} file_size)
+math(EXPR actual_bytes "${file_size} - ${data_offset}")
+# an odd length is padded by one byte
+math(EXPR padded_bytes "${data_bytes} + ${data_bytes} % 2")
+if(NOT actual_bytes EQUAL padded_bytes)
+    message(FATAL_ERROR "${WAV}: the header says ${data_bytes} data bytes, the file holds ${actual_bytes}")
+endif()
+if(DEFINED EXPECT_BYTES AND NOT data_bytes EQUAL EXPECT_BYTES)
+    message(FATAL_ERROR "${WAV}: ${data_bytes} data bytes, ${EXPECT_BYTES} expected")
+endif()
+message(STATUS "${WAV}: ${data_bytes} data bytes")
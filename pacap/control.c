@@ -0,0 +1,343 @@
+/*************************************************************************
+ Description: Control channel of a running stream, see control.h.
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "control.h"
+#include "telemetry.h"
+
+/* the middle slot holds a message the reader hasn't taken */
+#define CONTROL_MAILBOX_NEW 4u
+
+/* how often the thread looks at the answers when no command comes */
+#define CONTROL_POLL_MS 10
+
+void control_mailbox_init(struct Control_mailbox *mailbox, const struct Control_message *message)
+{
+    int i;
+    for (i = 0; i < 3; ++i)
+        mailbox->slots[i] = *message;
+    mailbox->back = 0;
+    atomic_init(&mailbox->middle, 1);
+    mailbox->front = 2;
+}
+
+void control_mailbox_post(struct Control_mailbox *mailbox, const struct Control_message *message)
+{
+    mailbox->slots[mailbox->back] = *message;
+    // release the slot just written, get back whichever the reader left in the middle
+    mailbox->back = atomic_exchange_explicit(&mailbox->middle, mailbox->back | CONTROL_MAILBOX_NEW,
+                                             memory_order_acq_rel) & ~CONTROL_MAILBOX_NEW;
+}
+
+int control_mailbox_take(struct Control_mailbox *mailbox, struct Control_message *message)
+{
+    if (!(atomic_load_explicit(&mailbox->middle, memory_order_relaxed) & CONTROL_MAILBOX_NEW))
+        return 0;
+    mailbox->front = atomic_exchange_explicit(&mailbox->middle, mailbox->front,
+                                              memory_order_acq_rel) & ~CONTROL_MAILBOX_NEW;
+    *message = mailbox->slots[mailbox->front];
+    return 1;
+}
+
+int control_open(struct Control *control, const char *path, double freq, double gain_db, double ramp_ms, double rate)
+{
+    memset(control, 0, sizeof(*control));
+    control->path = path;
+    control->listen_fd = -1;
+    control->rate = rate;
+    control->current.freq = freq;
+    control->current.gain_db = gain_db;
+    control->current.ramp_ms = ramp_ms;
+    control_mailbox_init(&control->params, &control->current);
+    control_mailbox_init(&control->answers, &control->current);
+    atomic_init(&control->is_stopping, 0);
+
+    int i;
+    for (i = 0; i < CONTROL_MAX_CLIENTS; ++i)
+        control->clients[i].fd = -1;
+    if (path == NULL)
+    {
+        // stdin is the only client
+        control->clients[0].fd = STDIN_FILENO;
+        return 0;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        printf("Control socket path is too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // a socket left over by an earlier run is replaced, anything else is kept
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+
+    control->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (control->listen_fd < 0 || bind(control->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(control->listen_fd, CONTROL_MAX_CLIENTS) != 0)
+    {
+        perror(path);
+        if (control->listen_fd >= 0)
+            close(control->listen_fd);
+        control->listen_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// answer a client, stdout for stdin
+static void reply(int fd, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void reply(int fd, const char *fmt, ...)
+{
+    char buf[CONTROL_LINE_MAX * 2];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (fd == STDIN_FILENO)
+    {
+        fputs(buf, stdout);
+        fflush(stdout);
+    }
+    // a client which went away is dropped on its next read, not by SIGPIPE here
+    else if (len > 0)
+        send(fd, buf, len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1, MSG_NOSIGNAL);
+}
+
+static void run_command(struct Control *control, int fd, char *line)
+{
+    char name[16];
+    double value;
+    char extra;
+
+    if (sscanf(line, "%15s %lf %c", name, &value, &extra) != 2)
+    {
+        reply(fd, "error: expected \"freq HZ\", \"gain DB\" or \"ramp MS\"\n");
+        return;
+    }
+
+    struct Control_message message = control->current;
+    if (!strcmp(name, "freq"))
+    {
+        if (value <= 0 || value >= control->rate / 2)
+        {
+            reply(fd, "error: frequency must be above 0 and below %.0f Hz\n", control->rate / 2);
+            return;
+        }
+        message.freq = value;
+    }
+    else if (!strcmp(name, "gain"))
+    {
+        if (value > 0)
+        {
+            reply(fd, "error: gain can't be above 0 dB\n");
+            return;
+        }
+        message.gain_db = value;
+    }
+    else if (!strcmp(name, "ramp"))
+    {
+        if (value < 0)
+        {
+            reply(fd, "error: ramp can't be negative\n");
+            return;
+        }
+        message.ramp_ms = value;
+    }
+    else
+    {
+        reply(fd, "error: unknown command %s\n", name);
+        return;
+    }
+
+    message.seq = ++control->commands;
+    message.sent_ns = telemetry_now_ns();
+    control->current = message;
+    control_mailbox_post(&control->params, &message);
+    reply(fd, "ok %llu\n", (unsigned long long)message.seq);
+}
+
+// read what a client sent, run every complete line. return -1 once the client is gone
+static int read_client(struct Control *control, struct Control_client *client)
+{
+    ssize_t n = read(client->fd, client->line + client->len, sizeof(client->line) - 1 - client->len);
+    if (n <= 0)
+        return n < 0 && errno == EINTR ? 0 : -1;
+    client->len += n;
+    client->line[client->len] = '\0';
+
+    char *begin = client->line;
+    char *end;
+    while ((end = strchr(begin, '\n')) != NULL)
+    {
+        *end = '\0';
+        if (end > begin && end[-1] == '\r')
+            end[-1] = '\0';
+        if (*begin != '\0')
+            run_command(control, client->fd, begin);
+        begin = end + 1;
+    }
+
+    client->len -= begin - client->line;
+    memmove(client->line, begin, client->len);
+    // a line longer than the buffer is dropped
+    if (client->len == sizeof(client->line) - 1)
+    {
+        reply(client->fd, "error: line too long\n");
+        client->len = 0;
+    }
+    return 0;
+}
+
+// account the answer of the callback, it covers every command up to its sequence number
+static void take_answer(struct Control *control)
+{
+    struct Control_message answer;
+    if (!control_mailbox_take(&control->answers, &answer) || answer.seq == 0)
+        return;
+
+    uint64_t apply_ns = answer.applied_ns - answer.sent_ns;
+    uint64_t audible_ns = answer.audible_ns - answer.sent_ns;
+    ++control->answered;
+    control->apply_sum_ns += apply_ns;
+    control->audible_sum_ns += audible_ns;
+    if (apply_ns > control->apply_max_ns)
+        control->apply_max_ns = apply_ns;
+    if (audible_ns > control->audible_max_ns)
+        control->audible_max_ns = audible_ns;
+
+    printf("command %llu: %.0f Hz, %.1f dB, taken by the callback after %.3f ms, audible after %.3f ms\n",
+           (unsigned long long)answer.seq, answer.freq, answer.gain_db, apply_ns / 1e6, audible_ns / 1e6);
+    fflush(stdout);
+}
+
+static void *control_main(void *arg)
+{
+    struct Control *control = arg;
+    struct pollfd fds[CONTROL_MAX_CLIENTS + 1];
+    struct Control_client *polled[CONTROL_MAX_CLIENTS + 1];
+
+    while (!atomic_load(&control->is_stopping))
+    {
+        int n = 0, i;
+        if (control->listen_fd >= 0)
+        {
+            fds[n].fd = control->listen_fd;
+            fds[n].events = POLLIN;
+            polled[n++] = NULL;
+        }
+        for (i = 0; i < CONTROL_MAX_CLIENTS; ++i)
+        {
+            if (control->clients[i].fd < 0)
+                continue;
+            fds[n].fd = control->clients[i].fd;
+            fds[n].events = POLLIN;
+            polled[n++] = &control->clients[i];
+        }
+
+        int ready = poll(fds, n, CONTROL_POLL_MS);
+        for (i = 0; ready > 0 && i < n; ++i)
+        {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            if (polled[i] == NULL)
+            {
+                int fd = accept(control->listen_fd, NULL, NULL);
+                int j;
+                for (j = 0; fd >= 0 && j < CONTROL_MAX_CLIENTS; ++j)
+                {
+                    if (control->clients[j].fd < 0)
+                    {
+                        control->clients[j].fd = fd;
+                        control->clients[j].len = 0;
+                        break;
+                    }
+                }
+                if (fd >= 0 && j == CONTROL_MAX_CLIENTS)
+                {
+                    reply(fd, "error: too many clients\n");
+                    close(fd);
+                }
+            }
+            else if (read_client(control, polled[i]) != 0)
+            {
+                // stdin stays open, only it isn't read any more
+                if (polled[i]->fd != STDIN_FILENO)
+                    close(polled[i]->fd);
+                polled[i]->fd = -1;
+            }
+        }
+
+        take_answer(control);
+    }
+    return NULL;
+}
+
+int control_start(struct Control *control)
+{
+    if (pthread_create(&control->thread, NULL, control_main, control) != 0)
+    {
+        printf("Failed to create control thread\n");
+        return -1;
+    }
+    control->has_thread = 1;
+    printf("Reading commands from %s: freq HZ, gain DB, ramp MS\n", control->path ? control->path : "stdin");
+    return 0;
+}
+
+void control_stop(struct Control *control, int is_quiet)
+{
+    if (!control->has_thread)
+        return;
+    atomic_store(&control->is_stopping, 1);
+    pthread_join(control->thread, NULL);
+    control->has_thread = 0;
+    take_answer(control);
+
+    if (is_quiet)
+        return;
+    printf("%-20s: %lu (%lu taken together with a later one)\n", "commands", control->commands,
+           control->commands - control->answered);
+    if (control->answered > 0)
+    {
+        printf("%-20s: mean %.3f ms, max %.3f ms\n", "command to callback",
+               control->apply_sum_ns / 1e6 / control->answered, control->apply_max_ns / 1e6);
+        printf("%-20s: mean %.3f ms, max %.3f ms\n", "command to DAC",
+               control->audible_sum_ns / 1e6 / control->answered, control->audible_max_ns / 1e6);
+    }
+}
+
+void control_close(struct Control *control)
+{
+    int i;
+    for (i = 0; i < CONTROL_MAX_CLIENTS; ++i)
+    {
+        if (control->clients[i].fd >= 0 && control->clients[i].fd != STDIN_FILENO)
+            close(control->clients[i].fd);
+        control->clients[i].fd = -1;
+    }
+    if (control->listen_fd >= 0)
+    {
+        close(control->listen_fd);
+        unlink(control->path);
+        control->listen_fd = -1;
+    }
+}
@@ -0,0 +1,104 @@
+/*************************************************************************
+ Description: Control channel of a running stream.
+
+              A thread reads commands, one per line, from stdin or from the
+              clients of a UNIX stream socket:
+
+                  freq HZ       sine wave frequency
+                  gain DB       output gain
+                  ramp MS       length of the ramps of later changes
+
+              and posts the whole parameter set through a wait-free mailbox,
+              a triple buffer: writer and reader each swap their slot with
+              the middle one in a single atomic exchange, neither ever waits
+              for the other. The callback takes the latest set once per
+              callback, sets superseded in between are never seen. It answers
+              through a second mailbox with when it took the set and when
+              the first sample played with it reaches the DAC, so the thread
+              can report the latency from a command to its audible effect.
+ ************************************************************************/
+
+#ifndef PACAP_CONTROL_H
+#define PACAP_CONTROL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* most socket clients connected at once */
+#define CONTROL_MAX_CLIENTS 4
+
+/* longest command line */
+#define CONTROL_LINE_MAX 128
+
+/* parameters from the thread, or the answer from the callback */
+struct Control_message
+{
+    uint64_t seq;           // of the last command in this set
+    double freq;            // Hz
+    double gain_db;
+    double ramp_ms;
+    uint64_t sent_ns;       // when the command was read, telemetry_now_ns()
+    uint64_t applied_ns;    // answer only: when the callback took the set
+    uint64_t audible_ns;    // answer only: when its first sample reaches the DAC
+};
+
+struct Control_mailbox
+{
+    struct Control_message slots[3];
+    _Alignas(64) atomic_uint middle;    // slot between writer and reader, CONTROL_MAILBOX_NEW if unread
+    _Alignas(64) unsigned back;         // writer only
+    _Alignas(64) unsigned front;        // reader only
+};
+
+struct Control_client
+{
+    int fd;                 // -1 if the entry is free
+    char line[CONTROL_LINE_MAX];
+    size_t len;
+};
+
+struct Control
+{
+    struct Control_mailbox params;      // thread -> callback
+    struct Control_mailbox answers;     // callback -> thread
+
+    /* thread only */
+    const char *path;       // socket path, NULL for stdin
+    int listen_fd;          // -1 for stdin
+    struct Control_client clients[CONTROL_MAX_CLIENTS];
+    double rate;
+    struct Control_message current;
+    pthread_t thread;
+    int has_thread;
+    atomic_int is_stopping;
+
+    /* command latency, seen by the thread */
+    unsigned long commands;
+    unsigned long answered;     // the others were taken together with a later command
+    uint64_t apply_sum_ns, apply_max_ns;
+    uint64_t audible_sum_ns, audible_max_ns;
+};
+
+void control_mailbox_init(struct Control_mailbox *mailbox, const struct Control_message *message);
+
+// writer side, never blocks
+void control_mailbox_post(struct Control_mailbox *mailbox, const struct Control_message *message);
+
+// reader side, never blocks, return 1 and the latest message if one was posted since the last call
+int control_mailbox_take(struct Control_mailbox *mailbox, struct Control_message *message);
+
+/* read commands from stdin if `path` is NULL, otherwise listen on a UNIX socket at `path`.
+ * `freq`, `gain_db` and `ramp_ms` are what the stream starts with. return 0 on success */
+int control_open(struct Control *control, const char *path, double freq, double gain_db, double ramp_ms, double rate);
+
+// start reading commands
+int control_start(struct Control *control);
+
+// stop reading commands, then print what the answers add up to
+void control_stop(struct Control *control, int is_quiet);
+
+// close the socket and remove its path
+void control_close(struct Control *control);
+
+#endif
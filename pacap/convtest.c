@@ -0,0 +1,343 @@
+/*************************************************************************
+ Description: Self-test of the render kernels, see convtest.h.
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "convtest.h"
+
+/* guard bytes after each output, they must still hold GUARD_BYTE afterwards */
+#define GUARD_SIZE 64
+#define GUARD_BYTE 0xa5
+
+struct Conv_format
+{
+    const char *name;
+    PaSampleFormat format;
+    Render_func scalar;
+};
+
+static const struct Conv_format formats[] = {
+    {"f32", paFloat32, render_f32},
+    {"i32", paInt32, render_i32},
+    {"i24", paInt24, render_i24},
+    {"i16", paInt16, render_i16},
+    {"i8", paInt8, render_i8},
+    {"u8", paUInt8, render_u8}
+};
+
+/* lengths past the first few, around vector and chunk (256) boundaries */
+static const unsigned long long_frames[] = {63, 64, 65, 127, 128, 129, 255, 256, 257, 511, 512, 513, 1000, 1023};
+
+// xorshift32, the same inputs on every run with the same seed
+static uint32_t next_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* every input the conversions could get wrong, then random values in [-1.5, 1.5] */
+static void fill_input(float *src, unsigned long n, uint32_t *state)
+{
+    const float special[] = {
+        0.0f, -0.0f, 1.0f, -1.0f, nextafterf(1.0f, 0), nextafterf(-1.0f, 0), nextafterf(1.0f, 2),
+        nextafterf(-1.0f, -2), 0.5f, -0.5f, 2.0f, -2.0f, 1e30f, -1e30f, INFINITY, -INFINITY, NAN, -NAN,
+        FLT_MIN, -FLT_MIN, FLT_MIN / 4, -FLT_MIN / 4, 1.0f / 65534, 1.0f / 254, -1.0f / 254, 0.99999994f
+    };
+    const unsigned n_special = sizeof(special) / sizeof(special[0]);
+    unsigned long i;
+
+    for (i = 0; i < n; ++i)
+    {
+        uint32_t r = next_random(state);
+        // a special value in every fourth sample, at random lanes
+        if ((r & 3) == 0)
+            src[i] = special[(r >> 2) % n_special];
+        else
+            src[i] = ((r >> 8) / (float)(1 << 24)) * 3.0f - 1.5f;
+    }
+}
+
+// run `render` into `out` with a guard behind it, return 0 if the guard is intact
+static int run_guarded(Render_func render, const float *src, unsigned char *out, size_t bytes,
+                       unsigned long frames, int channel)
+{
+    size_t i;
+    memset(out, 0, bytes);
+    memset(out + bytes, GUARD_BYTE, GUARD_SIZE);
+    render(src, out, frames, channel);
+    for (i = 0; i < GUARD_SIZE; ++i)
+        if (out[bytes + i] != GUARD_BYTE)
+            return -1;
+    return 0;
+}
+
+/* compare one kernel over every channel count, length and alignment, return the failed cases */
+static uint64_t test_kernel(const struct Conv_test_config *config, const struct Conv_format *format,
+                            enum Simd_level level, Render_func simd, float *src, unsigned char *expect,
+                            unsigned char *actual, struct Conv_test_result *result)
+{
+    size_t sample_size = Pa_GetSampleSize(format->format);
+    uint32_t state = config->seed ? config->seed : 1;
+    uint64_t failed = 0;
+    unsigned long n_length = config->max_frames < 40 ? config->max_frames + 1 : 41;
+    unsigned long l;
+    int channel, misalign;
+
+    for (l = 0; l < n_length + sizeof(long_frames) / sizeof(long_frames[0]); ++l)
+    {
+        unsigned long frames = l < n_length ? l : long_frames[l - n_length];
+        if (frames > config->max_frames)
+            continue;
+        for (channel = 1; channel <= config->max_channel; ++channel)
+        {
+            // misaligned by one sample, for source and output
+            for (misalign = 0; misalign < 2; ++misalign)
+            {
+                const float *in = src + misalign;
+                size_t bytes = frames * channel * sample_size;
+                unsigned char *out = actual + misalign * sample_size;
+                const char *why = NULL;
+
+                fill_input(src + misalign, frames, &state);
+                if (run_guarded(format->scalar, in, expect, bytes, frames, channel) != 0)
+                    why = "the scalar kernel wrote past its frames";
+                else if (run_guarded(simd, in, out, bytes, frames, channel) != 0)
+                {
+                    why = "wrote past its frames";
+                    ++result->overruns;
+                }
+                else if (memcmp(expect, out, bytes) != 0)
+                {
+                    why = "differs from the scalar kernel";
+                    ++result->mismatches;
+                }
+                ++result->cases;
+                if (why && failed++ == 0)
+                {
+                    size_t i = 0;
+                    while (i < bytes && expect[i] == out[i])
+                        ++i;
+                    printf("%s %s: %lu frames of %d channels%s %s", format->name, simd_level_to_name(level),
+                           frames, channel, misalign ? " (misaligned)" : "", why);
+                    if (i < bytes)
+                        printf(", first at frame %zu channel %zu (input %.9g)", i / sample_size / channel,
+                               i / sample_size % channel, in[i / sample_size / channel]);
+                    printf("\n");
+                }
+            }
+        }
+    }
+    return failed;
+}
+
+int conv_test_simd(const struct Conv_test_config *config, struct Conv_test_result *result)
+{
+    enum Simd_level best = simd_detect();
+    size_t max_bytes = (size_t)config->max_frames * config->max_channel * sizeof(float) + sizeof(float);
+    int ret = 0;
+    unsigned f;
+    int level;
+
+    memset(result, 0, sizeof(*result));
+    if (config->max_channel < 1)
+    {
+        printf("Invalid convtest configuration\n");
+        return -1;
+    }
+
+    float *src = malloc(sizeof(float) * (config->max_frames + 1));
+    unsigned char *expect = malloc(max_bytes + GUARD_SIZE);
+    unsigned char *actual = malloc(max_bytes + GUARD_SIZE);
+    if (src == NULL || expect == NULL || actual == NULL)
+    {
+        printf("Failed to allocate convtest buffers\n");
+        ret = -1;
+        goto out;
+    }
+
+    for (level = SIMD_SSE2; level <= SIMD_NEON; ++level)
+    {
+        // levels up to the best one of the same family run here
+        if (level > (int)best || (level == SIMD_NEON) != (best == SIMD_NEON))
+            continue;
+        for (f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f)
+        {
+            Render_func simd = render_simd(formats[f].format, (enum Simd_level)level);
+            if (simd == NULL)
+                continue;
+            ++result->n_kernel;
+            uint64_t failed = test_kernel(config, &formats[f], (enum Simd_level)level, simd, src, expect, actual,
+                                          result);
+            printf("%-4s %-6s %s\n", formats[f].name, simd_level_to_name((enum Simd_level)level),
+                   failed ? "FAIL" : "bit-exact");
+            if (failed)
+                ret = -1;
+        }
+    }
+
+out:
+    free(src);
+    free(expect);
+    free(actual);
+    return ret;
+}
+
+/* 24 bit reference: the clamp keeps NaN at -1 like render.h's kernels, truncated toward zero */
+#define I24_MAX 8388607
+
+static void reference_i24(const float *src, unsigned char *out, unsigned long frames, int channel)
+{
+    unsigned long i;
+    int j;
+
+    for (i = 0; i < frames; ++i)
+    {
+        float v = src[i];
+        if (!(v > -1.0f))
+            v = -1.0f;
+        if (!(v < 1.0f))
+            v = 1.0f;
+        int32_t sample = (int32_t)((double)v * I24_MAX);
+        for (j = 0; j < channel; ++j, out += 3)
+        {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            out[0] = (unsigned char)(sample >> 16);
+            out[1] = (unsigned char)(sample >> 8);
+            out[2] = (unsigned char)sample;
+#else
+            out[0] = (unsigned char)sample;
+            out[1] = (unsigned char)(sample >> 8);
+            out[2] = (unsigned char)(sample >> 16);
+#endif
+        }
+    }
+}
+
+static int32_t unpack_i24(const unsigned char *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    uint32_t u = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+#else
+    uint32_t u = ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+#endif
+    return (int32_t)(u << 8) >> 8;
+}
+
+/* largest distance of any unpacked sample from its clamped input, in steps of 24 bits */
+static double round_trip_error(const float *src, const unsigned char *out, unsigned long frames, int channel)
+{
+    double max_error = 0;
+    unsigned long i;
+    int j;
+
+    for (i = 0; i < frames; ++i)
+    {
+        double v = src[i];
+        if (isnan(v))
+            continue;
+        v = v < -1 ? -1 : v > 1 ? 1 : v;
+        for (j = 0; j < channel; ++j)
+        {
+            double error = fabs(unpack_i24(out + 3 * ((size_t)i * channel + j)) - v * I24_MAX);
+            if (error > max_error)
+                max_error = error;
+        }
+    }
+    return max_error;
+}
+
+int conv_test_i24(const struct Conv_test_config *config, struct Conv_test_result *result)
+{
+    size_t max_bytes = (size_t)config->max_frames * config->max_channel * 3 + 3;
+    uint32_t state = config->seed ? config->seed : 1;
+    unsigned long n_length = config->max_frames < 40 ? config->max_frames + 1 : 41;
+    uint64_t failed = 0;
+    unsigned long l;
+    int channel, misalign;
+
+    result->i24_cases = result->i24_mismatches = result->i24_overruns = 0;
+    result->i24_max_error = 0;
+    if (config->max_channel < 1)
+    {
+        printf("Invalid convtest configuration\n");
+        return -1;
+    }
+
+    float *src = malloc(sizeof(float) * (config->max_frames + 1));
+    unsigned char *expect = malloc(max_bytes + GUARD_SIZE);
+    unsigned char *actual = malloc(max_bytes + GUARD_SIZE);
+    if (src == NULL || expect == NULL || actual == NULL)
+    {
+        printf("Failed to allocate convtest buffers\n");
+        free(src);
+        free(expect);
+        free(actual);
+        return -1;
+    }
+
+    for (l = 0; l < n_length + sizeof(long_frames) / sizeof(long_frames[0]); ++l)
+    {
+        unsigned long frames = l < n_length ? l : long_frames[l - n_length];
+        if (frames > config->max_frames)
+            continue;
+        for (channel = 1; channel <= config->max_channel; ++channel)
+        {
+            // the packer writes 8 and 4 byte words, also at odd addresses
+            for (misalign = 0; misalign < 2; ++misalign)
+            {
+                const float *in = src + misalign;
+                size_t bytes = frames * channel * 3;
+                unsigned char *out = actual + misalign * 3;
+                const char *why = NULL;
+
+                fill_input(src + misalign, frames, &state);
+                reference_i24(in, expect, frames, channel);
+                if (run_guarded(render_i24, in, out, bytes, frames, channel) != 0)
+                {
+                    why = "wrote past its frames";
+                    ++result->i24_overruns;
+                }
+                else if (memcmp(expect, out, bytes) != 0)
+                {
+                    why = "differs from the reference";
+                    ++result->i24_mismatches;
+                }
+                else
+                {
+                    double error = round_trip_error(in, out, frames, channel);
+                    if (error > result->i24_max_error)
+                        result->i24_max_error = error;
+                    if (error >= 1)
+                        why = "is more than one step off after the round trip";
+                }
+                ++result->i24_cases;
+                if (why && failed++ == 0)
+                {
+                    size_t i = 0;
+                    while (i < bytes && expect[i] == out[i])
+                        ++i;
+                    printf("i24: %lu frames of %d channels%s %s", frames, channel, misalign ? " (misaligned)" : "",
+                           why);
+                    if (i < bytes)
+                        printf(", first at frame %zu channel %zu (input %.9g)", i / 3 / channel, i / 3 % channel,
+                               in[i / 3 / channel]);
+                    printf("\n");
+                }
+            }
+        }
+    }
+    printf("%-4s %-6s %s\n", "i24", "scalar", failed ? "FAIL" : "matches the reference");
+
+    free(src);
+    free(expect);
+    free(actual);
+    return failed ? -1 : 0;
+}
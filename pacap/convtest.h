@@ -0,0 +1,57 @@
+/*************************************************************************
+ Description: Self-test of the render kernels for "convtest".
+
+              Every SIMD kernel this build and CPU can run (render_simd())
+              is compared byte for byte with the scalar kernel of its
+              format, which defines the output (render.h), for every
+              channel count up to a maximum and block lengths around the
+              vector and chunk sizes, from aligned and misaligned buffers.
+              The inputs mix values which stress the conversion (+-1 and
+              their neighbours, out of range, +-inf, NaN, -0, denormals)
+              with random ones. Bytes just past each output are guarded,
+              a kernel writing beyond its frames fails too.
+
+              Packed 24 bit output is checked against a reference which
+              converts one sample at a time (clamp, scale in double,
+              truncate) and writes it byte by byte, over the same channel
+              counts, lengths and inputs, and every sample is unpacked back
+              to float, which must be within one step of 24 bits of the
+              clamped input. No audio hardware is involved.
+ ************************************************************************/
+
+#ifndef PACAP_CONVTEST_H
+#define PACAP_CONVTEST_H
+
+#include <stdint.h>
+
+#include "render.h"
+
+struct Conv_test_config
+{
+    int max_channel;            // channel counts 1..max_channel are tested
+    unsigned long max_frames;   // longest block
+    uint32_t seed;              // of the random inputs
+};
+
+struct Conv_test_result
+{
+    uint64_t cases;             // kernel runs compared
+    uint64_t mismatches;        // of them with any byte different from the scalar kernel
+    uint64_t overruns;          // of them which wrote past their frames
+    int n_kernel;               // SIMD kernels tested
+
+    uint64_t i24_cases;         // render_i24() runs compared with the reference
+    uint64_t i24_mismatches;
+    uint64_t i24_overruns;
+    double i24_max_error;       // largest round trip error, in steps of 24 bits
+};
+
+/* compare every SIMD kernel with its scalar kernel, the first failure of each kernel is printed.
+ * return 0 if all of them are bit-exact */
+int conv_test_simd(const struct Conv_test_config *config, struct Conv_test_result *result);
+
+/* compare render_i24() with the byte by byte reference and check the round trip, the first failure is
+ * printed. The i24 fields of `result` are filled. return 0 if all outputs match */
+int conv_test_i24(const struct Conv_test_config *config, struct Conv_test_result *result);
+
+#endif
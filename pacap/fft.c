@@ -0,0 +1,117 @@
+/*************************************************************************
+ Description: Radix-2 complex FFT, see fft.h.
+ ************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "fft.h"
+
+int fft_init(struct Fft *fft, size_t n)
+{
+    fft->n = n;
+    fft->cos_table = NULL;
+    fft->sin_table = NULL;
+    fft->reverse = NULL;
+
+    if (n < 2 || (n & (n - 1)))
+        return -1;
+
+    fft->cos_table = malloc(sizeof(float) * n / 2);
+    fft->sin_table = malloc(sizeof(float) * n / 2);
+    fft->reverse = malloc(sizeof(size_t) * n);
+    if (fft->cos_table == NULL || fft->sin_table == NULL || fft->reverse == NULL)
+    {
+        fft_free(fft);
+        return -1;
+    }
+
+    size_t i;
+    for (i = 0; i < n / 2; ++i)
+    {
+        fft->cos_table[i] = cos(2 * M_PI * i / n);
+        fft->sin_table[i] = sin(2 * M_PI * i / n);
+    }
+
+    unsigned bits = 0;
+    while (((size_t)1 << bits) < n)
+        ++bits;
+    for (i = 0; i < n; ++i)
+    {
+        size_t r = 0, v = i;
+        unsigned b;
+        for (b = 0; b < bits; ++b, v >>= 1)
+            r = (r << 1) | (v & 1);
+        fft->reverse[i] = r;
+    }
+    return 0;
+}
+
+void fft_free(struct Fft *fft)
+{
+    free(fft->cos_table);
+    free(fft->sin_table);
+    free(fft->reverse);
+    fft->cos_table = NULL;
+    fft->sin_table = NULL;
+    fft->reverse = NULL;
+}
+
+// `sign` -1 for forward, 1 for inverse (unscaled)
+static void transform(const struct Fft *fft, float *re, float *im, int sign)
+{
+    size_t n = fft->n;
+    size_t i;
+
+    for (i = 0; i < n; ++i)
+    {
+        size_t r = fft->reverse[i];
+        if (r > i)
+        {
+            float t = re[i]; re[i] = re[r]; re[r] = t;
+            t = im[i]; im[i] = im[r]; im[r] = t;
+        }
+    }
+
+    size_t half;
+    for (half = 1; half < n; half <<= 1)
+    {
+        size_t step = n / (2 * half);   // twiddle stride for this stage
+        size_t start;
+        for (start = 0; start < n; start += 2 * half)
+        {
+            size_t k;
+            for (k = 0; k < half; ++k)
+            {
+                float wr = fft->cos_table[k * step];
+                float wi = sign * fft->sin_table[k * step];
+                size_t a = start + k, b = a + half;
+
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+void fft_forward(const struct Fft *fft, float *re, float *im)
+{
+    transform(fft, re, im, -1);
+}
+
+void fft_inverse(const struct Fft *fft, float *re, float *im)
+{
+    transform(fft, re, im, 1);
+
+    float scale = 1.0f / fft->n;
+    size_t i;
+    for (i = 0; i < fft->n; ++i)
+    {
+        re[i] *= scale;
+        im[i] *= scale;
+    }
+}
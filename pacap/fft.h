@@ -0,0 +1,34 @@
+/*************************************************************************
+ Description: Radix-2 complex FFT.
+
+              In place, iterative, on split real/imaginary arrays (so loops
+              over one part vectorize). The twiddle factors and the bit
+              reversal permutation are computed once per size in double
+              precision. Not real-time safe to init, the transforms neither
+              block nor allocate.
+ ************************************************************************/
+
+#ifndef PACAP_FFT_H
+#define PACAP_FFT_H
+
+#include <stddef.h>
+
+struct Fft
+{
+    size_t n;           // power of 2
+    float *cos_table;   // n/2 entries: cos(2*pi*k/n)
+    float *sin_table;
+    size_t *reverse;    // bit reversed index of each index
+};
+
+// prepare transforms of `n` points, `n` must be a power of 2, return 0 on success
+int fft_init(struct Fft *fft, size_t n);
+void fft_free(struct Fft *fft);
+
+// X[k] = sum x[i] * e^(-2*pi*j*i*k/n)
+void fft_forward(const struct Fft *fft, float *re, float *im);
+
+// x[i] = 1/n * sum X[k] * e^(2*pi*j*i*k/n)
+void fft_inverse(const struct Fft *fft, float *re, float *im);
+
+#endif
@@ -0,0 +1,278 @@
+/*************************************************************************
+ Description: WAV file source for playback, see filesrc.h.
+ ************************************************************************/
+
+#define _GNU_SOURCE // RUSAGE_THREAD
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "filesrc.h"
+
+/* how often the read-ahead thread checks the play position */
+#define READER_POLL_MS 10
+
+int file_source_open(struct File_source *source, const char *path)
+{
+    memset(source, 0, sizeof(*source));
+    source->page_size = sysconf(_SC_PAGESIZE);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        printf("Failed to get size of %s\n", path);
+        close(fd);
+        return -1;
+    }
+
+    source->map_size = st.st_size;
+    source->map = mmap(NULL, source->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file
+    if (source->map == MAP_FAILED)
+    {
+        perror(path);
+        source->map = NULL;
+        return -1;
+    }
+
+    if (wav_parse_header(source->map, source->map_size, source->map_size, &source->info) != 0)
+    {
+        printf("%s is not a supported WAV file\n", path);
+        munmap(source->map, source->map_size);
+        source->map = NULL;
+        return -1;
+    }
+
+    source->bytes_per_frame = Pa_GetSampleSize(source->info.format) * source->info.channel;
+    source->frames = source->info.data_bytes / source->bytes_per_frame;
+    source->data = source->map + source->info.data_offset;
+
+    // the whole file is read front to back once
+    madvise(source->map, source->map_size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+/* the header of a streamed file is parsed from its beginning, "fmt " and "data" are expected
+ * within this many bytes */
+#define STREAMED_HEADER_BYTES 65536
+
+int file_source_open_streamed(struct File_source *source, const char *path, unsigned depth,
+                              unsigned long chunk_frames, unsigned io_delay_ms)
+{
+    memset(source, 0, sizeof(*source));
+    source->is_streamed = 1;
+
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    struct stat st;
+    unsigned char *header = malloc(STREAMED_HEADER_BYTES);
+    size_t header_size = header ? fread(header, 1, STREAMED_HEADER_BYTES, fp) : 0;
+    int ret = fstat(fileno(fp), &st);
+    fclose(fp);
+
+    if (ret != 0 || header_size == 0 || wav_parse_header(header, header_size, st.st_size, &source->info) != 0)
+    {
+        printf("%s is not a supported WAV file\n", path);
+        free(header);
+        return -1;
+    }
+    free(header);
+
+    source->bytes_per_frame = Pa_GetSampleSize(source->info.format) * source->info.channel;
+    source->frames = source->info.data_bytes / source->bytes_per_frame;
+
+    return prefetch_open(&source->prefetch, path, source->info.data_offset, source->info.data_bytes,
+                         source->bytes_per_frame, source->info.rate, depth, chunk_frames, io_delay_ms);
+}
+
+int file_source_open_shm(struct File_source *source, const char *name)
+{
+    memset(source, 0, sizeof(*source));
+    source->is_shm = 1;
+
+    if (shm_ring_open(&source->shm, name) != 0)
+        return -1;
+
+    // the ring's formats are PaSampleFormat values
+    const struct Shm_ring_header *header = source->shm.header;
+    source->info.format = header->format;
+    source->info.channel = header->channel;
+    source->info.rate = header->rate;
+    source->bytes_per_frame = header->bytes_per_frame;
+    return 0;
+}
+
+// make data up to `ahead_bytes` in front of the play position resident
+static void read_ahead(struct File_source *source, size_t ahead_bytes)
+{
+    size_t pos = atomic_load_explicit(&source->position, memory_order_acquire) * source->bytes_per_frame;
+    size_t end = pos + ahead_bytes;
+    if (end > source->info.data_bytes)
+        end = source->info.data_bytes;
+    if (source->touched < pos)
+        source->touched = pos;
+    if (source->touched >= end)
+        return;
+
+    // page aligned range in the mapping
+    size_t offset = source->info.data_offset + source->touched;
+    size_t first = offset & ~(source->page_size - 1);
+    size_t last = source->info.data_offset + end;
+    madvise(source->map + first, last - first, MADV_WILLNEED);
+
+    // WILLNEED only starts reading, touching maps the pages into our page table as well
+    volatile unsigned char sink;
+    size_t p;
+    for (p = first; p < last; p += source->page_size)
+        sink = source->map[p];
+    sink = source->map[last - 1];
+    (void)sink;
+
+    source->touched = end;
+}
+
+static size_t ahead_bytes(const struct File_source *source)
+{
+    size_t bytes = source->ahead_seconds * source->info.rate * source->bytes_per_frame;
+    return bytes < source->page_size ? source->page_size : bytes;
+}
+
+static void *reader_main(void *arg)
+{
+    struct File_source *source = arg;
+    struct timespec poll = {0, READER_POLL_MS * 1000000L};
+
+    while (!atomic_load(&source->is_stopping))
+    {
+        read_ahead(source, ahead_bytes(source));
+        nanosleep(&poll, NULL);
+    }
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0)
+    {
+        atomic_store(&source->reader_minor_faults, usage.ru_minflt);
+        atomic_store(&source->reader_major_faults, usage.ru_majflt);
+    }
+    return NULL;
+}
+
+int file_source_start(struct File_source *source, double ahead_seconds)
+{
+    if (source->is_streamed)
+        return prefetch_start(&source->prefetch);
+    if (source->is_shm)
+        return 0;
+
+    source->ahead_seconds = ahead_seconds;
+
+    // the first callbacks must not wait for the reader
+    read_ahead(source, ahead_bytes(source));
+
+    if (pthread_create(&source->reader, NULL, reader_main, source) != 0)
+    {
+        printf("Failed to create read-ahead thread\n");
+        return -1;
+    }
+    source->has_reader = 1;
+    return 0;
+}
+
+static inline int32_t get_i24(const unsigned char *p)
+{
+    int32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v ^ 0x800000) - 0x800000;
+}
+
+void file_source_decode(const struct File_source *source, const void *src, float *dst, unsigned long frames)
+{
+    unsigned long n = frames * source->info.channel;
+    unsigned long i;
+
+    switch (source->info.format)
+    {
+        case paFloat32:
+            memcpy(dst, src, n * sizeof(float));
+            break;
+        case paInt32:
+            for (i = 0; i < n; ++i)
+                dst[i] = (float)(((const int32_t*)src)[i] * (1.0 / 2147483648.0));
+            break;
+        case paInt24:
+            for (i = 0; i < n; ++i)
+                dst[i] = get_i24((const unsigned char*)src + 3 * i) * (1.0f / 8388608.0f);
+            break;
+        case paInt16:
+            for (i = 0; i < n; ++i)
+                dst[i] = ((const int16_t*)src)[i] * (1.0f / 32768.0f);
+            break;
+        case paUInt8:
+            for (i = 0; i < n; ++i)
+                dst[i] = (((const uint8_t*)src)[i] - 128) * (1.0f / 128.0f);
+            break;
+        default:
+            memset(dst, 0, n * sizeof(float));
+            break;
+    }
+}
+
+void file_source_get_stats(struct File_source *source, struct File_source_stats *stats)
+{
+    stats->reader_minor_faults = atomic_load(&source->reader_minor_faults);
+    stats->reader_major_faults = atomic_load(&source->reader_major_faults);
+    stats->frames_played = atomic_load(&source->position);
+    stats->is_streamed = source->is_streamed;
+    if (source->is_streamed)
+        prefetch_get_stats(&source->prefetch, &stats->prefetch);
+    stats->is_shm = source->is_shm;
+    if (source->is_shm && source->shm.header)
+    {
+        source->shm_underruns = atomic_load(&source->shm.header->underruns);
+        source->shm_frames_starved = atomic_load(&source->shm.header->frames_starved);
+    }
+    stats->shm_underruns = source->shm_underruns;
+    stats->shm_frames_starved = source->shm_frames_starved;
+}
+
+void file_source_close(struct File_source *source)
+{
+    if (source->is_streamed)
+        prefetch_close(&source->prefetch);
+    if (source->is_shm && source->shm.header)
+    {
+        source->shm_underruns = atomic_load(&source->shm.header->underruns);
+        source->shm_frames_starved = atomic_load(&source->shm.header->frames_starved);
+        shm_ring_close(&source->shm);
+    }
+
+    if (source->has_reader)
+    {
+        atomic_store(&source->is_stopping, 1);
+        pthread_join(source->reader, NULL);
+        source->has_reader = 0;
+    }
+    if (source->map)
+    {
+        munmap(source->map, source->map_size);
+        source->map = NULL;
+    }
+}
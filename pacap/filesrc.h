@@ -0,0 +1,143 @@
+/*************************************************************************
+ Description: WAV file source for playback.
+
+              The file is memory mapped. The audio callback reads samples
+              straight from the mapping, a read-ahead thread keeps the pages
+              in front of the play position resident (madvise + touching
+              each page), so the callback doesn't page-fault on the hot path.
+
+              A streamed source is read chunk by chunk instead, see
+              prefetch.h, for files larger than memory or storage too slow
+              to fault pages in from.
+
+              A shared memory source plays what another process writes into
+              a ring, see shmring.h. Its length is unknown, it ends when the
+              producer finishes.
+ ************************************************************************/
+
+#ifndef PACAP_FILESRC_H
+#define PACAP_FILESRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "portaudio.h"
+#include "wav.h"
+#include "prefetch.h"
+#include "shmring.h"
+
+struct File_source_stats
+{
+    long reader_minor_faults;   // taken by the read-ahead thread
+    long reader_major_faults;
+    uint64_t frames_played;
+    int is_streamed;
+    struct Prefetch_stats prefetch;     // streamed only
+    int is_shm;
+    uint64_t shm_underruns;             // shared memory only
+    uint64_t shm_frames_starved;
+};
+
+struct File_source
+{
+    struct Wav_info info;
+    size_t bytes_per_frame;
+    uint64_t frames;            // 0 for a shared memory source
+
+    unsigned char *map;
+    size_t map_size;
+    const unsigned char *data;  // first sample in the mapping
+    size_t page_size;
+
+    /* advanced by the callback */
+    atomic_uint_fast64_t position;  // in frames
+
+    pthread_t reader;
+    int has_reader;
+    atomic_int is_stopping;
+    double ahead_seconds;
+    size_t touched;                 // bytes of data made resident so far, reader only
+    atomic_long reader_minor_faults;
+    atomic_long reader_major_faults;
+
+    /* streamed source, nothing is mapped */
+    int is_streamed;
+    struct Prefetch prefetch;
+
+    /* shared memory source, read straight from the producer's ring */
+    int is_shm;
+    struct Shm_ring shm;
+    uint64_t shm_underruns;         // the consumer's counts from the ring's header, kept when it is closed
+    uint64_t shm_frames_starved;
+};
+
+/* map `path` and parse its header, return 0 on success */
+int file_source_open(struct File_source *source, const char *path);
+
+/* open `path` for streamed reading through `depth` chunks of `chunk_frames` frames, each read
+ * delayed by `io_delay_ms` (0 for none). return 0 on success */
+int file_source_open_streamed(struct File_source *source, const char *path, unsigned depth,
+                              unsigned long chunk_frames, unsigned io_delay_ms);
+
+/* map the shared memory ring `name`, which a producer has created, return 0 on success */
+int file_source_open_shm(struct File_source *source, const char *name);
+
+/* make the first `ahead_seconds` resident and start the read-ahead thread which keeps
+ * that much ahead of the play position (a streamed source fills all of its chunks instead),
+ * return 0 on success */
+int file_source_start(struct File_source *source, double ahead_seconds);
+
+/* called from the audio callback: return the next frames (at most `*frames`, updated to what's
+ * available) in file format, NULL at end of file. Call file_source_advance() once consumed */
+static inline const void *file_source_peek(struct File_source *source, unsigned long *frames)
+{
+    if (source->is_streamed)
+        return prefetch_peek(&source->prefetch, frames);
+    if (source->is_shm)
+        return shm_ring_peek(&source->shm, frames);
+
+    uint64_t pos = atomic_load_explicit(&source->position, memory_order_relaxed);
+    if (pos >= source->frames)
+        return NULL;
+    if (*frames > source->frames - pos)
+        *frames = source->frames - pos;
+    return source->data + pos * source->bytes_per_frame;
+}
+
+static inline void file_source_advance(struct File_source *source, unsigned long frames)
+{
+    if (source->is_streamed)
+        prefetch_advance(&source->prefetch, frames);
+    else if (source->is_shm)
+        shm_ring_advance(&source->shm, frames);
+
+    uint64_t pos = atomic_load_explicit(&source->position, memory_order_relaxed);
+    atomic_store_explicit(&source->position, pos + frames, memory_order_release);
+}
+
+/* called from the audio callback after file_source_peek() returned NULL: return 1 at end of file,
+ * 0 if a streamed or shared memory source starved, which is counted with the `frames` played as
+ * silence instead */
+static inline int file_source_at_end(struct File_source *source, unsigned long frames)
+{
+    if (source->is_shm)
+        return shm_ring_at_end(&source->shm, frames);
+    if (!source->is_streamed)
+        return 1;
+    if (prefetch_at_end(&source->prefetch))
+        return 1;
+    prefetch_starved(&source->prefetch, frames);
+    return 0;
+}
+
+/* convert `frames` frames in file format at `src` into interleaved float */
+void file_source_decode(const struct File_source *source, const void *src, float *dst, unsigned long frames);
+
+void file_source_get_stats(struct File_source *source, struct File_source_stats *stats);
+
+// stop the read-ahead thread and unmap the file, or stop reading chunks, or unmap the ring
+void file_source_close(struct File_source *source);
+
+#endif
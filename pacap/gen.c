@@ -0,0 +1,419 @@
+/*************************************************************************
+ Description: Per channel signal generators, see gen.h.
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gen.h"
+
+static const char *gen_names[GEN_KIND_NUM] = {"sine", "saw", "square", "noise", "silence"};
+
+/* one parsed node of the spec */
+struct Gen_node
+{
+    enum Gen_kind kind;
+    double freq;
+    double gain_db;
+};
+
+/* Kernels walk frames, and in every frame the lanes of their group one vector of GEN_WIDTH lanes
+ * at a time. Vectors are GCC's generic vector types, the compiler maps them onto the registers of
+ * the target: the baseline (SSE2 on x86-64, NEON on aarch64), and on x86 AVX2 as well, each kernel
+ * body below is compiled once for either. Per lane arrays are aligned to a whole vector. */
+typedef float Gen_vec __attribute__((vector_size(GEN_WIDTH * sizeof(float))));
+typedef int32_t Gen_ivec __attribute__((vector_size(GEN_WIDTH * sizeof(int32_t))));
+typedef uint32_t Gen_uvec __attribute__((vector_size(GEN_WIDTH * sizeof(uint32_t))));
+
+/* vectors are only passed around in macros, vector arguments wider than the target's registers
+ * would have a different ABI */
+#define BODY static inline __attribute__((always_inline))
+
+#define VEC(array, l) (*(Gen_vec*)((array) + (l)))
+
+// the output may not be aligned, e.g. when it's written directly
+#define STORE_VEC(dst, v) do { Gen_vec v_ = (v); memcpy((dst), &v_, sizeof(v_)); } while (0)
+
+// wrap into [0, 1) without a branch, the cycle is never negative
+#define WRAP_CYCLE(c) ((c) - __builtin_convertvector(__builtin_convertvector((c), Gen_ivec), Gen_vec))
+
+/* Like the recursive oscillator: each lane's phasor is rotated once per frame and re-seeded from
+ * the exact phase at the start of every block, so rounding never accumulates across blocks */
+BODY void sine_body(struct Gen *gen, int begin, int end, float *restrict lanes, unsigned long frames)
+{
+    float *restrict re = gen->re, *restrict im = gen->im;
+    const float *restrict rot_re = gen->rot_re, *restrict rot_im = gen->rot_im;
+    const float *restrict gain = gen->gain;
+    unsigned long f;
+    int l;
+
+    for (l = begin; l < end; ++l)
+    {
+        re[l] = cos(gen->phase[l]);
+        im[l] = sin(gen->phase[l]);
+    }
+
+    for (f = 0; f < frames; ++f, lanes += gen->n_lane)
+        for (l = begin; l < end; l += GEN_WIDTH)
+        {
+            Gen_vec r = VEC(re, l), i = VEC(im, l);
+
+            STORE_VEC(lanes + l, VEC(gain, l) * i);
+            VEC(re, l) = r * VEC(rot_re, l) - i * VEC(rot_im, l);
+            VEC(im, l) = r * VEC(rot_im, l) + i * VEC(rot_re, l);
+        }
+
+    for (l = begin; l < end; ++l)
+        gen->phase[l] = fmod(gen->phase[l] + frames * gen->step[l], 2*M_PI);
+}
+
+// rising ramp from -1 to 1 once per cycle
+BODY void saw_body(struct Gen *gen, int begin, int end, float *restrict lanes, unsigned long frames)
+{
+    float *restrict cycle = gen->cycle;
+    const float *restrict increment = gen->increment;
+    const float *restrict gain = gen->gain;
+    unsigned long f;
+    int l;
+
+    for (f = 0; f < frames; ++f, lanes += gen->n_lane)
+        for (l = begin; l < end; l += GEN_WIDTH)
+        {
+            Gen_vec c = VEC(cycle, l);
+
+            STORE_VEC(lanes + l, VEC(gain, l) * (2 * c - 1));
+            VEC(cycle, l) = WRAP_CYCLE(c + VEC(increment, l));
+        }
+}
+
+// 1 for the first half of a cycle, -1 for the second
+BODY void square_body(struct Gen *gen, int begin, int end, float *restrict lanes, unsigned long frames)
+{
+    float *restrict cycle = gen->cycle;
+    const float *restrict increment = gen->increment;
+    const float *restrict gain = gen->gain;
+    unsigned long f;
+    int l;
+
+    for (f = 0; f < frames; ++f, lanes += gen->n_lane)
+        for (l = begin; l < end; l += GEN_WIDTH)
+        {
+            Gen_vec c = VEC(cycle, l);
+            Gen_ivec is_low = c >= 0.5f;   // -1 where true, 0 where false
+
+            STORE_VEC(lanes + l, VEC(gain, l) * (1 + 2 * __builtin_convertvector(is_low, Gen_vec)));
+            VEC(cycle, l) = WRAP_CYCLE(c + VEC(increment, l));
+        }
+}
+
+// white noise in [-1, 1) from a xorshift32 generator per lane
+BODY void noise_body(struct Gen *gen, int begin, int end, float *restrict lanes, unsigned long frames)
+{
+    uint32_t *restrict state = gen->noise;
+    const float *restrict gain = gen->gain;
+    unsigned long f;
+    int l;
+
+    for (f = 0; f < frames; ++f, lanes += gen->n_lane)
+        for (l = begin; l < end; l += GEN_WIDTH)
+        {
+            Gen_uvec x = *(Gen_uvec*)(state + l);
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            *(Gen_uvec*)(state + l) = x;
+
+            Gen_vec v = __builtin_convertvector((Gen_ivec)x, Gen_vec) * (1.0f / 2147483648.0f);
+            STORE_VEC(lanes + l, VEC(gain, l) * v);
+        }
+}
+
+static void gen_silence(struct Gen *gen, int begin, int end, float *restrict lanes, unsigned long frames)
+{
+    unsigned long f;
+
+    for (f = 0; f < frames; ++f, lanes += gen->n_lane)
+        memset(lanes + begin, 0, sizeof(float) * (end - begin));
+}
+
+#define DEFINE_GEN_KERNEL(kind, isa, attr)                                                      \
+attr static void gen_##kind##_##isa(struct Gen *gen, int begin, int end, float *lanes, unsigned long frames) \
+{                                                                                               \
+    kind##_body(gen, begin, end, lanes, frames);                                                \
+}
+
+DEFINE_GEN_KERNEL(sine, base, )
+DEFINE_GEN_KERNEL(saw, base, )
+DEFINE_GEN_KERNEL(square, base, )
+DEFINE_GEN_KERNEL(noise, base, )
+
+static const Gen_kernel gen_kernels_base[GEN_KIND_NUM] = {
+    gen_sine_base, gen_saw_base, gen_square_base, gen_noise_base, gen_silence
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AVX2 __attribute__((target("avx2")))
+DEFINE_GEN_KERNEL(sine, avx2, AVX2)
+DEFINE_GEN_KERNEL(saw, avx2, AVX2)
+DEFINE_GEN_KERNEL(square, avx2, AVX2)
+DEFINE_GEN_KERNEL(noise, avx2, AVX2)
+
+static const Gen_kernel gen_kernels_avx2[GEN_KIND_NUM] = {
+    gen_sine_avx2, gen_saw_avx2, gen_square_avx2, gen_noise_avx2, gen_silence
+};
+#endif
+
+// parse "KIND[:FREQ[:GAIN_DB]]", return 0 on success
+static int parse_node(const char *str, size_t len, double default_freq, struct Gen_node *node)
+{
+    char item[64];
+    if (len == 0 || len >= sizeof(item))
+        return -1;
+    memcpy(item, str, len);
+    item[len] = '\0';
+
+    char *freq = strchr(item, ':');
+    char *gain = NULL;
+    if (freq)
+    {
+        *freq++ = '\0';
+        gain = strchr(freq, ':');
+        if (gain)
+            *gain++ = '\0';
+    }
+
+    int kind;
+    for (kind = 0; kind < GEN_KIND_NUM; ++kind)
+        if (!strcmp(item, gen_names[kind]))
+            break;
+    if (kind == GEN_KIND_NUM)
+        return -1;
+    node->kind = (enum Gen_kind)kind;
+
+    char *end;
+    node->freq = default_freq;
+    if (freq && *freq)
+    {
+        node->freq = strtod(freq, &end);
+        if (*end || node->freq < 0)
+            return -1;
+    }
+
+    node->gain_db = 0;
+    if (gain && *gain)
+    {
+        node->gain_db = strtod(gain, &end);
+        if (*end)
+            return -1;
+    }
+    return 0;
+}
+
+// zeroed per lane array aligned to a vector, NULL on failure
+static void *alloc_lanes(int n_lane, size_t size)
+{
+    void *p;
+    if (posix_memalign(&p, sizeof(Gen_vec), n_lane * size) != 0)
+        return NULL;
+    memset(p, 0, n_lane * size);
+    return p;
+}
+
+int gen_init(struct Gen *gen, const char *spec, int channel, double rate, double default_freq,
+             int is_planar, unsigned long max_frames, enum Simd_level simd_level)
+{
+    const Gen_kernel *kernels = gen_kernels_base;
+#ifdef AVX2
+    if (simd_level == SIMD_AVX2)
+        kernels = gen_kernels_avx2;
+#endif
+
+    memset(gen, 0, sizeof(*gen));
+
+    struct Gen_node *nodes = malloc(sizeof(struct Gen_node) * channel);
+    if (nodes == NULL)
+    {
+        printf("Failed to allocate generators\n");
+        return -1;
+    }
+
+    /* parse one node per channel, repeating the spec if it is shorter */
+    int count[GEN_KIND_NUM] = {0};
+    int n_node = 0;
+    const char *p = spec;
+    while (n_node < channel)
+    {
+        size_t len = strcspn(p, ",");
+        struct Gen_node *node = &nodes[n_node];
+        if (parse_node(p, len, default_freq, node) != 0)
+        {
+            printf("Invalid generator \"%.*s\", expecting KIND[:FREQ[:GAIN_DB]] with KIND one of "
+                   "sine, saw, square, noise, silence\n", (int)len, p);
+            free(nodes);
+            return -1;
+        }
+        if (node->freq >= rate / 2 && node->kind != GEN_NOISE && node->kind != GEN_SILENCE)
+        {
+            printf("Frequency %g of channel %d is not below Nyquist (%g)\n", node->freq, n_node, rate / 2);
+            free(nodes);
+            return -1;
+        }
+        ++count[node->kind];
+        ++n_node;
+
+        p += len;
+        p = *p ? p + 1 : spec;
+    }
+
+    // every group is padded to whole GEN_WIDTH lanes, padding lanes are generated but never played
+    int kind, n_lane = 0;
+    for (kind = 0; kind < GEN_KIND_NUM; ++kind)
+        n_lane += (count[kind] + GEN_WIDTH - 1) / GEN_WIDTH * GEN_WIDTH;
+
+    gen->channel = channel;
+    gen->n_lane = n_lane;
+    gen->rate = rate;
+    gen->channel_lane = malloc(sizeof(int) * channel);
+    gen->gain = alloc_lanes(n_lane, sizeof(float));
+    gen->phase = alloc_lanes(n_lane, sizeof(double));
+    gen->step = alloc_lanes(n_lane, sizeof(double));
+    gen->rot_re = alloc_lanes(n_lane, sizeof(float));
+    gen->rot_im = alloc_lanes(n_lane, sizeof(float));
+    gen->re = alloc_lanes(n_lane, sizeof(float));
+    gen->im = alloc_lanes(n_lane, sizeof(float));
+    gen->cycle = alloc_lanes(n_lane, sizeof(float));
+    gen->increment = alloc_lanes(n_lane, sizeof(float));
+    gen->noise = alloc_lanes(n_lane, sizeof(uint32_t));
+    gen->lanes = malloc(sizeof(float) * n_lane * max_frames);
+    if (gen->channel_lane == NULL || gen->gain == NULL || gen->phase == NULL || gen->step == NULL ||
+        gen->rot_re == NULL || gen->rot_im == NULL || gen->re == NULL || gen->im == NULL ||
+        gen->cycle == NULL || gen->increment == NULL || gen->noise == NULL || gen->lanes == NULL)
+    {
+        printf("Failed to allocate generators\n");
+        free(nodes);
+        gen_free(gen);
+        return -1;
+    }
+
+    /* group the channels by kind, every group is one step of the plan */
+    int lane = 0;
+    for (kind = 0; kind < GEN_KIND_NUM; ++kind)
+    {
+        if (count[kind] == 0)
+            continue;
+
+        struct Gen_step *step = &gen->plan[gen->n_step++];
+        step->kind = (enum Gen_kind)kind;
+        step->kernel = kernels[kind];
+        step->begin = lane;
+
+        int i;
+        for (i = 0; i < channel; ++i)
+        {
+            if (nodes[i].kind != (enum Gen_kind)kind)
+                continue;
+
+            double freq = nodes[i].freq;
+            gen->channel_lane[i] = lane;
+            gen->gain[lane] = pow(10, nodes[i].gain_db / 20);
+            gen->step[lane] = 2*M_PI*freq/rate;
+            gen->rot_re[lane] = cos(gen->step[lane]);
+            gen->rot_im[lane] = sin(gen->step[lane]);
+            gen->increment[lane] = freq / rate;
+            ++lane;
+        }
+        // padding lanes keep a zero gain
+        lane = step->begin + (count[kind] + GEN_WIDTH - 1) / GEN_WIDTH * GEN_WIDTH;
+        step->end = lane;
+    }
+    free(nodes);
+
+    for (lane = 0; lane < n_lane; ++lane)
+        gen->noise[lane] = 0x9e3779b9u * (lane + 1);  // distinct non-zero seed per lane
+
+    if (is_planar)
+    {
+        gen->frame_stride = 1;
+        gen->channel_stride = max_frames;
+    }
+    else
+    {
+        gen->frame_stride = channel;
+        gen->channel_stride = 1;
+    }
+
+    // lanes in channel order without padding are already interleaved frames
+    gen->is_direct = !is_planar && n_lane == channel;
+    int i;
+    for (i = 0; i < channel; ++i)
+        if (gen->channel_lane[i] != i)
+            gen->is_direct = 0;
+    return 0;
+}
+
+void gen_free(struct Gen *gen)
+{
+    free(gen->channel_lane);
+    free(gen->gain);
+    free(gen->phase);
+    free(gen->step);
+    free(gen->rot_re);
+    free(gen->rot_im);
+    free(gen->re);
+    free(gen->im);
+    free(gen->cycle);
+    free(gen->increment);
+    free(gen->noise);
+    free(gen->lanes);
+    memset(gen, 0, sizeof(*gen));
+}
+
+void gen_process(struct Gen *gen, float *out, unsigned long frames)
+{
+    float *lanes = gen->is_direct ? out : gen->lanes;
+    int i;
+
+    for (i = 0; i < gen->n_step; ++i)
+        gen->plan[i].kernel(gen, gen->plan[i].begin, gen->plan[i].end, lanes, frames);
+    if (gen->is_direct)
+        return;
+
+    // pick every channel's lane, in the order the output is written
+    unsigned long f;
+    int c;
+    if (gen->frame_stride == 1)
+        for (c = 0; c < gen->channel; ++c)
+        {
+            const float *src = lanes + gen->channel_lane[c];
+            float *dst = out + c * gen->channel_stride;
+            for (f = 0; f < frames; ++f)
+                dst[f] = src[f * gen->n_lane];
+        }
+    else
+        for (f = 0; f < frames; ++f, lanes += gen->n_lane)
+            for (c = 0; c < gen->channel; ++c)
+                out[f * gen->frame_stride + c] = lanes[gen->channel_lane[c]];
+}
+
+void gen_print(const struct Gen *gen)
+{
+    int c;
+    for (c = 0; c < gen->channel; ++c)
+    {
+        int lane = gen->channel_lane[c];
+        const struct Gen_step *step = gen->plan;
+        while (lane >= step->end)
+            ++step;
+
+        printf("Channel %d: %s", c, gen_names[step->kind]);
+        if (step->kind == GEN_SINE)
+            printf(" %g Hz", gen->step[lane] * gen->rate / (2*M_PI));
+        else if (step->kind == GEN_SAW || step->kind == GEN_SQUARE)
+            printf(" %g Hz", (double)gen->increment[lane] * gen->rate);
+        if (step->kind != GEN_SILENCE)
+            printf(", %.1f dB", 20 * log10(gen->gain[lane]));
+        printf("\n");
+    }
+}
@@ -0,0 +1,106 @@
+/*************************************************************************
+ Description: Per channel signal generators.
+
+              A generator spec gives every channel its own node: a kind
+              (sine, saw, square, noise or silence), a frequency and a gain,
+              e.g. "sine:440:-6,saw:220,noise::-20,silence". Nodes are
+              assigned to channels in order and repeat if there are fewer
+              nodes than channels.
+
+              When the stream is opened the nodes are resolved into a flat
+              plan: channels are grouped by kind, and each group is one
+              call of that kind's kernel over all of its lanes, so nothing
+              is dispatched per sample or per channel. Per channel state is
+              kept as structure of arrays (one array per field, lanes of a
+              group next to each other), so a kernel's inner loop runs over
+              contiguous lanes and vectorizes.
+
+              Every group is padded to a multiple of GEN_WIDTH lanes, so
+              kernels only ever run whole vectors of lanes. Kernels write
+              frames of lanes, which are interleaved frames as they are if
+              the lanes happen to be in channel order without padding (e.g.
+              8 or 64 sines). Otherwise, or for planar output, every
+              channel picks its lane in one more pass.
+ ************************************************************************/
+
+#ifndef PACAP_GEN_H
+#define PACAP_GEN_H
+
+#include <stdint.h>
+
+#include "render.h"
+
+/* lanes a kernel handles at once, 8 floats fill an AVX register */
+#define GEN_WIDTH 8
+
+enum Gen_kind
+{
+    GEN_SINE,
+    GEN_SAW,
+    GEN_SQUARE,
+    GEN_NOISE,
+    GEN_SILENCE,
+    GEN_KIND_NUM
+};
+
+struct Gen;
+
+/* generate `frames` frames of lanes [begin, end) into `lanes`, frame f of lane l at lanes[f * n_lane + l] */
+typedef void (*Gen_kernel)(struct Gen *gen, int begin, int end, float *lanes, unsigned long frames);
+
+/* one step of the plan */
+struct Gen_step
+{
+    enum Gen_kind kind;
+    Gen_kernel kernel;
+    int begin;          // lanes of the group
+    int end;
+};
+
+struct Gen
+{
+    int channel;
+    int n_lane;             // channels plus padding
+    double rate;
+
+    struct Gen_step plan[GEN_KIND_NUM];
+    int n_step;
+
+    int *channel_lane;      // lane each channel plays
+
+    /* per lane, lanes are sorted by kind */
+    float *gain;            // linear
+    double *phase;          // sine: radians, exactly tracked across blocks
+    double *step;           // sine: radians per frame
+    float *rot_re;          // sine: cos(step)
+    float *rot_im;          // sine: sin(step)
+    float *re;              // sine: phasor, re-seeded from `phase` every block
+    float *im;
+    float *cycle;           // saw/square: position in the cycle, [0, 1)
+    float *increment;       // saw/square: cycles per frame
+    uint32_t *noise;        // noise: xorshift state
+
+    float *lanes;           // `max_frames` frames of every lane
+    int is_direct;          // lanes are the interleaved channels, kernels write the output
+
+    /* where gen_process() writes sample f of channel c: out[c * channel_stride + f * frame_stride] */
+    unsigned long frame_stride;
+    unsigned long channel_stride;
+};
+
+/* build the plan for `channel` channels from `spec`, frequencies default to `default_freq`.
+ * `is_planar` lays out gen_process() output as one run of `max_frames` frames per channel,
+ * otherwise frames are interleaved. Kernels are picked for `simd_level`, AVX2 has its own, every
+ * other level the build's baseline ones. return 0 on success, messages are printed on errors */
+int gen_init(struct Gen *gen, const char *spec, int channel, double rate, double default_freq,
+             int is_planar, unsigned long max_frames, enum Simd_level simd_level);
+
+void gen_free(struct Gen *gen);
+
+/* called from the audio callback: generate `frames` (at most `max_frames`) of every channel into `out` */
+void gen_process(struct Gen *gen, float *out, unsigned long frames);
+
+// print one line per channel
+void gen_print(const struct Gen *gen);
+
+#endif
@@ -0,0 +1,90 @@
+/*************************************************************************
+ Description: HDR style log-linear histogram, see histogram.h.
+ ************************************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include "histogram.h"
+
+#define SUB_COUNT (1u << HIST_SUB_BITS)
+
+static inline unsigned bucket_index(uint64_t v)
+{
+    if (v < SUB_COUNT)
+        return v;
+
+    unsigned msb = 63 - __builtin_clzll(v);
+    unsigned shift = msb - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + (unsigned)((v >> shift) - SUB_COUNT);
+}
+
+// highest value falling into bucket `idx`
+static uint64_t bucket_upper(unsigned idx)
+{
+    unsigned b = idx >> HIST_SUB_BITS;
+    uint64_t sub = idx & (SUB_COUNT - 1);
+
+    if (b == 0)
+        return sub;
+
+    unsigned shift = b - 1;
+    return ((SUB_COUNT + sub) << shift) + ((1ull << shift) - 1);
+}
+
+void hist_reset(struct Histogram *hist)
+{
+    // memset also prefaults the counters before they are used in the callback
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+void hist_record(struct Histogram *hist, uint64_t value)
+{
+    hist->counts[bucket_index(value)]++;
+    hist->total++;
+    hist->sum += value;
+    hist->sum_sq += (double)value * value;
+    if (value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+double hist_mean(const struct Histogram *hist)
+{
+    return hist->total ? hist->sum / hist->total : 0;
+}
+
+double hist_stddev(const struct Histogram *hist)
+{
+    if (hist->total < 2)
+        return 0;
+
+    double mean = hist_mean(hist);
+    double var = hist->sum_sq / hist->total - mean * mean;
+    return var > 0 ? sqrt(var) : 0;
+}
+
+uint64_t hist_percentile(const struct Histogram *hist, double p)
+{
+    if (hist->total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)ceil(p / 100 * hist->total);
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    unsigned i;
+    for (i = 0; i < HIST_BUCKETS; ++i)
+    {
+        seen += hist->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t v = bucket_upper(i);
+            return v < hist->max ? v : hist->max;
+        }
+    }
+    return hist->max;
+}
@@ -0,0 +1,38 @@
+/*************************************************************************
+ Description: HDR style log-linear histogram of non-negative integers.
+
+              Values are bucketed by their highest set bit and the next
+              HIST_SUB_BITS bits, so the relative error of any bucket is
+              below 1/2^HIST_SUB_BITS whatever the magnitude. Recording is
+              O(1), touches one counter and never allocates, it is safe in
+              the audio callback.
+ ************************************************************************/
+
+#ifndef PACAP_HISTOGRAM_H
+#define PACAP_HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+struct Histogram
+{
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+    double sum_sq;
+};
+
+void hist_reset(struct Histogram *hist);
+void hist_record(struct Histogram *hist, uint64_t value);
+
+double hist_mean(const struct Histogram *hist);
+double hist_stddev(const struct Histogram *hist);
+
+// highest value equivalent to the bucket holding percentile `p` (0 ~ 100), 0 if empty
+uint64_t hist_percentile(const struct Histogram *hist, double p);
+
+#endif
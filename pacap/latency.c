@@ -0,0 +1,238 @@
+/*************************************************************************
+ Description: Round-trip latency estimator, see latency.h.
+ ************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "latency.h"
+
+/* estimates below this are noise, they don't move the unwrapping reference */
+#define MIN_SNR_DB 10.0
+
+/* feedback taps of a primitive polynomial per MLS order, terminated by 0 */
+static const unsigned mls_taps[LATENCY_MAX_ORDER + 1][5] = {
+    [10] = {10, 7, 0},
+    [11] = {11, 9, 0},
+    [12] = {12, 6, 4, 1, 0},
+    [13] = {13, 4, 3, 1, 0},
+    [14] = {14, 5, 3, 1, 0},
+    [15] = {15, 14, 0},
+    [16] = {16, 15, 13, 4, 0},
+    [17] = {17, 14, 0},
+    [18] = {18, 11, 0},
+    [19] = {19, 6, 2, 1, 0},
+    [20] = {20, 17, 0},
+};
+
+// 2^order - 1 values of +-amplitude from a Fibonacci LFSR, followed by a zero to fill the period
+static void generate_mls(float *probe, unsigned order, float amplitude)
+{
+    const unsigned *taps = mls_taps[order];
+    uint32_t state = 1;
+    size_t length = ((size_t)1 << order) - 1;
+    size_t i;
+
+    for (i = 0; i < length; ++i)
+    {
+        probe[i] = (state & 1) ? amplitude : -amplitude;
+
+        uint32_t feedback = 0;
+        const unsigned *t;
+        for (t = taps; *t; ++t)
+            feedback ^= state >> (order - *t);
+        state = (state >> 1) | ((feedback & 1) << (order - 1));
+    }
+    probe[length] = 0;
+}
+
+int latency_init(struct Latency *latency, enum Probe_signal signal, unsigned order, float amplitude,
+                 unsigned depth)
+{
+    memset(latency, 0, sizeof(*latency));
+    if (order < LATENCY_MIN_ORDER || order > LATENCY_MAX_ORDER || depth == 0)
+        return -1;
+
+    size_t period = (size_t)1 << order;
+    latency->signal = signal;
+    latency->period = period;
+    latency->depth = depth;
+
+    latency->probe = calloc(period, sizeof(float));
+    latency->probe_re = malloc(sizeof(float) * period);
+    latency->probe_im = malloc(sizeof(float) * period);
+    latency->re = malloc(sizeof(float) * period);
+    latency->im = malloc(sizeof(float) * period);
+    latency->pool = malloc(sizeof(float) * period * depth);
+    latency->block_period = calloc(depth, sizeof(uint64_t));
+    if (latency->probe == NULL || latency->probe_re == NULL || latency->probe_im == NULL ||
+        latency->re == NULL || latency->im == NULL || latency->pool == NULL ||
+        latency->block_period == NULL || fft_init(&latency->fft, period) != 0)
+    {
+        latency_free(latency);
+        return -1;
+    }
+    // touch every page now so that the audio thread never page faults on it
+    memset(latency->pool, 0, sizeof(float) * period * depth);
+
+    if (signal == PROBE_MLS)
+        generate_mls(latency->probe, order, amplitude);
+    else
+        latency->probe[0] = amplitude;
+
+    // correlating is multiplying by the conjugated spectrum
+    memcpy(latency->probe_re, latency->probe, sizeof(float) * period);
+    memset(latency->probe_im, 0, sizeof(float) * period);
+    fft_forward(&latency->fft, latency->probe_re, latency->probe_im);
+    size_t i;
+    for (i = 0; i < period; ++i)
+        latency->probe_im[i] = -latency->probe_im[i];
+
+    atomic_init(&latency->head, 0);
+    atomic_init(&latency->tail, 0);
+    return 0;
+}
+
+void latency_free(struct Latency *latency)
+{
+    fft_free(&latency->fft);
+    free(latency->probe);
+    free(latency->probe_re);
+    free(latency->probe_im);
+    free(latency->re);
+    free(latency->im);
+    free(latency->pool);
+    free(latency->block_period);
+    memset(latency, 0, sizeof(*latency));
+}
+
+void latency_play(struct Latency *latency, float *output, unsigned long frames, int channel)
+{
+    size_t mask = latency->period - 1;
+    unsigned long f;
+    int i;
+
+    for (f = 0; f < frames; ++f)
+    {
+        float v = latency->probe[(latency->out_frame + f) & mask];
+        for (i = 0; i < channel; ++i)
+            *output++ = v;
+    }
+    latency->out_frame += frames;
+}
+
+void latency_capture(struct Latency *latency, const float *input, unsigned long frames, int channel, int index)
+{
+    size_t period = latency->period;
+
+    while (frames > 0)
+    {
+        size_t offset = latency->in_frame & (period - 1);
+        unsigned long n = period - offset;
+        if (n > frames)
+            n = frames;
+
+        size_t head = atomic_load_explicit(&latency->head, memory_order_relaxed);
+
+        // a new period begins, it is captured only if there is a free block for it
+        if (offset == 0)
+        {
+            size_t tail = atomic_load_explicit(&latency->tail, memory_order_acquire);
+            latency->is_filling = head - tail < latency->depth;
+            if (!latency->is_filling)
+                atomic_fetch_add_explicit(&latency->periods_dropped, 1, memory_order_relaxed);
+        }
+
+        if (latency->is_filling)
+        {
+            size_t slot = head % latency->depth;
+            float *block = latency->pool + slot * period + offset;
+            unsigned long f;
+
+            if (input)
+                for (f = 0; f < n; ++f)
+                    block[f] = input[f * channel + index];
+            else
+                memset(block, 0, sizeof(float) * n);
+
+            if (offset + n == period)
+            {
+                latency->block_period[slot] = latency->in_frame / period;
+                atomic_store_explicit(&latency->head, head + 1, memory_order_release);
+            }
+        }
+
+        latency->in_frame += n;
+        if (input)
+            input += n * channel;
+        frames -= n;
+    }
+}
+
+int latency_analyse(struct Latency *latency, struct Latency_estimate *estimate)
+{
+    size_t tail = atomic_load_explicit(&latency->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&latency->head, memory_order_acquire);
+    if (head == tail)
+        return 0;
+
+    size_t period = latency->period;
+    size_t slot = tail % latency->depth;
+    float *re = latency->re, *im = latency->im;
+
+    memcpy(re, latency->pool + slot * period, sizeof(float) * period);
+    memset(im, 0, sizeof(float) * period);
+    estimate->period = latency->block_period[slot];
+
+    // the block is copied out, the callback may fill it again
+    atomic_store_explicit(&latency->tail, tail + 1, memory_order_release);
+
+    fft_forward(&latency->fft, re, im);
+    size_t i;
+    for (i = 0; i < period; ++i)
+    {
+        float a = re[i], b = im[i];
+        re[i] = a * latency->probe_re[i] - b * latency->probe_im[i];
+        im[i] = a * latency->probe_im[i] + b * latency->probe_re[i];
+    }
+    fft_inverse(&latency->fft, re, im);
+
+    // the input is real, so is the correlation: its peak is the latency
+    size_t peak = 0;
+    double energy = 0;
+    for (i = 0; i < period; ++i)
+    {
+        energy += (double)re[i] * re[i];
+        if (fabsf(re[i]) > fabsf(re[peak]))
+            peak = i;
+    }
+    double peak_energy = (double)re[peak] * re[peak];
+    double rest = (energy - peak_energy) / (period - 1);
+    estimate->snr_db = rest > 0 ? 10 * log10(peak_energy / rest) : 200;
+    estimate->is_inverted = re[peak] < 0;
+
+    /* a broadband probe correlates into a sinc around the peak: with r0 = sinc(d) and the larger
+     * neighbour r1 = sinc(1 - d) the fraction d of a frame is r1 / (r0 + r1) */
+    float sign = re[peak] < 0 ? -1 : 1;
+    double r0 = sign * re[peak];
+    double before = sign * re[(peak + period - 1) & (period - 1)];
+    double after = sign * re[(peak + 1) & (period - 1)];
+    double fraction = 0;
+    if (after > before && after > 0)
+        fraction = after / (r0 + after);
+    else if (before > 0)
+        fraction = -before / (r0 + before);
+    double lag = peak + fraction;
+
+    // a latency drifting across a period boundary keeps counting up or down
+    if (latency->has_lag)
+        lag += period * floor((latency->last_lag - lag) / period + 0.5);
+    if (estimate->snr_db >= MIN_SNR_DB)
+    {
+        latency->last_lag = lag;
+        latency->has_lag = 1;
+    }
+    estimate->lag = lag;
+    return 1;
+}
@@ -0,0 +1,97 @@
+/*************************************************************************
+ Description: Round-trip latency estimator for "loopback".
+
+              The output plays a probe signal repeating every `period`
+              frames (a power of 2): a maximum length sequence (MLS) padded
+              with one zero, or a single impulse. The callback copies one
+              input channel into period aligned blocks, so block k holds the
+              input frames [k * period, (k + 1) * period) counted from the
+              first callback, the same count the output is played at.
+
+              Full blocks reach the analysis thread through a lock-free
+              single-producer/single-consumer queue of block indexes, like
+              the prefetch chunks but the other way around. If no block is
+              free the callback drops that period rather than wait.
+
+              A block is circularly cross-correlated with the probe by FFT,
+              the correlation peaks at the round-trip latency (modulo the
+              period, which therefore must be longer than the latency). The
+              neighbours of the peak give a fraction of a frame, and
+              consecutive estimates are unwrapped so slow drift between the
+              input and output clocks can be followed for hours.
+ ************************************************************************/
+
+#ifndef PACAP_LATENCY_H
+#define PACAP_LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "fft.h"
+
+/* MLS orders with a known primitive polynomial */
+#define LATENCY_MIN_ORDER 10
+#define LATENCY_MAX_ORDER 20
+
+enum Probe_signal
+{
+    PROBE_MLS,
+    PROBE_IMPULSE,
+};
+
+struct Latency_estimate
+{
+    uint64_t period;        // index of the analysed block
+    double lag;             // in frames, unwrapped
+    double snr_db;          // correlation peak over the rest of the correlation
+    int is_inverted;        // negative peak, the loop inverts polarity
+};
+
+struct Latency
+{
+    enum Probe_signal signal;
+    size_t period;          // frames, 1 << order
+    float *probe;           // one period of the output
+
+    /* analysis side only */
+    struct Fft fft;
+    float *probe_re;        // conjugated spectrum of the probe
+    float *probe_im;
+    float *re;              // scratch
+    float *im;
+    int has_lag;
+    double last_lag;
+
+    /* capture block pool */
+    unsigned depth;
+    float *pool;
+    uint64_t *block_period;
+    _Alignas(64) atomic_size_t head;    // blocks filled, advanced by the callback
+    _Alignas(64) atomic_size_t tail;    // blocks analysed, advanced by the analysis
+
+    /* callback only */
+    uint64_t out_frame;     // frames played so far
+    uint64_t in_frame;      // frames captured so far
+    int is_filling;         // the block at `head` is being filled, not dropped
+    atomic_ulong periods_dropped;
+};
+
+/* generate one period of the probe at `amplitude` (linear, full scale 1.0) and allocate `depth`
+ * capture blocks. `order` is log2 of the period. return 0 on success */
+int latency_init(struct Latency *latency, enum Probe_signal signal, unsigned order, float amplitude,
+                 unsigned depth);
+void latency_free(struct Latency *latency);
+
+/* called from the audio callback: write the next `frames` frames of the probe to every one of
+ * `channel` interleaved float channels */
+void latency_play(struct Latency *latency, float *output, unsigned long frames, int channel);
+
+/* called from the audio callback: capture channel `index` of `channel` interleaved float
+ * channels, never blocks */
+void latency_capture(struct Latency *latency, const float *input, unsigned long frames, int channel, int index);
+
+/* analyse the oldest full block if there is one, return 1 if `estimate` was filled */
+int latency_analyse(struct Latency *latency, struct Latency_estimate *estimate);
+
+#endif
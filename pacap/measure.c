@@ -0,0 +1,249 @@
+/*************************************************************************
+ Description: Streaming frequency response estimator, see measure.h.
+ ************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "measure.h"
+
+/* a band whose stimulus is this far (-60 dB) below the average over all bins was not stimulated */
+#define MIN_BAND_ENERGY 1e-6
+
+int measure_init(struct Measure *measure, size_t segment, unsigned delay, unsigned depth)
+{
+    memset(measure, 0, sizeof(*measure));
+    if (segment < 16 || (segment & (segment - 1)) || depth == 0)
+        return -1;
+
+    size_t hop = segment / 2;
+    size_t bins = segment / 2 + 1;
+    measure->segment = segment;
+    measure->hop = hop;
+    measure->delay = delay;
+    measure->depth = depth;
+
+    measure->delay_line = calloc(delay ? delay : 1, sizeof(float));
+    measure->pool = malloc(sizeof(float) * 2 * hop * depth);
+    measure->block_index = calloc(depth, sizeof(uint64_t));
+    measure->window = malloc(sizeof(float) * segment);
+    measure->x = malloc(sizeof(float) * segment);
+    measure->y = malloc(sizeof(float) * segment);
+    measure->x_re = malloc(sizeof(float) * segment);
+    measure->x_im = malloc(sizeof(float) * segment);
+    measure->y_re = malloc(sizeof(float) * segment);
+    measure->y_im = malloc(sizeof(float) * segment);
+    measure->sxx = calloc(bins, sizeof(double));
+    measure->syy = calloc(bins, sizeof(double));
+    measure->sxy_re = calloc(bins, sizeof(double));
+    measure->sxy_im = calloc(bins, sizeof(double));
+    if (measure->delay_line == NULL || measure->pool == NULL || measure->block_index == NULL ||
+        measure->window == NULL || measure->x == NULL || measure->y == NULL ||
+        measure->x_re == NULL || measure->x_im == NULL || measure->y_re == NULL || measure->y_im == NULL ||
+        measure->sxx == NULL || measure->syy == NULL || measure->sxy_re == NULL || measure->sxy_im == NULL ||
+        fft_init(&measure->fft, segment) != 0)
+    {
+        measure_free(measure);
+        return -1;
+    }
+    // touch every page now so that the audio thread never page faults on it
+    memset(measure->pool, 0, sizeof(float) * 2 * hop * depth);
+
+    size_t i;
+    for (i = 0; i < segment; ++i)
+        measure->window[i] = 0.5 - 0.5 * cos(2*M_PI * i / segment);
+
+    atomic_init(&measure->head, 0);
+    atomic_init(&measure->tail, 0);
+    atomic_init(&measure->blocks_dropped, 0);
+    return 0;
+}
+
+void measure_free(struct Measure *measure)
+{
+    fft_free(&measure->fft);
+    free(measure->delay_line);
+    free(measure->pool);
+    free(measure->block_index);
+    free(measure->window);
+    free(measure->x);
+    free(measure->y);
+    free(measure->x_re);
+    free(measure->x_im);
+    free(measure->y_re);
+    free(measure->y_im);
+    free(measure->sxx);
+    free(measure->syy);
+    free(measure->sxy_re);
+    free(measure->sxy_im);
+    memset(measure, 0, sizeof(*measure));
+}
+
+void measure_capture(struct Measure *measure, const float *stimulus, const float *input, unsigned long frames,
+                     int channel, int index)
+{
+    size_t hop = measure->hop;
+
+    while (frames > 0)
+    {
+        size_t head = atomic_load_explicit(&measure->head, memory_order_relaxed);
+
+        // a new block begins, it is filled only if there is a free one
+        if (measure->fill == 0)
+        {
+            size_t tail = atomic_load_explicit(&measure->tail, memory_order_acquire);
+            measure->is_filling = head - tail < measure->depth;
+            if (!measure->is_filling)
+                atomic_fetch_add_explicit(&measure->blocks_dropped, 1, memory_order_relaxed);
+        }
+
+        unsigned long n = hop - measure->fill;
+        if (n > frames)
+            n = frames;
+
+        float *block = measure->pool + (head % measure->depth) * 2 * hop;
+        unsigned long f;
+        for (f = 0; f < n; ++f)
+        {
+            // the delay line keeps running while blocks are dropped
+            float x = stimulus[f];
+            if (measure->delay)
+            {
+                float delayed = measure->delay_line[measure->delay_pos];
+                measure->delay_line[measure->delay_pos] = x;
+                if (++measure->delay_pos == measure->delay)
+                    measure->delay_pos = 0;
+                x = delayed;
+            }
+
+            if (measure->is_filling)
+            {
+                block[measure->fill + f] = x;
+                block[hop + measure->fill + f] = input ? input[f * channel + index] : 0;
+            }
+        }
+
+        measure->fill += n;
+        if (measure->fill == hop)
+        {
+            if (measure->is_filling)
+            {
+                measure->block_index[head % measure->depth] = measure->blocks;
+                atomic_store_explicit(&measure->head, head + 1, memory_order_release);
+            }
+            ++measure->blocks;
+            measure->fill = 0;
+        }
+
+        stimulus += n;
+        if (input)
+            input += n * channel;
+        frames -= n;
+    }
+}
+
+// window and transform the current segment, add it into the spectra
+static void add_segment(struct Measure *measure)
+{
+    size_t segment = measure->segment;
+    size_t i;
+
+    for (i = 0; i < segment; ++i)
+    {
+        measure->x_re[i] = measure->x[i] * measure->window[i];
+        measure->y_re[i] = measure->y[i] * measure->window[i];
+    }
+    memset(measure->x_im, 0, sizeof(float) * segment);
+    memset(measure->y_im, 0, sizeof(float) * segment);
+    fft_forward(&measure->fft, measure->x_re, measure->x_im);
+    fft_forward(&measure->fft, measure->y_re, measure->y_im);
+
+    // both signals are real, the bins above segment / 2 mirror the ones below
+    for (i = 0; i <= segment / 2; ++i)
+    {
+        double xr = measure->x_re[i], xi = measure->x_im[i];
+        double yr = measure->y_re[i], yi = measure->y_im[i];
+
+        measure->sxx[i] += xr * xr + xi * xi;
+        measure->syy[i] += yr * yr + yi * yi;
+        measure->sxy_re[i] += xr * yr + xi * yi;   // conj(X) * Y
+        measure->sxy_im[i] += xr * yi - xi * yr;
+    }
+    ++measure->segments;
+}
+
+unsigned long measure_analyse(struct Measure *measure)
+{
+    size_t segment = measure->segment;
+    size_t hop = measure->hop;
+    unsigned long added = 0;
+
+    for (;;)
+    {
+        size_t tail = atomic_load_explicit(&measure->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&measure->head, memory_order_acquire);
+        if (head == tail)
+            break;
+
+        size_t slot = tail % measure->depth;
+        const float *block = measure->pool + slot * 2 * hop;
+
+        // a dropped block breaks the signal, the window starts over
+        if (measure->frames > 0 && measure->block_index[slot] != measure->next_block)
+            measure->frames = 0;
+        measure->next_block = measure->block_index[slot] + 1;
+
+        // slide the window by one hop
+        if (measure->frames == segment)
+        {
+            memmove(measure->x, measure->x + hop, sizeof(float) * (segment - hop));
+            memmove(measure->y, measure->y + hop, sizeof(float) * (segment - hop));
+            measure->frames -= hop;
+        }
+        memcpy(measure->x + measure->frames, block, sizeof(float) * hop);
+        memcpy(measure->y + measure->frames, block + hop, sizeof(float) * hop);
+        measure->frames += hop;
+
+        // the block is copied out, the callback may fill it again
+        atomic_store_explicit(&measure->tail, tail + 1, memory_order_release);
+
+        if (measure->frames == segment)
+        {
+            add_segment(measure);
+            ++added;
+        }
+    }
+    return added;
+}
+
+int measure_response(const struct Measure *measure, double rate, double low, double high,
+                     struct Measure_response *response)
+{
+    size_t bins = measure->segment / 2 + 1;
+    double bin_hz = rate / measure->segment;
+    double sxx = 0, syy = 0, sxy_re = 0, sxy_im = 0, total = 0;
+    size_t i, n = 0;
+
+    for (i = 0; i < bins; ++i)
+    {
+        total += measure->sxx[i];
+
+        double freq = i * bin_hz;
+        if (freq < low || freq >= high)
+            continue;
+        sxx += measure->sxx[i];
+        syy += measure->syy[i];
+        sxy_re += measure->sxy_re[i];
+        sxy_im += measure->sxy_im[i];
+        ++n;
+    }
+    if (n == 0 || sxx <= 0 || sxx / n < MIN_BAND_ENERGY * total / bins)
+        return -1;
+
+    double cross = sxy_re * sxy_re + sxy_im * sxy_im;
+    response->gain_db = 10 * log10(cross / (sxx * sxx) + 1e-30);
+    response->phase_deg = atan2(sxy_im, sxy_re) * 180 / M_PI;
+    response->coherence = syy > 0 ? cross / (sxx * syy) : 0;
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*************************************************************************
+ Description: Streaming frequency response estimator for "measure".
+
+              The callback pairs every played stimulus sample with the
+              sample captured at the same frame count, after delaying the
+              stimulus by the round trip of the loop (as "loopback" reports
+              it), and queues them in hop sized blocks through a lock-free
+              single-producer/single-consumer pool, like "loopback" does.
+
+              The analysis slides a Hann window of `segment` frames over
+              both signals, half a segment at a time, and adds the FFT of
+              every window into the auto and cross spectra (Welch). The
+              response is the H1 estimate Sxy / Sxx, with the coherence
+              |Sxy|^2 / (Sxx * Syy) telling how much of the input the
+              stimulus explains. Memory only depends on the segment, not on
+              how long the measurement runs.
+ ************************************************************************/
+
+#ifndef PACAP_MEASURE_H
+#define PACAP_MEASURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "fft.h"
+
+struct Measure_response
+{
+    double gain_db;
+    double phase_deg;
+    double coherence;       // 0 to 1
+};
+
+struct Measure
+{
+    size_t segment;         // FFT length, power of 2
+    size_t hop;             // segment / 2 frames per block
+
+    /* callback only */
+    float *delay_line;      // the last `delay` stimulus samples
+    unsigned delay;
+    unsigned delay_pos;
+    size_t fill;            // frames in the block at `head`
+    int is_filling;         // the block at `head` is being filled, not dropped
+    uint64_t blocks;        // blocks filled or dropped so far
+
+    /* block pool, every block is `hop` stimulus frames then `hop` input frames */
+    unsigned depth;
+    float *pool;
+    uint64_t *block_index;  // of the block in each slot, counted like `blocks`
+    _Alignas(64) atomic_size_t head;    // blocks filled, advanced by the callback
+    _Alignas(64) atomic_size_t tail;    // blocks analysed, advanced by the analysis
+    atomic_ulong blocks_dropped;
+
+    /* analysis side only */
+    struct Fft fft;
+    float *window;
+    float *x;               // last `segment` stimulus frames
+    float *y;               // last `segment` input frames
+    size_t frames;          // in x and y so far, up to `segment`
+    uint64_t next_block;    // index the next block has if none was dropped
+    float *x_re, *x_im, *y_re, *y_im;
+    double *sxx, *syy;      // auto spectra, segment / 2 + 1 bins
+    double *sxy_re, *sxy_im;// cross spectrum
+    unsigned long segments; // added into the spectra
+};
+
+/* `segment` must be a power of 2, `delay` in frames, `depth` blocks in the pool.
+ * return 0 on success */
+int measure_init(struct Measure *measure, size_t segment, unsigned delay, unsigned depth);
+void measure_free(struct Measure *measure);
+
+/* called from the audio callback: `stimulus` is what was played (mono), channel `index` of
+ * `channel` interleaved float channels of `input` is what came back, never blocks */
+void measure_capture(struct Measure *measure, const float *stimulus, const float *input, unsigned long frames,
+                     int channel, int index);
+
+/* add every full block into the spectra, return the count of segments added */
+unsigned long measure_analyse(struct Measure *measure);
+
+/* response over the bins between `low` and `high` Hz at `rate`, return -1 if the stimulus had no
+ * energy there */
+int measure_response(const struct Measure *measure, double rate, double low, double high,
+                     struct Measure_response *response);
+
+#endif
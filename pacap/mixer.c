@@ -0,0 +1,626 @@
+/*************************************************************************
+ Description: Mixer of several sources into one output stream, see mixer.h.
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "mixer.h"
+#include "telemetry.h"
+
+static const char *mix_kind_names[] = {"tone", "gen", "file", "shm"};
+
+/* Kernels walk an output plane one vector of MIX_WIDTH frames at a time. Planes are aligned to a
+ * whole vector and MIX_BLOCK_FRAMES long, a block is rounded up to whole vectors */
+typedef float Mix_vec __attribute__((vector_size(MIX_WIDTH * sizeof(float))));
+typedef int32_t Mix_ivec __attribute__((vector_size(MIX_WIDTH * sizeof(int32_t))));
+
+#define BODY static inline __attribute__((always_inline))
+
+#define VEC(plane, f) (*(Mix_vec*)((plane) + (f)))
+
+BODY uint64_t mix_body(const struct Mix_route *routes, const int *first_route, int channel, float *bus,
+                       unsigned long frames, float knee)
+{
+    const Mix_vec zero = {0};
+    const Mix_vec one = zero + 1, three = zero + 3;
+    const Mix_vec knee_vec = zero + knee, range = zero + (1 - knee), scale = zero + 1 / (1 - knee);
+    Mix_ivec count = {0};
+    unsigned long f;
+    int o, r, i;
+
+    for (o = 0; o < channel; ++o)
+    {
+        float *restrict dst = bus + (size_t)o * MIX_BLOCK_FRAMES;
+        int end = first_route[o + 1];
+
+        r = first_route[o];
+        if (r == end)
+        {
+            memset(dst, 0, sizeof(float) * frames);
+            continue;
+        }
+
+        // the first route stores, the others add
+        const float *restrict src = routes[r].src;
+        float coef = routes[r].coef;
+        for (f = 0; f < frames; f += MIX_WIDTH)
+            VEC(dst, f) = coef * VEC(src, f);
+        for (++r; r < end; ++r)
+        {
+            src = routes[r].src;
+            coef = routes[r].coef;
+            for (f = 0; f < frames; f += MIX_WIDTH)
+                VEC(dst, f) += coef * VEC(src, f);
+        }
+
+        /* Above the knee k the excess e = |x| - k is squashed by the rational approximation of tanh
+         * g(u) = u * (27 + u^2) / (27 + 9 * u^2), which has slope 1 at 0, stays below u and reaches 1 with
+         * slope 0 at u = 3. With u the excess in units of the headroom, e / (1 - k), the output
+         * k + (1 - k) * g(u) leaves the straight line without a kink, never exceeds the input and reaches
+         * exactly 1 at an input 3 * (1 - k) above the knee, beyond which it stays there. Signs are masked
+         * off and back on, nothing branches */
+        for (f = 0; f < frames; f += MIX_WIDTH)
+        {
+            Mix_ivec bits = (Mix_ivec)VEC(dst, f);
+            Mix_vec a = (Mix_vec)(bits & 0x7fffffff);
+            Mix_ivec over = a > knee_vec;
+            Mix_vec e = (Mix_vec)((Mix_ivec)(a - knee_vec) & over);
+            Mix_vec u = e * scale;
+            Mix_ivec is_full = u > three;
+            u = (Mix_vec)(((Mix_ivec)u & ~is_full) | ((Mix_ivec)three & is_full));
+            Mix_vec u2 = u * u;
+            Mix_vec y = (a - e) + range * (u * (27 + u2) / (27 + 9 * u2));
+            // rounding must not make a sample grow, or overshoot full scale, by an ulp either
+            Mix_ivec grew = y > a;
+            y = (Mix_vec)(((Mix_ivec)y & ~grew) | ((Mix_ivec)a & grew));
+            Mix_ivec is_over = y > one;
+            y = (Mix_vec)(((Mix_ivec)y & ~is_over) | ((Mix_ivec)one & is_over));
+
+            count += over;
+            VEC(dst, f) = (Mix_vec)((Mix_ivec)y | (bits & INT32_MIN));
+        }
+    }
+
+    // lanes counted -1 for each sample over the knee
+    int64_t sum = 0;
+    for (i = 0; i < MIX_WIDTH; ++i)
+        sum -= count[i];
+    return sum;
+}
+
+static uint64_t mix_base(const struct Mix_route *routes, const int *first_route, int channel, float *bus,
+                         unsigned long frames, float knee)
+{
+    return mix_body(routes, first_route, channel, bus, frames, knee);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2,fma")))
+static uint64_t mix_avx2(const struct Mix_route *routes, const int *first_route, int channel, float *bus,
+                         unsigned long frames, float knee)
+{
+    return mix_body(routes, first_route, channel, bus, frames, knee);
+}
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+static Mix_kernel pick_kernel(enum Simd_level simd_level)
+{
+#ifdef HAVE_AVX2_KERNEL
+    __builtin_cpu_init();
+    if (simd_level == SIMD_AVX2 && __builtin_cpu_supports("fma"))
+        return mix_avx2;
+#else
+    (void)simd_level;
+#endif
+    return mix_base;
+}
+
+// vector aligned and zeroed, NULL on failure
+static float *alloc_planes(int channel)
+{
+    void *p;
+    size_t size = sizeof(float) * MIX_BLOCK_FRAMES * channel;
+    if (posix_memalign(&p, sizeof(Mix_vec), size) != 0)
+        return NULL;
+    memset(p, 0, size);
+    return p;
+}
+
+// split "KIND[:ARG]", return the kind or -1, `arg` points past the colon or is NULL
+static int parse_kind(const char *spec, const char **arg)
+{
+    size_t len = strcspn(spec, ":");
+    unsigned kind;
+
+    *arg = spec[len] == ':' ? spec + len + 1 : NULL;
+    for (kind = 0; kind < sizeof(mix_kind_names) / sizeof(mix_kind_names[0]); ++kind)
+        if (strlen(mix_kind_names[kind]) == len && !strncmp(spec, mix_kind_names[kind], len))
+            return kind;
+    return -1;
+}
+
+/* fill the routing matrix from "IN:OUT[:DB],...", return 0 on success */
+static int parse_route(struct Mix_source *source, const char *route, int channel)
+{
+    const char *p = route;
+
+    while (*p)
+    {
+        char *end;
+        long in = strtol(p, &end, 10);
+        long out = -1;
+        double db = 0;
+
+        if (end != p && *end == ':')
+        {
+            p = end + 1;
+            out = strtol(p, &end, 10);
+            if (end == p)
+                out = -1;
+        }
+        if (out >= 0 && *end == ':')
+        {
+            p = end + 1;
+            db = strtod(p, &end);
+            if (end == p)
+                out = -1;
+        }
+        if (out < 0 || (*end != ',' && *end != '\0'))
+        {
+            printf("Invalid route \"%s\", expecting IN:OUT[:DB],...\n", route);
+            return -1;
+        }
+        if (in < 0 || in >= source->channel || out >= channel)
+        {
+            printf("Route %ld:%ld of %s is out of range, it has %d channels and the output %d\n", in, out,
+                   source->spec, source->channel, channel);
+            return -1;
+        }
+        source->matrix[out * source->channel + in] = pow(10, db / 20);
+        p = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+static int open_source(struct Mix_source *source, const struct Mix_source_config *config, int channel,
+                       double rate, double default_freq, enum Simd_level simd_level)
+{
+    const char *arg;
+    int kind = parse_kind(config->spec, &arg);
+    char spec[64];
+    int i;
+
+    source->spec = config->spec;
+    source->gain = pow(10, config->gain_db / 20);
+    switch (kind)
+    {
+        case MIX_TONE:
+            snprintf(spec, sizeof(spec), "sine:%s", arg ? arg : "");
+            source->channel = 1;
+            if (gen_init(&source->gen, spec, 1, rate, default_freq, 1, MIX_BLOCK_FRAMES, simd_level) != 0)
+                return -1;
+            break;
+        case MIX_GEN:
+            if (arg == NULL || *arg == '\0')
+            {
+                printf("Missing generators in %s\n", config->spec);
+                return -1;
+            }
+            source->channel = 1;
+            for (i = 0; arg[i]; ++i)
+                source->channel += arg[i] == ',';
+            if (gen_init(&source->gen, arg, source->channel, rate, default_freq, 1, MIX_BLOCK_FRAMES,
+                         simd_level) != 0)
+                return -1;
+            break;
+        case MIX_FILE:
+        case MIX_SHM:
+            if (arg == NULL || *arg == '\0')
+            {
+                printf("Missing %s in %s\n", kind == MIX_FILE ? "path" : "name", config->spec);
+                return -1;
+            }
+            if ((kind == MIX_FILE ? file_source_open(&source->file, arg) : file_source_open_shm(&source->file, arg)) != 0)
+                return -1;
+            if (source->file.info.rate != rate)
+            {
+                printf("%s is at %.0f Hz, not %.0f Hz, the sources of a mix must be at the same rate\n",
+                       config->spec, source->file.info.rate, rate);
+                file_source_close(&source->file);
+                return -1;
+            }
+            source->channel = source->file.info.channel;
+            source->decoded = malloc(sizeof(float) * MIX_BLOCK_FRAMES * source->channel);
+            break;
+        default:
+            printf("Unknown source %s, expecting tone[:FREQ], gen:SPEC, file:PATH or shm:NAME\n", config->spec);
+            return -1;
+    }
+    source->kind = kind;
+
+    source->planes = alloc_planes(source->channel);
+    source->matrix = calloc((size_t)channel * source->channel, sizeof(float));
+    if (source->planes == NULL || source->matrix == NULL || ((kind == MIX_FILE || kind == MIX_SHM) && !source->decoded))
+    {
+        printf("Failed to allocate mixer source\n");
+        return -1;
+    }
+
+    // like a file played alone, output channel o plays source channel o % channel
+    if (config->route == NULL)
+    {
+        for (i = 0; i < channel; ++i)
+            source->matrix[i * source->channel + i % source->channel] = 1;
+        return 0;
+    }
+    return parse_route(source, config->route, channel);
+}
+
+static void close_source(struct Mix_source *source)
+{
+    if (source->kind == MIX_TONE || source->kind == MIX_GEN)
+        gen_free(&source->gen);
+    else
+        file_source_close(&source->file);
+    free(source->decoded);
+    free(source->planes);
+    free(source->matrix);
+}
+
+int mixer_init(struct Mixer *mixer, const struct Mix_config *config, int channel, double rate,
+               double default_freq, int is_planar, enum Simd_level simd_level)
+{
+    int s, o, i;
+
+    memset(mixer, 0, sizeof(*mixer));
+    mixer->channel = channel;
+    mixer->is_planar = is_planar;
+    mixer->rate = rate;
+    mixer->knee = pow(10, config->knee_db / 20);
+    if (config->knee_db >= 0)
+    {
+        printf("The knee of the soft clipper must be below 0 dBFS\n");
+        return -1;
+    }
+
+    mixer->kernel = pick_kernel(simd_level);
+
+    mixer->sources = calloc(config->n_source, sizeof(*mixer->sources));
+    mixer->first_route = calloc(channel + 1, sizeof(int));
+    mixer->bus = alloc_planes(channel);
+    mixer->interleaved = is_planar ? NULL : malloc(sizeof(float) * MIX_BLOCK_FRAMES * channel);
+    if (mixer->sources == NULL || mixer->first_route == NULL || mixer->bus == NULL ||
+        (!is_planar && mixer->interleaved == NULL))
+    {
+        printf("Failed to allocate mixer\n");
+        mixer_free(mixer);
+        return -1;
+    }
+
+    for (s = 0; s < config->n_source; ++s)
+    {
+        struct Mix_source *source = &mixer->sources[s];
+        mixer->n_source = s + 1;
+        if (open_source(source, &config->sources[s], channel, rate, default_freq, simd_level) != 0)
+        {
+            mixer_free(mixer);
+            return -1;
+        }
+        if (source->kind == MIX_FILE || source->kind == MIX_SHM)
+            ++mixer->n_finite;
+    }
+
+    // every non-zero matrix entry is one route, grouped by output channel
+    for (o = 0; o < channel; ++o)
+        for (s = 0; s < mixer->n_source; ++s)
+            for (i = 0; i < mixer->sources[s].channel; ++i)
+                mixer->n_route += mixer->sources[s].matrix[o * mixer->sources[s].channel + i] != 0;
+    mixer->routes = malloc(sizeof(struct Mix_route) * (mixer->n_route ? mixer->n_route : 1));
+    if (mixer->routes == NULL)
+    {
+        printf("Failed to allocate mixer routes\n");
+        mixer_free(mixer);
+        return -1;
+    }
+
+    int n = 0;
+    for (o = 0; o < channel; ++o)
+    {
+        mixer->first_route[o] = n;
+        for (s = 0; s < mixer->n_source; ++s)
+        {
+            const struct Mix_source *source = &mixer->sources[s];
+            for (i = 0; i < source->channel; ++i)
+            {
+                float entry = source->matrix[o * source->channel + i];
+                if (entry == 0)
+                    continue;
+                mixer->routes[n].src = source->planes + (size_t)i * MIX_BLOCK_FRAMES;
+                mixer->routes[n].coef = entry * source->gain;
+                ++n;
+            }
+        }
+    }
+    mixer->first_route[channel] = n;
+    return 0;
+}
+
+void mixer_free(struct Mixer *mixer)
+{
+    int s;
+    for (s = 0; s < mixer->n_source; ++s)
+        close_source(&mixer->sources[s]);
+    free(mixer->sources);
+    free(mixer->routes);
+    free(mixer->first_route);
+    free(mixer->bus);
+    free(mixer->interleaved);
+    mixer->sources = NULL;
+    mixer->routes = NULL;
+    mixer->first_route = NULL;
+    mixer->bus = mixer->interleaved = NULL;
+    mixer->n_source = 0;
+}
+
+int mixer_start(struct Mixer *mixer, double ahead_seconds)
+{
+    int s;
+    for (s = 0; s < mixer->n_source; ++s)
+    {
+        struct Mix_source *source = &mixer->sources[s];
+        if ((source->kind == MIX_FILE || source->kind == MIX_SHM) &&
+            file_source_start(&source->file, ahead_seconds) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+// zero frames [begin, end) of every plane of `source`
+static void silence_planes(struct Mix_source *source, unsigned long begin, unsigned long end)
+{
+    int c;
+    if (begin < end)
+        for (c = 0; c < source->channel; ++c)
+            memset(source->planes + (size_t)c * MIX_BLOCK_FRAMES + begin, 0, sizeof(float) * (end - begin));
+}
+
+/* decode the next `frames` of a file/shm source into its planes, what it can't give is silence */
+static void pull_file(struct Mixer *mixer, struct Mix_source *source, unsigned long frames)
+{
+    unsigned long done = 0;
+
+    if (source->is_ended)
+    {
+        if (!source->is_silent)
+            silence_planes(source, 0, MIX_BLOCK_FRAMES);
+        source->is_silent = 1;
+        return;
+    }
+
+    while (done < frames)
+    {
+        unsigned long n = frames - done;
+        const void *src = file_source_peek(&source->file, &n);
+        if (src == NULL)
+        {
+            silence_planes(source, done, frames);
+            if (file_source_at_end(&source->file, frames - done))
+            {
+                source->is_ended = 1;
+                ++mixer->n_ended;
+            }
+            return;
+        }
+
+        file_source_decode(&source->file, src, source->decoded, n);
+        unsigned long f;
+        int c;
+        for (c = 0; c < source->channel; ++c)
+        {
+            float *plane = source->planes + (size_t)c * MIX_BLOCK_FRAMES + done;
+            for (f = 0; f < n; ++f)
+                plane[f] = source->decoded[f * source->channel + c];
+        }
+
+        file_source_advance(&source->file, n);
+        source->frames += n;
+        done += n;
+    }
+}
+
+int mixer_process(struct Mixer *mixer, unsigned long frames)
+{
+    // whole vectors, the lanes past the block are silent so the clipper doesn't count them
+    unsigned long padded = (frames + MIX_WIDTH - 1) & ~(unsigned long)(MIX_WIDTH - 1);
+    int s;
+
+    for (s = 0; s < mixer->n_source; ++s)
+    {
+        struct Mix_source *source = &mixer->sources[s];
+        if (source->kind == MIX_TONE || source->kind == MIX_GEN)
+            gen_process(&source->gen, source->planes, frames);
+        else
+            pull_file(mixer, source, frames);
+        silence_planes(source, frames, padded);
+    }
+
+    uint64_t begin_ns = telemetry_now_ns();
+    mixer->clipped += mixer->kernel(mixer->routes, mixer->first_route, mixer->channel, mixer->bus, padded,
+                                    mixer->knee);
+    if (!mixer->is_planar)
+    {
+        int channel = mixer->channel;
+        unsigned long f;
+        int c;
+        for (c = 0; c < channel; ++c)
+        {
+            const float *plane = mixer->bus + (size_t)c * MIX_BLOCK_FRAMES;
+            for (f = 0; f < frames; ++f)
+                mixer->interleaved[f * channel + c] = plane[f];
+        }
+    }
+    mixer->mix_ns += telemetry_now_ns() - begin_ns;
+    mixer->frames += frames;
+
+    return mixer->n_finite == mixer->n_source && mixer->n_ended == mixer->n_finite;
+}
+
+double mixer_source_rate(const struct Mix_config *config)
+{
+    int s;
+    for (s = 0; s < config->n_source; ++s)
+    {
+        const char *arg;
+        int kind = parse_kind(config->sources[s].spec, &arg);
+        struct File_source file;
+        double rate;
+
+        if ((kind != MIX_FILE && kind != MIX_SHM) || arg == NULL)
+            continue;
+        if ((kind == MIX_FILE ? file_source_open(&file, arg) : file_source_open_shm(&file, arg)) != 0)
+            return -1;
+        rate = file.info.rate;
+        file_source_close(&file);
+        return rate;
+    }
+    return 0;
+}
+
+int mixer_is_finite(const struct Mix_config *config)
+{
+    int s;
+    for (s = 0; s < config->n_source; ++s)
+    {
+        const char *arg;
+        int kind = parse_kind(config->sources[s].spec, &arg);
+        if (kind != MIX_FILE && kind != MIX_SHM)
+            return 0;
+    }
+    return config->n_source > 0;
+}
+
+int mixer_uses_shm(const struct Mix_config *config)
+{
+    int s;
+    for (s = 0; s < config->n_source; ++s)
+    {
+        const char *arg;
+        if (parse_kind(config->sources[s].spec, &arg) == MIX_SHM)
+            return 1;
+    }
+    return 0;
+}
+
+void mixer_print(const struct Mixer *mixer, const char *name)
+{
+    int s, o, i;
+
+    telemetry_print_prefix(name);
+    printf("Mixing %d sources into %d channels, %d routes, soft clip above %.1f dBFS\n", mixer->n_source,
+           mixer->channel, mixer->n_route, 20 * log10(mixer->knee));
+    for (s = 0; s < mixer->n_source; ++s)
+    {
+        const struct Mix_source *source = &mixer->sources[s];
+        telemetry_print_prefix(name);
+        printf("  %-24s %2d ch %+6.1f dB:", source->spec, source->channel, 20 * log10(source->gain));
+        for (o = 0; o < mixer->channel; ++o)
+        {
+            for (i = 0; i < source->channel; ++i)
+            {
+                float entry = source->matrix[o * source->channel + i];
+                if (entry == 1)
+                    printf(" %d>%d", i, o);
+                else if (entry != 0)
+                    printf(" %d>%d(%.1f dB)", i, o, 20 * log10(entry));
+            }
+        }
+        printf("\n");
+    }
+}
+
+void mixer_print_stats(struct Mixer *mixer, const char *name)
+{
+    int s;
+
+    for (s = 0; s < mixer->n_source; ++s)
+    {
+        struct Mix_source *source = &mixer->sources[s];
+        struct File_source_stats stats;
+
+        if (source->kind != MIX_FILE && source->kind != MIX_SHM)
+            continue;
+        file_source_get_stats(&source->file, &stats);
+        if (source->kind == MIX_FILE)
+            telemetry_print_line(name, "mix source", "%s, %llu of %llu frames%s", source->spec,
+                                 (unsigned long long)source->frames, (unsigned long long)source->file.frames,
+                                 source->is_ended ? ", ended" : "");
+        else
+            telemetry_print_line(name, "mix source", "%s, %llu frames, %llu underruns (%llu frames of silence)%s",
+                                 source->spec, (unsigned long long)source->frames,
+                                 (unsigned long long)stats.shm_underruns, (unsigned long long)stats.shm_frames_starved,
+                                 source->is_ended ? ", ended" : "");
+    }
+    telemetry_print_line(name, "mix soft clipped", "%llu of %llu samples above %.1f dBFS",
+                         (unsigned long long)mixer->clipped, (unsigned long long)mixer->frames * mixer->channel,
+                         20 * log10(mixer->knee));
+    telemetry_print_line(name, "mix cost", "%.2f ns per frame (%d routes)",
+                         mixer->frames ? (double)mixer->mix_ns / mixer->frames : 0.0, mixer->n_route);
+}
+
+uint64_t mixer_check_clip(double knee_db, enum Simd_level simd_level)
+{
+    const unsigned long n_sample = 1 << 20;
+    Mix_kernel kernel = pick_kernel(simd_level);
+    float knee = pow(10, knee_db / 20);
+    float *src = alloc_planes(1);
+    float *bus = alloc_planes(1);
+    struct Mix_route route = {src, 1};
+    int first_route[2] = {0, 1};
+    uint64_t failed = 0;
+    float last = -INFINITY;
+    unsigned long done, f;
+
+    if (src == NULL || bus == NULL)
+    {
+        printf("Failed to allocate clipper check planes\n");
+        free(src);
+        free(bus);
+        return 1;
+    }
+
+    // one route with gain 1, so each output sample is the clipped input sample
+    for (done = 0; done < n_sample; done += MIX_BLOCK_FRAMES)
+    {
+        for (f = 0; f < MIX_BLOCK_FRAMES; ++f)
+            src[f] = -4 + 8.0 * (done + f) / n_sample;
+        kernel(&route, first_route, 1, bus, MIX_BLOCK_FRAMES, knee);
+
+        for (f = 0; f < MIX_BLOCK_FRAMES; ++f)
+        {
+            float x = src[f], y = bus[f];
+            const char *why = NULL;
+
+            if (fabsf(x) <= knee && y != x)
+                why = "changed below the knee";
+            else if (fabsf(y) > fabsf(x))
+                why = "grew";
+            else if (fabsf(y) > 1)
+                why = "exceeds full scale";
+            else if (!signbit(y) != !signbit(x))
+                why = "flipped its sign";
+            else if (y < last - 4 * FLT_EPSILON) // the rational function rounds, by an ulp
+                why = "fell as the input rose";
+            last = y;
+            if (why && failed++ == 0)
+                printf("Soft clipper above %.1f dBFS: %.9g gave %.9g, which %s\n", knee_db, x, y, why);
+        }
+    }
+    free(src);
+    free(bus);
+    return failed;
+}
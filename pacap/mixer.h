@@ -0,0 +1,159 @@
+/*************************************************************************
+ Description: Mixer of several sources into one output stream.
+
+              Sources are test tones and generators (gen.h), WAV files and
+              shared memory rings (filesrc.h), each with its own channel
+              count, gain and routing matrix onto the output channels,
+              e.g. a tone, a file and a shm feed played into one device.
+
+              Every block each source fills its own channel planes in float,
+              then the non-zero entries of all routing matrices (the gain
+              folded in) are resolved into routes grouped by output
+              channel. An output plane is the sum of its routes, each a
+              multiply-add of one source plane over the whole block, so the
+              inner loops are plain vector FMAs whatever the number of
+              sources, and nothing is decided per sample. A soft clipper
+              then bends each output sample above the knee smoothly into
+              [-1, 1], and only the final planes are converted into the
+              stream's format, once.
+
+              Like the generators the kernels are GCC generic vectors,
+              compiled for the baseline and for AVX2 with FMA.
+ ************************************************************************/
+
+#ifndef PACAP_MIXER_H
+#define PACAP_MIXER_H
+
+#include <stdint.h>
+
+#include "render.h"
+#include "gen.h"
+#include "filesrc.h"
+
+/* frames of one mixer block, the planes are this long */
+#define MIX_BLOCK_FRAMES 256
+
+/* floats a kernel multiplies at once, 8 fill an AVX register */
+#define MIX_WIDTH 8
+
+#define MIX_MAX_SOURCES 32
+
+/* default knee of the soft clipper, in dBFS */
+#define MIX_DEFAULT_KNEE_DB -3.0
+
+enum Mix_kind
+{
+    MIX_TONE,       // tone[:FREQ], a mono sine
+    MIX_GEN,        // gen:SPEC, one channel per generator node
+    MIX_FILE,       // file:PATH
+    MIX_SHM,        // shm:NAME
+};
+
+/* one source as given on command line */
+struct Mix_source_config
+{
+    const char *spec;       // KIND[:ARG]
+    double gain_db;
+    const char *route;      // "IN:OUT[:DB],...", NULL routes output channel o from source channel o % channel
+};
+
+struct Mix_config
+{
+    int n_source;
+    struct Mix_source_config sources[MIX_MAX_SOURCES];
+    double knee_db;         // soft clipper knee
+};
+
+struct Mix_source
+{
+    enum Mix_kind kind;
+    const char *spec;
+    int channel;
+    float gain;             // linear
+    float *matrix;          // output channel o from source channel i at [o * channel + i], gain not applied
+    float *planes;          // `channel` planes of MIX_BLOCK_FRAMES frames, aligned to a vector
+
+    struct Gen gen;             // tone/gen
+    struct File_source file;    // file/shm
+    float *decoded;             // file/shm: MIX_BLOCK_FRAMES interleaved frames in float
+
+    int is_ended;           // file/shm played to its end, its planes are silent
+    int is_silent;
+    uint64_t frames;        // file/shm: frames played
+};
+
+/* one multiply-add of a source plane into an output plane */
+struct Mix_route
+{
+    const float *src;
+    float coef;             // routing matrix entry times the source's gain
+};
+
+/* sum the routes of every output channel into its plane of `bus`, soft clip above `knee` and return
+ * how many samples were above it. `frames` is a multiple of MIX_WIDTH */
+typedef uint64_t (*Mix_kernel)(const struct Mix_route *routes, const int *first_route, int channel,
+                               float *bus, unsigned long frames, float knee);
+
+struct Mixer
+{
+    int channel;            // of the output
+    int is_planar;          // the output is planar, otherwise the block is also interleaved
+    double rate;
+
+    struct Mix_source *sources;
+    int n_source;
+    int n_finite;           // files and shm rings, the mix ends when all of them did
+    int n_ended;
+
+    struct Mix_route *routes;   // sorted by output channel
+    int *first_route;           // routes of output channel o are [first_route[o], first_route[o + 1])
+    int n_route;
+    Mix_kernel kernel;
+    float knee;
+
+    float *bus;             // `channel` planes of MIX_BLOCK_FRAMES frames, the mixed block
+    float *interleaved;     // MIX_BLOCK_FRAMES interleaved frames, unless planar
+
+    /* kept by mixer_process() */
+    uint64_t frames;
+    uint64_t clipped;       // samples the clipper bent
+    uint64_t mix_ns;        // spent in routing, clipping and interleaving, not in the sources
+};
+
+/* parse the sources of `config` and open them for `channel` output channels at `rate`, every
+ * file/shm source must be at that rate. `is_planar` leaves the mix in `bus` only. Kernels are
+ * picked for `simd_level` like the generators'. return 0 on success, messages are printed on errors */
+int mixer_init(struct Mixer *mixer, const struct Mix_config *config, int channel, double rate,
+               double default_freq, int is_planar, enum Simd_level simd_level);
+
+void mixer_free(struct Mixer *mixer);
+
+/* make the first `ahead_seconds` of the file sources resident and start their read-ahead,
+ * return 0 on success */
+int mixer_start(struct Mixer *mixer, double ahead_seconds);
+
+/* called from the audio callback: mix the next `frames` (at most MIX_BLOCK_FRAMES) into `bus`, and
+ * into `interleaved` unless planar. return 1 once every source is a file/shm which has ended */
+int mixer_process(struct Mixer *mixer, unsigned long frames);
+
+/* rate of the first file/shm source of `config`, 0 if there is none, -1 if it can't be opened */
+double mixer_source_rate(const struct Mix_config *config);
+
+// return 1 if every source of `config` is a file/shm, which ends by itself
+int mixer_is_finite(const struct Mix_config *config);
+
+/* run the soft clipper kernel picked for `simd_level` over inputs sweeping [-4, 4], well past full scale,
+ * and check each output: unchanged below the knee, never larger than the input nor than 1, of the input's
+ * sign and rising with it. The first failure is printed, return the number of failed samples */
+uint64_t mixer_check_clip(double knee_db, enum Simd_level simd_level);
+
+// return 1 if a source of `config` is a shm ring, which only one stream may consume
+int mixer_uses_shm(const struct Mix_config *config);
+
+// print one line per source with its routes, `name` prefixes the lines and may be NULL
+void mixer_print(const struct Mixer *mixer, const char *name);
+
+// print the frames each file/shm source played and how it kept up, and what the clipper bent
+void mixer_print_stats(struct Mixer *mixer, const char *name);
+
+#endif
@@ -3,20 +3,43 @@
  Created Time: Thu 15 Dec 2016 09:20:30 PM CST
  Description:
  TODO List:
-    1. Format i24 supporting
-    2. Interleaved supporting
-    3. Capture
+    1. Non-interleaved recording supporting
  ************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
+#include <strings.h>
 #include <math.h>
 #include <stdint.h>
+#include <stdarg.h>
 #include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
 
 #include "portaudio.h"
+#include "render.h"
+#include "capture.h"
+#include "telemetry.h"
+#include "bench.h"
+#include "probe.h"
+#include "wav.h"
+#include "filesrc.h"
+#include "latency.h"
+#include "gen.h"
+#include "stimulus.h"
+#include "measure.h"
+#include "control.h"
+#include "resample.h"
+#include "rt.h"
+#include "rtcheck.h"
+#include "shmtest.h"
+#include "convtest.h"
+#include "prefetchtest.h"
+#include "mixer.h"
 
 /*******************
  * Declare
@@ -28,22 +51,225 @@ struct Subcommand
     int (*func)(int argc, char *argv[]);
 };
 
+/* max frames generated by the oscillator in one go, callback buffers are processed in blocks of this size */
+#define BLOCK_FRAMES 256
+
+/* default table size of the wavetable oscillator */
+#define DEFAULT_TABLE_SIZE 4096
+
+/* default capture ring length, in seconds */
+#define DEFAULT_RING_SECONDS 2.0
+
+/* default file to record into */
+#define DEFAULT_RECORD_FILE "pacap.wav"
+
+/* default interval of telemetry summaries, in seconds */
+#define DEFAULT_REPORT_INTERVAL 1.0
+
+/* how far the file read-ahead keeps in front of playback, in seconds */
+#define FILE_READ_AHEAD 0.5
+
+/* default length of a chunk of a streamed file (--prefetch) */
+#define DEFAULT_CHUNK_FRAMES 4096
+
+/* most frames one Pa_WriteStream()/Pa_ReadStream() of --io=blocking transfers, unless --frames is larger */
+#define BLOCKING_BATCH_FRAMES 4096
+
+/* default length of offline rendering, 10 seconds at 48kHz */
+#define DEFAULT_RENDER_FRAMES 480000
+
+/* loopback probe defaults: period of 2^15 frames (0.68 s at 48kHz), -12 dBFS */
+#define DEFAULT_LOOP_ORDER 15
+#define DEFAULT_LOOP_LEVEL -12.0
+#define DEFAULT_LOOP_MIN_SNR 15.0
+
+/* stimulus defaults: 20Hz-20kHz in 10 seconds, 31 steps (one per 1/3 octave), -12 dBFS */
+#define DEFAULT_STIMULUS_START 20.0
+#define DEFAULT_STIMULUS_STOP 20000.0
+#define DEFAULT_STIMULUS_PERIOD 10.0
+#define DEFAULT_STIMULUS_STEPS 31
+#define DEFAULT_STIMULUS_LEVEL -12.0
+
+/* default length of the gain and frequency ramps of --control changes, in milliseconds */
+#define DEFAULT_CONTROL_RAMP_MS 10.0
+
+/* default FFT length of "measure", 5.9 Hz resolution at 48kHz */
+#define DEFAULT_MEASURE_SEGMENT 8192
+
+/* defaults of "shmtest", 64 Mi frames go through a ring of 8192 */
+#define DEFAULT_SHMTEST_FRAMES (64ULL << 20)
+#define DEFAULT_SHMTEST_CAPACITY 8192
+#define DEFAULT_SHMTEST_CHUNK 1024
+
+/* defaults of "convtest" */
+#define DEFAULT_CONVTEST_CHANNEL 40
+#define DEFAULT_CONVTEST_FRAMES 1023
+
+/* defaults of "prefetchtest", each 4096 frame chunk plays for 85 ms and is read in 40 */
+#define DEFAULT_PREFETCHTEST_SECONDS 2
+#define DEFAULT_PREFETCHTEST_DEPTH 4
+#define DEFAULT_PREFETCHTEST_DELAY_MS 40
+
+/* defaults of "renderbench" */
+#define DEFAULT_RENDERBENCH_FORMATS "f32,i32,i24,i16,i8,u8"
+#define DEFAULT_RENDERBENCH_CHANNELS "2,8,32"
+
+/* defaults of "osctest" */
+#define DEFAULT_OSCTEST_MAX_THDN -135
+
+/* defaults of "mixbench" */
+#define DEFAULT_MIXBENCH_SOURCES "1,2,4,8,16"
+#define DEFAULT_MIXBENCH_CHANNELS "8,32"
+
+/* options without a letter, the letters are used up */
+enum Long_option
+{
+    OPT_MIX = 256,
+    OPT_MIX_GAIN,
+    OPT_ROUTE,
+    OPT_KNEE,
+};
+
+/* stream parameter not given on command line, filled from profile or device defaults */
+#define OPT_UNSET -1
+
 struct Stream_format
 {
     const char *name;
     PaSampleFormat macro;
+    Render_func render; // scalar kernel, NULL if this format can't be generated yet
+};
+
+enum Osc_type
+{
+    OSC_LIBM,       // sin() per frame
+    OSC_TABLE,      // linear interpolated wavetable lookup
+    OSC_RECURSIVE   // rotating phasor, re-synced to exact phase every block
+};
+
+struct Oscillator
+{
+    enum Osc_type type;
+    double step;    // phase increment per frame, in radian
+    double phase;   // current phase, in radian, kept in [0, 2*pi)
+
+    /* OSC_TABLE only */
+    float *table;       // `table_size + 1` entries, last one is a guard point equals to the first one
+    unsigned table_size;
+    double table_pos;   // current position in table, kept in [0, table_size)
+    double table_step;  // position increment per frame
+
+    /* frequency glide of --control, `step` moves by `glide_delta` every frame until it is `glide_step` */
+    unsigned long glide_frames;
+    double glide_delta;
+    double glide_step;
 };
 
 struct User_data
 {
-    double step; // calculated step based on current rate and frequency required
+    struct Oscillator osc;
+    float block[BLOCK_FRAMES]; // scratch buffer the oscillator generates into
     PaSampleFormat format;
+    Render_func render; // picked once according to `format` before stream is opened
+    size_t sample_size;
+    size_t bytes_per_frame; // of interleaved frames
+    double rate;
+    struct Capture *capture; // where captured frames go, only for input stream
+    struct Telemetry *telemetry;
+    struct Bench *bench; // only for "bench" subcommand
+    const _Atomic uint64_t *start_gate; // synchronized start: silent until CLOCK_MONOTONIC passes it, may be NULL
+    uint64_t first_active_ns; // when the callback got past the start gate
+    struct File_source *file; // file to play instead of the sine wave, may be NULL
+    int is_file_direct;     // file is in stream format and layout, copied as is
+    float *file_block;      // BLOCK_FRAMES frames of the file in float
+    float *file_remap;      // BLOCK_FRAMES frames of the file in float, remapped to stream channels
+    struct Gen gen;         // per channel generators, used instead of the oscillator if `gen_block` is set
+    float *gen_block;       // BLOCK_FRAMES frames of every channel, NULL without --gen
+    struct Stimulus stimulus; // played instead of the oscillator if `is_stimulus` is set
+    int is_stimulus;
+    struct Mixer mixer;     // several sources played instead of the oscillator if `is_mix` is set
+    int is_mix;
+    struct Measure *measure; // measure only
+    struct Control *control; // parameters changed while playing the oscillator, may be NULL
+    float gain;             // linear, only applied with `control`
+    float gain_target;
+    float gain_delta;       // per frame, for `gain_frames` more frames
+    unsigned long gain_frames;
+    struct Latency *latency; // loopback only
+    int loop_channel;       // loopback/measure only, input channel the loop comes back on
+    struct Resampler *resampler; // converts between `rate` and the stream's rate, NULL if they are the same
+    PaSampleFormat device_format; // with `resampler` the source is rendered as interleaved float, this is the stream's
+    Render_func device_render;
+    size_t device_sample_size;
+    float *src_in;          // frames at `rate` of one resampler call, interleaved
+    float *src_out;         // BLOCK_FRAMES frames at the stream's rate, laid out as the stream's buffer
+    void *src_pcm;          // record only, BLOCK_FRAMES resampled frames in `format`
+    uint64_t src_ns;        // time spent resampling
+    uint64_t src_frames;    // frames resampled at the stream's rate
+    const struct Rt_config *rt; // raise and pin the audio thread in its first callback, NULL to leave it alone
+    struct Rt_thread rt_thread;
+    int input_channel;
+    int output_channel;
+};
+
+/* everything play/record/bench can be told from command line */
+struct Play_options
+{
+    PaDeviceIndex device_idx;
     int input_channel;
     int output_channel;
+    PaTime input_latency;
+    PaTime output_latency;
+    const char *format;
+    int is_noninterleaved;
+    double rate;
+    int is_dry;
+    int freq;
+    unsigned duration;              // in seconds, 0 means until interrupted
+    enum Osc_type osc_type;
+    unsigned table_size;
+    enum Simd_level simd_level;
+    const char *output_file;        // record only
+    double ring_seconds;            // record only
+    double report_interval;
+    enum Bench_output bench_output; // bench only
+    const char *bench_file;         // bench only, NULL means stdout
+    unsigned long frames_per_buffer;// paFramesPerBufferUnspecified lets PA choose
+    int is_quiet;                   // don't print the per run summary
+    const char *tune_latencies;     // tune only, comma separated list
+    const char *tune_frames;        // tune only, comma separated list
+    int tune_load;                  // tune only, count of busy threads
+    const char *profile_out;        // tune only
+    const struct Probe_cache *probe_cache; // NULL if there is no capability cache
+    const char *file;               // play only, WAV file to play instead of the sine wave, or shared memory ring name
+    int is_shm;                     // file is the name of a shared memory ring, see shmring.h
+    unsigned file_prefetch;         // chunks of a streamed file, 0 to memory map it
+    unsigned long file_chunk_frames;
+    unsigned file_io_delay_ms;      // delay of each chunk read, to test slow storage
+    int is_blocking;                // use Pa_WriteStream()/Pa_ReadStream() instead of a callback
+    const char *gen;                // per channel generator spec, NULL plays the oscillator on every channel
+    struct Stimulus_config stimulus;// played instead of the oscillator unless STIMULUS_NONE
+    const char *control;            // play only, "-" for commands on stdin, otherwise a UNIX socket path
+    double ramp_ms;                 // initial ramp of --control changes
+    double device_rate;             // rate the stream runs at, OPT_UNSET: --rate, or the device's default if it can't
+    enum Src_quality src_quality;   // of the resampler between --rate and the stream's rate, SRC_OFF never resamples
+    struct Rt_config rt;            // --rt-prio, --cpu and --mlock
+    struct Mix_config mix;          // play only, sources mixed instead of the oscillator if there are any
 };
 
 static int play(int argc, char *argv[]);
 static int record(int argc, char *argv[]);
+static int bench(int argc, char *argv[]);
+static int tune(int argc, char *argv[]);
+static int render(int argc, char *argv[]);
+static int loopback(int argc, char *argv[]);
+static int measure(int argc, char *argv[]);
+static int shmtest(int argc, char *argv[]);
+static int mixbench(int argc, char *argv[]);
+static int renderbench(int argc, char *argv[]);
+static int osctest(int argc, char *argv[]);
+static int convtest(int argc, char *argv[]);
+static int prefetchtest(int argc, char *argv[]);
 static int traverse(int argc, char *argv[]);
 
 /*******************
@@ -56,29 +282,94 @@ static char *program_name = 0;
 /* used to flag if current stream is opened as input or output */
 static int is_output_stream = 1;
 
+/* used to flag if current stream is run as benchmark */
+static int is_bench = 0;
+
+/* used to flag if the stream is tuned instead of played */
+static int is_tune = 0;
+
+/* used to flag if startup phases are timed (--timing) */
+static int is_timing = 0;
+
+/* set by SIGINT, to stop playing/recording gracefully */
+static volatile sig_atomic_t is_interrupted = 0;
+
 static const struct Subcommand subcommands[] = {
     {"play", play},
     {"record", record},
+    {"bench", bench},
+    {"tune", tune},
+    {"render", render},
+    {"loopback", loopback},
+    {"measure", measure},
+    {"shmtest", shmtest},
+    {"mixbench", mixbench},
+    {"renderbench", renderbench},
+    {"osctest", osctest},
+    {"convtest", convtest},
+    {"prefetchtest", prefetchtest},
     {"traverse", traverse}
 };
 
 static const struct Stream_format pa_format[] = {
-    {"f32", paFloat32},
-    {"i32", paInt32},
-    {"i24", paInt24},
-    {"i16", paInt16},
-    {"i8", paInt8},
-    {"u8", paUInt8}
+    {"f32", paFloat32, render_f32},
+    {"i32", paInt32, render_i32},
+    {"i24", paInt24, render_i24},
+    {"i16", paInt16, render_i16},
+    {"i8", paInt8, render_i8},
+    {"u8", paUInt8, render_u8}
 };
 
+/* end of each startup phase (--timing), 0 if the phase wasn't reached */
+struct Startup_timing
+{
+    uint64_t begin_ns;
+    uint64_t init_ns;
+    uint64_t enumerate_ns;
+    uint64_t check_ns;
+    uint64_t open_ns;
+    uint64_t start_ns;
+    _Atomic uint64_t first_callback_ns;  // set by the callback
+};
+
+static struct Startup_timing startup_timing;
+
 /*********************************
  * Utility
  *********************************/
 
-#define IS_OUTPUT_UNDERFLOW(flag) ((paOutputUnderflow&flag))
-#define IS_OUTPUT_OVERFLOW(flag) ((paOutputOverflow&flag))
-#define IS_INPUT_UNDERFLOW(flag) ((paInputUnderflow&flag))
-#define IS_INPUT_OVERFLOW(flag) ((paInputOverflow&flag))
+// record end of a startup phase, only the first stream counts
+static void timing_mark(uint64_t *mark)
+{
+    if (is_timing && *mark == 0)
+        *mark = telemetry_now_ns();
+}
+
+static void print_startup_timing(void)
+{
+    const struct { const char *name; uint64_t ns; } phases[] = {
+        {"init", startup_timing.init_ns},
+        {"enumerate", startup_timing.enumerate_ns},
+        {"format check", startup_timing.check_ns},
+        {"open", startup_timing.open_ns},
+        {"start", startup_timing.start_ns},
+        {"first callback", atomic_load(&startup_timing.first_callback_ns)},
+    };
+
+    printf("\nStartup timing (ms):\n");
+    uint64_t last = startup_timing.begin_ns;
+    unsigned i;
+    for (i = 0; i < sizeof(phases)/sizeof(phases[0]); ++i)
+    {
+        if (phases[i].ns == 0)
+            break;
+        // the first callback may come before Pa_StartStream() returns
+        uint64_t end = phases[i].ns > last ? phases[i].ns : last;
+        printf("* %-14s: %9.3f\n", phases[i].name, (end - last) / 1e6);
+        last = end;
+    }
+    printf("* %-14s: %9.3f\n", "total", (last - startup_timing.begin_ns) / 1e6);
+}
 
 void exit_error(PaError err, const char *msg)
 {
@@ -92,6 +383,12 @@ void exit_error(PaError err, const char *msg)
     exit(-1);
 }
 
+static void on_interrupt(int sig)
+{
+    (void)sig;
+    is_interrupted = 1;
+}
+
 // format name -> pa macro
 static PaSampleFormat format_name_to_macro(const char *name)
 {
@@ -125,163 +422,1031 @@ static const char *format_macro_to_name(PaSampleFormat macro)
     exit(-1);
 }
 
+// format pa macro -> render kernel at given SIMD level, falls back to scalar one (paNonInterleaved bit is ignored)
+static Render_func format_macro_to_render(PaSampleFormat macro, enum Simd_level level)
+{
+    macro &= ~paNonInterleaved;
+
+    Render_func simd = render_simd(macro, level);
+    if (simd != NULL)
+        return simd;
+
+    unsigned i;
+    for (i = 0; i < sizeof(pa_format)/sizeof(pa_format[0]); ++i)
+    {
+        if (macro == pa_format[i].macro)
+            return pa_format[i].render;
+    }
+    printf("Unknown format macro: %lu\n", macro);
+    exit(-1);
+}
+
 /*******************************************************
- * Callback functions
+ * Oscillators
+ *
+ * All oscillators generate mono float samples in [-1, 1] block by block.
+ *
+ * The float block costs 32 bit output precision: its 24 bit mantissa puts
+ * the rounding noise of a full scale sine near -154 dB, where sin() in
+ * double scaled straight to i32 reached -192 dB. That is still far below
+ * any converter's noise floor. "osctest" measures it for every oscillator.
  *******************************************************/
-static int cb_play(const void *input_buf, void *output_buf,
-                   unsigned long frames_per_buf,
-                   const PaStreamCallbackTimeInfo *time_info,
-                   PaStreamCallbackFlags statusFlags,
-                   void *user_data_)
+
+static const char *osc_names[] = {"libm", "table", "recursive"};
+
+static int osc_name_to_type(const char *name, enum Osc_type *type)
 {
-    static double phase = 0.0;
-    unsigned i, j;
+    unsigned i;
+    for (i = 0; i < sizeof(osc_names)/sizeof(osc_names[0]); ++i)
+    {
+        if (!strcmp(name, osc_names[i]))
+        {
+            *type = (enum Osc_type)i;
+            return 0;
+        }
+    }
+    return -1;
+}
 
-    // fetch info from user_data passed in
-    struct User_data *user_data = (struct User_data*)user_data_;
-    double step = user_data->step;
-    PaSampleFormat format = user_data->format;
-    int input_channel = user_data->input_channel;
-    int output_channel = user_data->output_channel;
+// allocate everything the oscillator needs, must not be called from callback
+static int osc_init(struct Oscillator *osc, enum Osc_type type, double freq, double rate, unsigned table_size)
+{
+    memset(osc, 0, sizeof(*osc));
+    // a step past half a period (or backwards) would walk out of the table
+    if (!(freq > 0 && freq < rate / 2))
+    {
+        printf("Frequency %g is not above 0 and below Nyquist (%g)\n", freq, rate / 2);
+        return -1;
+    }
+    osc->type = type;
+    osc->step = 2*M_PI*freq/rate;
 
-    /* stream is opened for playing */
-    if (is_output_stream)
+    if (type == OSC_TABLE)
     {
-        /* check stream status */
+        if (table_size < 4)
+        {
+            printf("Table size should be at least 4\n");
+            return -1;
+        }
 
-        if (IS_OUTPUT_UNDERFLOW(statusFlags))
+        osc->table = malloc(sizeof(float) * (table_size + 1));
+        if (osc->table == NULL)
         {
-            fprintf(stderr, "Output underflow!\n");
+            printf("Failed to allocate sine table\n");
+            return -1;
         }
-        if (IS_OUTPUT_OVERFLOW(statusFlags))
+
+        unsigned i;
+        for (i = 0; i < table_size; ++i)
+            osc->table[i] = sin(2*M_PI*i/table_size);
+        osc->table[table_size] = osc->table[0];
+
+        osc->table_size = table_size;
+        osc->table_step = table_size * freq / rate;
+    }
+    return 0;
+}
+
+static void osc_free(struct Oscillator *osc)
+{
+    free(osc->table);
+    osc->table = NULL;
+}
+
+static void osc_libm(struct Oscillator *osc, float *buf, unsigned long frames)
+{
+    double phase = osc->phase;
+    double step = osc->step;
+    unsigned long i;
+
+    for (i = 0; i < frames; ++i)
+    {
+        buf[i] = sin(phase);
+
+        phase += step; // one step forward
+        while (phase >= 2*M_PI)
+            phase -= 2*M_PI;
+    }
+    osc->phase = phase;
+}
+
+static void osc_table(struct Oscillator *osc, float *buf, unsigned long frames)
+{
+    const float *table = osc->table;
+    double size = osc->table_size;
+    double pos = osc->table_pos;
+    double step = osc->table_step;
+    unsigned long i;
+
+    for (i = 0; i < frames; ++i)
+    {
+        unsigned idx = (unsigned)pos;
+        float frac = pos - idx;
+
+        // the guard point makes `idx + 1` always valid
+        buf[i] = table[idx] + frac * (table[idx+1] - table[idx]);
+
+        pos += step;
+        while (pos >= size)
+            pos -= size;
+    }
+    osc->table_pos = pos;
+}
+
+/* The phasor (re, im) is rotated by `step` each frame with one complex multiplication.
+ * Rounding error makes both its amplitude and phase drift, so at the start of every block
+ * it is re-seeded from the exactly tracked phase, the drift never accumulates over blocks.
+ */
+static void osc_recursive(struct Oscillator *osc, float *buf, unsigned long frames)
+{
+    double re = cos(osc->phase);
+    double im = sin(osc->phase);
+    double rot_re = cos(osc->step);
+    double rot_im = sin(osc->step);
+    unsigned long i;
+
+    for (i = 0; i < frames; ++i)
+    {
+        buf[i] = im;
+
+        double t = re * rot_re - im * rot_im;
+        im = re * rot_im + im * rot_re;
+        re = t;
+    }
+
+    osc->phase = fmod(osc->phase + frames * osc->step, 2*M_PI);
+}
+
+/* move to `freq` in `frames` frames, keeping the phase. Called from the callback */
+static void osc_set_freq(struct Oscillator *osc, double freq, double rate, unsigned long frames)
+{
+    osc->glide_step = 2*M_PI*freq/rate;
+    osc->glide_frames = frames;
+    osc->glide_delta = frames ? (osc->glide_step - osc->step) / frames : 0;
+
+    // the wavetable keeps its own position, the glide runs on the phase
+    if (osc->type == OSC_TABLE)
+        osc->phase = 2*M_PI * osc->table_pos / osc->table_size;
+    if (frames == 0)
+        osc->step = osc->glide_step;
+    osc->table_step = osc->table_size * osc->step / (2*M_PI);
+}
+
+/* the step changes every frame, which the table and the rotating phasor can't follow,
+ * so a glide is always computed with sin() */
+static void osc_glide(struct Oscillator *osc, float *buf, unsigned long frames)
+{
+    double phase = osc->phase;
+    double step = osc->step;
+    double delta = osc->glide_delta;
+    unsigned long i;
+
+    for (i = 0; i < frames; ++i)
+    {
+        buf[i] = sin(phase);
+
+        phase += step;
+        while (phase >= 2*M_PI)
+            phase -= 2*M_PI;
+        step += delta;
+    }
+
+    osc->glide_frames -= frames;
+    osc->step = osc->glide_frames ? step : osc->glide_step;
+    osc->phase = phase;
+    osc->table_step = osc->table_size * osc->step / (2*M_PI);
+    osc->table_pos = osc->table_size * phase / (2*M_PI);
+    if (osc->table_pos >= osc->table_size)
+        osc->table_pos -= osc->table_size;
+}
+
+// generate `frames` (at most BLOCK_FRAMES) samples
+static void osc_generate(struct Oscillator *osc, float *buf, unsigned long frames)
+{
+    if (osc->glide_frames > 0)
+    {
+        unsigned long n = frames < osc->glide_frames ? frames : osc->glide_frames;
+        osc_glide(osc, buf, n);
+        buf += n;
+        frames -= n;
+        if (frames == 0)
+            return;
+    }
+
+    switch (osc->type)
+    {
+        case OSC_LIBM:
+            osc_libm(osc, buf, frames);
+            break;
+        case OSC_TABLE:
+            osc_table(osc, buf, frames);
+            break;
+        case OSC_RECURSIVE:
+            osc_recursive(osc, buf, frames);
+            break;
+    }
+}
+
+/*******************************************************
+ * File playback
+ *******************************************************/
+
+// render `frames` frames of silence at frame `offset` of the output buffer
+static void render_silence(struct User_data *user_data, void *output_buf, unsigned long offset, unsigned long frames)
+{
+    int is_planar = (user_data->format & paNonInterleaved) != 0;
+    int channel = user_data->output_channel;
+
+    memset(user_data->block, 0, sizeof(user_data->block));
+    while (frames > 0)
+    {
+        unsigned long n = frames > BLOCK_FRAMES ? BLOCK_FRAMES : frames;
+        int i;
+
+        if (is_planar)
+            for (i = 0; i < channel; ++i)
+                user_data->render(user_data->block, (char*)((void**)output_buf)[i] + offset * user_data->sample_size, n, 1);
+        else
+            user_data->render(user_data->block, (char*)output_buf + offset * user_data->bytes_per_frame, n, channel);
+
+        offset += n;
+        frames -= n;
+    }
+}
+
+/* fill the output buffer from the file, samples are copied straight from the mapping if the file
+ * has the stream's format and layout, otherwise they go through float. return 1 at end of file */
+static int play_file(struct User_data *user_data, void *output_buf, unsigned long frames, int is_held)
+{
+    struct File_source *file = user_data->file;
+    int is_planar = (user_data->format & paNonInterleaved) != 0;
+    int channel = user_data->output_channel;
+    int file_channel = file->info.channel;
+    unsigned long done = 0;
+
+    while (done < frames)
+    {
+        unsigned long n = frames - done;
+        if (n > BLOCK_FRAMES)
+            n = BLOCK_FRAMES;
+
+        const void *src = is_held ? NULL : file_source_peek(file, &n);
+        if (src == NULL)
         {
-            fprintf(stderr, "Output overflow!\n");
+            render_silence(user_data, output_buf, done, frames - done);
+            return !is_held && file_source_at_end(file, frames - done);
         }
 
-        /* write frames to the buffer */
-        for (i = 0; i < frames_per_buf; ++i)
+        if (user_data->is_file_direct)
+            memcpy((char*)output_buf + done * user_data->bytes_per_frame, src, n * user_data->bytes_per_frame);
+        else
         {
-            double val = sin(phase);
+            float *samples = user_data->file_block;
+            file_source_decode(file, src, samples, n);
 
-            /* each sample(channel) in frame holds same value */
-            for (j = 0; j < output_channel; ++j)
+            // output channel i plays file channel i % file_channel
+            if (file_channel != channel && !is_planar)
             {
-                /* handle different format */
-                if (format & paFloat32)
-                {
-                    /* `*(type*)p_void++ = value` is illeagle!
-                     *
-                     * Because the "priority" of `(type)` and `++` are the same, the combination direction is right-to-left,
-                     * hence the `++` is evaluated first. However, because `p_void` is a void pointer, in standard C, it is
-                     * illeagle to do arithmatic operation on void pointer. GCC extension support this, however, which results to
-                     * `p_void` incremented by 1 byte. We shouldn't rely on this!
-                     * Therefore, we divide this to 2 steps instead.
-                     */
-                    *(float*)output_buf = val;
-                    output_buf = (float*)output_buf + 1;
-                }
-                else if (format & paInt32)
-                {
-                    *(int32_t*)output_buf = INT32_MAX * val;
-                    output_buf = (int32_t*)output_buf + 1;
-                }
-                else if (format & paInt16)
-                {
-                    *(int16_t*)output_buf = INT16_MAX * val;
-                    output_buf = (int16_t*)output_buf + 1;
-                }
-                else if (format & paInt8)
-                {
-                    *(int8_t*)output_buf = INT8_MAX * val;
-                    output_buf = (int8_t*)output_buf + 1;
-                }
-                else if (format & paUInt8)
-                {
+                unsigned long f;
+                int i;
+                for (f = 0; f < n; ++f)
+                    for (i = 0; i < channel; ++i)
+                        user_data->file_remap[f * channel + i] = samples[f * file_channel + i % file_channel];
+                samples = user_data->file_remap;
+            }
 
-                    *(uint8_t*)output_buf = ((UINT8_MAX+1)>>1) + ((UINT8_MAX+1)>>1) * val;
-                    output_buf = (uint8_t*)output_buf + 1;
+            if (is_planar)
+            {
+                int i;
+                for (i = 0; i < channel; ++i)
+                {
+                    unsigned long f;
+                    for (f = 0; f < n; ++f)
+                        user_data->block[f] = samples[f * file_channel + i % file_channel];
+                    user_data->render(user_data->block, (char*)((void**)output_buf)[i] + done * user_data->sample_size, n, 1);
                 }
             }
-
-            phase += step; // one step forward
-
-            if (phase >= 2*M_PI)
-                phase -= 2*M_PI;
+            else
+                // converting interleaved samples is converting a longer mono buffer
+                user_data->render(samples, (char*)output_buf + done * user_data->bytes_per_frame, n * channel, 1);
         }
+
+        file_source_advance(file, n);
+        done += n;
     }
-    // TODO: capture
-    
-    // intentionally make output-only stream underrun
-    //usleep(3 * 1000);
-    
-    return paContinue;
+    return 0;
 }
- 
+
 /*******************************************************
- * Usage function for every subcommand and the program itself.
+ * Per channel generators
  *******************************************************/
 
-static void usage(const char *subcommand)
+/* fill the output buffer from the generator plan, every channel is generated on its own into
+ * `gen_block` and then converted, interleaved as one long mono buffer or plane by plane */
+static void play_gen(struct User_data *user_data, void *output_buf, unsigned long frames, int is_held)
 {
-    /* no subcommand is specified */
-    if (subcommand == NULL)
-    {
-        printf("Usage: %s [COMMAND] [OPTION]\n", program_name);
+    int is_planar = (user_data->format & paNonInterleaved) != 0;
+    int channel = user_data->output_channel;
+    unsigned long done = 0;
 
-        printf("\nSupported [COMMAND] includes:\n");
-        unsigned i;
-        unsigned n_of_subcommands = sizeof(subcommands)/sizeof(subcommands[0]);
-        for (i = 0; i < n_of_subcommands; ++i)
-            printf("* %s\n", subcommands[i].name);
+    if (is_held)
+    {
+        render_silence(user_data, output_buf, 0, frames);
+        return;
     }
-    else if (!strcmp(subcommand, "traverse"))
+
+    while (done < frames)
     {
-        printf("Usage: %s %s [OPTION]\n\n",program_name, subcommand);
-        printf("-h, --help                  help\n");
+        unsigned long n = frames - done;
+        if (n > BLOCK_FRAMES)
+            n = BLOCK_FRAMES;
+
+        gen_process(&user_data->gen, user_data->gen_block, n);
+
+        if (is_planar)
+        {
+            int i;
+            for (i = 0; i < channel; ++i)
+                user_data->render(user_data->gen_block + i * BLOCK_FRAMES,
+                                  (char*)((void**)output_buf)[i] + done * user_data->sample_size, n, 1);
+        }
+        else
+            user_data->render(user_data->gen_block, (char*)output_buf + done * user_data->bytes_per_frame, n * channel, 1);
+
+        done += n;
     }
+}
 
-    else if (!strcmp(subcommand, "play"))
+/*******************************************************
+ * Mixed sources
+ *******************************************************/
+
+/* fill the output buffer with the mix, which is only converted into the stream's format here,
+ * interleaved as one long mono buffer or plane by plane. return 1 once every source has ended */
+static int play_mix(struct User_data *user_data, void *output_buf, unsigned long frames, int is_held)
+{
+    struct Mixer *mixer = &user_data->mixer;
+    int is_planar = (user_data->format & paNonInterleaved) != 0;
+    int channel = user_data->output_channel;
+    int is_ended = 0;
+    unsigned long done = 0;
+
+    if (is_held)
     {
-        printf("Usage: %s %s [OPTION] [DEVICE INDEX]\n\n",program_name, subcommand);
-        printf("-h, --help                  help\n");
-        printf("-c, --channel=#             channel count\n");
-        printf("-f, --format=FORMAT         sample format\n");
-        printf("-l, --latency=#             latency\n");
-        printf("-n, --nointerleaved         store different channels' samples in different buffers\n");
-        printf("-r, --rate                  sample rate (e.g. 48000, 44100,...)\n");
-        printf("--dry                       not indeed play, just check if the specified stream is supported to play\n");
-        printf("--freq                      sine wave frequency to play\n");
-        printf("--duration                  duration to play(in seconds)");
-        printf("\n\nSupported format includes: f32, i32, i16, i8, u8\n");
+        render_silence(user_data, output_buf, 0, frames);
+        return 0;
     }
 
-    else if (!strcmp(subcommand, "record"))
+    while (done < frames)
     {
-        printf("Usage: %s %s [OPTION] [DEVICE INDEX]\n\n",program_name, subcommand);
-        printf("-h, --help                  help\n");
-        printf("-c, --channel=#             channel count\n");
-        printf("-f, --format=FORMAT         sample format\n");
-        printf("-l, --latency=#             latency\n");
-        printf("-n, --nointerleaved         store different channels' samples in different buffers\n");
-        printf("-r, --rate                  sample rate (e.g. 48000, 44100,...)\n");
-        printf("--dry                       not indeed record, just check if the specified stream is supported to record\n");
-        printf("--duration                  duration to record(in seconds)");
-        printf("\n\nSupported format includes: f32, i32, i16, i8, u8\n");
+        unsigned long n = frames - done;
+        if (n > MIX_BLOCK_FRAMES)
+            n = MIX_BLOCK_FRAMES;
+
+        if (mixer_process(mixer, n))
+            is_ended = 1;
+
+        if (is_planar)
+        {
+            int i;
+            for (i = 0; i < channel; ++i)
+                user_data->render(mixer->bus + i * MIX_BLOCK_FRAMES,
+                                  (char*)((void**)output_buf)[i] + done * user_data->sample_size, n, 1);
+        }
+        else
+            user_data->render(mixer->interleaved, (char*)output_buf + done * user_data->bytes_per_frame, n * channel, 1);
+
+        done += n;
     }
-    // no need to check "else" cases, this is guaranteed because it will only be called by corresponding function
+    return is_ended;
 }
 
-/************************
- * Harness function
- * *********************/
+/*******************************************************
+ * Control of a running stream
+ *******************************************************/
 
-static void do_traverse()
+/* take the latest parameters once per callback and start ramping towards them, then answer
+ * with when they were taken and when the first frame played with them reaches the DAC */
+static void control_apply(struct User_data *user_data, const PaStreamCallbackTimeInfo *time_info, double rate)
 {
-    int num_device;
-    PaError err;
+    struct Control_message message;
+    if (!control_mailbox_take(&user_data->control->params, &message))
+        return;
 
-    // Init
-    Pa_Initialize();
+    unsigned long ramp = (unsigned long)(message.ramp_ms * rate / 1000 + 0.5);
+    osc_set_freq(&user_data->osc, message.freq, rate, ramp);
+
+    user_data->gain_target = pow(10, message.gain_db / 20);
+    user_data->gain_frames = ramp;
+    if (ramp == 0)
+        user_data->gain = user_data->gain_target;
+    else
+        user_data->gain_delta = (user_data->gain_target - user_data->gain) / ramp;
+
+    message.applied_ns = telemetry_now_ns();
+    message.audible_ns = message.applied_ns;
+    if (time_info && time_info->outputBufferDacTime > time_info->currentTime)
+        message.audible_ns += (uint64_t)((time_info->outputBufferDacTime - time_info->currentTime) * 1e9);
+    control_mailbox_post(&user_data->control->answers, &message);
+}
+
+// apply the gain, ramping it frame by frame after a change
+static void control_gain(struct User_data *user_data, float *buf, unsigned long frames)
+{
+    float gain = user_data->gain;
+    unsigned long i = 0;
+
+    if (user_data->gain_frames > 0)
+    {
+        float delta = user_data->gain_delta;
+        unsigned long n = frames < user_data->gain_frames ? frames : user_data->gain_frames;
+        for (; i < n; ++i)
+        {
+            buf[i] *= gain;
+            gain += delta;
+        }
+        user_data->gain_frames -= n;
+        if (user_data->gain_frames == 0)
+            gain = user_data->gain_target;
+        user_data->gain = gain;
+    }
+
+    for (; i < frames; ++i)
+        buf[i] *= gain;
+}
+
+/*******************************************************
+ * Callback functions
+ *******************************************************/
+
+/* fill `output_buf` with `frames_per_buf` frames of what is played, in `user_data->format` */
+static int play_source(struct User_data *user_data, void *output_buf, unsigned long frames_per_buf, int is_held,
+                       const PaStreamCallbackTimeInfo *time_info)
+{
+    int ret = paContinue;
+
+    /* stream is opened to play several sources mixed */
+    if (user_data->is_mix)
+    {
+        if (play_mix(user_data, output_buf, frames_per_buf, is_held))
+            ret = paComplete;
+    }
+    /* stream is opened to play a file */
+    else if (user_data->file)
+    {
+        if (play_file(user_data, output_buf, frames_per_buf, is_held))
+            ret = paComplete;
+    }
+    /* stream is opened to play a different signal on each channel */
+    else if (user_data->gen_block)
+    {
+        play_gen(user_data, output_buf, frames_per_buf, is_held);
+    }
+    /* stream is opened for playing */
+    else
+    {
+        /* in non-interleaved mode `output_buf` is an array of per-channel buffers: only the first one
+         * is rendered, others are plain copies of it */
+        int is_planar = (user_data->format & paNonInterleaved) != 0;
+        void *plane0 = is_planar ? ((void**)output_buf)[0] : output_buf;
+        char *out = plane0;
+
+        if (user_data->control && !is_held)
+            control_apply(user_data, time_info, user_data->rate);
+
+        /* write frames to the buffer block by block, format specific kernel is chosen in advance */
+        unsigned long done = 0;
+        while (done < frames_per_buf)
+        {
+            unsigned long n = frames_per_buf - done;
+            if (n > BLOCK_FRAMES)
+                n = BLOCK_FRAMES;
+
+            if (is_held)
+                memset(user_data->block, 0, sizeof(float) * n);
+            else if (user_data->is_stimulus)
+                stimulus_generate(&user_data->stimulus, user_data->block, n);
+            else
+            {
+                osc_generate(&user_data->osc, user_data->block, n);
+                if (user_data->control)
+                    control_gain(user_data, user_data->block, n);
+            }
+            user_data->render(user_data->block, out, n, is_planar ? 1 : user_data->output_channel);
+
+            out += n * (is_planar ? user_data->sample_size : user_data->bytes_per_frame);
+            done += n;
+        }
+
+        if (is_planar)
+        {
+            int i;
+            for (i = 1; i < user_data->output_channel; ++i)
+                memcpy(((void**)output_buf)[i], plane0, frames_per_buf * user_data->sample_size);
+        }
+    }
+    return ret;
+}
+
+/* pull the source through the resampler block by block, the source renders interleaved float at its
+ * own rate and only the resampled frames are converted into the stream's format */
+static int play_resampled(struct User_data *user_data, void *output_buf, unsigned long frames_per_buf, int is_held,
+                          const PaStreamCallbackTimeInfo *time_info)
+{
+    struct Resampler *resampler = user_data->resampler;
+    int is_planar = (user_data->device_format & paNonInterleaved) != 0;
+    int channel = user_data->output_channel;
+    int ret = paContinue;
+    unsigned long done = 0;
+
+    while (done < frames_per_buf)
+    {
+        unsigned long n = frames_per_buf - done;
+        if (n > BLOCK_FRAMES)
+            n = BLOCK_FRAMES;
+
+        unsigned long in = resampler_input_frames(resampler, n);
+        if (in > 0 && play_source(user_data, user_data->src_in, in, is_held, time_info) == paComplete)
+            ret = paComplete;
+
+        uint64_t begin_ns = telemetry_now_ns();
+        resampler_process(resampler, user_data->src_in, in, user_data->src_out, n,
+                          is_planar ? 1 : channel, is_planar ? BLOCK_FRAMES : 1);
+        user_data->src_ns += telemetry_now_ns() - begin_ns;
+        user_data->src_frames += n;
+
+        if (is_planar)
+        {
+            int i;
+            for (i = 0; i < channel; ++i)
+                user_data->device_render(user_data->src_out + i * BLOCK_FRAMES,
+                                         (char*)((void**)output_buf)[i] + done * user_data->device_sample_size, n, 1);
+        }
+        else
+            user_data->device_render(user_data->src_out, (char*)output_buf + done * user_data->device_sample_size * channel,
+                                     n * channel, 1);
+        done += n;
+    }
+    return ret;
+}
+
+/* resample captured interleaved float frames into `format` at `rate` before they are handed over */
+static void capture_resampled(struct User_data *user_data, const float *input_buf, unsigned long frames_per_buf)
+{
+    struct Resampler *resampler = user_data->resampler;
+    int channel = user_data->input_channel;
+    unsigned long done = 0;
+
+    while (done < frames_per_buf)
+    {
+        unsigned long n = frames_per_buf - done;
+        if (n > resampler->max_push)
+            n = resampler->max_push;
+
+        uint64_t begin_ns = telemetry_now_ns();
+        unsigned long out = resampler_process(resampler, input_buf + done * channel, n, user_data->src_out,
+                                              BLOCK_FRAMES, channel, 1);
+        user_data->src_ns += telemetry_now_ns() - begin_ns;
+        user_data->src_frames += n;
+
+        user_data->render(user_data->src_out, user_data->src_pcm, out * channel, 1);
+        capture_push(user_data->capture, user_data->src_pcm, out);
+        done += n;
+    }
+}
+
+static int cb_play(const void *input_buf, void *output_buf,
+                   unsigned long frames_per_buf,
+                   const PaStreamCallbackTimeInfo *time_info,
+                   PaStreamCallbackFlags statusFlags,
+                   void *user_data_)
+{
+    uint64_t begin_ns = telemetry_now_ns();
+
+    if (is_timing && atomic_load_explicit(&startup_timing.first_callback_ns, memory_order_relaxed) == 0)
+        atomic_store_explicit(&startup_timing.first_callback_ns, begin_ns, memory_order_relaxed);
+
+    // fetch info from user_data passed in
+    struct User_data *user_data = (struct User_data*)user_data_;
+
+    if (user_data->rt && !user_data->rt_thread.is_done)
+        rt_audio_thread(user_data->rt, &user_data->rt_thread);
+    rtcheck_enter();
+
+    /* hold back until every stream of a synchronized start is running */
+    int is_held = user_data->start_gate &&
+                  begin_ns < atomic_load_explicit(user_data->start_gate, memory_order_acquire);
+    if (!is_held && user_data->first_active_ns == 0)
+        user_data->first_active_ns = begin_ns;
+
+    int ret = paContinue;
+
+    /* stream is opened for playing, at another rate than the source's */
+    if (is_output_stream && user_data->resampler)
+    {
+        ret = play_resampled(user_data, output_buf, frames_per_buf, is_held, time_info);
+    }
+    else if (is_output_stream)
+    {
+        ret = play_source(user_data, output_buf, frames_per_buf, is_held, time_info);
+    }
+    /* stream is opened for recording, only hand frames over to the writer thread */
+    else if (!is_held)
+    {
+        if (user_data->resampler)
+            capture_resampled(user_data, input_buf, frames_per_buf);
+        else
+            capture_push(user_data->capture, input_buf, frames_per_buf);
+    }
+
+    if (user_data->bench)
+        bench_record(user_data->bench, begin_ns, telemetry_now_ns(), frames_per_buf, time_info);
+
+    /* stream status (xruns) is only counted here, it is reported by the telemetry thread */
+    telemetry_record(user_data->telemetry, begin_ns, frames_per_buf, time_info, statusFlags, is_output_stream);
+
+    // intentionally make output-only stream underrun
+    //usleep(3 * 1000);
+
+    rtcheck_leave();
+    return ret;
+}
+ 
+/* loopback: play the probe on every output channel and hand one input channel to the analysis,
+ * both streams are interleaved float */
+static int cb_loopback(const void *input_buf, void *output_buf,
+                       unsigned long frames_per_buf,
+                       const PaStreamCallbackTimeInfo *time_info,
+                       PaStreamCallbackFlags statusFlags,
+                       void *user_data_)
+{
+    uint64_t begin_ns = telemetry_now_ns();
+    struct User_data *user_data = (struct User_data*)user_data_;
+
+    rtcheck_enter();
+    latency_play(user_data->latency, output_buf, frames_per_buf, user_data->output_channel);
+    latency_capture(user_data->latency, input_buf, frames_per_buf, user_data->input_channel, user_data->loop_channel);
+
+    telemetry_record(user_data->telemetry, begin_ns, frames_per_buf, time_info, statusFlags, 1);
+    rtcheck_leave();
+    return paContinue;
+}
+
+/* measure: play the stimulus on every output channel and pair it with one input channel for the
+ * analysis, both streams are interleaved float */
+static int cb_measure(const void *input_buf, void *output_buf,
+                      unsigned long frames_per_buf,
+                      const PaStreamCallbackTimeInfo *time_info,
+                      PaStreamCallbackFlags statusFlags,
+                      void *user_data_)
+{
+    uint64_t begin_ns = telemetry_now_ns();
+    struct User_data *user_data = (struct User_data*)user_data_;
+    const float *in = input_buf;
+    float *out = output_buf;
+
+    rtcheck_enter();
+    unsigned long done = 0;
+    while (done < frames_per_buf)
+    {
+        unsigned long n = frames_per_buf - done;
+        if (n > BLOCK_FRAMES)
+            n = BLOCK_FRAMES;
+
+        stimulus_generate(&user_data->stimulus, user_data->block, n);
+        user_data->render(user_data->block, out + done * user_data->output_channel, n, user_data->output_channel);
+        measure_capture(user_data->measure, user_data->block, in ? in + done * user_data->input_channel : NULL, n,
+                        user_data->input_channel, user_data->loop_channel);
+        done += n;
+    }
+
+    telemetry_record(user_data->telemetry, begin_ns, frames_per_buf, time_info, statusFlags, 1);
+    rtcheck_leave();
+    return paContinue;
+}
+
+/*******************************************************
+ * Usage function for every subcommand and the program itself.
+ *******************************************************/
+
+static void usage(const char *subcommand)
+{
+    /* no subcommand is specified */
+    if (subcommand == NULL)
+    {
+        printf("Usage: %s [COMMAND] [OPTION]\n", program_name);
+
+        printf("\nSupported [COMMAND] includes:\n");
+        unsigned i;
+        unsigned n_of_subcommands = sizeof(subcommands)/sizeof(subcommands[0]);
+        for (i = 0; i < n_of_subcommands; ++i)
+            printf("* %s\n", subcommands[i].name);
+    }
+    else if (!strcmp(subcommand, "traverse"))
+    {
+        printf("Usage: %s %s [OPTION]\n\n",program_name, subcommand);
+        printf("-h, --help                  help\n");
+        printf("--probe                     check which format/rate/channel/interleaving combinations each device supports\n");
+        printf("                            and cache them for \"play\"/\"record\"\n");
+        printf("--cache=FILE                capability cache file (default: $HOME/.cache/pacap.probe)\n");
+    }
+
+    else if (!strcmp(subcommand, "play"))
+    {
+        printf("Usage: %s %s [OPTION] [DEVICE SPEC]...\n\n",program_name, subcommand);
+        printf("DEVICE SPEC is a device index, optionally followed by stream parameters which override the options,\n");
+        printf("e.g. \"0:c=2,f=i16 3:c=8,f=f32\". Keys: c (channel), f (format), l (latency), r (rate), b (frames per buffer),\n");
+        printf("n (non-interleaved), o (output file). Every device spec opens its own stream.\n\n");
+        printf("-h, --help                  help\n");
+        printf("-c, --channel=#             channel count\n");
+        printf("-f, --format=FORMAT         sample format\n");
+        printf("-l, --latency=#             latency\n");
+        printf("-n, --nointerleaved         store different channels' samples in different buffers\n");
+        printf("-r, --rate                  sample rate (e.g. 48000, 44100,...)\n");
+        printf("--dry                       not indeed play, just check if the specified stream is supported to play\n");
+        printf("--freq                      sine wave frequency to play\n");
+        printf("--duration                  duration to play(in seconds)\n");
+        printf("--osc=OSC                   sine wave oscillator: libm (default), table, recursive\n");
+        printf("--table-size=#              table size of \"table\" oscillator (default: %d)\n", DEFAULT_TABLE_SIZE);
+        printf("--gen=SPEC                  a different signal per channel instead of the sine wave, comma separated\n");
+        printf("                            KIND[:FREQ[:GAIN_DB]] per channel, repeated if there are more channels. KIND is\n");
+        printf("                            sine, saw, square, noise or silence, FREQ defaults to --freq, e.g. \"sine:440:-6,saw::-12\"\n");
+        printf("--stimulus=TYPE             play a frequency response stimulus instead of the sine wave: sweep (exponential,\n");
+        printf("                            repeated every --period), stepped (--steps log spaced tones) or pink (noise)\n");
+        printf("--start=#, --stop=#         frequency range of the stimulus (in Hz, default: %.0f-%.0f)\n", DEFAULT_STIMULUS_START, DEFAULT_STIMULUS_STOP);
+        printf("--period=#                  seconds of one sweep or of all steps (default: %.0f)\n", DEFAULT_STIMULUS_PERIOD);
+        printf("--steps=#                   tones of the stepped stimulus (default: %d)\n", DEFAULT_STIMULUS_STEPS);
+        printf("--level=#                   stimulus level in dBFS, peak for tones, 12 dB over RMS for noise (default: %.0f)\n", DEFAULT_STIMULUS_LEVEL);
+        printf("--simd=LEVEL                sample conversion kernels: scalar, sse2, avx2, neon (default: best supported)\n");
+        printf("--report=#                  interval of xrun/callback time summaries (in seconds, 0: only at the end, default: %.1f)\n", DEFAULT_REPORT_INTERVAL);
+        printf("--frames=#                  frames per buffer (default: 0, let PortAudio choose)\n");
+        printf("--profile=FILE              load format/channel/rate/latency/frames from a profile written by \"tune\"\n");
+        printf("--cache=FILE                capability cache written by \"traverse --probe\" (default: $HOME/.cache/pacap.probe)\n");
+        printf("--no-cache                  always ask the device whether the stream is supported\n");
+        printf("--timing                    print time spent in each startup phase: init, enumerate, format check, open, start, first callback\n");
+        printf("--io=MODEL                  callback (default), or blocking: a thread transfers batches with Pa_WriteStream/Pa_ReadStream\n");
+        printf("--sync-start                with several devices, keep streams silent until all of them run, then begin together\n");
+        printf("--file=FILE                 play a WAV file instead of the sine wave, until its end unless --duration is given.\n");
+        printf("                            Format, channel and rate default to the file's, the file is converted if they differ\n");
+        printf("                            (except the rate)\n");
+        printf("--source=SPEC               shm:NAME plays what a producer writes into shared memory ring NAME (see shmring.h)\n");
+        printf("                            until it finishes, format, channel and rate default to the ring's. file:PATH is\n");
+        printf("                            --file=PATH\n");
+        printf("--prefetch=#                read the file in a pool of # chunks filled ahead of playback instead of memory\n");
+        printf("                            mapping it, for files larger than memory or slow storage (default: 0, map it)\n");
+        printf("--chunk=#                   frames per prefetch chunk (default: %d)\n", DEFAULT_CHUNK_FRAMES);
+        printf("--io-delay=#                delay each chunk read by # ms, to try out slow storage\n");
+        printf("--mix=SOURCE                play a mix of up to %d sources instead, given once each: tone[:FREQ] (a sine,\n", MIX_MAX_SOURCES);
+        printf("                            default --freq), gen:SPEC (one channel per generator, see --gen), file:PATH or\n");
+        printf("                            shm:NAME. Files and rings must be at the mix rate and end the mix when all did\n");
+        printf("--mix-gain=#                gain of the --mix before it in dB (default: 0)\n");
+        printf("--route=IN:OUT[:DB],...     route channels of the --mix before it onto output channels, with a gain in dB\n");
+        printf("                            (default: output channel o plays source channel o modulo its channel count)\n");
+        printf("--knee=#                    the mix is soft clipped above # dBFS, smoothly reaching full scale (default: %.0f)\n", MIX_DEFAULT_KNEE_DB);
+        printf("--control=SRC               change the sine wave while it plays, with commands \"freq HZ\", \"gain DB\" and\n");
+        printf("                            \"ramp MS\" one per line, read from stdin if SRC is \"-\", otherwise from clients of a UNIX\n");
+        printf("                            socket created at SRC. The time from each command to its effect is reported\n");
+        printf("--ramp=#                    changes ramp over # ms, the phase is kept (default: %.0f)\n", DEFAULT_CONTROL_RAMP_MS);
+        printf("--device-rate=#             rate the device runs at, the signal or file is resampled from --rate (default: --rate,\n");
+        printf("                            or the device's default rate if it can't run --rate). With --file, a --rate other\n");
+        printf("                            than the file's is taken as the device rate\n");
+        printf("--src=QUALITY               resampler: low (32 taps, 70 dB stopband), medium (64 taps, 100 dB, default),\n");
+        printf("                            high (128 taps, 120 dB), or off to never resample\n");
+        printf("--rt-prio=#                 run the audio thread as SCHED_FIFO with priority # (1-99)\n");
+        printf("--cpu=AUDIO[,WORKERS]       pin the audio thread to CPU AUDIO and every other thread to WORKERS, a comma\n");
+        printf("                            separated list of CPUs and ranges, e.g. \"3,0-2\" (default: every other CPU)\n");
+        printf("--mlock                     lock and fault in every buffer and stack before the stream starts\n");
+        printf("                            With any of these, page faults and callback jitter are reported");
+        printf("\n\nSupported format includes: f32, i32, i24, i16, i8, u8\n");
+    }
+
+    else if (!strcmp(subcommand, "record"))
+    {
+        printf("Usage: %s %s [OPTION] [DEVICE SPEC]...\n\n",program_name, subcommand);
+        printf("DEVICE SPEC is a device index, optionally followed by stream parameters which override the options,\n");
+        printf("e.g. \"0:c=2,f=i16 3:c=8,f=f32\". Keys: c (channel), f (format), l (latency), r (rate), b (frames per buffer),\n");
+        printf("n (non-interleaved), o (output file). Every device spec opens its own stream.\n\n");
+        printf("-h, --help                  help\n");
+        printf("-c, --channel=#             channel count\n");
+        printf("-f, --format=FORMAT         sample format\n");
+        printf("-l, --latency=#             latency\n");
+        printf("-n, --nointerleaved         store different channels' samples in different buffers\n");
+        printf("-r, --rate                  sample rate (e.g. 48000, 44100,...)\n");
+        printf("-o, --output=FILE           file to record into, \".wav\" suffix means WAV, otherwise raw (default: %s)\n", DEFAULT_RECORD_FILE);
+        printf("--dry                       not indeed record, just check if the specified stream is supported to record\n");
+        printf("--duration                  duration to record(in seconds), 0 means until interrupted\n");
+        printf("--ring=#                    length of the capture ring buffer (in seconds, default: %.1f)\n", DEFAULT_RING_SECONDS);
+        printf("--report=#                  interval of xrun/callback time summaries (in seconds, 0: only at the end, default: %.1f)\n", DEFAULT_REPORT_INTERVAL);
+        printf("--timing                    print time spent in each startup phase: init, enumerate, format check, open, start, first callback\n");
+        printf("--io=MODEL                  callback (default), or blocking: a thread transfers batches with Pa_WriteStream/Pa_ReadStream\n");
+        printf("--sync-start                with several devices, keep streams silent until all of them run, then begin together\n");
+        printf("--device-rate=#             rate the device runs at, what it captures is resampled to --rate (default: --rate,\n");
+        printf("                            or the device's default rate if it can't run --rate)\n");
+        printf("--src=QUALITY               resampler: low (32 taps, 70 dB stopband), medium (64 taps, 100 dB, default),\n");
+        printf("                            high (128 taps, 120 dB), or off to never resample\n");
+        printf("--rt-prio=#                 run the audio thread as SCHED_FIFO with priority # (1-99)\n");
+        printf("--cpu=AUDIO[,WORKERS]       pin the audio thread to CPU AUDIO and every other thread to WORKERS, a comma\n");
+        printf("                            separated list of CPUs and ranges, e.g. \"3,0-2\" (default: every other CPU)\n");
+        printf("--mlock                     lock and fault in every buffer and stack before the stream starts\n");
+        printf("                            With any of these, page faults and callback jitter are reported");
+        printf("\n\nSupported format includes: f32, i32, i24, i16, i8, u8 (i8 only for raw file)\n");
+    }
+    else if (!strcmp(subcommand, "bench"))
+    {
+        printf("Usage: %s %s [OPTION] [DEVICE INDEX]\n\n",program_name, subcommand);
+        printf("Open the stream as \"play\" does (takes the same options) and measure callback timing:\n");
+        printf("callback period jitter, processing time, buffer time lead and deadline misses.\n\n");
+        printf("-h, --help                  help\n");
+        printf("--record                    bench an input stream instead of an output stream\n");
+        printf("--bench-format=FORMAT       result format: text (default), json, csv\n");
+        printf("--bench-out=FILE            write result into FILE instead of stdout\n");
+    }
+    else if (!strcmp(subcommand, "tune"))
+    {
+        printf("Usage: %s %s [OPTION] [DEVICE INDEX]\n\n",program_name, subcommand);
+        printf("Search the lowest latency/frames per buffer which plays (takes the same options as \"play\") without xruns.\n");
+        printf("Each configuration runs for --duration seconds (default: 2).\n\n");
+        printf("-h, --help                  help\n");
+        printf("--record                    tune an input stream instead of an output stream\n");
+        printf("--latencies=LIST            comma separated suggested latencies to try (in seconds)\n");
+        printf("--frames-list=LIST          comma separated frames per buffer to try (0: let PortAudio choose)\n");
+        printf("--load=#                    count of busy threads to run in background while tuning\n");
+        printf("--profile-out=FILE          write the best configuration into FILE, load it with \"play --profile=FILE\"\n");
+    }
+    else if (!strcmp(subcommand, "render"))
+    {
+        printf("Usage: %s %s [OPTION]\n\n",program_name, subcommand);
+        printf("Drive the playback callback without a device, as fast as possible, and report its throughput\n");
+        printf("for every format and channel count given.\n\n");
+        printf("-h, --help                  help\n");
+        printf("-c, --channel=LIST          comma separated channel counts (default: 2)\n");
+        printf("-f, --format=LIST           comma separated sample formats (default: f32)\n");
+        printf("-n, --nointerleaved         render into per channel buffers\n");
+        printf("-r, --rate                  sample rate (default: 48000)\n");
+        printf("--frames=#                  frames to render for each format/channel count (default: %d)\n", DEFAULT_RENDER_FRAMES);
+        printf("--buffer=#                  frames per callback (default: %d)\n", BLOCK_FRAMES);
+        printf("--out=FILE                  write the samples into FILE, \".wav\" suffix means WAV, otherwise raw, \"-\" means WAV to stdout\n");
+        printf("--min-speed=#               fail if any combination renders slower than # times realtime\n");
+        printf("--device-rate=#             resample from --rate to # before the conversion, and report its cost per channel\n");
+        printf("--src=QUALITY               resampler quality: low, medium (default), high\n");
+        printf("--freq, --osc, --table-size, --gen, --simd, --stimulus, --start, --stop, --period, --steps, --level, --mix,\n");
+        printf("--mix-gain, --route, --knee as for \"play\"\n");
+    }
+
+    else if (!strcmp(subcommand, "loopback"))
+    {
+        printf("Usage: %s %s [OPTION] INPUT_DEVICE [OUTPUT_DEVICE]\n\n",program_name, subcommand);
+        printf("Measure the round-trip latency of a loop from the output device back into the input device (the same\n");
+        printf("device if only one is given) with one full-duplex stream. A probe signal repeating every period is played\n");
+        printf("and cross-correlated with the captured input, once per period, until --duration or interrupted.\n\n");
+        printf("-h, --help                  help\n");
+        printf("-c, --channel=#             channel count of both directions (default: 2), the probe is played on all of them\n");
+        printf("-i, --input-channel=#       input channel the loop comes back on, from 0 (default: 0)\n");
+        printf("-l, --latency=#             suggested latency of both directions (default: the devices' low latency)\n");
+        printf("-r, --rate                  sample rate (default: the output device's)\n");
+        printf("--frames=#                  frames per buffer (default: 0, let PortAudio choose)\n");
+        printf("--signal=SIGNAL             probe: mls (default), impulse\n");
+        printf("--order=#                   period of the probe is 2^# frames, it must be longer than the latency (%d-%d, default: %d)\n",
+               LATENCY_MIN_ORDER, LATENCY_MAX_ORDER, DEFAULT_LOOP_ORDER);
+        printf("--level=#                   probe level in dBFS (default: %.0f)\n", DEFAULT_LOOP_LEVEL);
+        printf("--min-snr=#                 ignore periods whose correlation peak is less than # dB over the rest (default: %.0f)\n", DEFAULT_LOOP_MIN_SNR);
+        printf("--duration=#                seconds to measure, 0 means until interrupted, e.g. for soak tests (default: 10)\n");
+        printf("--report=#                  interval of latency/drift reports (in seconds, default: %.1f)\n", DEFAULT_REPORT_INTERVAL);
+    }
+
+    else if (!strcmp(subcommand, "measure"))
+    {
+        printf("Usage: %s %s [OPTION] INPUT_DEVICE [OUTPUT_DEVICE]\n\n",program_name, subcommand);
+        printf("Measure the frequency response of a loop from the output device back into the input device (the same\n");
+        printf("device if only one is given) with one full-duplex stream. The stimulus is played on every output channel\n");
+        printf("and compared with what comes back, with a streaming FFT, until --duration or interrupted. Pass the\n");
+        printf("round-trip latency \"loopback\" reports as --delay, or the phase is off and the coherence drops.\n\n");
+        printf("-h, --help                  help\n");
+        printf("-c, --channel=#             channel count of both directions (default: 2)\n");
+        printf("-i, --input-channel=#       input channel the loop comes back on, from 0 (default: 0)\n");
+        printf("-l, --latency=#             suggested latency of both directions (default: the devices' low latency)\n");
+        printf("-r, --rate                  sample rate (default: the output device's)\n");
+        printf("--frames=#                  frames per buffer (default: 0, let PortAudio choose)\n");
+        printf("--stimulus=TYPE             sweep (exponential, repeated every --period, default), stepped (--steps log\n");
+        printf("                            spaced tones) or pink (noise)\n");
+        printf("--start=#, --stop=#         frequency range of the stimulus (in Hz, default: %.0f-%.0f)\n", DEFAULT_STIMULUS_START, DEFAULT_STIMULUS_STOP);
+        printf("--period=#                  seconds of one sweep or of all steps (default: %.0f)\n", DEFAULT_STIMULUS_PERIOD);
+        printf("--steps=#                   tones of the stepped stimulus (default: %d)\n", DEFAULT_STIMULUS_STEPS);
+        printf("--level=#                   stimulus level in dBFS, peak for tones, 12 dB over RMS for noise (default: %.0f)\n", DEFAULT_STIMULUS_LEVEL);
+        printf("--delay=#                   round-trip latency of the loop in frames (default: 0)\n");
+        printf("--segment=#                 FFT length, a power of 2, longer resolves lower frequencies (default: %d)\n", DEFAULT_MEASURE_SEGMENT);
+        printf("--duration=#                seconds to measure, 0 means until interrupted (default: one period and a second, 10 for pink)\n");
+        printf("--report=#                  interval of progress reports (in seconds, 0: only at the end, default: %.1f)\n", DEFAULT_REPORT_INTERVAL);
+        printf("--out=FILE                  write the response of every FFT bin as CSV: frequency, gain, phase, coherence\n");
+    }
+
+    else if (!strcmp(subcommand, "mixbench"))
+    {
+        printf("Usage: %s %s [OPTION]\n\n",program_name, subcommand);
+        printf("Mix stereo generators (sine left, saw right) into every output channel, without a device, as fast as\n");
+        printf("possible, and report the cost per frame for every source and channel count given: all of it, and the\n");
+        printf("mixer's share (routing, soft clipping, interleaving) without generating the sources. First the soft\n");
+        printf("clipper of the baseline and --simd kernels is swept past full scale, and fails if an output exceeds\n");
+        printf("its input or full scale.\n\n");
+        printf("-h, --help                  help\n");
+        printf("-c, --channel=LIST          comma separated output channel counts (default: %s)\n", DEFAULT_MIXBENCH_CHANNELS);
+        printf("-f, --format=FORMAT         sample format the mix is converted into (default: f32)\n");
+        printf("-r, --rate                  sample rate (default: 48000)\n");
+        printf("--sources=LIST              comma separated source counts, at most %d (default: %s)\n", MIX_MAX_SOURCES, DEFAULT_MIXBENCH_SOURCES);
+        printf("--frames=#                  frames to mix for each source/channel count (default: %d)\n", DEFAULT_RENDER_FRAMES);
+        printf("--simd=LEVEL                as for \"play\", avx2 mixes with AVX2 and FMA\n");
+        printf("--knee=#                    soft clipper knee in dBFS (default: %.0f)\n", MIX_DEFAULT_KNEE_DB);
+    }
+
+    else if (!strcmp(subcommand, "renderbench"))
+    {
+        printf("Usage: %s %s [OPTION]\n\n",program_name, subcommand);
+        printf("Render a sine in every format and channel count given, without a device, and report the ns per frame\n");
+        printf("of the callback: per sample (sin() and a branch on the format for every sample, as before block\n");
+        printf("rendering, not for i24), with the scalar block kernels, and with the --simd ones, into interleaved\n");
+        printf("frames and into one plane per channel (--noninterleaved).\n\n");
+        printf("-h, --help                  help\n");
+        printf("-c, --channel=LIST          comma separated channel counts (default: %s)\n", DEFAULT_RENDERBENCH_CHANNELS);
+        printf("-f, --format=LIST           comma separated sample formats (default: %s)\n", DEFAULT_RENDERBENCH_FORMATS);
+        printf("-r, --rate                  sample rate (default: 48000)\n");
+        printf("--freq=#                    sine wave frequency (default: 1000)\n");
+        printf("--osc=TYPE                  oscillator of the block kernels, as for \"play\" (default: libm)\n");
+        printf("--simd=LEVEL                as for \"play\" (default: the best the CPU supports)\n");
+        printf("--frames=#                  frames to render per combination (default: %d)\n", DEFAULT_RENDER_FRAMES);
+        printf("--buffer=#                  frames per callback (default: %d)\n", BLOCK_FRAMES);
+    }
+
+    else if (!strcmp(subcommand, "osctest"))
+    {
+        printf("Usage: %s %s [OPTION]\n\n",program_name, subcommand);
+        printf("Play a 997 Hz sine at 48 kHz for a second into i32 with every oscillator, through the float block and the\n");
+        printf("scalar kernel like the callback, and report its THD (harmonics 2 to 10) and THD+N next to sin() in\n");
+        printf("double scaled sample by sample, the path before block rendering. Fails if any oscillator's THD+N is\n");
+        printf("above the limit.\n\n");
+        printf("-h, --help                  help\n");
+        printf("--table-size=#              wavetable size of the table oscillator (default: %d)\n", DEFAULT_TABLE_SIZE);
+        printf("--max-thdn=#                THD+N limit in dB (default: %d)\n", DEFAULT_OSCTEST_MAX_THDN);
+    }
+
+    else if (!strcmp(subcommand, "shmtest"))
+    {
+        printf("Usage: %s %s [OPTION]\n\n",program_name, subcommand);
+        printf("Run a producer process writing into a shared memory ring and a consumer reading it the way the callback\n");
+        printf("of --source=shm does, without a device, and check that every frame arrives intact and in order.\n\n");
+        printf("-h, --help                  help\n");
+        printf("-c, --channel=#             channel count of the i32 frames (default: 8)\n");
+        printf("-r, --rate                  pace the consumer like a device at # Hz (default: 0, as fast as possible)\n");
+        printf("--frames=#                  frames the producer writes (default: %llu)\n", DEFAULT_SHMTEST_FRAMES);
+        printf("--capacity=#                frames the ring holds, rounded up to a power of 2 (default: %d)\n", DEFAULT_SHMTEST_CAPACITY);
+        printf("--buffer=#                  frames the consumer takes per callback (default: %d)\n", BLOCK_FRAMES);
+        printf("--chunk=#                   frames the producer writes at a time (default: %d)\n", DEFAULT_SHMTEST_CHUNK);
+        printf("--name=NAME                 of the ring (default: pacap-shmtest-PID)\n");
+    }
+
+    else if (!strcmp(subcommand, "convtest"))
+    {
+        printf("Usage: %s %s [OPTION]\n\n",program_name, subcommand);
+        printf("Check that every SIMD render kernel this CPU runs writes bit-exact the bytes of the scalar kernel of its\n");
+        printf("format, for every channel count up to --channel and block lengths up to --frames, with inputs at and\n");
+        printf("beyond full scale, infinities, NaN and random values, from aligned and misaligned buffers. Packed i24\n");
+        printf("output is compared with a byte by byte reference conversion, and unpacked back to float.\n\n");
+        printf("-h, --help                  help\n");
+        printf("-c, --channel=#             highest channel count (default: %d)\n", DEFAULT_CONVTEST_CHANNEL);
+        printf("--frames=#                  longest block (default: %d)\n", DEFAULT_CONVTEST_FRAMES);
+        printf("--seed=#                    of the random inputs (default: 1)\n");
+    }
+
+    else if (!strcmp(subcommand, "prefetchtest"))
+    {
+        printf("Usage: %s %s [OPTION]\n\n",program_name, subcommand);
+        printf("Write a WAV file, play it through the prefetched chunk pool of --prefetch with every chunk read delayed\n");
+        printf("like slow storage, paced like a device but without one, and check every frame. Fails on any starvation:\n");
+        printf("as long as a chunk is read faster than it plays, the pool must absorb the delay.\n\n");
+        printf("-h, --help                  help\n");
+        printf("-c, --channel=#             channel count of the i32 frames (default: 2)\n");
+        printf("-r, --rate                  rate the file plays at (default: 48000)\n");
+        printf("--duration=#                seconds of the file (default: %d)\n", DEFAULT_PREFETCHTEST_SECONDS);
+        printf("--prefetch=#                chunks in the pool (default: %d)\n", DEFAULT_PREFETCHTEST_DEPTH);
+        printf("--chunk=#                   frames per chunk (default: %d)\n", DEFAULT_CHUNK_FRAMES);
+        printf("--io-delay=#                delay each chunk read by # ms (default: %d)\n", DEFAULT_PREFETCHTEST_DELAY_MS);
+        printf("--buffer=#                  frames per callback (default: %d)\n", BLOCK_FRAMES);
+        printf("--path=FILE                 the file written and removed again (default: pacap-prefetchtest-PID.wav in\n");
+        printf("                            $TMPDIR or /tmp)\n");
+    }
+    // no need to check "else" cases, this is guaranteed because it will only be called by corresponding function
+}
+
+/************************
+ * Harness function
+ * *********************/
+
+static void do_traverse()
+{
+    int num_device;
+    PaError err;
+
+    // Init
+    Pa_Initialize();
 
     // get device count
     num_device = Pa_GetDeviceCount();
@@ -308,157 +1473,3941 @@ static void do_traverse()
         printf("default high output latency : %f\n", deviceInfo->defaultHighOutputLatency);
         printf("default sample rate         : %f\n", deviceInfo->defaultSampleRate);
     }
-    
-    // terminate
-    Pa_Terminate();
-}
+    
+    // terminate
+    Pa_Terminate();
+}
+
+// cache key of a device, PortAudio has to be initialized
+static void device_key(PaDeviceIndex idx, const char **host_api, const char **device_name)
+{
+    const PaDeviceInfo *device_info = Pa_GetDeviceInfo(idx);
+    const PaHostApiInfo *host_info = device_info ? Pa_GetHostApiInfo(device_info->hostApi) : NULL;
+
+    *host_api = host_info ? host_info->name : "";
+    *device_name = device_info ? device_info->name : "";
+}
+
+/* check every format/interleaving/rate/channel combination of one direction of a device,
+ * add the records into cache and print the highest supported channel count of each */
+static int probe_direction(struct Probe_cache *cache, PaDeviceIndex idx, int is_output)
+{
+    const PaDeviceInfo *device_info = Pa_GetDeviceInfo(idx);
+    int max_channel = is_output ? device_info->maxOutputChannels : device_info->maxInputChannels;
+    if (max_channel <= 0)
+        return 0;
+    if (max_channel > PROBE_MAX_CHANNEL)
+        max_channel = PROBE_MAX_CHANNEL;
+
+    const char *host_api, *device_name;
+    device_key(idx, &host_api, &device_name);
+
+    // common channel counts the device has, plus its maximum
+    int channels[PROBE_MAX_CHANNEL];
+    int n_channel = 0;
+    int i;
+    for (i = 0; probe_channels[i] && probe_channels[i] < max_channel; ++i)
+        channels[n_channel++] = probe_channels[i];
+    channels[n_channel++] = max_channel;
+
+    char label[32];
+    snprintf(label, sizeof(label), "%s (max channel %d)", is_output ? "output" : "input", max_channel);
+    printf("\n%-27s", label);
+    int r;
+    for (r = 0; probe_rates[r]; ++r)
+        printf(" %7g", probe_rates[r]);
+    printf("\n");
+
+    unsigned f;
+    for (f = 0; f < sizeof(pa_format)/sizeof(pa_format[0]); ++f)
+    {
+        int is_noninterleaved;
+        for (is_noninterleaved = 0; is_noninterleaved <= 1; ++is_noninterleaved)
+        {
+            PaSampleFormat format = pa_format[f].macro | (is_noninterleaved ? paNonInterleaved : 0);
+            printf("%-4s %-22s", pa_format[f].name, is_noninterleaved ? "non-interleaved" : "interleaved");
+
+            for (r = 0; probe_rates[r]; ++r)
+            {
+                struct Probe_record record;
+                probe_record_set_device(&record, host_api, device_name);
+                record.is_output = is_output;
+                record.format = format;
+                record.rate = probe_rates[r];
+                record.probed = record.supported = 0;
+
+                int best = 0;
+                int c;
+                for (c = 0; c < n_channel; ++c)
+                {
+                    PaStreamParameters param;
+                    param.device = idx;
+                    param.channelCount = channels[c];
+                    param.sampleFormat = format;
+                    param.suggestedLatency = is_output ? device_info->defaultLowOutputLatency : device_info->defaultLowInputLatency;
+                    param.hostApiSpecificStreamInfo = NULL;
+
+                    uint64_t bit = (uint64_t)1 << (channels[c] - 1);
+                    record.probed |= bit;
+                    if (Pa_IsFormatSupported(is_output ? NULL : &param, is_output ? &param : NULL,
+                                             probe_rates[r]) == paFormatIsSupported)
+                    {
+                        record.supported |= bit;
+                        best = channels[c];
+                    }
+                }
+
+                if (best)
+                    printf(" %7d", best);
+                else
+                    printf(" %7s", "-");
+
+                if (probe_cache_add(cache, &record) != 0)
+                {
+                    printf("\nFailed to allocate probe cache\n");
+                    return -1;
+                }
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
+
+/* probe every device in one Pa_Initialize and store the result into `cache_file` */
+static int do_probe(const char *cache_file)
+{
+    struct Probe_cache cache;
+    probe_cache_init(&cache);
+
+    // keep records of devices which are not present now
+    if (probe_cache_load(&cache, cache_file) != 0)
+        probe_cache_free(&cache);
+
+    Pa_Initialize();
+
+    int num_device = Pa_GetDeviceCount();
+    if (num_device < 0) exit_error(num_device, "Pa_GetDeviceCount failed");
+
+    int i;
+    int ret = 0;
+    for (i = 0; i < num_device && ret == 0 && !is_interrupted; i++)
+    {
+        const char *host_api, *device_name;
+        device_key(i, &host_api, &device_name);
+
+        printf("\ndevice index %d: %s (%s), highest supported channel count:\n", i, device_name, host_api);
+        probe_cache_forget(&cache, host_api, device_name);
+        if (probe_direction(&cache, i, 1) != 0 || probe_direction(&cache, i, 0) != 0)
+            ret = -1;
+    }
+
+    Pa_Terminate();
+
+    if (ret == 0)
+    {
+        ret = probe_cache_save(&cache, cache_file);
+        if (ret == 0)
+            printf("\nCapabilities cached in %s\n", cache_file);
+    }
+    probe_cache_free(&cache);
+    return ret;
+}
+
+/* stream parameters derived from options */
+struct Stream_setup
+{
+    PaSampleFormat sample_format;
+    PaStreamParameters input_param;
+    PaStreamParameters output_param;
+    double rate;        // of the stream, the source is resampled if it isn't the options' rate
+};
+
+/* resources the whole process used so far */
+struct Process_usage
+{
+    long minor_faults;
+    long major_faults;
+    double cpu_seconds;         // user + system
+    uint64_t wall_ns;
+};
+
+/* --io=blocking: a thread generates each batch with the callback's code and writes it with
+ * Pa_WriteStream(), or reads a batch with Pa_ReadStream() and hands it to the callback's code */
+struct Blocking_io
+{
+    void *batch;                // preallocated, reused for every transfer
+    void **planes;              // non-interleaved only, one pointer per channel into `batch`
+    unsigned long max_frames;   // capacity of `batch`
+    unsigned long min_frames;   // fewest frames per transfer, it blocks until they fit
+    pthread_t thread;
+    int has_thread;
+    atomic_int is_stopping;
+    atomic_int is_done;         // the source has ended, e.g. the whole file is played
+    atomic_int error;           // PaError which stopped the thread
+    unsigned long transfers;    // thread only until joined
+    uint64_t frames;
+};
+
+/* an opened stream and everything its callback works with */
+struct Stream_run
+{
+    const struct Play_options *opt;
+    struct Stream_setup setup;
+    struct User_data user_data;
+    struct Capture capture;     // record only
+    struct Telemetry telemetry;
+    struct Bench *bench;        // bench only
+    struct File_source file;    // play --file only
+    struct Blocking_io io;      // --io=blocking only
+    struct Control control;     // --control only
+    struct Process_usage usage; // of the process: at start, then while the stream ran
+    struct Rt_memory memory;    // --mlock only
+    struct Process_usage running; // of the process: once the stream and its threads started, then since
+    PaStream *stream;
+};
+
+/* what one run of a stream ended with */
+struct Run_result
+{
+    unsigned long counters[TM_COUNTER_NUM];
+    PaTime latency;     // actual latency reported by the opened stream
+    double cpu_load;
+};
+
+/* check if the stream of `setup` can run at `rate`, from the capability cache if it knows.
+ * return 1 if it can, `reason` is PortAudio's answer, NULL if the cache answered */
+static int stream_supported(const struct Play_options *opt, const struct Stream_setup *setup, double rate,
+                            const char **reason)
+{
+    const PaStreamParameters *param = is_output_stream ? &setup->output_param : &setup->input_param;
+
+    // a probed combination is answered without asking the device
+    if (opt->probe_cache)
+    {
+        const char *host_api, *device_name;
+        device_key(opt->device_idx, &host_api, &device_name);
+
+        int cached = probe_cache_lookup(opt->probe_cache, host_api, device_name, is_output_stream,
+                                        param->sampleFormat, rate, param->channelCount);
+        if (cached >= 0)
+        {
+            *reason = NULL;
+            return cached;
+        }
+    }
+
+    // input parameters come first: an input stream passed as the output one asks about a device's output
+    PaError err = Pa_IsFormatSupported(is_output_stream ? NULL : &setup->input_param,
+                                       is_output_stream ? &setup->output_param : NULL, rate);
+    *reason = Pa_GetErrorText(err);
+    return err == paFormatIsSupported;
+}
+
+/* build stream parameters from options and check if the stream can be opened with them,
+ * return 0 if supported. Messages are only printed if `is_verbose`. */
+static int check_stream(const struct Play_options *opt, struct Stream_setup *setup, int is_verbose)
+{
+    // construct PaSampleFormat
+    PaSampleFormat sample_format = format_name_to_macro(opt->format);
+    if (is_output_stream && format_macro_to_render(sample_format, SIMD_SCALAR) == NULL)
+    {
+        if (is_verbose)
+            printf("Format %s is not supported to play yet\n", opt->format);
+        return -1;
+    }
+    if (opt->is_noninterleaved)
+    {
+        if (!is_output_stream)
+        {
+            if (is_verbose)
+                printf("Non-interleaved recording is not supported yet\n");
+            return -1;
+        }
+        sample_format |= paNonInterleaved;
+    }
+    setup->sample_format = sample_format;
+
+    // construct stream parameter
+    PaStreamParameters *expect_input_param = &setup->input_param;
+    PaStreamParameters *expect_output_param = &setup->output_param;
+
+    expect_input_param->device = opt->device_idx;
+    expect_input_param->channelCount = opt->input_channel;
+    expect_input_param->sampleFormat = sample_format;
+    expect_input_param->suggestedLatency = opt->input_latency;
+    expect_input_param->hostApiSpecificStreamInfo = NULL;
+
+    expect_output_param->device = opt->device_idx;
+    expect_output_param->channelCount = opt->output_channel;
+    expect_output_param->sampleFormat = sample_format;
+    expect_output_param->suggestedLatency = opt->output_latency;
+    expect_output_param->hostApiSpecificStreamInfo = NULL;
+
+    // check if parameter given is OK to open stream
+    PaStreamParameters *param = is_output_stream ? expect_output_param : expect_input_param;
+    setup->rate = opt->device_rate != OPT_UNSET ? opt->device_rate : opt->rate;
+
+    // resampled frames are captured in float, they are only converted once resampled
+    if (!is_output_stream && setup->rate != opt->rate)
+        expect_input_param->sampleFormat = paFloat32;
+
+    if (is_verbose)
+    {
+        printf("Open this stream as %s with following parameters:\n", is_output_stream ? "output" : "input");
+        printf("* channel       : %d\n", param->channelCount);
+        printf("* format        : %s\n", opt->format);
+        printf("* is_interleaved: %s\n", opt->is_noninterleaved?"no":"yes");
+        printf("* latency (sec) : %f\n", param->suggestedLatency);
+        printf("* rate (Hz)     : %f\n", opt->rate);
+        if (setup->rate != opt->rate)
+            printf("* device rate   : %f\n", setup->rate);
+        if (opt->frames_per_buffer != paFramesPerBufferUnspecified)
+            printf("* frames/buffer : %lu\n", opt->frames_per_buffer);
+        if (is_output_stream)
+            printf("* simd          : %s\n", simd_level_to_name(opt->simd_level));
+    }
+
+    const char *reason;
+    int is_supported = stream_supported(opt, setup, setup->rate, &reason);
+
+    // a rate the device can't run is resampled to the device's default rate
+    const PaDeviceInfo *device_info = Pa_GetDeviceInfo(opt->device_idx);
+    if (!is_supported && opt->device_rate == OPT_UNSET && opt->src_quality != SRC_OFF &&
+        device_info && device_info->defaultSampleRate != opt->rate)
+    {
+        const char *fallback_reason;
+        if (!is_output_stream)
+            expect_input_param->sampleFormat = paFloat32;
+        if (stream_supported(opt, setup, device_info->defaultSampleRate, &fallback_reason))
+        {
+            if (is_verbose)
+                printf("\n%.0f Hz is not supported (%s), the device runs at %.0f Hz\n", opt->rate,
+                       reason ? reason : "cached", device_info->defaultSampleRate);
+            setup->rate = device_info->defaultSampleRate;
+            is_supported = 1;
+            reason = fallback_reason;
+        }
+        else
+            expect_input_param->sampleFormat = sample_format;
+    }
+
+    if (!is_supported)
+    {
+        if (is_verbose)
+        {
+            if (reason == NULL)
+                printf("\nNot supported (cached)\n");
+            else
+                printf("\nNot supported: %s\n", reason);
+        }
+        return -1;
+    }
+    if (is_verbose)
+    {
+        printf("\nSupported%s\n", reason == NULL ? " (cached)" : "");
+        if (setup->rate != opt->rate)
+            printf("Resampling %.0f Hz to %.0f Hz, quality %s\n", is_output_stream ? opt->rate : setup->rate,
+                   is_output_stream ? setup->rate : opt->rate, src_quality_to_name(opt->src_quality));
+    }
+    return 0;
+}
+
+// one line description of a stimulus, into `buf` of `size` bytes
+static const char *stimulus_describe(const struct Stimulus_config *config, char *buf, size_t size)
+{
+    if (config->type == STIMULUS_PINK)
+        snprintf(buf, size, "pink noise, %.1f dBFS", config->level_db);
+    else if (config->type == STIMULUS_STEPPED)
+        snprintf(buf, size, "%u steps %.0f-%.0f Hz in %g s, %.1f dBFS", config->steps, config->start, config->stop,
+                 config->period, config->level_db);
+    else
+        snprintf(buf, size, "sweep %.0f-%.0f Hz in %g s, %.1f dBFS", config->start, config->stop, config->period,
+                 config->level_db);
+    return buf;
+}
+
+// free what user_data_init() allocated
+static void user_data_free(struct User_data *user_data)
+{
+    osc_free(&user_data->osc);
+    gen_free(&user_data->gen);
+    if (user_data->is_mix)
+        mixer_free(&user_data->mixer);
+    user_data->is_mix = 0;
+    free(user_data->gen_block);
+    user_data->gen_block = NULL;
+    if (user_data->resampler)
+        resampler_free(user_data->resampler);
+    free(user_data->resampler);
+    free(user_data->src_in);
+    free(user_data->src_out);
+    free(user_data->src_pcm);
+    user_data->resampler = NULL;
+    user_data->src_in = user_data->src_out = NULL;
+    user_data->src_pcm = NULL;
+}
+
+/* set up the resampler between `opt->rate` and the stream's `device_rate`. Played, the source renders
+ * interleaved float and `sample_format` is only rendered at the end, recorded, the stream captures
+ * interleaved float and the resampled frames are converted into `sample_format`. return 0 on success */
+static int user_data_init_resampler(struct User_data *user_data, const struct Play_options *opt,
+                                    PaSampleFormat sample_format, double device_rate)
+{
+    int channel = is_output_stream ? opt->output_channel : opt->input_channel;
+
+    user_data->resampler = malloc(sizeof(*user_data->resampler));
+    if (user_data->resampler == NULL)
+    {
+        printf("Failed to allocate resampler\n");
+        return -1;
+    }
+    if (resampler_init(user_data->resampler, is_output_stream ? opt->rate : device_rate,
+                       is_output_stream ? device_rate : opt->rate, channel, opt->src_quality, BLOCK_FRAMES,
+                       opt->simd_level) != 0)
+    {
+        free(user_data->resampler);
+        user_data->resampler = NULL;
+        return -1;
+    }
+
+    user_data->device_format = is_output_stream ? sample_format : paFloat32;
+    user_data->device_render = format_macro_to_render(user_data->device_format, opt->simd_level);
+    user_data->device_sample_size = Pa_GetSampleSize(user_data->device_format);
+    user_data->src_in = malloc(sizeof(float) * user_data->resampler->max_in * channel);
+    user_data->src_out = malloc(sizeof(float) * BLOCK_FRAMES * channel);
+    if (!is_output_stream)
+        user_data->src_pcm = malloc(Pa_GetSampleSize(sample_format) * BLOCK_FRAMES * channel);
+    if (user_data->src_in == NULL || user_data->src_out == NULL || (!is_output_stream && user_data->src_pcm == NULL))
+    {
+        printf("Failed to allocate resampler buffers\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* prepare what the callback needs to play, except capture/telemetry/bench which are left NULL.
+ * The stream runs at `device_rate`, the source is resampled if it isn't `opt->rate`. return 0 on success */
+static int user_data_init(struct User_data *user_data, const struct Play_options *opt, PaSampleFormat sample_format,
+                          double device_rate)
+{
+    memset(user_data, 0, sizeof(*user_data));
+    if (device_rate != opt->rate)
+    {
+        if (user_data_init_resampler(user_data, opt, sample_format, device_rate) != 0)
+        {
+            user_data_free(user_data);
+            return -1;
+        }
+        if (is_output_stream)
+            sample_format = paFloat32;
+    }
+    if (osc_init(&user_data->osc, opt->osc_type, opt->freq, opt->rate, opt->table_size) != 0)
+    {
+        user_data_free(user_data);
+        return -1;
+    }
+    user_data->format = sample_format;
+    user_data->render = format_macro_to_render(sample_format, opt->simd_level);
+    user_data->sample_size = Pa_GetSampleSize(sample_format);
+    user_data->bytes_per_frame = user_data->sample_size * opt->output_channel;
+    user_data->rate = opt->rate;
+    user_data->gain = 1;
+    user_data->capture = NULL;
+    user_data->telemetry = NULL;
+    user_data->bench = NULL;
+    user_data->start_gate = NULL;
+    user_data->input_channel = opt->input_channel;
+    user_data->output_channel = opt->output_channel;
+
+    if (opt->stimulus.type != STIMULUS_NONE)
+    {
+        if (stimulus_init(&user_data->stimulus, &opt->stimulus, opt->rate) != 0)
+        {
+            user_data_free(user_data);
+            return -1;
+        }
+        user_data->is_stimulus = 1;
+    }
+
+    if (opt->gen)
+    {
+        if (gen_init(&user_data->gen, opt->gen, opt->output_channel, opt->rate, opt->freq,
+                     (sample_format & paNonInterleaved) != 0, BLOCK_FRAMES, opt->simd_level) != 0)
+        {
+            user_data_free(user_data);
+            return -1;
+        }
+        user_data->gen_block = malloc(sizeof(float) * BLOCK_FRAMES * opt->output_channel);
+        if (user_data->gen_block == NULL)
+        {
+            printf("Failed to allocate generator block\n");
+            user_data_free(user_data);
+            return -1;
+        }
+    }
+
+    if (opt->mix.n_source > 0)
+    {
+        if (mixer_init(&user_data->mixer, &opt->mix, opt->output_channel, opt->rate, opt->freq,
+                       (sample_format & paNonInterleaved) != 0, opt->simd_level) != 0)
+        {
+            user_data_free(user_data);
+            return -1;
+        }
+        user_data->is_mix = 1;
+    }
+    return 0;
+}
+
+/* allocate the batch --io=blocking transfers, as large as the device may take at once, in the format the
+ * stream is opened with (`setup`, a resampled recording captures float). return 0 on success */
+static int blocking_io_init(struct Blocking_io *io, const struct Play_options *opt, const struct Stream_setup *setup)
+{
+    const PaStreamParameters *param = is_output_stream ? &setup->output_param : &setup->input_param;
+    PaSampleFormat sample_format = param->sampleFormat;
+    int channel = param->channelCount;
+    size_t sample_size = Pa_GetSampleSize(sample_format);
+
+    io->min_frames = opt->frames_per_buffer != paFramesPerBufferUnspecified ? opt->frames_per_buffer : BLOCK_FRAMES;
+    io->max_frames = io->min_frames > BLOCKING_BATCH_FRAMES ? io->min_frames : BLOCKING_BATCH_FRAMES;
+
+    io->batch = malloc(io->max_frames * channel * sample_size);
+    if (io->batch == NULL)
+        return -1;
+    // touch it now so that the first transfers don't page fault
+    memset(io->batch, 0, io->max_frames * channel * sample_size);
+
+    if (sample_format & paNonInterleaved)
+    {
+        io->planes = malloc(sizeof(void*) * channel);
+        if (io->planes == NULL)
+        {
+            free(io->batch);
+            return -1;
+        }
+        int i;
+        for (i = 0; i < channel; ++i)
+            io->planes[i] = (char*)io->batch + i * io->max_frames * sample_size;
+    }
+    return 0;
+}
+
+static void *blocking_io_main(void *arg)
+{
+    struct Stream_run *run = arg;
+    struct Blocking_io *io = &run->io;
+    void *buf = io->planes ? (void*)io->planes : io->batch;
+    PaStreamCallbackTimeInfo time_info = {0, 0, 0};
+    PaStreamCallbackFlags flags = 0;
+
+    const PaStreamInfo *info = Pa_GetStreamInfo(run->stream);
+    PaTime latency = info ? (is_output_stream ? info->outputLatency : info->inputLatency) : 0;
+
+    while (!atomic_load(&io->is_stopping))
+    {
+        // size each transfer to what the device takes right now, so the calls rarely block
+        signed long avail = is_output_stream ? Pa_GetStreamWriteAvailable(run->stream)
+                                             : Pa_GetStreamReadAvailable(run->stream);
+        if (avail < 0)
+        {
+            atomic_store(&io->error, (int)avail);
+            break;
+        }
+        unsigned long frames = avail < (signed long)io->min_frames ? io->min_frames :
+                               avail > (signed long)io->max_frames ? io->max_frames : (unsigned long)avail;
+
+        PaError err;
+        int ret = paContinue;
+        if (is_output_stream)
+        {
+            // an underflow is only known once written, it is counted with the next batch
+            time_info.currentTime = Pa_GetStreamTime(run->stream);
+            time_info.outputBufferDacTime = time_info.currentTime + latency;
+            ret = cb_play(NULL, buf, frames, &time_info, flags, &run->user_data);
+            err = Pa_WriteStream(run->stream, buf, frames);
+            flags = err == paOutputUnderflowed ? paOutputUnderflow : 0;
+        }
+        else
+        {
+            err = Pa_ReadStream(run->stream, buf, frames);
+            flags = err == paInputOverflowed ? paInputOverflow : 0;
+            time_info.currentTime = Pa_GetStreamTime(run->stream);
+            time_info.inputBufferAdcTime = time_info.currentTime - latency;
+            cb_play(buf, NULL, frames, &time_info, flags, &run->user_data);
+        }
+        if (err != paNoError && err != paOutputUnderflowed && err != paInputOverflowed)
+        {
+            atomic_store(&io->error, err);
+            break;
+        }
+
+        ++io->transfers;
+        io->frames += frames;
+        if (ret == paComplete)
+        {
+            atomic_store(&io->is_done, 1);
+            break;
+        }
+    }
+    return NULL;
+}
+
+// open the file to play as the options say, memory mapped or streamed, or the shared memory ring
+static int file_open(struct File_source *file, const struct Play_options *opt)
+{
+    if (opt->is_shm)
+        return file_source_open_shm(file, opt->file);
+    if (opt->file_prefetch > 0)
+        return file_source_open_streamed(file, opt->file, opt->file_prefetch, opt->file_chunk_frames,
+                                         opt->file_io_delay_ms);
+    return file_source_open(file, opt->file);
+}
+
+/* open one stream checked by check_stream() with everything its callback needs,
+ * `name` prefixes its telemetry lines and may be NULL. return 0 on success */
+static int stream_open(struct Stream_run *run, const struct Play_options *opt, const struct Stream_setup *setup,
+                       const char *name)
+{
+    PaSampleFormat sample_format = setup->sample_format;
+    PaError err;
+
+    memset(run, 0, sizeof(*run));
+    run->opt = opt;
+    run->setup = *setup;
+
+    // if open to play, prepare the oscillator of sine wave
+    struct User_data *user_data = &run->user_data;
+    if (user_data_init(user_data, opt, sample_format, setup->rate) != 0)
+        return -1;
+
+    // if open to play a file, map it and prepare the conversion if it isn't in stream format
+    if (opt->file)
+    {
+        if (!is_output_stream)
+        {
+            printf("A file can only be played\n");
+            goto free_osc;
+        }
+        if (file_open(&run->file, opt) != 0)
+            goto free_osc;
+        user_data->file = &run->file;
+
+        const struct Wav_info *info = &run->file.info;
+        if (info->rate != opt->rate)
+        {
+            printf("%s is at %.0f Hz, not %.0f Hz, give the device's rate as --device-rate to resample it\n",
+                   opt->file, info->rate, opt->rate);
+            goto close_file;
+        }
+        // resampled, the file is played into interleaved float
+        user_data->is_file_direct = info->format == (user_data->format & ~paNonInterleaved) &&
+                                    info->channel == opt->output_channel && !(user_data->format & paNonInterleaved);
+        if (!user_data->is_file_direct)
+        {
+            user_data->file_block = malloc(sizeof(float) * BLOCK_FRAMES * info->channel);
+            user_data->file_remap = malloc(sizeof(float) * BLOCK_FRAMES * opt->output_channel);
+            if (user_data->file_block == NULL || user_data->file_remap == NULL)
+            {
+                printf("Failed to allocate file conversion buffers\n");
+                goto close_file;
+            }
+        }
+        telemetry_print_prefix(name);
+        if (opt->is_shm)
+            printf("Playing shared memory ring %s (%llu frames), %s\n", run->file.shm.name,
+                   (unsigned long long)run->file.shm.header->capacity,
+                   user_data->is_file_direct ? "copied as is" : "converted");
+        else
+            printf("Playing %s (%lu frames), %s\n", opt->file, (unsigned long)run->file.frames,
+                   user_data->is_file_direct ? "copied as is" : "converted");
+    }
+
+    if (user_data->gen_block && !opt->is_quiet)
+    {
+        telemetry_print_prefix(name);
+        printf("Generating %s\n", opt->gen);
+        gen_print(&user_data->gen);
+    }
+    if (user_data->is_mix && !opt->is_quiet)
+        mixer_print(&user_data->mixer, name);
+    if (user_data->is_stimulus && !opt->is_quiet)
+    {
+        char desc[128];
+        telemetry_print_prefix(name);
+        printf("Playing %s\n", stimulus_describe(&opt->stimulus, desc, sizeof(desc)));
+    }
+
+    // if open to record, prepare the ring buffer and the file it is drained into
+    if (!is_output_stream)
+    {
+        if (capture_open(&run->capture, opt->output_file, sample_format, opt->input_channel, opt->rate,
+                         opt->ring_seconds) != 0)
+            goto free_osc;
+        if (capture_start(&run->capture) != 0)
+            goto close_capture;
+        user_data->capture = &run->capture;
+        telemetry_print_prefix(name);
+        printf("Recording into %s\n", opt->output_file);
+    }
+
+    if (telemetry_init(&run->telemetry, name, opt->report_interval) != 0)
+    {
+        printf("Failed to allocate telemetry\n");
+        goto close_capture;
+    }
+    user_data->telemetry = &run->telemetry;
+    if (rt_is_enabled(&opt->rt))
+        user_data->rt = &opt->rt;
+
+    // histograms are too large for the stack, with --rt-prio/--cpu/--mlock they measure callback jitter
+    if (is_bench || user_data->rt)
+    {
+        run->bench = malloc(sizeof(*run->bench));
+        if (run->bench == NULL)
+        {
+            printf("Failed to allocate benchmark data\n");
+            goto free_telemetry;
+        }
+        bench_init(run->bench, setup->rate, is_output_stream);
+        user_data->bench = run->bench;
+    }
+
+    if (opt->is_blocking && blocking_io_init(&run->io, opt, setup) != 0)
+    {
+        printf("Failed to allocate blocking I/O batch\n");
+        goto free_bench;
+    }
+
+    if (opt->control)
+    {
+        if (control_open(&run->control, strcmp(opt->control, "-") ? opt->control : NULL, opt->freq, 0,
+                         opt->ramp_ms, opt->rate) != 0)
+            goto free_io;
+        user_data->control = &run->control;
+    }
+
+    signal(SIGINT, on_interrupt);
+
+    // open stream, without a callback it is read/written with the blocking API
+    err = Pa_OpenStream(&run->stream,
+                        (is_output_stream? NULL:&run->setup.input_param),
+                        (is_output_stream? &run->setup.output_param:NULL),
+                        run->setup.rate,
+                        opt->frames_per_buffer,
+                        paNoFlag,
+                        opt->is_blocking ? NULL : cb_play,
+                        opt->is_blocking ? NULL : user_data);
+    if (err != paNoError)
+    {
+        if (!opt->is_quiet)
+            printf("Pa_OpenStream failed: %s\n", Pa_GetErrorText(err));
+        goto close_control;
+    }
+    timing_mark(&startup_timing.open_ns);
+
+    return 0;
+
+close_control:
+    if (user_data->control)
+        control_close(&run->control);
+free_io:
+    free(run->io.batch);
+    free(run->io.planes);
+free_bench:
+    free(run->bench);
+free_telemetry:
+    telemetry_free(&run->telemetry);
+close_capture:
+    if (!is_output_stream)
+        capture_close(&run->capture);
+close_file:
+    free(user_data->file_block);
+    free(user_data->file_remap);
+    if (user_data->file)
+        file_source_close(&run->file);
+free_osc:
+    user_data_free(user_data);
+    return -1;
+}
+
+static void get_usage(struct Process_usage *usage)
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+    {
+        usage->minor_faults = ru.ru_minflt;
+        usage->major_faults = ru.ru_majflt;
+        usage->cpu_seconds = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+                             ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    }
+    usage->wall_ns = telemetry_now_ns();
+}
+
+// print a line of the per run summary, prefixed like the telemetry totals
+static void print_total(const struct Stream_run *run, const char *label, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    telemetry_vprint_line(run->telemetry.name, label, fmt, ap);
+    va_end(ap);
+}
+
+/* what the resampler is and what it cost: per channel, in time per frame and as a share of the callback
+ * budget, i.e. of the time the frames take to play */
+static void print_resampler(const struct Stream_run *run)
+{
+    const struct User_data *user_data = &run->user_data;
+    const struct Resampler *resampler = user_data->resampler;
+    double channel_frames = (double)user_data->src_frames * resampler->channel;
+
+    print_total(run, "resampler", "%.0f Hz to %.0f Hz, %s: %u taps, %.0f dB stopband, passband to %.0f Hz",
+                resampler->in_rate, resampler->out_rate, src_quality_to_name(run->opt->src_quality),
+                resampler->taps, resampler->stopband_db, resampler->passband);
+    print_total(run, "resampler cost", "%.1f ns per frame and channel, %.3f%% of the callback budget per channel",
+                channel_frames ? user_data->src_ns / channel_frames : 0.0,
+                channel_frames ? 100 * user_data->src_ns / 1e9 / (channel_frames / run->setup.rate) : 0.0);
+}
+
+/* what --rt-prio/--cpu/--mlock got, and what the audio path ran like: page faults of the whole process
+ * and how far each callback came from one period after the previous one */
+static void print_rt(const struct Stream_run *run)
+{
+    const struct Histogram *jitter = &run->bench->jitter;
+    char desc[160];
+
+    print_total(run, "audio thread", "%s", rt_describe_thread(run->user_data.rt, &run->user_data.rt_thread,
+                                                               desc, sizeof(desc)));
+    if (run->memory.is_locked)
+        print_total(run, "locked memory", "%lu kB, %s", run->memory.locked_kb,
+                    run->memory.is_future_locked ? "current and future mappings" :
+                    "current mappings only, the memlock limit is too low for future ones");
+    print_total(run, "page faults", "%ld minor, %ld major while running (%ld minor, %ld major starting)",
+                run->running.minor_faults, run->running.major_faults,
+                run->usage.minor_faults - run->running.minor_faults, run->usage.major_faults - run->running.major_faults);
+    print_total(run, "callback jitter us", "p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f (%lu callbacks)",
+                hist_percentile(jitter, 50) / 1e3, hist_percentile(jitter, 99) / 1e3,
+                hist_percentile(jitter, 99.9) / 1e3, jitter->max / 1e3, (unsigned long)run->bench->callbacks);
+}
+
+static void stream_start(struct Stream_run *run)
+{
+    if (run->user_data.file && file_source_start(&run->file, FILE_READ_AHEAD) != 0)
+        exit(-1);
+    if (run->user_data.is_mix && mixer_start(&run->user_data.mixer, FILE_READ_AHEAD) != 0)
+        exit(-1);
+    // every buffer is allocated by now, fault them in and keep them so
+    if (run->opt->rt.is_mlock && rt_lock_memory(&run->memory) != 0)
+        exit(-1);
+    get_usage(&run->usage);
+
+    PaError err = Pa_StartStream(run->stream);
+    if (err != paNoError) exit_error(err, "Pa_StartStream failed");
+    timing_mark(&startup_timing.start_ns);
+
+    if (telemetry_start(&run->telemetry, run->stream) != 0)
+        exit(-1);
+
+    if (run->opt->is_blocking)
+    {
+        if (pthread_create(&run->io.thread, NULL, blocking_io_main, run) != 0)
+        {
+            printf("Failed to create blocking I/O thread\n");
+            exit(-1);
+        }
+        run->io.has_thread = 1;
+    }
+
+    if (run->user_data.control && control_start(&run->control) != 0)
+        exit(-1);
+
+    // starting faults in new thread stacks, what happens from now on is what the audio path pays
+    get_usage(&run->running);
+}
+
+// stop the stream and its telemetry, fill `result` if it is not NULL
+static void stream_stop(struct Stream_run *run, struct Run_result *result)
+{
+    PaError err;
+
+    if (result)
+    {
+        const PaStreamInfo *info = Pa_GetStreamInfo(run->stream);
+        result->latency = info ? (is_output_stream ? info->outputLatency : info->inputLatency) : 0;
+        result->cpu_load = Pa_GetStreamCpuLoad(run->stream);
+    }
+
+    // the blocking I/O thread returns once its transfer in progress is done
+    if (run->io.has_thread)
+    {
+        atomic_store(&run->io.is_stopping, 1);
+        pthread_join(run->io.thread, NULL);
+        run->io.has_thread = 0;
+        err = atomic_load(&run->io.error);
+        if (err != paNoError) exit_error(err, "Blocking I/O failed");
+    }
+
+    // stop/abort stream
+    err = Pa_StopStream(run->stream);
+    if (err != paNoError) exit_error(err, "Pa_StopStream failed");
+
+    struct Process_usage usage;
+    get_usage(&usage);
+    run->usage.minor_faults = usage.minor_faults - run->usage.minor_faults;
+    run->usage.major_faults = usage.major_faults - run->usage.major_faults;
+    run->usage.cpu_seconds = usage.cpu_seconds - run->usage.cpu_seconds;
+    run->usage.wall_ns = usage.wall_ns - run->usage.wall_ns;
+    run->running.minor_faults = usage.minor_faults - run->running.minor_faults;
+    run->running.major_faults = usage.major_faults - run->running.major_faults;
+
+    telemetry_stop(&run->telemetry);
+    if (run->user_data.control)
+        control_stop(&run->control, run->opt->is_quiet);
+    if (!run->opt->is_quiet)
+    {
+        telemetry_print_totals(&run->telemetry);
+
+        // comparable across --io models: frames moved, and what it cost the whole process
+        double seconds = run->usage.wall_ns / 1e9;
+        const PaStreamInfo *info = Pa_GetStreamInfo(run->stream);
+        if (run->opt->is_blocking)
+            print_total(run, "io", "blocking, %lu transfers of %.0f frames on average", run->io.transfers,
+                        run->io.transfers ? (double)run->io.frames / run->io.transfers : 0.0);
+        else
+            print_total(run, "io", "callback");
+        if (info)
+            print_total(run, "stream latency ms", "%.2f", 1000 * (is_output_stream ? info->outputLatency : info->inputLatency));
+        print_total(run, "throughput frames/s", "%.0f", seconds > 0 ? telemetry_get(&run->telemetry, TM_FRAMES) / seconds : 0.0);
+        print_total(run, "process cpu %", "%.2f", seconds > 0 ? 100 * run->usage.cpu_seconds / seconds : 0.0);
+        if (run->user_data.resampler)
+            print_resampler(run);
+        if (run->user_data.rt)
+            print_rt(run);
+    }
+    if (result)
+    {
+        int i;
+        for (i = 0; i < TM_COUNTER_NUM; ++i)
+            result->counters[i] = telemetry_get(&run->telemetry, i);
+    }
+}
+
+/* close a stopped stream, report and free what stream_open() set up,
+ * return 0 on success, -1 if the recorded file couldn't be written */
+static int stream_close(struct Stream_run *run)
+{
+    const struct Play_options *opt = run->opt;
+    PaError err;
+    int ret = 0;
+
+    // close stream
+    err = Pa_CloseStream(run->stream);
+    if (err != paNoError) exit_error(err, "Pa_CloseStream failed");
+
+    if (is_bench)
+    {
+        struct Bench_config config;
+        config.device = opt->device_idx;
+        config.format = opt->format;
+        config.channel = is_output_stream ? opt->output_channel : opt->input_channel;
+        config.rate = run->setup.rate;
+        config.latency = is_output_stream ? opt->output_latency : opt->input_latency;
+        config.frames_per_buffer = opt->frames_per_buffer;
+        config.is_output = is_output_stream;
+
+        FILE *fp = opt->bench_file ? fopen(opt->bench_file, "w") : stdout;
+        if (fp == NULL)
+            perror(opt->bench_file);
+        else
+        {
+            if (fp == stdout)
+                printf("\n");
+            bench_report(run->bench, &config, &run->telemetry, opt->bench_output, fp);
+            if (fp != stdout)
+                fclose(fp);
+        }
+    }
+
+    // the callback won't push anything any more, flush what's left in the ring
+    if (!is_output_stream)
+    {
+        struct Capture_stats stats;
+        ret = capture_close(&run->capture);
+        capture_get_stats(&run->capture, &stats);
+
+        print_total(run, "recorded frames", "%llu", (unsigned long long)stats.frames_written);
+        print_total(run, "ring overruns", "%lu (%lu frames dropped)", stats.overruns, stats.frames_dropped);
+        if (ret != 0)
+            printf("Failed to write %s\n", opt->output_file);
+    }
+
+    // the read-ahead thread stops with the file, only then its fault counts are known
+    if (run->user_data.file)
+    {
+        struct File_source_stats stats;
+        file_source_close(&run->file);
+        file_source_get_stats(&run->file, &stats);
+
+        if (stats.is_shm)
+        {
+            print_total(run, "shm frames played", "%llu", (unsigned long long)stats.frames_played);
+            print_total(run, "shm underruns", "%llu (%llu frames of silence)", (unsigned long long)stats.shm_underruns,
+                        (unsigned long long)stats.shm_frames_starved);
+        }
+        else
+            print_total(run, "file frames played", "%llu of %llu", (unsigned long long)stats.frames_played,
+                        (unsigned long long)run->file.frames);
+        if (stats.is_streamed)
+        {
+            print_total(run, "file prefetch", "%u chunks of %lu frames (%.0f ms buffered), %lu read",
+                        opt->file_prefetch, opt->file_chunk_frames,
+                        1000.0 * opt->file_prefetch * opt->file_chunk_frames / opt->rate, stats.prefetch.chunks_read);
+            print_total(run, "file starvations", "%lu (%lu frames of silence), fewest chunks queued: %u",
+                        stats.prefetch.starvations, stats.prefetch.frames_starved, stats.prefetch.min_queued);
+            print_total(run, "page faults", "%ld minor, %ld major", run->usage.minor_faults, run->usage.major_faults);
+        }
+        else if (stats.is_shm)
+            print_total(run, "page faults", "%ld minor, %ld major", run->usage.minor_faults, run->usage.major_faults);
+        else
+            print_total(run, "page faults", "%ld minor, %ld major (read-ahead thread: %ld minor, %ld major)",
+                        run->usage.minor_faults, run->usage.major_faults, stats.reader_minor_faults,
+                        stats.reader_major_faults);
+        free(run->user_data.file_block);
+        free(run->user_data.file_remap);
+    }
+    if (run->user_data.is_mix)
+        mixer_print_stats(&run->user_data.mixer, run->telemetry.name);
+
+    if (run->user_data.control)
+        control_close(&run->control);
+    free(run->io.batch);
+    free(run->io.planes);
+    free(run->bench);
+    user_data_free(&run->user_data);
+    telemetry_free(&run->telemetry);
+
+    return ret;
+}
+
+// sleep for `opt->duration` or until interrupted, or until every stream has completed (e.g. played a whole file)
+static void wait_duration(const struct Play_options *opt, struct Stream_run *runs, int n)
+{
+    unsigned long slept_ms = 0;
+    while (!is_interrupted && (opt->duration == 0 || slept_ms < 1000UL * opt->duration))
+    {
+        int i;
+        for (i = 0; i < n; ++i)
+            if (Pa_IsStreamActive(runs[i].stream) == 1 && !atomic_load(&runs[i].io.is_done))
+                break;
+        if (i == n)
+            break;
+
+        Pa_Sleep(100);
+        slept_ms += 100;
+    }
+}
+
+/* open, run for `opt->duration` and close one stream checked by check_stream(),
+ * return 0 on success, -1 if the stream couldn't be opened or set up */
+static int run_stream(const struct Play_options *opt, struct Stream_setup *setup, struct Run_result *result)
+{
+    struct Stream_run run;
+
+    if (stream_open(&run, opt, setup, NULL) != 0)
+        return -1;
+
+    stream_start(&run);
+    wait_duration(opt, &run, 1);
+    stream_stop(&run, result);
+
+    return stream_close(&run);
+}
+
+/* PortAudio is initialized by the caller */
+static int do_play(const struct Play_options *opt)
+{
+    struct Stream_setup setup;
+
+    int ret = check_stream(opt, &setup, 1);
+    timing_mark(&startup_timing.check_ns);
+    if (ret != 0)
+        return -1;
+
+    /* return if this is a dry run */
+    if (opt->is_dry)
+        return 0;
+
+    return run_stream(opt, &setup, NULL);
+}
+
+/*******************************************************
+ * Multiple streams
+ *
+ * Every device spec gets its own stream, User_data and telemetry. With a
+ * synchronized start all streams are started first and output silence
+ * (or drop captured frames) until each of them has called back once,
+ * then a common gate on CLOCK_MONOTONIC is opened, so every stream
+ * begins within one of its own callback periods after the gate.
+ *******************************************************/
+
+/* closed until all streams are running, see cb_play() */
+static _Atomic uint64_t start_gate_ns;
+
+/* how long to wait for every stream to call back once before opening the gate anyway */
+#define SYNC_TIMEOUT_MS 2000
+
+static int do_play_multi(const struct Play_options *opts, int n, int is_sync)
+{
+    struct Stream_setup *setups = calloc(n, sizeof(*setups));
+    struct Stream_run *runs = calloc(n, sizeof(*runs));
+    char (*names)[16] = calloc(n, sizeof(*names));
+    int ret = 0;
+    int i;
+
+    if (setups == NULL || runs == NULL || names == NULL)
+    {
+        printf("Failed to allocate streams\n");
+        ret = -1;
+        goto out;
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        printf("%sStream %d (device %d):\n", i ? "\n" : "", i, opts[i].device_idx);
+        ret = check_stream(&opts[i], &setups[i], 1);
+        timing_mark(&startup_timing.check_ns);
+        if (ret != 0)
+            goto out;
+    }
+
+    /* return if this is a dry run */
+    if (opts[0].is_dry)
+        goto out;
+
+    atomic_store(&start_gate_ns, UINT64_MAX);
+
+    printf("\n");
+    int n_open;
+    for (n_open = 0; n_open < n; ++n_open)
+    {
+        snprintf(names[n_open], sizeof(names[n_open]), "%d:dev%d", n_open, opts[n_open].device_idx);
+        if (stream_open(&runs[n_open], &opts[n_open], &setups[n_open], names[n_open]) != 0)
+            break;
+        if (is_sync)
+            runs[n_open].user_data.start_gate = &start_gate_ns;
+    }
+
+    if (n_open < n)
+    {
+        printf("Failed to open stream %d, closing the others\n", n_open);
+        for (i = 0; i < n_open; ++i)
+            stream_close(&runs[i]);
+        ret = -1;
+        goto out;
+    }
+
+    for (i = 0; i < n; ++i)
+        stream_start(&runs[i]);
+
+    uint64_t gate = 0;
+    if (is_sync)
+    {
+        // every stream has to be running before the gate opens
+        int waited_ms;
+        for (waited_ms = 0; waited_ms < SYNC_TIMEOUT_MS && !is_interrupted; waited_ms += 1)
+        {
+            for (i = 0; i < n; ++i)
+                if (telemetry_get(&runs[i].telemetry, TM_CALLBACKS) == 0)
+                    break;
+            if (i == n)
+                break;
+            Pa_Sleep(1);
+        }
+        if (waited_ms >= SYNC_TIMEOUT_MS)
+            printf("Not every stream is running after %d ms, starting anyway\n", SYNC_TIMEOUT_MS);
+
+        gate = telemetry_now_ns();
+        atomic_store_explicit(&start_gate_ns, gate, memory_order_release);
+    }
+
+    wait_duration(&opts[0], runs, n);
+
+    for (i = 0; i < n; ++i)
+        stream_stop(&runs[i], NULL);
+
+    if (is_sync)
+    {
+        printf("\nSynchronized start, delay after gate:\n");
+        for (i = 0; i < n; ++i)
+        {
+            const struct User_data *user_data = &runs[i].user_data;
+            unsigned long callbacks = telemetry_get(&runs[i].telemetry, TM_CALLBACKS);
+            double period_ms = callbacks ? 1e3 * telemetry_get(&runs[i].telemetry, TM_FRAMES) / callbacks / setups[i].rate : 0;
+
+            if (user_data->first_active_ns == 0)
+                printf("* %-12s: never began\n", names[i]);
+            else
+                printf("* %-12s: %.3f ms (callback period %.3f ms)\n", names[i],
+                       (user_data->first_active_ns - gate) / 1e6, period_ms);
+        }
+    }
+
+    for (i = 0; i < n; ++i)
+        if (stream_close(&runs[i]) != 0)
+            ret = -1;
+
+out:
+    free(setups);
+    free(runs);
+    free(names);
+    return ret;
+}
+
+/*******************************************************
+ * Tuning
+ *
+ * Every latency/frames-per-buffer combination of the grid is filtered by
+ * check_stream() (as "--dry" does), then played for a while and its xruns
+ * are counted. For each frames-per-buffer value latencies are tried from
+ * low to high, and the first clean one stops the search for that value.
+ *******************************************************/
+
+#define MAX_TUNE_VALUES 32
+
+static const double default_tune_latencies[] = {0.001, 0.002, 0.003, 0.005, 0.008, 0.010, 0.016, 0.020, 0.032, 0.050, 0.100};
+static const unsigned long default_tune_frames[] = {paFramesPerBufferUnspecified, 32, 64, 128, 256, 512, 1024};
+
+/* set to stop the synthetic load threads */
+static atomic_int is_load_stopping;
+
+static void *load_main(void *arg)
+{
+    (void)arg;
+    volatile double x = 0;
+    while (!atomic_load_explicit(&is_load_stopping, memory_order_relaxed))
+    {
+        int i;
+        for (i = 1; i < 1000; ++i)
+            x += sqrt(x + i);
+    }
+    return NULL;
+}
+
+// parse comma separated numbers, return count of numbers or -1 on error
+static int parse_list(const char *str, double *values, int max)
+{
+    int n = 0;
+    while (*str)
+    {
+        char *end;
+        if (n == max)
+            return -1;
+        values[n++] = strtod(str, &end);
+        if (end == str)
+            return -1;
+        str = (*end == ',') ? end + 1 : end;
+    }
+    return n;
+}
+
+static int write_profile(const char *path, const struct Play_options *opt)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    const PaDeviceInfo *device_info = Pa_GetDeviceInfo(opt->device_idx);
+    const PaHostApiInfo *host_info = Pa_GetHostApiInfo(device_info->hostApi);
+
+    fprintf(fp, "# generated by \"%s tune\", load with \"--profile=%s\"\n", program_name, path);
+    fprintf(fp, "device_name=%s\n", device_info->name);
+    fprintf(fp, "host_api=%s\n", host_info ? host_info->name : "");
+    fprintf(fp, "format=%s\n", opt->format);
+    fprintf(fp, "channel=%d\n", is_output_stream ? opt->output_channel : opt->input_channel);
+    fprintf(fp, "rate=%f\n", opt->rate);
+    fprintf(fp, "latency=%f\n", is_output_stream ? opt->output_latency : opt->input_latency);
+    fprintf(fp, "frames=%lu\n", opt->frames_per_buffer);
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+static int do_tune(const struct Play_options *opt)
+{
+    double latencies[MAX_TUNE_VALUES], frames[MAX_TUNE_VALUES];
+    int n_latency, n_frames;
+    int i, j;
+
+    if (opt->tune_latencies)
+        n_latency = parse_list(opt->tune_latencies, latencies, MAX_TUNE_VALUES);
+    else
+    {
+        n_latency = sizeof(default_tune_latencies)/sizeof(default_tune_latencies[0]);
+        memcpy(latencies, default_tune_latencies, sizeof(default_tune_latencies));
+    }
+    if (opt->tune_frames)
+        n_frames = parse_list(opt->tune_frames, frames, MAX_TUNE_VALUES);
+    else
+    {
+        n_frames = sizeof(default_tune_frames)/sizeof(default_tune_frames[0]);
+        for (i = 0; i < n_frames; ++i)
+            frames[i] = default_tune_frames[i];
+    }
+    if (n_latency <= 0 || n_frames <= 0)
+    {
+        printf("Bad latency or frames list\n");
+        return -1;
+    }
+
+    // lowest latency first within one frames value
+    for (i = 0; i < n_latency; ++i)
+        for (j = i + 1; j < n_latency; ++j)
+            if (latencies[j] < latencies[i])
+            {
+                double t = latencies[i];
+                latencies[i] = latencies[j];
+                latencies[j] = t;
+            }
+
+    // show what is going to be tuned, and fail early if it can never work
+    struct Stream_setup setup;
+    int ret = check_stream(opt, &setup, 1);
+    timing_mark(&startup_timing.check_ns);
+    if (ret != 0)
+        return -1;
+
+    pthread_t load_threads[MAX_TUNE_VALUES];
+    int n_load = opt->tune_load < MAX_TUNE_VALUES ? opt->tune_load : MAX_TUNE_VALUES;
+    atomic_store(&is_load_stopping, 0);
+    for (i = 0; i < n_load; ++i)
+    {
+        if (pthread_create(&load_threads[i], NULL, load_main, NULL) != 0)
+        {
+            printf("Failed to create load thread\n");
+            n_load = i;
+            break;
+        }
+    }
+    if (n_load)
+        printf("\nRunning with %d load thread(s)\n", n_load);
+
+    printf("\n%10s %8s | %12s %9s %9s %9s %6s\n",
+           "latency", "frames", "actual (ms)", "callbacks", "underflow", "overflow", "cpu");
+
+    struct Play_options trial = *opt;
+    trial.is_quiet = 1;
+    trial.report_interval = 0;
+
+    struct Play_options best = *opt;
+    PaTime best_latency = -1;
+
+    for (i = 0; i < n_frames && !is_interrupted; ++i)
+    {
+        for (j = 0; j < n_latency && !is_interrupted; ++j)
+        {
+            struct Run_result result;
+
+            trial.frames_per_buffer = (unsigned long)frames[i];
+            trial.input_latency = trial.output_latency = latencies[j];
+
+            printf("%10.4f %8lu | ", latencies[j], trial.frames_per_buffer);
+            if (check_stream(&trial, &setup, 0) != 0)
+            {
+                printf("%12s\n", "unsupported");
+                continue;
+            }
+            fflush(stdout);
+            if (run_stream(&trial, &setup, &result) != 0)
+            {
+                printf("%12s\n", "open failed");
+                continue;
+            }
+
+            unsigned long xruns = is_output_stream ?
+                result.counters[TM_OUTPUT_UNDERFLOW] + result.counters[TM_OUTPUT_OVERFLOW] :
+                result.counters[TM_INPUT_UNDERFLOW] + result.counters[TM_INPUT_OVERFLOW];
+            printf("%12.3f %9lu %9lu %9lu %5.1f%%\n", result.latency * 1e3, result.counters[TM_CALLBACKS],
+                   result.counters[is_output_stream ? TM_OUTPUT_UNDERFLOW : TM_INPUT_UNDERFLOW],
+                   result.counters[is_output_stream ? TM_OUTPUT_OVERFLOW : TM_INPUT_OVERFLOW],
+                   result.cpu_load * 100);
+
+            if (xruns == 0 && result.counters[TM_CALLBACKS] > 0)
+            {
+                if (best_latency < 0 || result.latency < best_latency)
+                {
+                    best_latency = result.latency;
+                    best = trial;
+                    best.is_quiet = opt->is_quiet;
+                    best.report_interval = opt->report_interval;
+                }
+                // higher suggested latency won't do better for this frames value
+                break;
+            }
+        }
+    }
+
+    atomic_store(&is_load_stopping, 1);
+    for (i = 0; i < n_load; ++i)
+        pthread_join(load_threads[i], NULL);
+
+    if (best_latency < 0)
+    {
+        printf("\nNo configuration ran without xruns\n");
+        ret = -1;
+    }
+    else
+    {
+        printf("\nBest: --latency=%g --frames=%lu (actual latency %.3f ms)\n",
+               is_output_stream ? best.output_latency : best.input_latency, best.frames_per_buffer,
+               best_latency * 1e3);
+        if (opt->profile_out)
+        {
+            if (write_profile(opt->profile_out, &best) == 0)
+                printf("Profile written to %s\n", opt->profile_out);
+            else
+                ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/*******************************************************
+ * Loopback latency
+ *
+ * One full-duplex stream plays a probe and captures it back through the
+ * loop (a cable, or ALSA's snd-aloop). Input and output buffers of a
+ * duplex callback are counted in the same frames, so the lag of the
+ * captured probe behind the played one is the whole round trip: both
+ * PortAudio buffers, the host API, the converters and the loop itself.
+ * The callback only copies, the FFT correlation runs on the main thread.
+ *******************************************************/
+
+/* capture blocks between the callback and the analysis */
+#define LOOP_BLOCKS 4
+
+struct Loopback_options
+{
+    PaDeviceIndex input_idx;
+    PaDeviceIndex output_idx;
+    int channel;                // of both directions
+    int loop_channel;           // input channel the probe comes back on
+    double latency;             // suggested, OPT_UNSET for the devices' low latency
+    double rate;                // OPT_UNSET for the output device's default
+    unsigned long frames_per_buffer;
+    enum Probe_signal signal;
+    unsigned order;
+    double level_db;
+    double min_snr_db;
+    unsigned duration;          // in seconds, 0 means until interrupted
+    double report_interval;
+};
+
+/* what the estimates of the whole run and of one report interval add up to */
+struct Loopback_stats
+{
+    unsigned long count;
+    double sum;
+    double min;
+    double max;
+};
+
+static void loopback_stats_add(struct Loopback_stats *stats, double lag)
+{
+    if (stats->count == 0 || lag < stats->min)
+        stats->min = lag;
+    if (stats->count == 0 || lag > stats->max)
+        stats->max = lag;
+    stats->sum += lag;
+    ++stats->count;
+}
+
+static int do_loopback(const struct Loopback_options *lopt)
+{
+    const PaDeviceInfo *input_info = Pa_GetDeviceInfo(lopt->input_idx);
+    const PaDeviceInfo *output_info = Pa_GetDeviceInfo(lopt->output_idx);
+    if (input_info == NULL || output_info == NULL)
+    {
+        printf("Failed to get info of device %d or %d\n", lopt->input_idx, lopt->output_idx);
+        return -1;
+    }
+    if (lopt->loop_channel < 0 || lopt->loop_channel >= lopt->channel)
+    {
+        printf("Input channel %d is not one of the %d channels\n", lopt->loop_channel, lopt->channel);
+        return -1;
+    }
+
+    double rate = lopt->rate != OPT_UNSET ? lopt->rate : output_info->defaultSampleRate;
+    PaStreamParameters input_param = {lopt->input_idx, lopt->channel, paFloat32,
+                                      lopt->latency != OPT_UNSET ? lopt->latency : input_info->defaultLowInputLatency, NULL};
+    PaStreamParameters output_param = {lopt->output_idx, lopt->channel, paFloat32,
+                                       lopt->latency != OPT_UNSET ? lopt->latency : output_info->defaultLowOutputLatency, NULL};
+
+    printf("Loop from device %d (%s) to device %d (%s), %d channels at %.0f Hz\n", lopt->output_idx, output_info->name,
+           lopt->input_idx, input_info->name, lopt->channel, rate);
+
+    PaError err = Pa_IsFormatSupported(&input_param, &output_param, rate);
+    if (err != paFormatIsSupported)
+    {
+        printf("Full-duplex stream not supported: %s\n", Pa_GetErrorText(err));
+        return -1;
+    }
+
+    struct Latency latency;
+    if (latency_init(&latency, lopt->signal, lopt->order, pow(10, lopt->level_db / 20), LOOP_BLOCKS) != 0)
+    {
+        printf("Failed to prepare the probe\n");
+        return -1;
+    }
+    double period_seconds = latency.period / rate;
+    if (period_seconds < 2 * (input_param.suggestedLatency + output_param.suggestedLatency))
+        printf("Warning: the period (%.0f ms) may be shorter than the latency, use a larger --order\n",
+               1000 * period_seconds);
+
+    int ret = -1;
+    struct Telemetry telemetry;
+    if (telemetry_init(&telemetry, NULL, 0) != 0)
+    {
+        printf("Failed to allocate telemetry\n");
+        goto free_latency;
+    }
+
+    struct User_data user_data;
+    memset(&user_data, 0, sizeof(user_data));
+    user_data.latency = &latency;
+    user_data.telemetry = &telemetry;
+    user_data.input_channel = user_data.output_channel = lopt->channel;
+    user_data.loop_channel = lopt->loop_channel;
+
+    signal(SIGINT, on_interrupt);
+
+    PaStream *stream;
+    err = Pa_OpenStream(&stream, &input_param, &output_param, rate, lopt->frames_per_buffer, paNoFlag,
+                        cb_loopback, &user_data);
+    if (err != paNoError)
+    {
+        printf("Pa_OpenStream failed: %s\n", Pa_GetErrorText(err));
+        goto free_telemetry;
+    }
+
+    const PaStreamInfo *info = Pa_GetStreamInfo(stream);
+    if (info)
+        printf("PortAudio reports %.1f frames of latency (input %.1f + output %.1f), %s probe period %zu frames\n\n",
+               (info->inputLatency + info->outputLatency) * rate, info->inputLatency * rate,
+               info->outputLatency * rate, lopt->signal == PROBE_MLS ? "MLS" : "impulse", latency.period);
+
+    err = Pa_StartStream(stream);
+    if (err != paNoError) exit_error(err, "Pa_StartStream failed");
+    if (telemetry_start(&telemetry, stream) != 0)
+        exit(-1);
+
+    struct Loopback_stats total, interval;
+    memset(&total, 0, sizeof(total));
+    memset(&interval, 0, sizeof(interval));
+    double first_lag = 0, last_lag = 0, interval_snr = 0;
+    uint64_t first_period = 0, last_period = 0;
+    unsigned long noisy = 0;
+    int is_inverted = 0;
+    double next_report = lopt->report_interval;
+    unsigned long slept_ms = 0;
+
+    while (!is_interrupted && (lopt->duration == 0 || slept_ms < 1000UL * lopt->duration))
+    {
+        struct Latency_estimate estimate;
+        while (latency_analyse(&latency, &estimate))
+        {
+            // the first period starts before anything has come back through the loop
+            if (estimate.period == 0)
+                continue;
+            if (estimate.snr_db < lopt->min_snr_db)
+            {
+                ++noisy;
+                continue;
+            }
+
+            if (total.count == 0)
+            {
+                first_lag = estimate.lag;
+                first_period = estimate.period;
+            }
+            last_lag = estimate.lag;
+            last_period = estimate.period;
+            is_inverted |= estimate.is_inverted;
+            loopback_stats_add(&total, estimate.lag);
+            loopback_stats_add(&interval, estimate.lag);
+            interval_snr += estimate.snr_db;
+
+            // stream time at the end of the analysed period
+            double seconds = (estimate.period + 1) * period_seconds;
+            if (lopt->report_interval > 0 && seconds >= next_report)
+            {
+                double elapsed = (last_period - first_period) * latency.period;
+                double mean = interval.sum / interval.count;
+                printf("%9.1f s  latency %10.2f frames %9.3f ms  range %.2f..%.2f  drift %+8.2f frames %+8.2f ppm  snr %5.1f dB\n",
+                       seconds, mean, 1000 * mean / rate, interval.min, interval.max, last_lag - first_lag,
+                       elapsed > 0 ? 1e6 * (last_lag - first_lag) / elapsed : 0.0, interval_snr / interval.count);
+                memset(&interval, 0, sizeof(interval));
+                interval_snr = 0;
+                while (next_report <= seconds)
+                    next_report += lopt->report_interval;
+            }
+        }
+
+        Pa_Sleep(10);
+        slept_ms += 10;
+    }
+
+    err = Pa_StopStream(stream);
+    if (err != paNoError) exit_error(err, "Pa_StopStream failed");
+    telemetry_stop(&telemetry);
+
+    telemetry_print_totals(&telemetry);
+    printf("%-20s: %lu (%lu below %.0f dB snr, %lu dropped by the analysis)\n", "periods analysed",
+           total.count + noisy, noisy, lopt->min_snr_db, atomic_load(&latency.periods_dropped));
+    if (total.count > 0)
+    {
+        double elapsed = (last_period - first_period) * latency.period;
+        double mean = total.sum / total.count;
+        printf("%-20s: %.2f frames (%.3f ms), min %.2f, max %.2f%s\n", "round-trip latency", mean,
+               1000 * mean / rate, total.min, total.max, is_inverted ? ", polarity inverted" : "");
+        printf("%-20s: %+.2f frames over %.1f s (%+.2f ppm)\n", "drift", last_lag - first_lag, elapsed / rate,
+               elapsed > 0 ? 1e6 * (last_lag - first_lag) / elapsed : 0.0);
+        ret = 0;
+    }
+    else
+        printf("The probe was not found in the input, is the loop connected to input channel %d?\n", lopt->loop_channel);
+
+    err = Pa_CloseStream(stream);
+    if (err != paNoError) exit_error(err, "Pa_CloseStream failed");
+
+free_telemetry:
+    telemetry_free(&telemetry);
+free_latency:
+    latency_free(&latency);
+    return ret;
+}
+
+/*******************************************************
+ * Frequency response
+ *
+ * Like "loopback", one full-duplex stream plays the stimulus and captures
+ * it back through the loop. The callback only generates and copies, the
+ * spectra are averaged on the main thread, so the measurement can run as
+ * long as wanted in the same memory.
+ *******************************************************/
+
+/* capture blocks between the callback and the analysis, each is half a segment */
+#define MEASURE_BLOCKS 8
+
+struct Measure_options
+{
+    PaDeviceIndex input_idx;
+    PaDeviceIndex output_idx;
+    int channel;                // of both directions
+    int loop_channel;           // input channel the stimulus comes back on
+    double latency;             // suggested, OPT_UNSET for the devices' low latency
+    double rate;                // OPT_UNSET for the output device's default
+    unsigned long frames_per_buffer;
+    struct Stimulus_config stimulus;
+    unsigned delay;             // round trip of the loop in frames
+    size_t segment;
+    double duration;            // in seconds, 0 means until interrupted, OPT_UNSET for one period and a second
+    double report_interval;
+    const char *out;            // CSV of every bin, may be NULL
+};
+
+static int write_response(const char *path, const struct Measure *measure, double rate, double low, double high)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    double bin_hz = rate / measure->segment;
+    size_t i;
+    fprintf(fp, "freq_hz,gain_db,phase_deg,coherence\n");
+    for (i = 1; i <= measure->segment / 2; ++i)
+    {
+        struct Measure_response response;
+        double freq = i * bin_hz;
+        if (freq < low || freq > high || measure_response(measure, rate, freq, (i + 1) * bin_hz, &response) != 0)
+            continue;
+        fprintf(fp, "%.2f,%.3f,%.2f,%.4f\n", freq, response.gain_db, response.phase_deg, response.coherence);
+    }
+
+    if (fclose(fp) != 0)
+    {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+static int do_measure(const struct Measure_options *mopt)
+{
+    const PaDeviceInfo *input_info = Pa_GetDeviceInfo(mopt->input_idx);
+    const PaDeviceInfo *output_info = Pa_GetDeviceInfo(mopt->output_idx);
+    if (input_info == NULL || output_info == NULL)
+    {
+        printf("Failed to get info of device %d or %d\n", mopt->input_idx, mopt->output_idx);
+        return -1;
+    }
+    if (mopt->loop_channel < 0 || mopt->loop_channel >= mopt->channel)
+    {
+        printf("Input channel %d is not one of the %d channels\n", mopt->loop_channel, mopt->channel);
+        return -1;
+    }
+
+    double rate = mopt->rate != OPT_UNSET ? mopt->rate : output_info->defaultSampleRate;
+    PaStreamParameters input_param = {mopt->input_idx, mopt->channel, paFloat32,
+                                      mopt->latency != OPT_UNSET ? mopt->latency : input_info->defaultLowInputLatency, NULL};
+    PaStreamParameters output_param = {mopt->output_idx, mopt->channel, paFloat32,
+                                       mopt->latency != OPT_UNSET ? mopt->latency : output_info->defaultLowOutputLatency, NULL};
+
+    printf("Loop from device %d (%s) to device %d (%s), %d channels at %.0f Hz\n", mopt->output_idx, output_info->name,
+           mopt->input_idx, input_info->name, mopt->channel, rate);
+
+    PaError err = Pa_IsFormatSupported(&input_param, &output_param, rate);
+    if (err != paFormatIsSupported)
+    {
+        printf("Full-duplex stream not supported: %s\n", Pa_GetErrorText(err));
+        return -1;
+    }
+
+    struct User_data user_data;
+    memset(&user_data, 0, sizeof(user_data));
+    if (stimulus_init(&user_data.stimulus, &mopt->stimulus, rate) != 0)
+        return -1;
+    user_data.is_stimulus = 1;
+    user_data.render = format_macro_to_render(paFloat32, simd_detect());
+    user_data.input_channel = user_data.output_channel = mopt->channel;
+    user_data.loop_channel = mopt->loop_channel;
+
+    struct Measure measure;
+    if (measure_init(&measure, mopt->segment, mopt->delay, MEASURE_BLOCKS) != 0)
+    {
+        printf("Failed to prepare the analysis, is the segment a power of 2?\n");
+        return -1;
+    }
+    user_data.measure = &measure;
+
+    // report over the stimulated range, which pink noise covers up to Nyquist
+    double low = mopt->stimulus.start;
+    double high = mopt->stimulus.stop < rate / 2 ? mopt->stimulus.stop : rate / 2;
+    double duration = mopt->duration;
+    if (duration == OPT_UNSET)
+        duration = mopt->stimulus.type == STIMULUS_PINK ? 10 : mopt->stimulus.period + 1;
+
+    int ret = -1;
+    struct Telemetry telemetry;
+    if (telemetry_init(&telemetry, NULL, 0) != 0)
+    {
+        printf("Failed to allocate telemetry\n");
+        goto free_measure;
+    }
+    user_data.telemetry = &telemetry;
+
+    signal(SIGINT, on_interrupt);
+
+    PaStream *stream;
+    err = Pa_OpenStream(&stream, &input_param, &output_param, rate, mopt->frames_per_buffer, paNoFlag,
+                        cb_measure, &user_data);
+    if (err != paNoError)
+    {
+        printf("Pa_OpenStream failed: %s\n", Pa_GetErrorText(err));
+        goto free_telemetry;
+    }
+
+    char desc[128];
+    printf("Playing %s, %zu point FFT (%.2f Hz per bin), delay %u frames\n\n",
+           stimulus_describe(&mopt->stimulus, desc, sizeof(desc)), mopt->segment, rate / mopt->segment, mopt->delay);
+
+    err = Pa_StartStream(stream);
+    if (err != paNoError) exit_error(err, "Pa_StartStream failed");
+    if (telemetry_start(&telemetry, stream) != 0)
+        exit(-1);
+
+    double next_report = mopt->report_interval;
+    unsigned long slept_ms = 0;
+
+    while (!is_interrupted && (duration == 0 || slept_ms < 1000 * duration))
+    {
+        if (measure_analyse(&measure) > 0 && mopt->report_interval > 0)
+        {
+            // stream time at the end of the analysed frames, and what the stimulus played there
+            uint64_t frames = (uint64_t)atomic_load(&measure.tail) * measure.hop;
+            double seconds = frames / rate;
+            double freq = stimulus_frequency(&user_data.stimulus, frames > mopt->delay ? frames - mopt->delay : 0);
+            struct Measure_response response;
+
+            // a third of an octave around a tone, all of the range for noise
+            double band_low = freq > 0 ? freq / pow(2, 1.0/6) : low;
+            double band_high = freq > 0 ? freq * pow(2, 1.0/6) : high;
+            if (seconds >= next_report && measure_response(&measure, rate, band_low, band_high, &response) == 0)
+            {
+                printf("%9.1f s  %8.1f Hz  gain %+7.2f dB  phase %+7.1f deg  coherence %.3f\n", seconds, freq,
+                       response.gain_db, response.phase_deg, response.coherence);
+                while (next_report <= seconds)
+                    next_report += mopt->report_interval;
+            }
+        }
+
+        Pa_Sleep(10);
+        slept_ms += 10;
+    }
+
+    err = Pa_StopStream(stream);
+    if (err != paNoError) exit_error(err, "Pa_StopStream failed");
+    telemetry_stop(&telemetry);
+    measure_analyse(&measure);
+
+    telemetry_print_totals(&telemetry);
+    printf("%-20s: %lu (%lu blocks dropped by the analysis)\n\n", "segments analysed", measure.segments,
+           atomic_load(&measure.blocks_dropped));
+
+    // one row per 1/3 octave band of the preferred frequencies around 1 kHz
+    printf("%10s %10s %10s %10s\n", "band Hz", "gain dB", "phase deg", "coherence");
+    int k, n_band = 0;
+    for (k = (int)ceil(3 * log2(low / 1000)); k <= (int)floor(3 * log2(high / 1000)); ++k)
+    {
+        double center = 1000 * pow(2, k / 3.0);
+        struct Measure_response response;
+        if (measure_response(&measure, rate, center / pow(2, 1.0/6), center * pow(2, 1.0/6), &response) != 0)
+        {
+            printf("%10.1f %10s\n", center, "-");
+            continue;
+        }
+        printf("%10.1f %+10.2f %+10.1f %10.3f\n", center, response.gain_db, response.phase_deg, response.coherence);
+        ++n_band;
+    }
+
+    struct Measure_response overall;
+    if (n_band == 0 || measure_response(&measure, rate, low, high, &overall) != 0)
+        printf("\nNo band was measured, is the stimulus longer than a segment?\n");
+    else
+    {
+        printf("\n%-20s: %+.2f dB, coherence %.3f\n", "overall", overall.gain_db, overall.coherence);
+        if (overall.coherence < 0.5)
+            printf("The input hardly follows the stimulus, is the loop connected to input channel %d and --delay right?\n",
+                   mopt->loop_channel);
+        ret = 0;
+    }
+
+    if (mopt->out && write_response(mopt->out, &measure, rate, low, high) != 0)
+        ret = -1;
+
+    err = Pa_CloseStream(stream);
+    if (err != paNoError) exit_error(err, "Pa_CloseStream failed");
+
+free_telemetry:
+    telemetry_free(&telemetry);
+free_measure:
+    measure_free(&measure);
+    return ret;
+}
+
+/*******************************************************
+ * Offline render
+ *
+ * cb_play() is called in a tight loop with fake time info and no device,
+ * for every format/channel combination asked for, so generator and
+ * conversion throughput can be measured without sound hardware.
+ *******************************************************/
+
+/* most values in a format or channel list */
+#define MAX_RENDER_VALUES 32
+
+struct Render_options
+{
+    struct Play_options play;   // format/channel/rate/oscillator/simd, device fields are unused
+    const char *formats;        // comma separated list
+    const char *channels;       // comma separated list
+    uint64_t frames;            // frames to render per combination
+    unsigned long buffer_frames;// frames per callback
+    const char *out;            // NULL: discard, "-": WAV to stdout, "*.wav": WAV, otherwise raw
+    double min_speed;           // fail if slower than this many times realtime, 0: no check
+};
+
+/* render one format/channel combination, return its speed (times realtime) in `speed`. Its line of
+ * results goes to `report`, unless NULL */
+static int render_one(const struct Render_options *ropt, FILE *report, double *speed)
+{
+    const struct Play_options *opt = &ropt->play;
+    PaSampleFormat sample_format = format_name_to_macro(opt->format);
+    int is_planar = opt->is_noninterleaved;
+    int channel = opt->output_channel;
+    int ret = -1;
+
+    if (is_planar)
+        sample_format |= paNonInterleaved;
+
+    // resampled, the buffers are at the device's rate
+    double rate = opt->device_rate != OPT_UNSET ? opt->device_rate : opt->rate;
+
+    struct User_data user_data;
+    if (user_data_init(&user_data, opt, sample_format, rate) != 0)
+        return -1;
+
+    struct Telemetry telemetry;
+    if (telemetry_init(&telemetry, NULL, 0) != 0)
+    {
+        printf("Failed to allocate telemetry\n");
+        user_data_free(&user_data);
+        return -1;
+    }
+    user_data.telemetry = &telemetry;
+
+    size_t buffer_bytes = ropt->buffer_frames * user_data.bytes_per_frame;
+    char *buf = malloc(buffer_bytes);
+    void **planes = malloc(sizeof(void*) * channel);
+    if (buf == NULL || planes == NULL)
+    {
+        printf("Failed to allocate render buffer\n");
+        goto out;
+    }
+    int i;
+    for (i = 0; i < channel; ++i)
+        planes[i] = buf + i * ropt->buffer_frames * user_data.sample_size;
+
+    // resampled, the callback generates float but writes frames in the device format
+    size_t frame_bytes = user_data.resampler ? user_data.device_sample_size * channel : user_data.bytes_per_frame;
+
+    // header carries the final length, so the file can also be a pipe
+    FILE *fp = NULL;
+    int is_wav = 0;
+    uint64_t data_bytes = ropt->frames * frame_bytes;
+    if (ropt->out)
+    {
+        size_t len = strlen(ropt->out);
+        is_wav = !strcmp(ropt->out, "-") || (len >= 4 && !strcasecmp(ropt->out + len - 4, ".wav"));
+        fp = strcmp(ropt->out, "-") ? fopen(ropt->out, "wb") : stdout;
+        if (fp == NULL)
+        {
+            perror(ropt->out);
+            goto out;
+        }
+        if (is_wav && wav_write_header(fp, sample_format, channel, rate, data_bytes) != 0)
+        {
+            printf("This format can't be stored in WAV, use a raw file instead\n");
+            goto close;
+        }
+    }
+
+    PaStreamCallbackTimeInfo time_info = {0};
+    uint64_t done = 0, callback_ns = 0;
+    uint64_t begin_ns = telemetry_now_ns();
+    while (done < ropt->frames && !is_interrupted)
+    {
+        unsigned long n = ropt->buffer_frames;
+        if (n > ropt->frames - done)
+            n = ropt->frames - done;
+
+        time_info.currentTime = done / rate;
+        time_info.outputBufferDacTime = time_info.currentTime;
+
+        uint64_t t = telemetry_now_ns();
+        cb_play(NULL, is_planar ? (void*)planes : (void*)buf, n, &time_info, 0, &user_data);
+        callback_ns += telemetry_now_ns() - t;
+
+        if (fp && fwrite(buf, frame_bytes, n, fp) != n)
+        {
+            perror(ropt->out);
+            goto close;
+        }
+        done += n;
+    }
+    if (fp && is_wav && (data_bytes & 1) && fputc(0, fp) == EOF)
+        goto close;
+    if (fp && fflush(fp) != 0)
+        goto close;
+    uint64_t total_ns = telemetry_now_ns() - begin_ns;
+
+    double seconds = done / rate;
+    *speed = callback_ns ? seconds / (callback_ns / 1e9) : 0;
+    if (report)
+    {
+        fprintf(report, "%-4s %5d %12.0f %10.2f %10.1f %12.0f", opt->format, channel,
+                callback_ns ? done / (callback_ns / 1e9) : 0, callback_ns / (double)(done ? done : 1),
+                *speed, total_ns ? done / (total_ns / 1e9) : 0);
+        // resampling per frame and channel, and its share of the time the frames take to play
+        if (user_data.resampler)
+            fprintf(report, " %10.2f %9.3f%%", user_data.src_ns / ((double)(done ? done : 1) * channel),
+                    100 * user_data.src_ns / 1e9 / seconds / channel);
+        fprintf(report, "\n");
+    }
+    ret = 0;
+
+close:
+    if (fp && fp != stdout)
+        fclose(fp);
+out:
+    free(planes);
+    free(buf);
+    telemetry_free(&telemetry);
+    user_data_free(&user_data);
+    return ret;
+}
+
+static int do_render(struct Render_options *ropt)
+{
+    // info goes to stderr when the samples go to stdout
+    FILE *report = (ropt->out && !strcmp(ropt->out, "-")) ? stderr : stdout;
+    char *formats = strdup(ropt->formats);
+    double channels[MAX_RENDER_VALUES];
+    int n_channel = parse_list(ropt->channels, channels, MAX_RENDER_VALUES);
+    int ret = 0;
+    int i;
+
+    if (n_channel <= 0)
+    {
+        printf("Bad channel list: %s\n", ropt->channels);
+        free(formats);
+        return -1;
+    }
+
+    char desc[128];
+    if (ropt->play.mix.n_source > 0)
+        snprintf(desc, sizeof(desc), "mix of %d sources", ropt->play.mix.n_source);
+    else if (ropt->play.gen)
+        snprintf(desc, sizeof(desc), "gen %s", ropt->play.gen);
+    else if (ropt->play.stimulus.type != STIMULUS_NONE)
+        stimulus_describe(&ropt->play.stimulus, desc, sizeof(desc));
+    else
+        snprintf(desc, sizeof(desc), "osc %s", osc_names[ropt->play.osc_type]);
+    fprintf(report, "Rendering %llu frames at %.0f Hz, %lu frames per callback, simd %s, %s\n",
+            (unsigned long long)ropt->frames, ropt->play.rate, ropt->buffer_frames,
+            simd_level_to_name(ropt->play.simd_level), desc);
+    int is_resampled = ropt->play.device_rate != OPT_UNSET && ropt->play.device_rate != ropt->play.rate;
+    if (is_resampled)
+        fprintf(report, "Resampled to %.0f Hz, quality %s, frames are counted at %.0f Hz\n", ropt->play.device_rate,
+                src_quality_to_name(ropt->play.src_quality), ropt->play.device_rate);
+    fprintf(report, "\n%-4s %5s %12s %10s %10s %12s", "fmt", "ch", "frames/s", "ns/frame", "realtime", "with output");
+    if (is_resampled)
+        fprintf(report, " %10s %10s", "src ns/ch", "src/ch");
+    fprintf(report, "\n");
+
+    char *save = NULL;
+    char *format;
+    for (format = strtok_r(formats, ",", &save); format && !is_interrupted; format = strtok_r(NULL, ",", &save))
+    {
+        format_name_to_macro(format); // exits on unknown name
+        for (i = 0; i < n_channel && !is_interrupted; ++i)
+        {
+            double speed;
+            ropt->play.format = format;
+            ropt->play.output_channel = (int)channels[i];
+            if (ropt->play.output_channel < 1)
+            {
+                printf("Bad channel count: %d\n", ropt->play.output_channel);
+                ret = -1;
+                continue;
+            }
+            if (render_one(ropt, report, &speed) != 0)
+                ret = -1;
+            else if (ropt->min_speed > 0 && speed < ropt->min_speed)
+            {
+                fprintf(report, "%-4s %5d is slower than %.1f times realtime\n", format,
+                        ropt->play.output_channel, ropt->min_speed);
+                ret = -1;
+            }
+        }
+    }
+
+    free(formats);
+    return ret;
+}
+
+/*******************************************************
+ * Render benchmark
+ *
+ * The callback as it was before the oscillator and the conversion were
+ * split into blocks: sin() and a branch on the format for every sample,
+ * is the baseline the block kernels are timed against, format by format.
+ *******************************************************/
+
+/* the per-sample callback body, `phase` carries over between calls. return -1 for a format it never had */
+static int render_per_sample(void *output, unsigned long frames, int channel, PaSampleFormat format,
+                             double *phase, double step)
+{
+    unsigned long i;
+    int j;
+
+    if (format != paFloat32 && format != paInt32 && format != paInt16 && format != paInt8 && format != paUInt8)
+        return -1;
+    for (i = 0; i < frames; ++i)
+    {
+        double val = sin(*phase);
+        for (j = 0; j < channel; ++j)
+        {
+            size_t k = i * channel + j;
+            if (format == paFloat32)
+                ((float*)output)[k] = val;
+            else if (format == paInt32)
+                ((int32_t*)output)[k] = INT32_MAX * val;
+            else if (format == paInt16)
+                ((int16_t*)output)[k] = INT16_MAX * val;
+            else if (format == paInt8)
+                ((int8_t*)output)[k] = INT8_MAX * val;
+            else
+                ((uint8_t*)output)[k] = ((UINT8_MAX+1)>>1) + ((UINT8_MAX+1)>>1) * val;
+        }
+        *phase += step;
+        if (*phase >= 2 * M_PI)
+            *phase -= 2 * M_PI;
+    }
+    return 0;
+}
+
+/* time the per-sample baseline of the format/channel in `ropt`, return ns per frame or -1 */
+static double renderbench_per_sample(const struct Render_options *ropt)
+{
+    PaSampleFormat format = format_name_to_macro(ropt->play.format);
+    int channel = ropt->play.output_channel;
+    double phase = 0, step = 2 * M_PI * ropt->play.freq / ropt->play.rate;
+
+    if (render_per_sample(NULL, 0, channel, format, &phase, step) != 0)
+        return -1;
+    char *buf = malloc(Pa_GetSampleSize(format) * ropt->buffer_frames * channel);
+    if (buf == NULL)
+    {
+        printf("Failed to allocate renderbench buffer\n");
+        return -1;
+    }
+
+    uint64_t done = 0;
+    uint64_t begin_ns = telemetry_now_ns();
+    while (done < ropt->frames && !is_interrupted)
+    {
+        unsigned long n = ropt->buffer_frames;
+        if (n > ropt->frames - done)
+            n = ropt->frames - done;
+        render_per_sample(buf, n, channel, format, &phase, step);
+        done += n;
+    }
+    uint64_t total_ns = telemetry_now_ns() - begin_ns;
+
+    free(buf);
+    return total_ns / (double)(done ? done : 1);
+}
+
+/* time the callback in `ropt` at `level`, into planes if `is_planar`, return ns per frame or -1 */
+static double renderbench_callback(const struct Render_options *ropt, enum Simd_level level, int is_planar)
+{
+    struct Render_options copy = *ropt;
+    double speed;
+
+    copy.play.simd_level = level;
+    copy.play.is_noninterleaved = is_planar;
+    if (render_one(&copy, NULL, &speed) != 0 || speed <= 0)
+        return -1;
+    return 1e9 / (speed * ropt->play.rate);
+}
+
+static int do_renderbench(struct Render_options *ropt)
+{
+    char *formats = strdup(ropt->formats);
+    double channels[MAX_RENDER_VALUES];
+    int n_channel = parse_list(ropt->channels, channels, MAX_RENDER_VALUES);
+    int ret = 0;
+    int i;
+
+    if (n_channel <= 0)
+    {
+        printf("Bad channel list: %s\n", ropt->channels);
+        free(formats);
+        return -1;
+    }
+
+    printf("Rendering %llu frames at %.0f Hz, %lu frames per callback, osc %s, simd %s\n",
+           (unsigned long long)ropt->frames, ropt->play.rate, ropt->buffer_frames, osc_names[ropt->play.osc_type],
+           simd_level_to_name(ropt->play.simd_level));
+    printf("ns per frame per sample (sin() and a branch on the format for every sample, before block rendering),\n");
+    printf("with the scalar and the simd block kernels, and the speedup of simd over per sample. planar is simd\n");
+    printf("into one buffer per channel (--noninterleaved), and its speedup over the interleaved simd\n\n");
+    printf("%-4s %5s %12s %12s %12s %10s %12s %10s\n", "fmt", "ch", "per sample", "scalar", "simd", "speedup",
+           "planar", "speedup");
+
+    char *save = NULL;
+    char *format;
+    for (format = strtok_r(formats, ",", &save); format && !is_interrupted; format = strtok_r(NULL, ",", &save))
+    {
+        format_name_to_macro(format); // exits on unknown name
+        for (i = 0; i < n_channel && !is_interrupted; ++i)
+        {
+            ropt->play.format = format;
+            ropt->play.output_channel = (int)channels[i];
+            if (ropt->play.output_channel < 1)
+            {
+                printf("Bad channel count: %d\n", ropt->play.output_channel);
+                ret = -1;
+                continue;
+            }
+
+            double baseline = renderbench_per_sample(ropt);
+            double scalar = renderbench_callback(ropt, SIMD_SCALAR, 0);
+            double simd = ropt->play.simd_level == SIMD_SCALAR ? scalar :
+                          renderbench_callback(ropt, ropt->play.simd_level, 0);
+            double planar = renderbench_callback(ropt, ropt->play.simd_level, 1);
+            if (scalar < 0 || simd < 0 || planar < 0)
+            {
+                ret = -1;
+                continue;
+            }
+
+            printf("%-4s %5d ", format, ropt->play.output_channel);
+            if (baseline < 0)
+                printf("%12s ", "-");
+            else
+                printf("%12.2f ", baseline);
+            printf("%12.2f %12.2f ", scalar, simd);
+            if (baseline < 0)
+                printf("%10s ", "-");
+            else
+                printf("%9.2fx ", baseline / simd);
+            printf("%12.2f %9.2fx\n", planar, simd / planar);
+        }
+    }
+
+    free(formats);
+    return ret;
+}
+
+/*******************************************************
+ * Oscillator test
+ *
+ * Every oscillator plays a sine into i32 through the float block and the
+ * scalar kernel, like the callback does, and is measured against the
+ * per-sample double path the block replaced. 997 periods fit exactly in
+ * the second at 48 kHz: the harmonics fall on exact bins with no window,
+ * and 997 being prime spreads the rounding over every phase.
+ *******************************************************/
+
+#define OSCTEST_RATE 48000
+#define OSCTEST_FREQ 997
+#define OSCTEST_HARMONICS 10
+
+struct Osc_quality
+{
+    double thd_db;          // harmonics 2..OSCTEST_HARMONICS over the fundamental
+    double thdn_db;         // everything but DC and the fundamental, over the fundamental
+    double ns_per_frame;
+};
+
+static double power_db(double ratio)
+{
+    return 10 * log10(ratio > 1e-40 ? ratio : 1e-40);
+}
+
+/* measure OSCTEST_RATE frames of a OSCTEST_FREQ sine, `ns_per_frame` is left to the caller */
+static void osc_quality(const int32_t *x, struct Osc_quality *quality)
+{
+    double mean = 0, fundamental = 0, harmonics = 0, residual = 0;
+    double a[OSCTEST_HARMONICS + 1], b[OSCTEST_HARMONICS + 1];
+    unsigned long i;
+    int k;
+
+    for (i = 0; i < OSCTEST_RATE; ++i)
+        mean += x[i] / (double)INT32_MAX;
+    mean /= OSCTEST_RATE;
+
+    for (k = 1; k <= OSCTEST_HARMONICS; ++k)
+    {
+        a[k] = b[k] = 0;
+        for (i = 0; i < OSCTEST_RATE; ++i)
+        {
+            // the phase in whole steps of the period, so it is exact however long the signal
+            double phase = 2 * M_PI * ((uint64_t)k * OSCTEST_FREQ * i % OSCTEST_RATE) / OSCTEST_RATE;
+            a[k] += x[i] / (double)INT32_MAX * sin(phase);
+            b[k] += x[i] / (double)INT32_MAX * cos(phase);
+        }
+        a[k] *= 2.0 / OSCTEST_RATE;
+        b[k] *= 2.0 / OSCTEST_RATE;
+        if (k == 1)
+            fundamental = (a[k] * a[k] + b[k] * b[k]) / 2;
+        else
+            harmonics += (a[k] * a[k] + b[k] * b[k]) / 2;
+    }
+
+    for (i = 0; i < OSCTEST_RATE; ++i)
+    {
+        double phase = 2 * M_PI * ((uint64_t)OSCTEST_FREQ * i % OSCTEST_RATE) / OSCTEST_RATE;
+        double r = x[i] / (double)INT32_MAX - mean - a[1] * sin(phase) - b[1] * cos(phase);
+        residual += r * r;
+    }
+    residual /= OSCTEST_RATE;
+
+    quality->thd_db = power_db(harmonics / fundamental);
+    quality->thdn_db = power_db(residual / fundamental);
+}
+
+/* the callback before block rendering: sin() in double, scaled to i32 sample by sample */
+static void osc_quality_double(int32_t *x, struct Osc_quality *quality)
+{
+    double phase = 0, step = 2 * M_PI * OSCTEST_FREQ / OSCTEST_RATE;
+    unsigned long i;
+
+    uint64_t begin_ns = telemetry_now_ns();
+    for (i = 0; i < OSCTEST_RATE; ++i)
+    {
+        x[i] = INT32_MAX * sin(phase);
+        phase += step;
+        if (phase >= 2 * M_PI)
+            phase -= 2 * M_PI;
+    }
+    quality->ns_per_frame = (telemetry_now_ns() - begin_ns) / (double)OSCTEST_RATE;
+    osc_quality(x, quality);
+}
+
+// generate and convert the sine block by block like cb_play(), return 0 on success
+static int osc_quality_block(enum Osc_type type, unsigned table_size, int32_t *x, struct Osc_quality *quality)
+{
+    struct Oscillator osc;
+    float block[BLOCK_FRAMES];
+    unsigned long done = 0;
+
+    if (osc_init(&osc, type, OSCTEST_FREQ, OSCTEST_RATE, table_size) != 0)
+    {
+        osc_free(&osc);
+        return -1;
+    }
+
+    uint64_t begin_ns = telemetry_now_ns();
+    while (done < OSCTEST_RATE)
+    {
+        unsigned long n = OSCTEST_RATE - done < BLOCK_FRAMES ? OSCTEST_RATE - done : BLOCK_FRAMES;
+        osc_generate(&osc, block, n);
+        render_i32(block, x + done, n, 1);
+        done += n;
+    }
+    quality->ns_per_frame = (telemetry_now_ns() - begin_ns) / (double)OSCTEST_RATE;
+    osc_free(&osc);
+    osc_quality(x, quality);
+    return 0;
+}
+
+static int do_osctest(unsigned table_size, double max_thdn_db)
+{
+    struct Osc_quality quality;
+    int32_t *x = malloc(sizeof(int32_t) * OSCTEST_RATE);
+    int ret = 0;
+    int type;
+
+    if (x == NULL)
+    {
+        printf("Failed to allocate osctest buffer\n");
+        return -1;
+    }
+
+    printf("A %d Hz sine at %d Hz into i32, table of %u points, THD up to harmonic %d\n\n", OSCTEST_FREQ,
+           OSCTEST_RATE, table_size, OSCTEST_HARMONICS);
+    printf("%-10s %10s %10s %10s\n", "osc", "THD dB", "THD+N dB", "ns/frame");
+    osc_quality_double(x, &quality);
+    printf("%-10s %10.1f %10.1f %10.2f\n", "double", quality.thd_db, quality.thdn_db, quality.ns_per_frame);
+    for (type = OSC_LIBM; type <= OSC_RECURSIVE; ++type)
+    {
+        if (osc_quality_block((enum Osc_type)type, table_size, x, &quality) != 0)
+        {
+            ret = -1;
+            continue;
+        }
+        printf("%-10s %10.1f %10.1f %10.2f\n", osc_names[type], quality.thd_db, quality.thdn_db,
+               quality.ns_per_frame);
+        if (quality.thdn_db > max_thdn_db)
+            ret = -1;
+    }
+
+    printf("\n%-20s: %.1f dB %s\n", "THD+N limit", max_thdn_db, ret ? "FAIL" : "PASS");
+    free(x);
+    return ret;
+}
+
+struct Mixbench_options
+{
+    const char *sources;
+    const char *channels;
+    const char *format;
+    double rate;
+    uint64_t frames;
+    enum Simd_level simd_level;
+    double knee_db;
+};
+
+// mix `n_source` stereo generators into `channel` channels and print one line of results
+static int mixbench_one(const struct Mixbench_options *bopt, int n_source, int channel)
+{
+    PaSampleFormat format = format_name_to_macro(bopt->format);
+    Render_func render = format_macro_to_render(format, bopt->simd_level);
+    struct Mix_config config;
+    char specs[MIX_MAX_SOURCES][64];
+    struct Mixer mixer;
+    int s;
+
+    config.n_source = n_source;
+    config.knee_db = bopt->knee_db;
+    for (s = 0; s < n_source; ++s)
+    {
+        // spread out, and quiet enough that 16 of them only just reach the knee
+        snprintf(specs[s], sizeof(specs[s]), "gen:sine:%d:-30,saw:%d:-30", 100 + 37 * s, 55 + 23 * s);
+        config.sources[s].spec = specs[s];
+        config.sources[s].gain_db = 0;
+        config.sources[s].route = NULL;
+    }
+    if (mixer_init(&mixer, &config, channel, bopt->rate, 1000, 0, bopt->simd_level) != 0)
+        return -1;
+
+    char *out = malloc(Pa_GetSampleSize(format) * MIX_BLOCK_FRAMES * channel);
+    if (out == NULL)
+    {
+        printf("Failed to allocate mixbench output\n");
+        mixer_free(&mixer);
+        return -1;
+    }
+
+    uint64_t done = 0;
+    uint64_t begin_ns = telemetry_now_ns();
+    while (done < bopt->frames && !is_interrupted)
+    {
+        unsigned long n = MIX_BLOCK_FRAMES;
+        if (n > bopt->frames - done)
+            n = bopt->frames - done;
+        mixer_process(&mixer, n);
+        render(mixer.interleaved, out, n * channel, 1);
+        done += n;
+    }
+    uint64_t total_ns = telemetry_now_ns() - begin_ns;
+
+    double per_frame = total_ns / (double)(done ? done : 1);
+    double mix_per_frame = mixer.mix_ns / (double)(done ? done : 1);
+    printf("%7d %5d %7d %10.1f %10.1f %12.2f %10.0f %10.2f%%\n", n_source, channel, mixer.n_route, per_frame,
+           mix_per_frame, 1000 * mix_per_frame / (mixer.n_route ? mixer.n_route : 1),
+           per_frame > 0 ? 1e9 / per_frame / bopt->rate : 0,
+           100.0 * mixer.clipped / ((double)(done ? done : 1) * channel));
+
+    free(out);
+    mixer_free(&mixer);
+    return 0;
+}
+
+static int do_mixbench(const struct Mixbench_options *bopt)
+{
+    double sources[MAX_RENDER_VALUES], channels[MAX_RENDER_VALUES];
+    int n_sources = parse_list(bopt->sources, sources, MAX_RENDER_VALUES);
+    int n_channels = parse_list(bopt->channels, channels, MAX_RENDER_VALUES);
+    int ret = 0;
+    int i, j;
+
+    if (n_sources <= 0 || n_channels <= 0)
+    {
+        printf("Bad source or channel list: %s, %s\n", bopt->sources, bopt->channels);
+        return -1;
+    }
+    format_name_to_macro(bopt->format); // exits on unknown name
+    if (bopt->knee_db >= 0)
+    {
+        printf("The knee of the soft clipper must be below 0 dBFS\n");
+        return -1;
+    }
+
+    // a clipper which amplifies or overshoots makes every number below meaningless
+    if (mixer_check_clip(bopt->knee_db, SIMD_SCALAR) != 0 ||
+        (bopt->simd_level != SIMD_SCALAR && mixer_check_clip(bopt->knee_db, bopt->simd_level) != 0))
+    {
+        printf("Soft clipper check: FAIL\n");
+        return -1;
+    }
+    printf("Soft clipper check: output within the input and full scale\n");
+
+    printf("Mixing %llu frames at %.0f Hz into %s, simd %s, soft clip above %.1f dBFS\n\n",
+           (unsigned long long)bopt->frames, bopt->rate, bopt->format, simd_level_to_name(bopt->simd_level),
+           bopt->knee_db);
+    printf("%7s %5s %7s %10s %10s %12s %10s %11s\n", "sources", "ch", "routes", "ns/frame", "mix ns", "mix ps/route",
+           "realtime", "clipped");
+    for (j = 0; j < n_channels && !is_interrupted; ++j)
+    {
+        for (i = 0; i < n_sources && !is_interrupted; ++i)
+        {
+            int n_source = (int)sources[i], channel = (int)channels[j];
+            if (n_source < 1 || n_source > MIX_MAX_SOURCES || channel < 1)
+            {
+                printf("Bad source/channel count: %d/%d\n", n_source, channel);
+                ret = -1;
+                continue;
+            }
+            if (mixbench_one(bopt, n_source, channel) != 0)
+                ret = -1;
+        }
+    }
+    return ret;
+}
+
+/* load a profile written by "tune" into `opt`, options given on command line
+ * (anything not OPT_UNSET) are kept. return 0 on success */
+static int load_profile(const char *path, struct Play_options *opt)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), fp))
+    {
+        char *value = strchr(line, '=');
+        if (line[0] == '#' || value == NULL)
+            continue;
+        *value++ = '\0';
+        value[strcspn(value, "\r\n")] = '\0';
+
+        if (!strcmp(line, "format") && opt->format == NULL)
+            opt->format = strdup(value);
+        else if (!strcmp(line, "channel") && opt->output_channel == OPT_UNSET)
+            opt->input_channel = opt->output_channel = strtol(value, NULL, 0);
+        else if (!strcmp(line, "rate") && opt->rate == OPT_UNSET)
+            opt->rate = strtod(value, NULL);
+        else if (!strcmp(line, "latency") && opt->output_latency == OPT_UNSET)
+            opt->input_latency = opt->output_latency = strtod(value, NULL);
+        else if (!strcmp(line, "frames") && opt->frames_per_buffer == (unsigned long)OPT_UNSET)
+            opt->frames_per_buffer = strtoul(value, NULL, 0);
+        else if (!strcmp(line, "device_name"))
+        {
+            const PaDeviceInfo *device_info = Pa_GetDeviceInfo(opt->device_idx);
+            if (device_info && strcmp(device_info->name, value))
+                printf("Warning: profile was tuned for \"%s\", not \"%s\"\n", value, device_info->name);
+        }
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/************************
+ * Sub-command functions
+ * *********************/
+
+static int traverse(int argc, char *argv[])
+{
+
+    optind = 1; // reset the index
+
+    const char *optstring = ":h";
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"probe", no_argument, NULL, 'z'},
+        {"cache", required_argument, NULL, 'y'},
+        {0,0,0,0}
+    };
+
+    int is_probe = 0;
+    const char *cache_file = probe_cache_default_path();
+
+    int val;
+    while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1)
+    {
+        switch (val)
+        {
+            case 'z':
+                is_probe = 1;
+                break;
+            case 'y':
+                cache_file = strdup(optarg);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            case '?':
+                printf("unknown option: %c\n", optopt);
+                return -1;
+            case ':':
+                printf("option requires an argument -- %c\n", optopt);
+                return -1;
+            default:
+                printf("will never reach here\n");
+                return -1;
+        }
+    }
+
+    if (is_probe)
+    {
+        if (cache_file == NULL)
+        {
+            printf("Please specify the cache file by --cache, $HOME is not set\n");
+            return -1;
+        }
+        signal(SIGINT, on_interrupt);
+        return do_probe(cache_file);
+    }
+
+    do_traverse();
+
+    return 0;
+}
+
+/* "pacap.wav" -> "pacap-3.wav", so streams of several devices don't share one file */
+static const char *path_for_device(const char *path, PaDeviceIndex idx)
+{
+    const char *dot = strrchr(path, '.');
+    if (dot == NULL || strchr(dot, '/'))
+        dot = path + strlen(path);
+
+    size_t len = strlen(path) + 16;
+    char *buf = malloc(len);
+    if (buf == NULL)
+        return path;
+    snprintf(buf, len, "%.*s-%d%s", (int)(dot - path), path, idx, dot);
+    return buf;
+}
+
+/* parse a device spec "INDEX[:KEY=VALUE,...]" on top of `opt`, keys are
+ * c (channel), f (format), l (latency), r (rate), b (frames per buffer), n (non-interleaved), o (output file).
+ * With `is_multi` file names are made per device unless given in the spec. return 0 on success */
+static int parse_device_spec(const char *spec, struct Play_options *opt, int is_multi)
+{
+    char *end;
+    opt->device_idx = strtol(spec, &end, 0);
+    if (end == spec || (*end != '\0' && *end != ':'))
+    {
+        printf("Bad device spec: %s\n", spec);
+        return -1;
+    }
+
+    int has_output_file = 0;
+    const char *p = (*end == ':') ? end + 1 : end;
+    while (*p)
+    {
+        size_t len = strcspn(p, ",");
+        char item[256];
+        snprintf(item, sizeof(item), "%.*s", (int)len, p);
+        p += len;
+        if (*p == ',')
+            ++p;
+
+        char *value = strchr(item, '=');
+        if (value)
+            *value++ = '\0';
+
+        if (!strcmp(item, "n") && (value == NULL || strtol(value, NULL, 0)))
+            opt->is_noninterleaved = 1;
+        else if (value == NULL)
+        {
+            printf("Bad device spec item \"%s\" in %s\n", item, spec);
+            return -1;
+        }
+        else if (!strcmp(item, "c"))
+            opt->input_channel = opt->output_channel = strtol(value, NULL, 0);
+        else if (!strcmp(item, "f"))
+            opt->format = strdup(value);
+        else if (!strcmp(item, "l"))
+            opt->input_latency = opt->output_latency = strtod(value, NULL);
+        else if (!strcmp(item, "r"))
+            opt->rate = strtod(value, NULL);
+        else if (!strcmp(item, "b"))
+            opt->frames_per_buffer = strtoul(value, NULL, 0);
+        else if (!strcmp(item, "n"))
+            opt->is_noninterleaved = 0;
+        else if (!strcmp(item, "o"))
+        {
+            opt->output_file = strdup(value);
+            has_output_file = 1;
+        }
+        else
+        {
+            printf("Unknown device spec key \"%s\" in %s\n", item, spec);
+            return -1;
+        }
+    }
+
+    if (is_multi)
+    {
+        if (!has_output_file)
+            opt->output_file = path_for_device(opt->output_file, opt->device_idx);
+        if (opt->bench_file)
+            opt->bench_file = path_for_device(opt->bench_file, opt->device_idx);
+    }
+    return 0;
+}
+
+/* fill stream parameters not given on command line or device spec from the profile,
+ * then from the device defaults. return 0 on success */
+static int fill_device_defaults(struct Play_options *opt, const char *profile_file)
+{
+    const PaDeviceInfo *deviceInfo = NULL;
+    if (opt->device_idx >= 0 && opt->device_idx < Pa_GetDeviceCount())
+        deviceInfo = Pa_GetDeviceInfo(opt->device_idx);
+    if (deviceInfo == 0)
+    {
+        printf("Failed to get info of device %d\n", opt->device_idx);
+        return -1;
+    }
+
+    if (profile_file && load_profile(profile_file, opt) != 0)
+        return -1;
+
+    // a file is played as it is stored, unless told otherwise
+    if (opt->file)
+    {
+        struct File_source file;
+        if (file_open(&file, opt) != 0)
+            return -1;
+        if (opt->input_channel == OPT_UNSET)
+            opt->input_channel = opt->output_channel = file.info.channel;
+        if (opt->rate == OPT_UNSET)
+            opt->rate = file.info.rate;
+        // another rate is the one to play it at, the file is resampled
+        else if (opt->rate != file.info.rate && opt->device_rate == OPT_UNSET && opt->src_quality != SRC_OFF)
+        {
+            opt->device_rate = opt->rate;
+            opt->rate = file.info.rate;
+        }
+        if (opt->format == NULL)
+            opt->format = format_macro_to_name(file.info.format);
+        file_source_close(&file);
+    }
+
+    // mixed files and rings are at the rate the mix runs at, like a file played alone
+    if (opt->mix.n_source > 0)
+    {
+        double rate = mixer_source_rate(&opt->mix);
+        if (rate < 0)
+            return -1;
+        if (rate > 0 && opt->rate == OPT_UNSET)
+            opt->rate = rate;
+        else if (rate > 0 && opt->rate != rate && opt->device_rate == OPT_UNSET && opt->src_quality != SRC_OFF)
+        {
+            opt->device_rate = opt->rate;
+            opt->rate = rate;
+        }
+    }
+
+    if (opt->input_channel == OPT_UNSET)
+    {
+        opt->input_channel = deviceInfo->maxInputChannels;
+        opt->output_channel = deviceInfo->maxOutputChannels;
+    }
+    if (opt->input_latency == OPT_UNSET)
+    {
+        opt->input_latency = deviceInfo->defaultLowInputLatency;
+        opt->output_latency = deviceInfo->defaultLowOutputLatency;
+    }
+    if (opt->rate == OPT_UNSET)
+        opt->rate = deviceInfo->defaultSampleRate;
+    if (opt->frames_per_buffer == (unsigned long)OPT_UNSET)
+        opt->frames_per_buffer = paFramesPerBufferUnspecified;
+    if (opt->format == NULL)
+        opt->format = "f32";
+
+    // the sine wave (and the default frequency of --gen and --mix tones) must be playable at the rate
+    if (is_output_stream && !(opt->freq > 0 && opt->freq < opt->rate / 2))
+    {
+        printf("Frequency %d is not above 0 and below Nyquist (%g)\n", opt->freq, opt->rate / 2);
+        return -1;
+    }
+    return 0;
+}
+
+static void stimulus_config_default(struct Stimulus_config *config, enum Stimulus_type type)
+{
+    config->type = type;
+    config->start = DEFAULT_STIMULUS_START;
+    config->stop = DEFAULT_STIMULUS_STOP;
+    config->period = DEFAULT_STIMULUS_PERIOD;
+    config->steps = DEFAULT_STIMULUS_STEPS;
+    config->level_db = DEFAULT_STIMULUS_LEVEL;
+}
+
+/* parse the stimulus options shared by play/render/measure: --stimulus 'A', --start 'H', --stop 'M',
+ * --period 'R', --steps 'U', --level 'V'. return 0 if `val` is one of them, 1 if it isn't, -1 on error */
+static int stimulus_option(int val, const char *arg, struct Stimulus_config *config)
+{
+    switch (val)
+    {
+        case 'A':
+            if (stimulus_name_to_type(arg, &config->type) != 0)
+            {
+                printf("Unknown stimulus: %s\n", arg);
+                return -1;
+            }
+            return 0;
+        case 'H':
+            config->start = strtod(arg, NULL);
+            return 0;
+        case 'M':
+            config->stop = strtod(arg, NULL);
+            return 0;
+        case 'R':
+            config->period = strtod(arg, NULL);
+            return 0;
+        case 'U':
+            config->steps = strtoul(arg, NULL, 0);
+            return 0;
+        case 'V':
+            config->level_db = strtod(arg, NULL);
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+/* parse the mixer options shared by play/render: --mix adds a source, --mix-gain and --route apply to the
+ * last one added, --knee to the clipper. return 0 if `val` is one of them, 1 if it isn't, -1 on error */
+static int mix_option(int val, const char *arg, struct Mix_config *config)
+{
+    struct Mix_source_config *last = config->n_source ? &config->sources[config->n_source - 1] : NULL;
+
+    switch (val)
+    {
+        case OPT_MIX:
+            if (config->n_source == MIX_MAX_SOURCES)
+            {
+                printf("At most %d sources can be mixed\n", MIX_MAX_SOURCES);
+                return -1;
+            }
+            last = &config->sources[config->n_source++];
+            last->spec = strdup(arg);
+            last->gain_db = 0;
+            last->route = NULL;
+            return 0;
+        case OPT_MIX_GAIN:
+        case OPT_ROUTE:
+            if (last == NULL)
+            {
+                printf("--%s applies to the source of the --mix before it\n", val == OPT_ROUTE ? "route" : "mix-gain");
+                return -1;
+            }
+            if (val == OPT_ROUTE)
+                last->route = strdup(arg);
+            else
+                last->gain_db = strtod(arg, NULL);
+            return 0;
+        case OPT_KNEE:
+            config->knee_db = strtod(arg, NULL);
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+static int play(int argc, char *argv[])
+{
+    timing_mark(&startup_timing.begin_ns);
+
+    optind = 1; // reset the index
+    int val;
+
+    const char *optstring = ":hc:f:l:nr:o:";
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"channel", required_argument, NULL, 'c'},
+        {"format", required_argument, NULL, 'f'},
+        {"latency", required_argument, NULL, 'l'},
+        {"noninterleaved", no_argument, NULL, 'n'},
+        {"rate", required_argument, NULL, 'r'},
+        {"dry", no_argument, NULL, 'z'},
+        {"freq", required_argument, NULL, 'y'},
+        {"duration", required_argument, NULL, 'x'},
+        {"osc", required_argument, NULL, 'w'},
+        {"table-size", required_argument, NULL, 'v'},
+        {"simd", required_argument, NULL, 'u'},
+        {"output", required_argument, NULL, 'o'},
+        {"ring", required_argument, NULL, 't'},
+        {"report", required_argument, NULL, 's'},
+        {"bench-format", required_argument, NULL, 'q'},
+        {"bench-out", required_argument, NULL, 'p'},
+        {"frames", required_argument, NULL, 'F'},
+        {"profile", required_argument, NULL, 'P'},
+        {"latencies", required_argument, NULL, 'L'},
+        {"frames-list", required_argument, NULL, 'B'},
+        {"load", required_argument, NULL, 'D'},
+        {"profile-out", required_argument, NULL, 'O'},
+        {"cache", required_argument, NULL, 'C'},
+        {"no-cache", no_argument, NULL, 'N'},
+        {"timing", no_argument, NULL, 'T'},
+        {"sync-start", no_argument, NULL, 'S'},
+        {"file", required_argument, NULL, 'I'},
+        {"source", required_argument, NULL, 'Z'},
+        {"prefetch", required_argument, NULL, 'Q'},
+        {"chunk", required_argument, NULL, 'K'},
+        {"io-delay", required_argument, NULL, 'J'},
+        {"io", required_argument, NULL, 'G'},
+        {"control", required_argument, NULL, 'E'},
+        {"ramp", required_argument, NULL, 'W'},
+        {"gen", required_argument, NULL, 'g'},
+        {"stimulus", required_argument, NULL, 'A'},
+        {"start", required_argument, NULL, 'H'},
+        {"stop", required_argument, NULL, 'M'},
+        {"period", required_argument, NULL, 'R'},
+        {"steps", required_argument, NULL, 'U'},
+        {"level", required_argument, NULL, 'V'},
+        {"device-rate", required_argument, NULL, 'X'},
+        {"src", required_argument, NULL, 'Y'},
+        {"rt-prio", required_argument, NULL, 'a'},
+        {"cpu", required_argument, NULL, 'j'},
+        {"mlock", no_argument, NULL, 'k'},
+        {"mix", required_argument, NULL, OPT_MIX},
+        {"mix-gain", required_argument, NULL, OPT_MIX_GAIN},
+        {"route", required_argument, NULL, OPT_ROUTE},
+        {"knee", required_argument, NULL, OPT_KNEE},
+        {0,0,0,0}
+    };
+
+    /* Step 1. parse options, parameters which default to the device defaults are left OPT_UNSET */
+
+    struct Play_options opt;
+    opt.input_channel = opt.output_channel = OPT_UNSET;
+    opt.input_latency = opt.output_latency = OPT_UNSET;
+    opt.rate = OPT_UNSET;
+    opt.frames_per_buffer = (unsigned long)OPT_UNSET;
+    opt.format = NULL;
+
+    // other parameters are not available from device info, set them to some sane defaults
+    opt.is_noninterleaved = 0; // by default PA pass data as a single buffer with all channels interleaved 
+    opt.is_dry = 0; // play/record by default
+    opt.freq = 1000; // play 1000Hz sine wave by default
+    opt.duration = is_tune ? 2 : 5; // play/record 5 seconds by default, tune each configuration for 2 seconds
+    opt.osc_type = OSC_LIBM;
+    opt.table_size = DEFAULT_TABLE_SIZE;
+    opt.simd_level = simd_detect();
+    opt.output_file = DEFAULT_RECORD_FILE;
+    opt.ring_seconds = DEFAULT_RING_SECONDS;
+    opt.report_interval = DEFAULT_REPORT_INTERVAL;
+    opt.bench_output = BENCH_TEXT;
+    opt.bench_file = NULL;
+    opt.is_quiet = 0;
+    opt.tune_latencies = NULL;
+    opt.tune_frames = NULL;
+    opt.tune_load = 0;
+    opt.profile_out = NULL;
+    opt.probe_cache = NULL;
+    opt.file = NULL;
+    opt.is_shm = 0;
+    opt.file_prefetch = 0;
+    opt.file_chunk_frames = DEFAULT_CHUNK_FRAMES;
+    opt.file_io_delay_ms = 0;
+    opt.is_blocking = 0;
+    opt.gen = NULL;
+    stimulus_config_default(&opt.stimulus, STIMULUS_NONE);
+    opt.control = NULL;
+    opt.ramp_ms = DEFAULT_CONTROL_RAMP_MS;
+    opt.device_rate = OPT_UNSET;
+    opt.src_quality = SRC_MEDIUM;
+    rt_config_init(&opt.rt);
+    opt.mix.n_source = 0;
+    opt.mix.knee_db = MIX_DEFAULT_KNEE_DB;
+
+    const char *profile_file = NULL;
+    int is_duration_set = 0;
+    const char *cache_file = probe_cache_default_path();
+    int is_sync = 0;
+
+    while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1)
+    {
+        int is_stimulus = stimulus_option(val, optarg, &opt.stimulus);
+        if (is_stimulus < 0)
+            return -1;
+        if (is_stimulus == 0)
+            continue;
+        int is_mix = mix_option(val, optarg, &opt.mix);
+        if (is_mix < 0)
+            return -1;
+        if (is_mix == 0)
+            continue;
+
+        switch (val)
+        {
+            case 'c':
+                opt.input_channel = opt.output_channel = strtol(optarg, NULL, 0);
+                break;
+            case 'f':
+                opt.format = strdup(optarg);
+                break;
+            case 'l':
+                opt.input_latency = opt.output_latency = strtod(optarg, NULL);
+                break;
+            case 'n':
+                opt.is_noninterleaved = 1;
+                break;
+            case 'r':
+                opt.rate = strtod(optarg, NULL);
+                break;
+            case 'z':
+                opt.is_dry = 1;
+                break;
+            case 'y':
+                opt.freq = strtol(optarg, NULL, 0);
+                break;
+            case 'x':
+                opt.duration = strtol(optarg, NULL, 0);
+                is_duration_set = 1;
+                break;
+            case 'w':
+                if (osc_name_to_type(optarg, &opt.osc_type) != 0)
+                {
+                    printf("Unknown oscillator: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'v':
+                opt.table_size = strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                opt.output_file = strdup(optarg);
+                break;
+            case 't':
+                opt.ring_seconds = strtod(optarg, NULL);
+                break;
+            case 's':
+                opt.report_interval = strtod(optarg, NULL);
+                break;
+            case 'q':
+                if (bench_output_from_name(optarg, &opt.bench_output) != 0)
+                {
+                    printf("Unknown benchmark output format: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'p':
+                opt.bench_file = strdup(optarg);
+                break;
+            case 'F':
+                opt.frames_per_buffer = strtoul(optarg, NULL, 0);
+                break;
+            case 'P':
+                profile_file = strdup(optarg);
+                break;
+            case 'L':
+                opt.tune_latencies = strdup(optarg);
+                break;
+            case 'B':
+                opt.tune_frames = strdup(optarg);
+                break;
+            case 'D':
+                opt.tune_load = strtol(optarg, NULL, 0);
+                break;
+            case 'O':
+                opt.profile_out = strdup(optarg);
+                break;
+            case 'C':
+                cache_file = strdup(optarg);
+                break;
+            case 'N':
+                cache_file = NULL;
+                break;
+            case 'S':
+                is_sync = 1;
+                break;
+            case 'I':
+                opt.file = strdup(optarg);
+                opt.is_shm = 0;
+                break;
+            case 'Z':
+                if (strncmp(optarg, "shm:", 4) == 0 && optarg[4] != '\0')
+                    opt.is_shm = 1;
+                else if (strncmp(optarg, "file:", 5) == 0 && optarg[5] != '\0')
+                    opt.is_shm = 0;
+                else
+                {
+                    printf("Invalid --source %s, expected shm:NAME or file:PATH\n", optarg);
+                    return -1;
+                }
+                opt.file = strdup(strchr(optarg, ':') + 1);
+                break;
+            case 'Q':
+                opt.file_prefetch = strtoul(optarg, NULL, 0);
+                break;
+            case 'K':
+                opt.file_chunk_frames = strtoul(optarg, NULL, 0);
+                break;
+            case 'J':
+                opt.file_io_delay_ms = strtoul(optarg, NULL, 0);
+                break;
+            case 'g':
+                opt.gen = strdup(optarg);
+                break;
+            case 'E':
+                opt.control = strdup(optarg);
+                break;
+            case 'W':
+                opt.ramp_ms = strtod(optarg, NULL);
+                break;
+            case 'X':
+                opt.device_rate = strtod(optarg, NULL);
+                break;
+            case 'Y':
+                if (src_name_to_quality(optarg, &opt.src_quality) != 0)
+                {
+                    printf("Unknown resampler quality: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'a':
+                opt.rt.priority = strtol(optarg, NULL, 0);
+                if (rt_check_priority(opt.rt.priority) != 0)
+                    return -1;
+                break;
+            case 'j':
+                if (rt_parse_cpus(optarg, &opt.rt) != 0)
+                    return -1;
+                break;
+            case 'k':
+                opt.rt.is_mlock = 1;
+                break;
+            case 'G':
+                if (!strcmp(optarg, "blocking"))
+                    opt.is_blocking = 1;
+                else if (!strcmp(optarg, "callback"))
+                    opt.is_blocking = 0;
+                else
+                {
+                    printf("Unknown I/O model: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'T':
+                is_timing = 1;
+                timing_mark(&startup_timing.begin_ns);
+                break;
+            case 'u':
+            {
+                enum Simd_level best = simd_detect();
+                if (simd_name_to_level(optarg, &opt.simd_level) != 0)
+                {
+                    printf("Unknown SIMD level: %s\n", optarg);
+                    return -1;
+                }
+                if (opt.simd_level != SIMD_SCALAR && (opt.simd_level > best || (opt.simd_level == SIMD_NEON) != (best == SIMD_NEON)))
+                {
+                    printf("SIMD level %s is not supported on this CPU\n", optarg);
+                    return -1;
+                }
+                break;
+            }
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            case '?':
+                printf("unknown option: %c\n", optopt);
+                return -1;
+            case ':':
+                printf("option requires an argument -- %c\n", optopt);
+                return -1;
+            default:
+                printf("will never reach here\n");
+                return -1;
+        }
+    }
+    if (opt.gen && (opt.file || !is_output_stream))
+    {
+        printf("--gen only applies to playing the generated signal\n");
+        return -1;
+    }
+    if (opt.mix.n_source > 0 && (opt.gen || opt.file || opt.stimulus.type != STIMULUS_NONE || !is_output_stream))
+    {
+        printf("--mix only applies to playing, instead of --gen, --file, --source or --stimulus (mix them instead)\n");
+        return -1;
+    }
+    if (opt.stimulus.type != STIMULUS_NONE && (opt.gen || opt.file || !is_output_stream))
+    {
+        printf("--stimulus only applies to playing the generated signal, without --gen\n");
+        return -1;
+    }
+    if (opt.control && (opt.gen || opt.file || opt.stimulus.type != STIMULUS_NONE || opt.mix.n_source || opt.is_blocking ||
+                        !is_output_stream || is_bench || is_tune))
+    {
+        printf("--control only applies to playing the sine wave with --io=callback\n");
+        return -1;
+    }
+    if (opt.ramp_ms < 0)
+    {
+        printf("Ramp can't be negative\n");
+        return -1;
+    }
+    if (opt.device_rate != OPT_UNSET && opt.src_quality == SRC_OFF)
+    {
+        printf("--device-rate needs the resampler, not --src=off\n");
+        return -1;
+    }
+
+    if (opt.is_shm && opt.file_prefetch > 0)
+    {
+        printf("--prefetch is for files, not --source=shm\n");
+        return -1;
+    }
+
+    // a file plays to its end unless a duration is given, so do mixed files
+    if ((opt.file || mixer_is_finite(&opt.mix)) && !is_duration_set)
+        opt.duration = 0;
+
+    // now optind points to the first non-option argv-element or ending '\0' of argv
+    int n_stream = argc - optind;
+    if (n_stream == 0)
+    {
+        // no non-option argv-element specified
+        printf("Please choose specify device index to check!\n");
+        return -1;
+    }
+    if (n_stream > 1 && is_tune)
+    {
+        printf("Only one device can be tuned at a time\n");
+        return -1;
+    }
+    if (n_stream > 1 && opt.control)
+    {
+        printf("Only one device can be controlled at a time\n");
+        return -1;
+    }
+    // a shared memory ring has a single consumer, every stream would open its own on the same ring
+    if (n_stream > 1 && (opt.is_shm || mixer_uses_shm(&opt.mix)))
+    {
+        printf("A shared memory ring can only be played on one device at a time\n");
+        return -1;
+    }
+
+    // every device spec starts from the options given on command line
+    struct Play_options *opts = malloc(sizeof(*opts) * n_stream);
+    if (opts == NULL)
+    {
+        printf("Failed to allocate stream options\n");
+        return -1;
+    }
+    int i;
+    for (i = 0; i < n_stream; ++i)
+    {
+        opts[i] = opt;
+        if (parse_device_spec(argv[optind + i], &opts[i], n_stream > 1) != 0)
+        {
+            free(opts);
+            return -1;
+        }
+    }
+
+    /* Step 2. pin this thread before any other exists, so they inherit it, then init lib once,
+     * it stays initialized until the stream is done */
+
+    if (rt_prepare(&opt.rt) != 0)
+    {
+        free(opts);
+        return -1;
+    }
+
+    PaError err = Pa_Initialize();
+    if (err != paNoError) exit_error(err, "Pa_Initialize failed");
+    timing_mark(&startup_timing.init_ns);
+
+    /* Step 3. fill what's not given on command line from the profile, then from device defaults */
+
+    int ret = -1;
+    struct Probe_cache probe_cache;
+    probe_cache_init(&probe_cache);
+
+    for (i = 0; i < n_stream; ++i)
+        if (fill_device_defaults(&opts[i], profile_file) != 0)
+            goto out;
+    timing_mark(&startup_timing.enumerate_ns);
+
+    // a missing cache is fine, it only saves asking the device
+    if (cache_file && probe_cache_load(&probe_cache, cache_file) == 0)
+        for (i = 0; i < n_stream; ++i)
+            opts[i].probe_cache = &probe_cache;
+
+    if (is_tune)
+        ret = do_tune(&opts[0]);
+    else if (n_stream == 1)
+        ret = do_play(&opts[0]);
+    else
+        ret = do_play_multi(opts, n_stream, is_sync);
+
+out:
+    probe_cache_free(&probe_cache);
+    free(opts);
+
+    // terminate
+    Pa_Terminate();
+
+    if (is_timing)
+        print_startup_timing();
+
+    return ret;
+}
+
+static int record(int argc, char *argv[])
+{
+    // change global flag to indicate this stream is opended as input
+    is_output_stream = 0;
+
+    return play(argc, argv);
+}
+
+static int bench(int argc, char *argv[])
+{
+    // change global flag to indicate this stream is run as benchmark
+    is_bench = 1;
+
+    // "--record" benches an input stream instead, hide it from option parsing of play()
+    int i;
+    for (i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--record"))
+        {
+            is_output_stream = 0;
+            memmove(&argv[i], &argv[i+1], sizeof(char*) * (argc - i));
+            --argc;
+            break;
+        }
+    }
+
+    return play(argc, argv);
+}
+
+static int tune(int argc, char *argv[])
+{
+    // change global flag to indicate this stream is tuned
+    is_tune = 1;
+
+    // "--record" tunes an input stream instead, hide it from option parsing of play()
+    int i;
+    for (i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--record"))
+        {
+            is_output_stream = 0;
+            memmove(&argv[i], &argv[i+1], sizeof(char*) * (argc - i));
+            --argc;
+            break;
+        }
+    }
+
+    return play(argc, argv);
+}
+
+static void render_options_default(struct Render_options *ropt)
+{
+    memset(ropt, 0, sizeof(*ropt));
+    ropt->play.rate = 48000;
+    ropt->play.freq = 1000;
+    ropt->play.osc_type = OSC_LIBM;
+    ropt->play.table_size = DEFAULT_TABLE_SIZE;
+    ropt->play.simd_level = simd_detect();
+    ropt->formats = "f32";
+    ropt->channels = "2";
+    ropt->frames = DEFAULT_RENDER_FRAMES;
+    ropt->buffer_frames = BLOCK_FRAMES;
+    stimulus_config_default(&ropt->play.stimulus, STIMULUS_NONE);
+    ropt->play.device_rate = OPT_UNSET;
+    ropt->play.src_quality = SRC_MEDIUM;
+    ropt->play.mix.knee_db = MIX_DEFAULT_KNEE_DB;
+}
+
+static int render(int argc, char *argv[])
+{
+    optind = 1; // reset the index
+
+    const char *optstring = ":hc:f:nr:";
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"channel", required_argument, NULL, 'c'},
+        {"format", required_argument, NULL, 'f'},
+        {"noninterleaved", no_argument, NULL, 'n'},
+        {"rate", required_argument, NULL, 'r'},
+        {"freq", required_argument, NULL, 'y'},
+        {"osc", required_argument, NULL, 'w'},
+        {"table-size", required_argument, NULL, 'v'},
+        {"simd", required_argument, NULL, 'u'},
+        {"frames", required_argument, NULL, 'F'},
+        {"buffer", required_argument, NULL, 'b'},
+        {"out", required_argument, NULL, 'o'},
+        {"min-speed", required_argument, NULL, 'm'},
+        {"gen", required_argument, NULL, 'g'},
+        {"stimulus", required_argument, NULL, 'A'},
+        {"start", required_argument, NULL, 'H'},
+        {"stop", required_argument, NULL, 'M'},
+        {"period", required_argument, NULL, 'R'},
+        {"steps", required_argument, NULL, 'U'},
+        {"level", required_argument, NULL, 'V'},
+        {"device-rate", required_argument, NULL, 'X'},
+        {"src", required_argument, NULL, 'Y'},
+        {"mix", required_argument, NULL, OPT_MIX},
+        {"mix-gain", required_argument, NULL, OPT_MIX_GAIN},
+        {"route", required_argument, NULL, OPT_ROUTE},
+        {"knee", required_argument, NULL, OPT_KNEE},
+        {0,0,0,0}
+    };
+
+    struct Render_options ropt;
+    render_options_default(&ropt);
+
+    int val;
+    while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1)
+    {
+        int is_stimulus = stimulus_option(val, optarg, &ropt.play.stimulus);
+        if (is_stimulus < 0)
+            return -1;
+        if (is_stimulus == 0)
+            continue;
+        int is_mix = mix_option(val, optarg, &ropt.play.mix);
+        if (is_mix < 0)
+            return -1;
+        if (is_mix == 0)
+            continue;
+
+        switch (val)
+        {
+            case 'c':
+                ropt.channels = strdup(optarg);
+                break;
+            case 'f':
+                ropt.formats = strdup(optarg);
+                break;
+            case 'n':
+                ropt.play.is_noninterleaved = 1;
+                break;
+            case 'r':
+                ropt.play.rate = strtod(optarg, NULL);
+                break;
+            case 'y':
+                ropt.play.freq = strtol(optarg, NULL, 0);
+                break;
+            case 'w':
+                if (osc_name_to_type(optarg, &ropt.play.osc_type) != 0)
+                {
+                    printf("Unknown oscillator: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'v':
+                ropt.play.table_size = strtoul(optarg, NULL, 0);
+                break;
+            case 'u':
+            {
+                enum Simd_level best = simd_detect();
+                if (simd_name_to_level(optarg, &ropt.play.simd_level) != 0)
+                {
+                    printf("Unknown SIMD level: %s\n", optarg);
+                    return -1;
+                }
+                if (ropt.play.simd_level != SIMD_SCALAR && (ropt.play.simd_level > best || (ropt.play.simd_level == SIMD_NEON) != (best == SIMD_NEON)))
+                {
+                    printf("SIMD level %s is not supported on this CPU\n", optarg);
+                    return -1;
+                }
+                break;
+            }
+            case 'F':
+                ropt.frames = strtoull(optarg, NULL, 0);
+                break;
+            case 'b':
+                ropt.buffer_frames = strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                ropt.out = strdup(optarg);
+                break;
+            case 'g':
+                ropt.play.gen = strdup(optarg);
+                break;
+            case 'm':
+                ropt.min_speed = strtod(optarg, NULL);
+                break;
+            case 'X':
+                ropt.play.device_rate = strtod(optarg, NULL);
+                break;
+            case 'Y':
+                if (src_name_to_quality(optarg, &ropt.play.src_quality) != 0)
+                {
+                    printf("Unknown resampler quality: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            case '?':
+                printf("unknown option: %c\n", optopt);
+                return -1;
+            case ':':
+                printf("option requires an argument -- %c\n", optopt);
+                return -1;
+            default:
+                printf("will never reach here\n");
+                return -1;
+        }
+    }
+
+    if (ropt.buffer_frames == 0 || ropt.play.rate <= 0)
+    {
+        printf("Frames per callback and rate should be positive\n");
+        return -1;
+    }
+    if (ropt.out && (strchr(ropt.formats, ',') || strchr(ropt.channels, ',')))
+    {
+        printf("Only one format and channel count can be rendered into a file\n");
+        return -1;
+    }
+    if (ropt.out && ropt.play.is_noninterleaved)
+    {
+        printf("Non-interleaved output can't be written into a file\n");
+        return -1;
+    }
+    if (ropt.play.stimulus.type != STIMULUS_NONE && ropt.play.gen)
+    {
+        printf("--stimulus and --gen can't be rendered together\n");
+        return -1;
+    }
+    if (ropt.play.mix.n_source > 0 && (ropt.play.stimulus.type != STIMULUS_NONE || ropt.play.gen))
+    {
+        printf("--mix renders instead of --stimulus or --gen\n");
+        return -1;
+    }
+    if (ropt.play.device_rate != OPT_UNSET && ropt.play.src_quality == SRC_OFF)
+    {
+        printf("--device-rate needs the resampler, not --src=off\n");
+        return -1;
+    }
+
+    signal(SIGINT, on_interrupt);
+
+    return do_render(&ropt);
+}
+
+static int loopback(int argc, char *argv[])
+{
+    optind = 1; // reset the index
+
+    const char *optstring = ":hc:i:l:r:";
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"channel", required_argument, NULL, 'c'},
+        {"input-channel", required_argument, NULL, 'i'},
+        {"latency", required_argument, NULL, 'l'},
+        {"rate", required_argument, NULL, 'r'},
+        {"frames", required_argument, NULL, 'F'},
+        {"signal", required_argument, NULL, 'g'},
+        {"order", required_argument, NULL, 'e'},
+        {"level", required_argument, NULL, 'v'},
+        {"min-snr", required_argument, NULL, 'm'},
+        {"duration", required_argument, NULL, 'x'},
+        {"report", required_argument, NULL, 's'},
+        {0,0,0,0}
+    };
+
+    struct Loopback_options lopt;
+    lopt.channel = 2;
+    lopt.loop_channel = 0;
+    lopt.latency = OPT_UNSET;
+    lopt.rate = OPT_UNSET;
+    lopt.frames_per_buffer = paFramesPerBufferUnspecified;
+    lopt.signal = PROBE_MLS;
+    lopt.order = DEFAULT_LOOP_ORDER;
+    lopt.level_db = DEFAULT_LOOP_LEVEL;
+    lopt.min_snr_db = DEFAULT_LOOP_MIN_SNR;
+    lopt.duration = 10;
+    lopt.report_interval = DEFAULT_REPORT_INTERVAL;
+
+    int val;
+    while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1)
+    {
+        switch (val)
+        {
+            case 'c':
+                lopt.channel = strtol(optarg, NULL, 0);
+                break;
+            case 'i':
+                lopt.loop_channel = strtol(optarg, NULL, 0);
+                break;
+            case 'l':
+                lopt.latency = strtod(optarg, NULL);
+                break;
+            case 'r':
+                lopt.rate = strtod(optarg, NULL);
+                break;
+            case 'F':
+                lopt.frames_per_buffer = strtoul(optarg, NULL, 0);
+                break;
+            case 'g':
+                if (!strcmp(optarg, "mls"))
+                    lopt.signal = PROBE_MLS;
+                else if (!strcmp(optarg, "impulse"))
+                    lopt.signal = PROBE_IMPULSE;
+                else
+                {
+                    printf("Unknown probe signal: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'e':
+                lopt.order = strtoul(optarg, NULL, 0);
+                if (lopt.order < LATENCY_MIN_ORDER || lopt.order > LATENCY_MAX_ORDER)
+                {
+                    printf("Order must be within %d-%d\n", LATENCY_MIN_ORDER, LATENCY_MAX_ORDER);
+                    return -1;
+                }
+                break;
+            case 'v':
+                lopt.level_db = strtod(optarg, NULL);
+                break;
+            case 'm':
+                lopt.min_snr_db = strtod(optarg, NULL);
+                break;
+            case 'x':
+                lopt.duration = strtol(optarg, NULL, 0);
+                break;
+            case 's':
+                lopt.report_interval = strtod(optarg, NULL);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            case '?':
+                printf("unknown option: %c\n", optopt);
+                return -1;
+            case ':':
+                printf("option requires an argument -- %c\n", optopt);
+                return -1;
+            default:
+                printf("will never reach here\n");
+                return -1;
+        }
+    }
+
+    int n_device = argc - optind;
+    if (n_device < 1 || n_device > 2)
+    {
+        printf("Please specify the input device index, and the output device index if it is another device!\n");
+        return -1;
+    }
+    lopt.input_idx = strtol(argv[optind], NULL, 0);
+    lopt.output_idx = n_device == 2 ? strtol(argv[optind + 1], NULL, 0) : lopt.input_idx;
+
+    PaError err = Pa_Initialize();
+    if (err != paNoError) exit_error(err, "Pa_Initialize failed");
+
+    int ret = do_loopback(&lopt);
+
+    Pa_Terminate();
+    return ret;
+}
+
+static int measure(int argc, char *argv[])
+{
+    optind = 1; // reset the index
+
+    const char *optstring = ":hc:i:l:r:";
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"channel", required_argument, NULL, 'c'},
+        {"input-channel", required_argument, NULL, 'i'},
+        {"latency", required_argument, NULL, 'l'},
+        {"rate", required_argument, NULL, 'r'},
+        {"frames", required_argument, NULL, 'F'},
+        {"stimulus", required_argument, NULL, 'A'},
+        {"start", required_argument, NULL, 'H'},
+        {"stop", required_argument, NULL, 'M'},
+        {"period", required_argument, NULL, 'R'},
+        {"steps", required_argument, NULL, 'U'},
+        {"level", required_argument, NULL, 'V'},
+        {"delay", required_argument, NULL, 'd'},
+        {"segment", required_argument, NULL, 'e'},
+        {"duration", required_argument, NULL, 'x'},
+        {"report", required_argument, NULL, 's'},
+        {"out", required_argument, NULL, 'o'},
+        {0,0,0,0}
+    };
+
+    struct Measure_options mopt;
+    mopt.channel = 2;
+    mopt.loop_channel = 0;
+    mopt.latency = OPT_UNSET;
+    mopt.rate = OPT_UNSET;
+    mopt.frames_per_buffer = paFramesPerBufferUnspecified;
+    stimulus_config_default(&mopt.stimulus, STIMULUS_SWEEP);
+    mopt.delay = 0;
+    mopt.segment = DEFAULT_MEASURE_SEGMENT;
+    mopt.duration = OPT_UNSET;
+    mopt.report_interval = DEFAULT_REPORT_INTERVAL;
+    mopt.out = NULL;
+
+    int val;
+    while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1)
+    {
+        int is_stimulus = stimulus_option(val, optarg, &mopt.stimulus);
+        if (is_stimulus < 0)
+            return -1;
+        if (is_stimulus == 0)
+            continue;
+
+        switch (val)
+        {
+            case 'c':
+                mopt.channel = strtol(optarg, NULL, 0);
+                break;
+            case 'i':
+                mopt.loop_channel = strtol(optarg, NULL, 0);
+                break;
+            case 'l':
+                mopt.latency = strtod(optarg, NULL);
+                break;
+            case 'r':
+                mopt.rate = strtod(optarg, NULL);
+                break;
+            case 'F':
+                mopt.frames_per_buffer = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                mopt.delay = strtoul(optarg, NULL, 0);
+                break;
+            case 'e':
+                mopt.segment = strtoul(optarg, NULL, 0);
+                break;
+            case 'x':
+                mopt.duration = strtod(optarg, NULL);
+                break;
+            case 's':
+                mopt.report_interval = strtod(optarg, NULL);
+                break;
+            case 'o':
+                mopt.out = strdup(optarg);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            case '?':
+                printf("unknown option: %c\n", optopt);
+                return -1;
+            case ':':
+                printf("option requires an argument -- %c\n", optopt);
+                return -1;
+            default:
+                printf("will never reach here\n");
+                return -1;
+        }
+    }
 
-static int do_play(PaDeviceIndex device_idx, int input_channel, int output_channel, PaTime input_latency, 
-                   PaTime output_latency, const char *format, int is_noninterleaved, double rate, int is_dry,
-                   int freq, unsigned duration)
-{
-    // init lib
-    Pa_Initialize();
+    int n_device = argc - optind;
+    if (n_device < 1 || n_device > 2)
+    {
+        printf("Please specify the input device index, and the output device index if it is another device!\n");
+        return -1;
+    }
+    mopt.input_idx = strtol(argv[optind], NULL, 0);
+    mopt.output_idx = n_device == 2 ? strtol(argv[optind + 1], NULL, 0) : mopt.input_idx;
 
+    PaError err = Pa_Initialize();
+    if (err != paNoError) exit_error(err, "Pa_Initialize failed");
 
-    // construct PaSampleFormat
-    PaSampleFormat sample_format = format_name_to_macro(format);
-    if (is_noninterleaved)
-        sample_format |= paNonInterleaved;
+    int ret = do_measure(&mopt);
 
-    // construct stream parameter
-    PaStreamParameters expect_input_param;
-    PaStreamParameters expect_output_param;
+    Pa_Terminate();
+    return ret;
+}
 
-    expect_input_param.device = device_idx;
-    expect_input_param.channelCount = input_channel;
-    expect_input_param.sampleFormat = sample_format;
-    expect_input_param.suggestedLatency = input_latency;
-    expect_input_param.hostApiSpecificStreamInfo = NULL;
+static int mixbench(int argc, char *argv[])
+{
+    optind = 1; // reset the index
 
-    expect_output_param.device = device_idx;
-    expect_output_param.channelCount = output_channel;
-    expect_output_param.sampleFormat = sample_format;
-    expect_output_param.suggestedLatency = output_latency;
-    expect_output_param.hostApiSpecificStreamInfo = NULL;
+    const char *optstring = ":hc:f:r:";
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"channel", required_argument, NULL, 'c'},
+        {"format", required_argument, NULL, 'f'},
+        {"rate", required_argument, NULL, 'r'},
+        {"sources", required_argument, NULL, 'S'},
+        {"frames", required_argument, NULL, 'F'},
+        {"simd", required_argument, NULL, 'u'},
+        {"knee", required_argument, NULL, 'K'},
+        {0,0,0,0}
+    };
 
-    // check if parameter given is OK to open stream
-    PaError err;
+    struct Mixbench_options bopt;
+    bopt.sources = DEFAULT_MIXBENCH_SOURCES;
+    bopt.channels = DEFAULT_MIXBENCH_CHANNELS;
+    bopt.format = "f32";
+    bopt.rate = 48000;
+    bopt.frames = DEFAULT_RENDER_FRAMES;
+    bopt.simd_level = simd_detect();
+    bopt.knee_db = MIX_DEFAULT_KNEE_DB;
 
-    if (is_output_stream)
+    int val;
+    while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1)
     {
-        printf("Open this stream as output with following parameters:\n");
-        printf("* channel       : %d\n", expect_output_param.channelCount);
-        printf("* format        : %s\n", format);
-        printf("* is_interleaved: %s\n", is_noninterleaved?"no":"yes");
-        printf("* latency (sec) : %f\n", expect_output_param.suggestedLatency);
-        printf("* rate (Hz)     : %f\n", rate);
-
-        err = Pa_IsFormatSupported(NULL, &expect_output_param, rate);
-        if (err != paFormatIsSupported)
+        switch (val)
         {
-            printf("\nNot supported: %s\n", Pa_GetErrorText(err));
-            return -1;
+            case 'c':
+                bopt.channels = strdup(optarg);
+                break;
+            case 'f':
+                bopt.format = strdup(optarg);
+                break;
+            case 'r':
+                bopt.rate = strtod(optarg, NULL);
+                break;
+            case 'S':
+                bopt.sources = strdup(optarg);
+                break;
+            case 'F':
+                bopt.frames = strtoull(optarg, NULL, 0);
+                break;
+            case 'u':
+            {
+                enum Simd_level best = simd_detect();
+                if (simd_name_to_level(optarg, &bopt.simd_level) != 0)
+                {
+                    printf("Unknown SIMD level: %s\n", optarg);
+                    return -1;
+                }
+                if (bopt.simd_level != SIMD_SCALAR && (bopt.simd_level > best || (bopt.simd_level == SIMD_NEON) != (best == SIMD_NEON)))
+                {
+                    printf("SIMD level %s is not supported on this CPU\n", optarg);
+                    return -1;
+                }
+                break;
+            }
+            case 'K':
+                bopt.knee_db = strtod(optarg, NULL);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            case '?':
+                printf("unknown option: %c\n", optopt);
+                return -1;
+            case ':':
+                printf("option requires an argument -- %c\n", optopt);
+                return -1;
+            default:
+                printf("will never reach here\n");
+                return -1;
         }
-        else
-            printf("\nSupported\n");
     }
-    else
-    {
-        printf("Open this stream as input with following parameters:\n");
-        printf("* channel       : %d\n", expect_input_param.channelCount);
-        printf("* format        : %s\n", format);
-        printf("* is_interleaved: %s\n", is_noninterleaved?"no":"yes");
-        printf("* latency (sec) : %f\n", expect_input_param.suggestedLatency);
-        printf("* rate (Hz)     : %f\n", rate);
 
-        err = Pa_IsFormatSupported(NULL, &expect_input_param, rate);
-        if (err != paFormatIsSupported)
-        {
-            printf("\nNot supported: %s\n", Pa_GetErrorText(err));
-            return -1;
-        }
-        else
-            printf("\nSupported\n");
-    }
+    signal(SIGINT, on_interrupt);
 
-    /* return if this is a dry run */
-    if (is_dry)
-    {
-        // terminate
-        Pa_Terminate();
+    return do_mixbench(&bopt);
+}
 
-        return 0;
-    }
+static int renderbench(int argc, char *argv[])
+{
+    optind = 1; // reset the index
 
-    // if open to play, calculate the step of sine wave
-    struct User_data user_data;
-    user_data.step = 2*M_PI*freq/rate;
-    user_data.format = sample_format;
-    user_data.input_channel = input_channel;
-    user_data.output_channel = output_channel;
-    
-    // open stream
-    PaStream *stream;
-    err = Pa_OpenStream(&stream,
-                        (is_output_stream? NULL:&expect_input_param),
-                        (is_output_stream? &expect_output_param:NULL),
-                        rate,
-                        paFramesPerBufferUnspecified, // Let PA to choose
-                        paNoFlag,
-                        cb_play,
-                        &user_data);
-    if (err != paNoError) exit_error(err, "Pa_OpenDefaultStream failed");
+    const char *optstring = ":hc:f:r:";
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"channel", required_argument, NULL, 'c'},
+        {"format", required_argument, NULL, 'f'},
+        {"rate", required_argument, NULL, 'r'},
+        {"freq", required_argument, NULL, 'y'},
+        {"osc", required_argument, NULL, 'w'},
+        {"simd", required_argument, NULL, 'u'},
+        {"frames", required_argument, NULL, 'F'},
+        {"buffer", required_argument, NULL, 'b'},
+        {0,0,0,0}
+    };
 
-    // start stream
-    err = Pa_StartStream(stream);
-    if (err != paNoError) exit_error(err, "Pa_StartStream failed");
+    struct Render_options ropt;
+    render_options_default(&ropt);
+    ropt.formats = DEFAULT_RENDERBENCH_FORMATS;
+    ropt.channels = DEFAULT_RENDERBENCH_CHANNELS;
 
-    // Sleep some time or forever
-    if (duration == 0)
+    int val;
+    while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1)
     {
-        while (1)
+        switch (val)
         {
-            Pa_Sleep(1000);
+            case 'c':
+                ropt.channels = strdup(optarg);
+                break;
+            case 'f':
+                ropt.formats = strdup(optarg);
+                break;
+            case 'r':
+                ropt.play.rate = strtod(optarg, NULL);
+                break;
+            case 'y':
+                ropt.play.freq = strtol(optarg, NULL, 0);
+                break;
+            case 'w':
+                if (osc_name_to_type(optarg, &ropt.play.osc_type) != 0)
+                {
+                    printf("Unknown oscillator: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'u':
+            {
+                enum Simd_level best = simd_detect();
+                if (simd_name_to_level(optarg, &ropt.play.simd_level) != 0)
+                {
+                    printf("Unknown SIMD level: %s\n", optarg);
+                    return -1;
+                }
+                if (ropt.play.simd_level != SIMD_SCALAR && (ropt.play.simd_level > best || (ropt.play.simd_level == SIMD_NEON) != (best == SIMD_NEON)))
+                {
+                    printf("SIMD level %s is not supported on this CPU\n", optarg);
+                    return -1;
+                }
+                break;
+            }
+            case 'F':
+                ropt.frames = strtoull(optarg, NULL, 0);
+                break;
+            case 'b':
+                ropt.buffer_frames = strtoul(optarg, NULL, 0);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            case '?':
+                printf("unknown option: %c\n", optopt);
+                return -1;
+            case ':':
+                printf("option requires an argument -- %c\n", optopt);
+                return -1;
+            default:
+                printf("will never reach here\n");
+                return -1;
         }
     }
-    else
-        Pa_Sleep(1000 * duration);
-
-    // stop/abort stream
-    err = Pa_StopStream(stream);
-    if (err != paNoError) exit_error(err, "Pa_StopStream failed");
-
-    // close stream
-    err = Pa_CloseStream(stream);
-    if (err != paNoError) exit_error(err, "Pa_CloseStream failed");
+    if (ropt.buffer_frames == 0 || ropt.play.rate <= 0)
+    {
+        printf("The buffer and the rate must be above 0\n");
+        return -1;
+    }
 
-    // terminate
-    Pa_Terminate();
+    signal(SIGINT, on_interrupt);
 
-    return 0;
+    return do_renderbench(&ropt);
 }
 
-/************************
- * Sub-command functions
- * *********************/
-
-static int traverse(int argc, char *argv[])
+static int osctest(int argc, char *argv[])
 {
-
     optind = 1; // reset the index
 
     const char *optstring = ":h";
     const struct option longopts[] = {
         {"help", no_argument, NULL, 'h'},
+        {"table-size", required_argument, NULL, 'v'},
+        {"max-thdn", required_argument, NULL, 'T'},
         {0,0,0,0}
     };
 
+    unsigned table_size = DEFAULT_TABLE_SIZE;
+    double max_thdn_db = DEFAULT_OSCTEST_MAX_THDN;
+
     int val;
     while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1)
     {
         switch (val)
         {
+            case 'v':
+                table_size = strtoul(optarg, NULL, 0);
+                break;
+            case 'T':
+                max_thdn_db = strtod(optarg, NULL);
+                break;
             case 'h':
                 usage(argv[0]);
                 return 0;
@@ -474,37 +5423,64 @@ static int traverse(int argc, char *argv[])
         }
     }
 
-    do_traverse();
-
-    return 0;
+    return do_osctest(table_size, max_thdn_db);
 }
 
-static int play(int argc, char *argv[])
+static int shmtest(int argc, char *argv[])
 {
-    
     optind = 1; // reset the index
-    int val;
 
-    const char *optstring = ":hc:f:l:nr:";
+    const char *optstring = ":hc:r:";
     const struct option longopts[] = {
         {"help", no_argument, NULL, 'h'},
         {"channel", required_argument, NULL, 'c'},
-        {"format", required_argument, NULL, 'f'},
-        {"latency", required_argument, NULL, 'l'},
-        {"noninterleaved", no_argument, NULL, 'n'},
         {"rate", required_argument, NULL, 'r'},
-        {"dry", no_argument, NULL, 'z'},
-        {"freq", required_argument, NULL, 'y'},
-        {"duration", required_argument, NULL, 'x'},
+        {"frames", required_argument, NULL, 'F'},
+        {"capacity", required_argument, NULL, 'C'},
+        {"buffer", required_argument, NULL, 'b'},
+        {"chunk", required_argument, NULL, 'K'},
+        {"name", required_argument, NULL, 'N'},
         {0,0,0,0}
     };
 
-    /* Step 1. parse option for the first time to just get the device index */
+    char name[64];
+    snprintf(name, sizeof(name), "pacap-shmtest-%d", (int)getpid());
 
-    while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1) 
+    struct Shm_test_config config;
+    config.name = name;
+    config.channel = 8;
+    config.frames = DEFAULT_SHMTEST_FRAMES;
+    config.capacity = DEFAULT_SHMTEST_CAPACITY;
+    config.block_frames = BLOCK_FRAMES;
+    config.chunk_frames = DEFAULT_SHMTEST_CHUNK;
+    config.rate = 0;
+
+    int val;
+    while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1)
     {
         switch (val)
         {
+            case 'c':
+                config.channel = strtol(optarg, NULL, 0);
+                break;
+            case 'r':
+                config.rate = strtod(optarg, NULL);
+                break;
+            case 'F':
+                config.frames = strtoull(optarg, NULL, 0);
+                break;
+            case 'C':
+                config.capacity = strtoull(optarg, NULL, 0);
+                break;
+            case 'b':
+                config.block_frames = strtoul(optarg, NULL, 0);
+                break;
+            case 'K':
+                config.chunk_frames = strtoul(optarg, NULL, 0);
+                break;
+            case 'N':
+                config.name = strdup(optarg);
+                break;
             case 'h':
                 usage(argv[0]);
                 return 0;
@@ -515,87 +5491,163 @@ static int play(int argc, char *argv[])
                 printf("option requires an argument -- %c\n", optopt);
                 return -1;
             default:
-                // not care other options
-                break;
+                printf("will never reach here\n");
+                return -1;
         }
     }
-    // now optind points to the first non-option argv-element or ending '\0' of argv
-    switch (argc-optind)
-    {
-        case 0:
-            // no non-option argv-element specified
-            printf("Please choose specify device index to check!\n");
-            return -1;
-        case 1:
-            // good case
-            break;
-        default:
-            printf("Warning: multiple device indexes are specified, only the first one is taken\n");
-            break;
-    }
-    int arg_device_idx = strtol(argv[optind], NULL, 0);
 
-    /* Step 2. set expected device parameter to device default parameters */
+    printf("%llu frames of %d channels through ring %s of %llu frames, %lu per callback, %s\n",
+           (unsigned long long)config.frames, config.channel, config.name, (unsigned long long)config.capacity,
+           config.block_frames, config.rate > 0 ? "paced" : "unpaced");
 
-    PaError err;
+    struct Shm_test_result result;
+    int ret = shm_test_run(&config, &result);
 
-    // init lib
-    Pa_Initialize();
+    double bytes = (double)result.frames_read * config.channel * sizeof(int32_t);
+    printf("%-20s: %llu of %llu, %llu wrong samples", "frames read", (unsigned long long)result.frames_read,
+           (unsigned long long)config.frames, (unsigned long long)result.mismatches);
+    if (result.mismatches)
+        printf(" (first in frame %llu)", (unsigned long long)result.first_mismatch);
+    printf("\n");
+    printf("%-20s: %.3f s, %.1f Mframes/s, %.0f MB/s, %.0fx realtime at 48 kHz\n", "throughput", result.seconds,
+           result.seconds > 0 ? result.frames_read / result.seconds * 1e-6 : 0.0,
+           result.seconds > 0 ? bytes / result.seconds * 1e-6 : 0.0,
+           result.seconds > 0 ? result.frames_read / result.seconds / 48000 : 0.0);
+    printf("%-20s: %llu of %llu (%llu frames of silence)\n", "consumer underruns",
+           (unsigned long long)result.underruns, (unsigned long long)result.blocks,
+           (unsigned long long)result.frames_starved);
+    printf("%-20s: %llu\n", "producer ring full", (unsigned long long)result.producer_waits);
+    printf("%s\n", ret == 0 ? "PASS" : "FAIL");
+    return ret;
+}
 
-    const PaDeviceInfo *deviceInfo = Pa_GetDeviceInfo(arg_device_idx);
-    if (deviceInfo == 0)
+static int convtest(int argc, char *argv[])
+{
+    optind = 1; // reset the index
+
+    const char *optstring = ":hc:";
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"channel", required_argument, NULL, 'c'},
+        {"frames", required_argument, NULL, 'F'},
+        {"seed", required_argument, NULL, 'S'},
+        {0,0,0,0}
+    };
+
+    struct Conv_test_config config;
+    config.max_channel = DEFAULT_CONVTEST_CHANNEL;
+    config.max_frames = DEFAULT_CONVTEST_FRAMES;
+    config.seed = 1;
+
+    int val;
+    while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1)
     {
-        printf("Failed to get device info\n");
-        return -1;
+        switch (val)
+        {
+            case 'c':
+                config.max_channel = strtol(optarg, NULL, 0);
+                break;
+            case 'F':
+                config.max_frames = strtoul(optarg, NULL, 0);
+                break;
+            case 'S':
+                config.seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            case '?':
+                printf("unknown option: %c\n", optopt);
+                return -1;
+            case ':':
+                printf("option requires an argument -- %c\n", optopt);
+                return -1;
+            default:
+                printf("will never reach here\n");
+                return -1;
+        }
     }
 
-    int arg_input_channel = deviceInfo->maxInputChannels;
-    int arg_output_channel = deviceInfo->maxOutputChannels;
-    double arg_input_latency = deviceInfo->defaultLowInputLatency;
-    double arg_output_latency = deviceInfo->defaultLowOutputLatency;
-    double arg_rate = deviceInfo->defaultSampleRate;
+    printf("SIMD kernels against the scalar ones, 1-%d channels, up to %lu frames, best level here %s\n\n",
+           config.max_channel, config.max_frames, simd_level_to_name(simd_detect()));
 
-    // other parameters are not available from device info, set them to some sane defaults
-    char *arg_format = "f32";
-    int arg_is_noninterleaved = 0; // by default PA pass data as a single buffer with all channels interleaved 
-    int arg_is_dry = 0; // play/record by default
-    int arg_freq = 1000; // play 1000Hz sine wave by default
-    unsigned arg_duration = 5; // play/record 5 seconds by default
+    struct Conv_test_result result;
+    int ret = conv_test_simd(&config, &result);
+    if (conv_test_i24(&config, &result) != 0)
+        ret = -1;
 
-    // uninit lib
-    Pa_Terminate();
+    printf("\n%-20s: %d\n", "kernels", result.n_kernel);
+    printf("%-20s: %llu, %llu differ, %llu wrote past their frames\n", "cases",
+           (unsigned long long)result.cases, (unsigned long long)result.mismatches,
+           (unsigned long long)result.overruns);
+    printf("%-20s: %llu, %llu differ from the reference, %llu wrote past their frames\n", "i24 cases",
+           (unsigned long long)result.i24_cases, (unsigned long long)result.i24_mismatches,
+           (unsigned long long)result.i24_overruns);
+    printf("%-20s: %.6f steps of 24 bits at most\n", "i24 round trip", result.i24_max_error);
+    printf("%s\n", ret == 0 ? "PASS" : "FAIL");
+    return ret;
+}
+
+static int prefetchtest(int argc, char *argv[])
+{
+    optind = 1; // reset the index
+
+    const char *optstring = ":hc:r:";
+    const struct option longopts[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"channel", required_argument, NULL, 'c'},
+        {"rate", required_argument, NULL, 'r'},
+        {"duration", required_argument, NULL, 'x'},
+        {"prefetch", required_argument, NULL, 'P'},
+        {"chunk", required_argument, NULL, 'K'},
+        {"io-delay", required_argument, NULL, 'D'},
+        {"buffer", required_argument, NULL, 'b'},
+        {"path", required_argument, NULL, 'N'},
+        {0,0,0,0}
+    };
 
+    char path[256];
+    const char *tmpdir = getenv("TMPDIR");
+    snprintf(path, sizeof(path), "%s/pacap-prefetchtest-%d.wav", tmpdir && *tmpdir ? tmpdir : "/tmp", (int)getpid());
 
-    /* Step 3. Re-process options to set expected device parameter from command line on top of default value */
+    struct Prefetch_test_config config;
+    double seconds = DEFAULT_PREFETCHTEST_SECONDS;
+    config.path = path;
+    config.channel = 2;
+    config.rate = 48000;
+    config.depth = DEFAULT_PREFETCHTEST_DEPTH;
+    config.chunk_frames = DEFAULT_CHUNK_FRAMES;
+    config.io_delay_ms = DEFAULT_PREFETCHTEST_DELAY_MS;
+    config.block_frames = BLOCK_FRAMES;
 
-    optind = 1;
+    int val;
     while ((val = getopt_long(argc, argv, optstring, longopts, NULL)) != -1)
     {
         switch (val)
         {
             case 'c':
-                arg_input_channel = arg_output_channel = strtol(optarg, NULL, 0);
+                config.channel = strtol(optarg, NULL, 0);
                 break;
-            case 'f':
-                arg_format = strdup(optarg);
+            case 'r':
+                config.rate = strtod(optarg, NULL);
                 break;
-            case 'l':
-                arg_input_latency = arg_output_latency = strtod(optarg, NULL);
+            case 'x':
+                seconds = strtod(optarg, NULL);
                 break;
-            case 'n':
-                arg_is_noninterleaved = 1;
+            case 'P':
+                config.depth = strtoul(optarg, NULL, 0);
                 break;
-            case 'r':
-                arg_rate = strtod(optarg, NULL);
+            case 'K':
+                config.chunk_frames = strtoul(optarg, NULL, 0);
                 break;
-            case 'z':
-                arg_is_dry = 1;
+            case 'D':
+                config.io_delay_ms = strtoul(optarg, NULL, 0);
                 break;
-            case 'y':
-                arg_freq = strtol(optarg, NULL, 0);
+            case 'b':
+                config.block_frames = strtoul(optarg, NULL, 0);
                 break;
-            case 'x':
-                arg_duration = strtol(optarg, NULL, 0);
+            case 'N':
+                config.path = strdup(optarg);
                 break;
             case 'h':
                 usage(argv[0]);
@@ -611,18 +5663,30 @@ static int play(int argc, char *argv[])
                 return -1;
         }
     }
+    config.frames = (uint64_t)(seconds * config.rate);
 
+    // the reader keeps up if a chunk is read before one plays, the pool covers what a read takes meanwhile
+    double chunk_ms = 1000.0 * config.chunk_frames / config.rate;
+    printf("%llu frames of %d channels from %s, %u chunks of %lu frames (%.1f ms each, %.1f ms in the pool),\n",
+           (unsigned long long)config.frames, config.channel, config.path, config.depth, config.chunk_frames,
+           chunk_ms, chunk_ms * config.depth);
+    printf("each read delayed by %u ms, %lu frames per callback\n", config.io_delay_ms, config.block_frames);
+    if (config.io_delay_ms >= chunk_ms)
+        printf("The delay is longer than a chunk plays, the reader can't keep up and the pool will run dry\n");
 
-    return do_play(arg_device_idx, arg_input_channel, arg_output_channel, arg_input_latency, arg_output_latency,
-                   arg_format, arg_is_noninterleaved, arg_rate, arg_is_dry, arg_freq, arg_duration);
-}
-
-static int record(int argc, char *argv[])
-{
-    // change global flag to indicate this stream is opended as input
-    is_output_stream = 0;
+    struct Prefetch_test_result result;
+    int ret = prefetch_test_run(&config, &result);
 
-    return play(argc, argv);
+    printf("%-20s: %llu of %llu, %llu wrong samples", "frames read", (unsigned long long)result.frames_read,
+           (unsigned long long)config.frames, (unsigned long long)result.mismatches);
+    if (result.mismatches)
+        printf(" (first in frame %llu)", (unsigned long long)result.first_mismatch);
+    printf("\n");
+    printf("%-20s: %lu (%lu frames of silence)\n", "starvations", result.starvations, result.frames_starved);
+    printf("%-20s: %lu, fewest queued %u of %u\n", "chunks read", result.chunks_read, result.min_queued, config.depth);
+    printf("%-20s: %.3f s\n", "played in", result.seconds);
+    printf("%s\n", ret == 0 ? "PASS" : "FAIL");
+    return ret;
 }
 
 /*************
@@ -633,7 +5697,10 @@ int main(int argc, char *argv[])
 {
     opterr = 0; // make getopt quiet
 
-    int ret;
+    int ret = 0;
+
+    // debug build only: check the callbacks for RT-unsafe calls until exit
+    rtcheck_init();
 
     /* store program name in global variable */
     program_name = strdup(argv[0]);
@@ -696,5 +5763,9 @@ int main(int argc, char *argv[])
     /* free allocated memeory before leave */
     free(program_name);
 
-    return 0;
+    // any RT-unsafe call in a callback fails the run
+    if (rtcheck_report() != 0)
+        ret = -1;
+
+    return ret == 0 ? 0 : 1;
 }
@@ -0,0 +1,199 @@
+/*************************************************************************
+ Description: Streamed file reader, see prefetch.h.
+
+              `head` and `tail` count chunks and are never wrapped, the slot
+              of a chunk in the pool is `index % depth`. The reader fills
+              the slot at `head` only while `head - tail < depth` and then
+              publishes it with a release store of `head`, which the
+              callback loads with acquire; the same the other way around
+              for `tail`, so a slot is never read and written at once.
+ ************************************************************************/
+
+#define _XOPEN_SOURCE 700 // pread, posix_fadvise, posix_memalign
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "prefetch.h"
+
+/* how often the reader checks for a free chunk, at most */
+#define READER_POLL_MAX_MS 10
+
+int prefetch_open(struct Prefetch *prefetch, const char *path, uint64_t data_offset, uint64_t data_bytes,
+                  size_t bytes_per_frame, double rate, unsigned depth, unsigned long chunk_frames,
+                  unsigned io_delay_ms)
+{
+    memset(prefetch, 0, sizeof(*prefetch));
+    prefetch->data_offset = data_offset;
+    prefetch->data_bytes = data_bytes;
+    prefetch->bytes_per_frame = bytes_per_frame;
+    prefetch->rate = rate;
+    prefetch->depth = depth;
+    prefetch->chunk_frames = chunk_frames;
+    prefetch->io_delay_ms = io_delay_ms;
+
+    if (depth == 0 || chunk_frames == 0)
+    {
+        printf("Prefetch needs at least one chunk of at least one frame\n");
+        return -1;
+    }
+
+    size_t chunk_bytes = chunk_frames * bytes_per_frame;
+    prefetch->chunk_stride = (chunk_bytes + PREFETCH_ALIGN - 1) & ~(size_t)(PREFETCH_ALIGN - 1);
+
+    void *pool = NULL;
+    if (posix_memalign(&pool, PREFETCH_ALIGN, prefetch->chunk_stride * depth) == 0)
+        prefetch->pool = pool;
+    prefetch->chunk_length = calloc(depth, sizeof(*prefetch->chunk_length));
+    if (prefetch->pool == NULL || prefetch->chunk_length == NULL)
+    {
+        printf("Failed to allocate %u prefetch chunks of %zu bytes\n", depth, chunk_bytes);
+        free(prefetch->pool);
+        free(prefetch->chunk_length);
+        return -1;
+    }
+    // touch every page now so that the audio thread never page faults on it
+    memset(prefetch->pool, 0, prefetch->chunk_stride * depth);
+
+    prefetch->fd = open(path, O_RDONLY);
+    if (prefetch->fd < 0)
+    {
+        perror(path);
+        free(prefetch->pool);
+        free(prefetch->chunk_length);
+        return -1;
+    }
+    // the kernel may read ahead on its own as well, and drop what's been played
+    posix_fadvise(prefetch->fd, data_offset, data_bytes, POSIX_FADV_SEQUENTIAL);
+
+    atomic_init(&prefetch->head, 0);
+    atomic_init(&prefetch->tail, 0);
+    atomic_init(&prefetch->min_queued, depth);
+    return 0;
+}
+
+// read the next chunk of the file into a free slot, return 1 if one was queued
+static int read_chunk(struct Prefetch *prefetch)
+{
+    if (atomic_load_explicit(&prefetch->is_eof, memory_order_relaxed))
+        return 0;
+
+    size_t head = atomic_load_explicit(&prefetch->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&prefetch->tail, memory_order_acquire);
+    if (head - tail == prefetch->depth)
+        return 0;
+
+    if (prefetch->io_delay_ms)
+    {
+        struct timespec delay = {prefetch->io_delay_ms / 1000, (prefetch->io_delay_ms % 1000) * 1000000L};
+        nanosleep(&delay, NULL);
+    }
+
+    unsigned i = head % prefetch->depth;
+    unsigned char *chunk = prefetch->pool + i * prefetch->chunk_stride;
+    size_t want = prefetch->chunk_frames * prefetch->bytes_per_frame;
+    if (want > prefetch->data_bytes - prefetch->read_pos)
+        want = prefetch->data_bytes - prefetch->read_pos;
+
+    // pread may return less than asked, e.g. on a pipe or when interrupted
+    size_t got = 0;
+    while (got < want)
+    {
+        ssize_t n = pread(prefetch->fd, chunk + got, want - got, prefetch->data_offset + prefetch->read_pos + got);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            atomic_store(&prefetch->read_error, 1);
+            break;
+        }
+        got += n;
+    }
+    got -= got % prefetch->bytes_per_frame;
+
+    if (got > 0)
+    {
+        prefetch->chunk_length[i] = got / prefetch->bytes_per_frame;
+        prefetch->read_pos += got;
+        atomic_store_explicit(&prefetch->head, head + 1, memory_order_release);
+        atomic_fetch_add_explicit(&prefetch->chunks_read, 1, memory_order_relaxed);
+    }
+
+    // on a read error the file ends at the last full chunk
+    if (prefetch->read_pos == prefetch->data_bytes || atomic_load(&prefetch->read_error))
+        atomic_store_explicit(&prefetch->is_eof, 1, memory_order_release);
+    return got > 0;
+}
+
+static void *reader_main(void *arg)
+{
+    struct Prefetch *prefetch = arg;
+
+    // poll a few times per chunk, a chunk is played in chunk_frames / rate seconds
+    long poll_ns = prefetch->chunk_frames / prefetch->rate / 4 * 1e9;
+    if (poll_ns > READER_POLL_MAX_MS * 1000000L)
+        poll_ns = READER_POLL_MAX_MS * 1000000L;
+    if (poll_ns < 1000000L)
+        poll_ns = 1000000L;
+    struct timespec poll = {0, poll_ns};
+
+    while (!atomic_load(&prefetch->is_stopping))
+    {
+        // read as long as there are free chunks, then wait for the callback to give one back
+        if (!read_chunk(prefetch))
+            nanosleep(&poll, NULL);
+    }
+    return NULL;
+}
+
+int prefetch_start(struct Prefetch *prefetch)
+{
+    // the first callbacks must not wait for the reader
+    while (read_chunk(prefetch))
+        ;
+    if (prefetch_read_error(prefetch))
+        printf("Failed to read the file\n");
+
+    if (pthread_create(&prefetch->reader, NULL, reader_main, prefetch) != 0)
+    {
+        printf("Failed to create prefetch thread\n");
+        return -1;
+    }
+    prefetch->has_reader = 1;
+    return 0;
+}
+
+void prefetch_get_stats(struct Prefetch *prefetch, struct Prefetch_stats *stats)
+{
+    stats->starvations = atomic_load(&prefetch->starvations);
+    stats->frames_starved = atomic_load(&prefetch->frames_starved);
+    stats->chunks_read = atomic_load(&prefetch->chunks_read);
+    stats->min_queued = atomic_load(&prefetch->min_queued);
+}
+
+int prefetch_read_error(struct Prefetch *prefetch)
+{
+    return atomic_load(&prefetch->read_error);
+}
+
+void prefetch_close(struct Prefetch *prefetch)
+{
+    if (prefetch->has_reader)
+    {
+        atomic_store(&prefetch->is_stopping, 1);
+        pthread_join(prefetch->reader, NULL);
+        prefetch->has_reader = 0;
+    }
+    if (prefetch->pool)
+    {
+        close(prefetch->fd);
+        free(prefetch->pool);
+        free(prefetch->chunk_length);
+        prefetch->pool = NULL;
+    }
+}
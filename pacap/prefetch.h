@@ -0,0 +1,143 @@
+/*************************************************************************
+ Description: Streamed file reader for playback from slow storage.
+
+              A reader thread fills a pool of pre-allocated, page aligned
+              chunks with pread() ahead of the play position. Chunks are
+              handed to the audio callback in order through a lock-free
+              single-producer/single-consumer queue of chunk indexes: the
+              reader publishes a chunk only once it is completely read, the
+              callback gives it back once every frame of it is played.
+
+              The callback never blocks and never touches the file. If the
+              queue is empty before the end of file the callback starves:
+              it plays silence and the event is counted.
+
+              Unlike the memory mapped source only `depth` chunks are ever
+              resident, so files larger than RAM (or the address space) can
+              be played.
+ ************************************************************************/
+
+#ifndef PACAP_PREFETCH_H
+#define PACAP_PREFETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* chunks start on this boundary, so they could be read with O_DIRECT as well */
+#define PREFETCH_ALIGN 4096
+
+struct Prefetch_stats
+{
+    unsigned long starvations;      // callbacks which found no chunk before end of file
+    unsigned long frames_starved;   // frames played as silence because of them
+    unsigned long chunks_read;
+    unsigned min_queued;            // fewest full chunks the callback has seen queued before end of file
+};
+
+struct Prefetch
+{
+    int fd;
+    uint64_t data_offset;       // in the file
+    uint64_t data_bytes;
+    size_t bytes_per_frame;
+    double rate;
+
+    unsigned depth;             // chunks in the pool
+    unsigned long chunk_frames;
+    size_t chunk_stride;        // bytes between chunks, multiple of PREFETCH_ALIGN
+    unsigned char *pool;
+    unsigned long *chunk_length; // frames in each chunk, the last one of the file may be short
+
+    /* free running chunk counts, each on its own cache line to avoid false sharing */
+    _Alignas(64) atomic_size_t head;    // chunks read, advanced by the reader
+    _Alignas(64) atomic_size_t tail;    // chunks played, advanced by the callback
+    unsigned long offset;               // frames played of the chunk at `tail`, callback only
+
+    /* reader only */
+    uint64_t read_pos;          // bytes of data read so far
+    unsigned io_delay_ms;       // artificial delay before each read, to test slow storage
+    pthread_t reader;
+    int has_reader;
+    atomic_int is_stopping;
+    atomic_int is_eof;          // every chunk of the file is queued
+    atomic_int read_error;
+    atomic_ulong chunks_read;
+
+    /* written by the callback */
+    atomic_ulong starvations;
+    atomic_ulong frames_starved;
+    atomic_uint min_queued;
+};
+
+/* open the file at `path` for streamed reading of `data_bytes` from `data_offset` and allocate
+ * (and prefault) `depth` chunks of `chunk_frames` frames. return 0 on success */
+int prefetch_open(struct Prefetch *prefetch, const char *path, uint64_t data_offset, uint64_t data_bytes,
+                  size_t bytes_per_frame, double rate, unsigned depth, unsigned long chunk_frames,
+                  unsigned io_delay_ms);
+
+/* fill the whole pool, then start the reader thread. return 0 on success */
+int prefetch_start(struct Prefetch *prefetch);
+
+/* called from the audio callback: return the unplayed frames (at most `*frames`, updated to
+ * what's available) of the oldest full chunk, NULL if there is none. Call prefetch_advance()
+ * once consumed */
+static inline const void *prefetch_peek(struct Prefetch *prefetch, unsigned long *frames)
+{
+    size_t tail = atomic_load_explicit(&prefetch->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&prefetch->head, memory_order_acquire);
+    if (head == tail)
+        return NULL;
+
+    // the queue drains at the end of file anyway, only lows before it tell how close to starving it got
+    unsigned queued = head - tail;
+    if (queued < atomic_load_explicit(&prefetch->min_queued, memory_order_relaxed) &&
+        !atomic_load_explicit(&prefetch->is_eof, memory_order_relaxed))
+        atomic_store_explicit(&prefetch->min_queued, queued, memory_order_relaxed);
+
+    unsigned i = tail % prefetch->depth;
+    unsigned long left = prefetch->chunk_length[i] - prefetch->offset;
+    if (*frames > left)
+        *frames = left;
+    return prefetch->pool + i * prefetch->chunk_stride + prefetch->offset * prefetch->bytes_per_frame;
+}
+
+// called from the audio callback, gives a chunk back to the reader once it is played
+static inline void prefetch_advance(struct Prefetch *prefetch, unsigned long frames)
+{
+    size_t tail = atomic_load_explicit(&prefetch->tail, memory_order_relaxed);
+    prefetch->offset += frames;
+    if (prefetch->offset == prefetch->chunk_length[tail % prefetch->depth])
+    {
+        prefetch->offset = 0;
+        atomic_store_explicit(&prefetch->tail, tail + 1, memory_order_release);
+    }
+}
+
+// called from the audio callback: return 1 if every chunk of the file is played
+static inline int prefetch_at_end(struct Prefetch *prefetch)
+{
+    // is_eof is set after the last chunk is queued, so once it is seen `head` is final
+    if (!atomic_load_explicit(&prefetch->is_eof, memory_order_acquire))
+        return 0;
+    return atomic_load_explicit(&prefetch->head, memory_order_relaxed) ==
+           atomic_load_explicit(&prefetch->tail, memory_order_relaxed);
+}
+
+// called from the audio callback when prefetch_peek() found nothing before the end of file
+static inline void prefetch_starved(struct Prefetch *prefetch, unsigned long frames)
+{
+    atomic_fetch_add_explicit(&prefetch->starvations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&prefetch->frames_starved, frames, memory_order_relaxed);
+}
+
+void prefetch_get_stats(struct Prefetch *prefetch, struct Prefetch_stats *stats);
+
+// return non-zero if reading the file failed, playback stops at the failed chunk
+int prefetch_read_error(struct Prefetch *prefetch);
+
+// stop the reader thread, close the file and free the pool
+void prefetch_close(struct Prefetch *prefetch);
+
+#endif
@@ -0,0 +1,171 @@
+/*************************************************************************
+ Description: Self-test of the streamed file source, see prefetchtest.h.
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "prefetchtest.h"
+#include "filesrc.h"
+#include "wav.h"
+
+/* frames written to the file at a time */
+#define WRITE_FRAMES 4096
+
+/* sample of `frame` on `ch`, scrambled so swapped or torn samples don't look like a counter */
+static inline int32_t pattern(uint64_t frame, int channel, int ch)
+{
+    return (int32_t)((uint32_t)(frame * channel + ch) * 0x9E3779B1u);
+}
+
+// write the pattern as a WAV file of i32 samples, return 0 on success
+static int write_file(const struct Prefetch_test_config *config)
+{
+    uint64_t bytes = config->frames * config->channel * sizeof(int32_t);
+    int32_t *buf = malloc(sizeof(int32_t) * WRITE_FRAMES * config->channel);
+    uint64_t frame = 0;
+    int ret = -1;
+
+    FILE *fp = fopen(config->path, "wb");
+    if (fp == NULL || buf == NULL)
+    {
+        if (fp == NULL)
+            perror(config->path);
+        else
+            printf("Failed to allocate the file buffer\n");
+        goto out;
+    }
+    if (wav_write_header(fp, paInt32, config->channel, config->rate, bytes) != 0)
+        goto out;
+    while (frame < config->frames)
+    {
+        uint64_t n = config->frames - frame, i;
+        int ch;
+        if (n > WRITE_FRAMES)
+            n = WRITE_FRAMES;
+        for (i = 0; i < n; ++i)
+            for (ch = 0; ch < config->channel; ++ch)
+                buf[i * config->channel + ch] = pattern(frame + i, config->channel, ch);
+        if (fwrite(buf, sizeof(int32_t) * config->channel, n, fp) != n)
+        {
+            perror(config->path);
+            goto out;
+        }
+        frame += n;
+    }
+    ret = 0;
+
+out:
+    if (fp && fclose(fp) != 0 && ret == 0)
+    {
+        perror(config->path);
+        ret = -1;
+    }
+    free(buf);
+    return ret;
+}
+
+static double elapsed(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) * 1e-9;
+}
+
+static void next_deadline(struct timespec *t, long ns)
+{
+    t->tv_nsec += ns;
+    while (t->tv_nsec >= 1000000000L)
+    {
+        t->tv_nsec -= 1000000000L;
+        ++t->tv_sec;
+    }
+}
+
+// one consumer "callback": return 1 once the whole file is played
+static int consume_block(struct File_source *source, const struct Prefetch_test_config *config,
+                         struct Prefetch_test_result *result)
+{
+    unsigned long done = 0;
+
+    while (done < config->block_frames)
+    {
+        unsigned long n = config->block_frames - done;
+        const int32_t *p = file_source_peek(source, &n);
+        if (p == NULL)
+            return file_source_at_end(source, config->block_frames - done);
+
+        unsigned long i;
+        int ch;
+        for (i = 0; i < n; ++i)
+        {
+            for (ch = 0; ch < config->channel; ++ch)
+            {
+                if (p[i * config->channel + ch] != pattern(result->frames_read + i, config->channel, ch))
+                {
+                    if (result->mismatches++ == 0)
+                        result->first_mismatch = result->frames_read + i;
+                }
+            }
+        }
+        file_source_advance(source, n);
+        result->frames_read += n;
+        done += n;
+    }
+    return 0;
+}
+
+int prefetch_test_run(const struct Prefetch_test_config *config, struct Prefetch_test_result *result)
+{
+    struct File_source source;
+    struct File_source_stats stats;
+    struct timespec start, end, deadline;
+    int ret = -1;
+
+    memset(result, 0, sizeof(*result));
+    if (config->channel <= 0 || config->rate <= 0 || config->depth < 2 || config->chunk_frames == 0 ||
+        config->block_frames == 0)
+    {
+        printf("Invalid prefetchtest configuration\n");
+        return -1;
+    }
+
+    if (write_file(config) != 0)
+        goto unlink_file;
+    if (file_source_open_streamed(&source, config->path, config->depth, config->chunk_frames,
+                                  config->io_delay_ms) != 0)
+        goto unlink_file;
+    // fills the whole pool, through the delay, before the first block like play does
+    if (file_source_start(&source, 0) != 0)
+        goto close_source;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    deadline = start;
+    for (;;)
+    {
+        if (consume_block(&source, config, result))
+            break;
+        next_deadline(&deadline, (long)(1e9 * config->block_frames / config->rate));
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result->seconds = elapsed(&start, &end);
+
+    file_source_get_stats(&source, &stats);
+    result->starvations = stats.prefetch.starvations;
+    result->frames_starved = stats.prefetch.frames_starved;
+    result->chunks_read = stats.prefetch.chunks_read;
+    result->min_queued = stats.prefetch.min_queued;
+
+    if (prefetch_read_error(&source.prefetch))
+        printf("Reading %s failed\n", config->path);
+    else if (result->frames_read == config->frames && result->mismatches == 0 && result->starvations == 0)
+        ret = 0;
+
+close_source:
+    file_source_close(&source);
+unlink_file:
+    unlink(config->path);
+    return ret;
+}
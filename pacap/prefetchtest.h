@@ -0,0 +1,49 @@
+/*************************************************************************
+ Description: Self-test of the streamed file source for "prefetchtest".
+
+              A WAV file of a counting pattern of i32 samples is written,
+              then read back through the prefetched chunk pool like
+              --prefetch does, with each chunk read delayed like slow
+              storage (--io-delay). The consumer takes blocks through
+              file_source_peek(), file_source_advance() and
+              file_source_at_end() exactly as the playback callback does,
+              paced like a device, and checks every sample. As long as a
+              chunk is read faster than it plays, the pool must absorb the
+              delay: any starvation fails the test. No audio hardware is
+              involved.
+ ************************************************************************/
+
+#ifndef PACAP_PREFETCHTEST_H
+#define PACAP_PREFETCHTEST_H
+
+#include <stdint.h>
+
+struct Prefetch_test_config
+{
+    const char *path;           // of the WAV file written and removed again
+    int channel;
+    double rate;                // the consumer's pace
+    uint64_t frames;            // of the file
+    unsigned depth;             // chunks in the pool
+    unsigned long chunk_frames;
+    unsigned io_delay_ms;       // before each chunk read
+    unsigned long block_frames; // taken by the consumer at a time, like a callback
+};
+
+struct Prefetch_test_result
+{
+    uint64_t frames_read;
+    uint64_t mismatches;        // samples which weren't what was written
+    uint64_t first_mismatch;    // frame of the first one
+    unsigned long starvations;  // blocks which found no chunk before end of file
+    unsigned long frames_starved;
+    unsigned long chunks_read;
+    unsigned min_queued;        // fewest full chunks queued before end of file
+    double seconds;             // from the first to the last block
+};
+
+/* write the file, play it through the pool and remove it. return 0 if every frame arrived intact
+ * and in order without a single starvation */
+int prefetch_test_run(const struct Prefetch_test_config *config, struct Prefetch_test_result *result);
+
+#endif
@@ -0,0 +1,199 @@
+/*************************************************************************
+ Description: Device capability cache, see probe.h.
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "probe.h"
+
+#define CACHE_VERSION_LINE "# pacap probe cache v1"
+
+const double probe_rates[] = {8000, 11025, 16000, 22050, 32000, 44100, 48000, 88200, 96000, 176400, 192000, 0};
+const int probe_channels[] = {1, 2, 4, 6, 8, 16, 32, 0};
+
+const char *probe_cache_default_path(void)
+{
+    static char path[4096];
+    const char *home = getenv("HOME");
+    if (home == NULL || *home == '\0')
+        return NULL;
+    snprintf(path, sizeof(path), "%s/.cache/pacap.probe", home);
+    return path;
+}
+
+void probe_cache_init(struct Probe_cache *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+}
+
+void probe_cache_free(struct Probe_cache *cache)
+{
+    free(cache->records);
+    probe_cache_init(cache);
+}
+
+int probe_cache_add(struct Probe_cache *cache, const struct Probe_record *record)
+{
+    if (cache->count == cache->capacity)
+    {
+        size_t capacity = cache->capacity ? 2 * cache->capacity : 256;
+        struct Probe_record *records = realloc(cache->records, capacity * sizeof(*records));
+        if (records == NULL)
+            return -1;
+        cache->records = records;
+        cache->capacity = capacity;
+    }
+    cache->records[cache->count++] = *record;
+    return 0;
+}
+
+void probe_cache_forget(struct Probe_cache *cache, const char *host_api, const char *device_name)
+{
+    size_t i, n = 0;
+    for (i = 0; i < cache->count; ++i)
+    {
+        struct Probe_record *r = &cache->records[i];
+        if (!strcmp(r->host_api, host_api) && !strcmp(r->device_name, device_name))
+            continue;
+        cache->records[n++] = *r;
+    }
+    cache->count = n;
+}
+
+// names are stored tab separated, so tabs and newlines in them can't be kept
+static void copy_name(char *dst, const char *src)
+{
+    size_t i;
+    for (i = 0; i + 1 < PROBE_NAME_LEN && src[i]; ++i)
+        dst[i] = (src[i] == '\t' || src[i] == '\n') ? ' ' : src[i];
+    dst[i] = '\0';
+}
+
+void probe_record_set_device(struct Probe_record *record, const char *host_api, const char *device_name)
+{
+    copy_name(record->host_api, host_api);
+    copy_name(record->device_name, device_name);
+}
+
+// create the directory `path` is in, if it doesn't exist yet
+static void make_parent_dir(const char *path)
+{
+    char dir[4096];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL || slash == dir)
+        return;
+    *slash = '\0';
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+        perror(dir);
+}
+
+int probe_cache_load(struct Probe_cache *cache, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+
+    char line[1024];
+    int ret = 0;
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        // host_api and device name may hold spaces, so split on tabs only
+        char *field[8];
+        int n = 0;
+        char *p = line;
+        while (n < 8)
+        {
+            field[n++] = p;
+            p = strchr(p, '\t');
+            if (p == NULL)
+                break;
+            *p++ = '\0';
+        }
+        if (n != 8)
+        {
+            ret = -1;
+            break;
+        }
+
+        struct Probe_record r;
+        probe_record_set_device(&r, field[0], field[1]);
+        r.is_output = !strcmp(field[2], "out");
+        r.format = strtoul(field[3], NULL, 16);
+        if (!strcmp(field[4], "no"))
+            r.format |= paNonInterleaved;
+        r.rate = strtod(field[5], NULL);
+        r.probed = strtoull(field[6], NULL, 16);
+        r.supported = strtoull(field[7], NULL, 16);
+        if (r.probed == 0)
+        {
+            ret = -1;
+            break;
+        }
+
+        if (probe_cache_add(cache, &r) != 0)
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    fclose(fp);
+    return ret;
+}
+
+int probe_cache_save(const struct Probe_cache *cache, const char *path)
+{
+    make_parent_dir(path);
+
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(fp, "%s\n", CACHE_VERSION_LINE);
+    fprintf(fp, "# host_api\tdevice_name\tdirection\tformat\tinterleaved\trate\tprobed\tsupported\n");
+
+    size_t i;
+    for (i = 0; i < cache->count; ++i)
+    {
+        const struct Probe_record *r = &cache->records[i];
+        fprintf(fp, "%s\t%s\t%s\t%lx\t%s\t%g\t%llx\t%llx\n",
+                r->host_api, r->device_name, r->is_output ? "out" : "in",
+                (unsigned long)(r->format & ~paNonInterleaved), (r->format & paNonInterleaved) ? "no" : "yes",
+                r->rate, (unsigned long long)r->probed, (unsigned long long)r->supported);
+    }
+
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+int probe_cache_lookup(const struct Probe_cache *cache, const char *host_api, const char *device_name,
+                       int is_output, PaSampleFormat format, double rate, int channel)
+{
+    if (channel < 1 || channel > PROBE_MAX_CHANNEL)
+        return -1;
+
+    uint64_t bit = (uint64_t)1 << (channel - 1);
+    size_t i;
+    for (i = 0; i < cache->count; ++i)
+    {
+        const struct Probe_record *r = &cache->records[i];
+        if (r->is_output == is_output && r->format == format && r->rate == rate &&
+            !strcmp(r->host_api, host_api) && !strcmp(r->device_name, device_name))
+        {
+            if (!(r->probed & bit))
+                return -1;
+            return (r->supported & bit) ? 1 : 0;
+        }
+    }
+    return -1;
+}
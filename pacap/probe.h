@@ -0,0 +1,83 @@
+/*************************************************************************
+ Description: Device capability cache.
+
+              "traverse --probe" checks every format/rate/channel/interleaving
+              combination of each device with Pa_IsFormatSupported and stores
+              the result here, keyed by device name and host API name (device
+              indexes change when cards are plugged). "play" looks parameters
+              up in the cache before asking PortAudio, which may have to open
+              the device to answer.
+
+              On disk the cache is a text file, one tab separated record per
+              line:
+
+              host_api device_name direction format interleaved rate probed supported
+
+              where direction is "in" or "out", format is the PaSampleFormat
+              value (hex, without paNonInterleaved), and probed/supported are
+              hex masks with bit (N-1) set for N channels.
+ ************************************************************************/
+
+#ifndef PACAP_PROBE_H
+#define PACAP_PROBE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "portaudio.h"
+
+#define PROBE_NAME_LEN 128
+
+/* channel counts above this are neither probed nor cached */
+#define PROBE_MAX_CHANNEL 64
+
+struct Probe_record
+{
+    char host_api[PROBE_NAME_LEN];
+    char device_name[PROBE_NAME_LEN];
+    int is_output;
+    PaSampleFormat format;      // may include paNonInterleaved
+    double rate;
+    uint64_t probed;            // bit (N-1): N channels was checked
+    uint64_t supported;         // bit (N-1): N channels is supported
+};
+
+struct Probe_cache
+{
+    struct Probe_record *records;
+    size_t count;
+    size_t capacity;
+};
+
+/* sample rates and channel counts "traverse --probe" checks, terminated by 0 */
+extern const double probe_rates[];
+extern const int probe_channels[];
+
+// $HOME/.cache/pacap.probe, or NULL if $HOME is not set
+const char *probe_cache_default_path(void);
+
+void probe_cache_init(struct Probe_cache *cache);
+
+void probe_cache_free(struct Probe_cache *cache);
+
+/* load records from `path` into an initialized cache, return 0 on success,
+ * -1 if the file can't be opened or is malformed */
+int probe_cache_load(struct Probe_cache *cache, const char *path);
+
+int probe_cache_save(const struct Probe_cache *cache, const char *path);
+
+// drop every record of one device, before it is probed again
+void probe_cache_forget(struct Probe_cache *cache, const char *host_api, const char *device_name);
+
+// set the cache key of `record`, names are truncated to fit
+void probe_record_set_device(struct Probe_record *record, const char *host_api, const char *device_name);
+
+// copy `record` into the cache, return 0 on success
+int probe_cache_add(struct Probe_cache *cache, const struct Probe_record *record);
+
+/* return 1 if the combination is known to be supported, 0 if known to be not supported,
+ * -1 if it was never probed */
+int probe_cache_lookup(const struct Probe_cache *cache, const char *host_api, const char *device_name,
+                       int is_output, PaSampleFormat format, double rate, int channel);
+
+#endif
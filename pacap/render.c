@@ -0,0 +1,697 @@
+/*************************************************************************
+ Description: Render kernels, see render.h.
+
+              Each kernel runs in 2 passes over chunks of samples:
+                1. convert: clamp float samples to [-1, 1] and convert them
+                   into the device format, in a small contiguous buffer
+                2. fan-out: copy each converted sample to every channel
+              For mono the conversion writes straight into the output.
+
+              The scalar `to_xxx()` conversions below define the output of
+              each format. SIMD kernels must stay bit-exact with them, that's
+              why the clamp is written as `v > lo ? v : lo` (same semantic as
+              SSE `max`, also for NaN), and why i32 is scaled in double.
+ ************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define HAVE_NEON_SIMD 1
+#include <arm_neon.h>
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+#include "render.h"
+
+/* frames converted at one time before being fanned out */
+#define CHUNK_FRAMES 256
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static const char *simd_names[] = {"scalar", "sse2", "avx2", "neon"};
+
+/*******************************************************
+ * Scalar
+ *******************************************************/
+
+static inline float clamp_unit(float v)
+{
+    v = v > -1.0f ? v : -1.0f;
+    return v < 1.0f ? v : 1.0f;
+}
+
+static inline float to_f32(float v) { return clamp_unit(v); }
+static inline int32_t to_i32(float v) { return (int32_t)((double)clamp_unit(v) * INT32_MAX); }
+static inline int16_t to_i16(float v) { return (int16_t)(clamp_unit(v) * (float)INT16_MAX); }
+static inline int8_t to_i8(float v) { return (int8_t)(clamp_unit(v) * (float)INT8_MAX); }
+static inline uint8_t to_u8(float v) { return (uint8_t)((int)(clamp_unit(v) * (float)INT8_MAX) + 128); }
+
+/* 24 bit samples are handled as int32 in [-2^23+1, 2^23-1] until they are packed */
+#define INT24_MAX 8388607
+static inline int32_t to_i24(float v) { return (int32_t)((double)clamp_unit(v) * INT24_MAX); }
+
+#define DEFINE_RENDER(fmt, type)                                                                \
+void render_##fmt(const float *src, void *output_buf, unsigned long frames, int channel)        \
+{                                                                                               \
+    type *out = (type*)output_buf;                                                              \
+    unsigned long i;                                                                            \
+    int j;                                                                                      \
+                                                                                                \
+    for (i = 0; i < frames; ++i)                                                                \
+    {                                                                                           \
+        type sample = to_##fmt(src[i]);                                                         \
+                                                                                                \
+        /* each sample(channel) in frame holds same value */                                    \
+        for (j = 0; j < channel; ++j)                                                           \
+            *out++ = sample;                                                                    \
+    }                                                                                           \
+}
+
+DEFINE_RENDER(f32, float)
+DEFINE_RENDER(i32, int32_t)
+DEFINE_RENDER(i16, int16_t)
+DEFINE_RENDER(i8, int8_t)
+DEFINE_RENDER(u8, uint8_t)
+
+/* pack 4 samples into 12 bytes, as packed 24 bit in native byte order */
+static inline void pack4_i24(int32_t a, int32_t b, int32_t c, int32_t d, uint8_t *dst)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    const int32_t s[4] = {a, b, c, d};
+    int i;
+    for (i = 0; i < 4; ++i)
+    {
+        dst[3*i] = (uint8_t)(s[i] >> 16);
+        dst[3*i + 1] = (uint8_t)(s[i] >> 8);
+        dst[3*i + 2] = (uint8_t)s[i];
+    }
+#else
+    // built in registers, going through a word array makes the 8 byte store wait for store forwarding
+    uint64_t lo = ((uint64_t)a & 0xffffff) | (((uint64_t)b & 0xffffff) << 24) | ((uint64_t)c << 48);
+    uint32_t hi = (((uint32_t)c >> 16) & 0xff) | ((uint32_t)d << 8);
+    memcpy(dst, &lo, 8);
+    memcpy(dst + 8, &hi, 4);
+#endif
+}
+
+static inline void pack1_i24(int32_t a, uint8_t *dst)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    dst[0] = (uint8_t)(a >> 16);
+    dst[1] = (uint8_t)(a >> 8);
+    dst[2] = (uint8_t)a;
+#else
+    dst[0] = (uint8_t)a;
+    dst[1] = (uint8_t)(a >> 8);
+    dst[2] = (uint8_t)(a >> 16);
+#endif
+}
+
+/* PortAudio's paInt24 is packed, 3 bytes per sample in native byte order. Samples are packed
+ * 4 at a time into 12 bytes: 4 mono frames, 2 stereo frames, or for wider frames 4 channels
+ * of one frame, whose 12 byte pattern is then repeated over the frame */
+void render_i24(const float *src, void *output_buf, unsigned long frames, int channel)
+{
+    uint8_t *out = (uint8_t*)output_buf;
+    unsigned long i = 0;
+
+    if (channel == 1)
+    {
+        for (; i + 4 <= frames; i += 4, out += 12)
+            pack4_i24(to_i24(src[i]), to_i24(src[i + 1]), to_i24(src[i + 2]), to_i24(src[i + 3]), out);
+        for (; i < frames; ++i, out += 3)
+            pack1_i24(to_i24(src[i]), out);
+        return;
+    }
+
+    if (channel == 2)
+    {
+        for (; i + 2 <= frames; i += 2, out += 12)
+        {
+            int32_t a = to_i24(src[i]), b = to_i24(src[i + 1]);
+            pack4_i24(a, a, b, b, out);
+        }
+        for (; i < frames; ++i, out += 6)
+        {
+            pack1_i24(to_i24(src[i]), out);
+            memcpy(out + 3, out, 3);
+        }
+        return;
+    }
+
+    for (; i < frames; ++i)
+    {
+        int32_t sample = to_i24(src[i]);
+        uint8_t pattern[12];
+        int j = 0;
+
+        pack4_i24(sample, sample, sample, sample, pattern);
+        for (; j + 4 <= channel; j += 4, out += 12)
+            memcpy(out, pattern, 12);
+        for (; j < channel; ++j, out += 3)
+            memcpy(out, pattern, 3);
+    }
+}
+
+/* convert the tail which doesn't fill a whole vector */
+#define CONVERT_TAIL(fmt, type, src, dst, i, n)                                                 \
+    for (; (i) < (n); ++(i))                                                                    \
+        ((type*)(dst))[i] = to_##fmt((src)[i]);
+
+#define DEFINE_FANOUT_SCALAR(bits, utype)                                                       \
+static void fanout##bits##_scalar(const void *src, void *dst, unsigned long frames, int channel) \
+{                                                                                               \
+    const utype *s = (const utype*)src;                                                         \
+    utype *d = (utype*)dst;                                                                     \
+    unsigned long i;                                                                            \
+    int j;                                                                                      \
+                                                                                                \
+    for (i = 0; i < frames; ++i)                                                                \
+    {                                                                                           \
+        for (j = 0; j < channel; ++j)                                                           \
+            *d++ = s[i];                                                                        \
+    }                                                                                           \
+}
+
+/* used for channel layouts no SIMD path covers */
+DEFINE_FANOUT_SCALAR(8, uint8_t)
+DEFINE_FANOUT_SCALAR(16, uint16_t)
+DEFINE_FANOUT_SCALAR(32, uint32_t)
+
+/*******************************************************
+ * SSE2 / AVX2
+ *******************************************************/
+
+#ifdef HAVE_X86_SIMD
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+SSE2 static inline __m128 clamp_sse2(__m128 v)
+{
+    return _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+}
+
+SSE2 static inline __m128i scale_trunc_sse2(const float *src, float scale)
+{
+    return _mm_cvttps_epi32(_mm_mul_ps(clamp_sse2(_mm_loadu_ps(src)), _mm_set1_ps(scale)));
+}
+
+SSE2 static void convert_f32_sse2(const float *src, void *dst, unsigned long n)
+{
+    unsigned long i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps((float*)dst + i, clamp_sse2(_mm_loadu_ps(src + i)));
+    CONVERT_TAIL(f32, float, src, dst, i, n)
+}
+
+SSE2 static void convert_i32_sse2(const float *src, void *dst, unsigned long n)
+{
+    const __m128d scale = _mm_set1_pd(INT32_MAX);
+    unsigned long i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = clamp_sse2(_mm_loadu_ps(src + i));
+        __m128i lo = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtps_pd(v), scale));
+        __m128i hi = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(v, v)), scale));
+        _mm_storeu_si128((__m128i*)((int32_t*)dst + i), _mm_unpacklo_epi64(lo, hi));
+    }
+    CONVERT_TAIL(i32, int32_t, src, dst, i, n)
+}
+
+SSE2 static void convert_i16_sse2(const float *src, void *dst, unsigned long n)
+{
+    unsigned long i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i a = scale_trunc_sse2(src + i, INT16_MAX);
+        __m128i b = scale_trunc_sse2(src + i + 4, INT16_MAX);
+        _mm_storeu_si128((__m128i*)((int16_t*)dst + i), _mm_packs_epi32(a, b));
+    }
+    CONVERT_TAIL(i16, int16_t, src, dst, i, n)
+}
+
+SSE2 static void convert_i8_sse2(const float *src, void *dst, unsigned long n)
+{
+    unsigned long i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i ab = _mm_packs_epi32(scale_trunc_sse2(src + i, INT8_MAX), scale_trunc_sse2(src + i + 4, INT8_MAX));
+        __m128i cd = _mm_packs_epi32(scale_trunc_sse2(src + i + 8, INT8_MAX), scale_trunc_sse2(src + i + 12, INT8_MAX));
+        _mm_storeu_si128((__m128i*)((int8_t*)dst + i), _mm_packs_epi16(ab, cd));
+    }
+    CONVERT_TAIL(i8, int8_t, src, dst, i, n)
+}
+
+SSE2 static void convert_u8_sse2(const float *src, void *dst, unsigned long n)
+{
+    const __m128i bias = _mm_set1_epi32(128);
+    unsigned long i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_add_epi32(scale_trunc_sse2(src + i, INT8_MAX), bias);
+        __m128i b = _mm_add_epi32(scale_trunc_sse2(src + i + 4, INT8_MAX), bias);
+        __m128i c = _mm_add_epi32(scale_trunc_sse2(src + i + 8, INT8_MAX), bias);
+        __m128i d = _mm_add_epi32(scale_trunc_sse2(src + i + 12, INT8_MAX), bias);
+        _mm_storeu_si128((__m128i*)((uint8_t*)dst + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    }
+    CONVERT_TAIL(u8, uint8_t, src, dst, i, n)
+}
+
+/* Fan-out of `bits` wide samples:
+ *  - frames of at least one vector: broadcast the sample and store whole vectors, the last
+ *    store overlaps the previous one to end exactly at the frame boundary. It rewrites the
+ *    same values, so the overlap is harmless.
+ *  - 8 bytes frames: broadcast and store the low half
+ *  - stereo: interleave the samples with themselves by unpacking
+ *  - anything else: scalar
+ */
+#define DEFINE_FANOUT_SSE2(bits, utype, set1, unpacklo, unpackhi)                               \
+SSE2 static void fanout##bits##_sse2(const void *src, void *dst, unsigned long frames, int channel) \
+{                                                                                               \
+    const size_t frame_bytes = channel * sizeof(utype);                                         \
+    const utype *s = (const utype*)src;                                                         \
+    char *d = (char*)dst;                                                                       \
+    unsigned long i = 0;                                                                        \
+                                                                                                \
+    if (frame_bytes >= sizeof(__m128i))                                                         \
+    {                                                                                           \
+        const size_t last = frame_bytes - sizeof(__m128i);                                      \
+        for (; i < frames; ++i, d += frame_bytes)                                               \
+        {                                                                                       \
+            utype x;                                                                            \
+            memcpy(&x, s + i, sizeof(x));                                                       \
+            __m128i v = set1(x);                                                                \
+            size_t off;                                                                         \
+            for (off = 0; off < last; off += sizeof(__m128i))                                   \
+                _mm_storeu_si128((__m128i*)(d + off), v);                                       \
+            _mm_storeu_si128((__m128i*)(d + last), v);                                          \
+        }                                                                                       \
+        return;                                                                                 \
+    }                                                                                           \
+                                                                                                \
+    if (frame_bytes == 8)                                                                       \
+    {                                                                                           \
+        for (; i < frames; ++i, d += frame_bytes)                                               \
+        {                                                                                       \
+            utype x;                                                                            \
+            memcpy(&x, s + i, sizeof(x));                                                       \
+            _mm_storel_epi64((__m128i*)d, set1(x));                                             \
+        }                                                                                       \
+        return;                                                                                 \
+    }                                                                                           \
+                                                                                                \
+    if (channel == 2)                                                                           \
+    {                                                                                           \
+        const unsigned long per_vec = sizeof(__m128i) / sizeof(utype);                          \
+        for (; i + per_vec <= frames; i += per_vec, d += 2 * sizeof(__m128i))                   \
+        {                                                                                       \
+            __m128i v = _mm_loadu_si128((const __m128i*)(s + i));                               \
+            _mm_storeu_si128((__m128i*)d, unpacklo(v, v));                                      \
+            _mm_storeu_si128((__m128i*)d + 1, unpackhi(v, v));                                  \
+        }                                                                                       \
+    }                                                                                           \
+    fanout##bits##_scalar(s + i, d, frames - i, channel);                                       \
+}
+
+DEFINE_FANOUT_SSE2(8, uint8_t, _mm_set1_epi8, _mm_unpacklo_epi8, _mm_unpackhi_epi8)
+DEFINE_FANOUT_SSE2(16, uint16_t, _mm_set1_epi16, _mm_unpacklo_epi16, _mm_unpackhi_epi16)
+DEFINE_FANOUT_SSE2(32, uint32_t, _mm_set1_epi32, _mm_unpacklo_epi32, _mm_unpackhi_epi32)
+
+AVX2 static inline __m256 clamp_avx2(__m256 v)
+{
+    return _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-1.0f)), _mm256_set1_ps(1.0f));
+}
+
+AVX2 static inline __m256i scale_trunc_avx2(const float *src, float scale)
+{
+    return _mm256_cvttps_epi32(_mm256_mul_ps(clamp_avx2(_mm256_loadu_ps(src)), _mm256_set1_ps(scale)));
+}
+
+AVX2 static void convert_f32_avx2(const float *src, void *dst, unsigned long n)
+{
+    unsigned long i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps((float*)dst + i, clamp_avx2(_mm256_loadu_ps(src + i)));
+    CONVERT_TAIL(f32, float, src, dst, i, n)
+}
+
+AVX2 static void convert_i32_avx2(const float *src, void *dst, unsigned long n)
+{
+    const __m256d scale = _mm256_set1_pd(INT32_MAX);
+    unsigned long i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 v = clamp_avx2(_mm256_loadu_ps(src + i));
+        __m128i lo = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), scale));
+        __m128i hi = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)), scale));
+        _mm_storeu_si128((__m128i*)((int32_t*)dst + i), lo);
+        _mm_storeu_si128((__m128i*)((int32_t*)dst + i + 4), hi);
+    }
+    CONVERT_TAIL(i32, int32_t, src, dst, i, n)
+}
+
+/* AVX2 packs work within 128-bit lanes, the permutes restore the sample order */
+AVX2 static void convert_i16_avx2(const float *src, void *dst, unsigned long n)
+{
+    unsigned long i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i ab = _mm256_packs_epi32(scale_trunc_avx2(src + i, INT16_MAX), scale_trunc_avx2(src + i + 8, INT16_MAX));
+        _mm256_storeu_si256((__m256i*)((int16_t*)dst + i), _mm256_permute4x64_epi64(ab, 0xD8));
+    }
+    CONVERT_TAIL(i16, int16_t, src, dst, i, n)
+}
+
+AVX2 static void convert_i8_avx2(const float *src, void *dst, unsigned long n)
+{
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    unsigned long i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i ab = _mm256_packs_epi32(scale_trunc_avx2(src + i, INT8_MAX), scale_trunc_avx2(src + i + 8, INT8_MAX));
+        __m256i cd = _mm256_packs_epi32(scale_trunc_avx2(src + i + 16, INT8_MAX), scale_trunc_avx2(src + i + 24, INT8_MAX));
+        __m256i abcd = _mm256_packs_epi16(ab, cd);
+        _mm256_storeu_si256((__m256i*)((int8_t*)dst + i), _mm256_permutevar8x32_epi32(abcd, order));
+    }
+    CONVERT_TAIL(i8, int8_t, src, dst, i, n)
+}
+
+AVX2 static void convert_u8_avx2(const float *src, void *dst, unsigned long n)
+{
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256i bias = _mm256_set1_epi32(128);
+    unsigned long i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i a = _mm256_add_epi32(scale_trunc_avx2(src + i, INT8_MAX), bias);
+        __m256i b = _mm256_add_epi32(scale_trunc_avx2(src + i + 8, INT8_MAX), bias);
+        __m256i c = _mm256_add_epi32(scale_trunc_avx2(src + i + 16, INT8_MAX), bias);
+        __m256i d = _mm256_add_epi32(scale_trunc_avx2(src + i + 24, INT8_MAX), bias);
+        __m256i abcd = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+        _mm256_storeu_si256((__m256i*)((uint8_t*)dst + i), _mm256_permutevar8x32_epi32(abcd, order));
+    }
+    CONVERT_TAIL(u8, uint8_t, src, dst, i, n)
+}
+
+/* Only wide frames benefit from 256-bit broadcast stores, the rest is left to SSE2 */
+#define DEFINE_FANOUT_AVX2(bits, utype, set1)                                                   \
+AVX2 static void fanout##bits##_avx2(const void *src, void *dst, unsigned long frames, int channel) \
+{                                                                                               \
+    const size_t frame_bytes = channel * sizeof(utype);                                         \
+    if (frame_bytes < sizeof(__m256i))                                                          \
+    {                                                                                           \
+        fanout##bits##_sse2(src, dst, frames, channel);                                         \
+        return;                                                                                 \
+    }                                                                                           \
+                                                                                                \
+    const size_t last = frame_bytes - sizeof(__m256i);                                         \
+    const utype *s = (const utype*)src;                                                         \
+    char *d = (char*)dst;                                                                       \
+    unsigned long i;                                                                            \
+    for (i = 0; i < frames; ++i, d += frame_bytes)                                              \
+    {                                                                                           \
+        utype x;                                                                                \
+        memcpy(&x, s + i, sizeof(x));                                                           \
+        __m256i v = set1(x);                                                                    \
+        size_t off;                                                                             \
+        for (off = 0; off < last; off += sizeof(__m256i))                                       \
+            _mm256_storeu_si256((__m256i*)(d + off), v);                                        \
+        _mm256_storeu_si256((__m256i*)(d + last), v);                                           \
+    }                                                                                           \
+}
+
+DEFINE_FANOUT_AVX2(8, uint8_t, _mm256_set1_epi8)
+DEFINE_FANOUT_AVX2(16, uint16_t, _mm256_set1_epi16)
+DEFINE_FANOUT_AVX2(32, uint32_t, _mm256_set1_epi32)
+
+#endif /* HAVE_X86_SIMD */
+
+/*******************************************************
+ * NEON
+ *******************************************************/
+
+#ifdef HAVE_NEON_SIMD
+
+/* vmaxq/vminq propagate NaN while the scalar clamp doesn't, so select explicitly */
+static inline float32x4_t clamp_neon(float32x4_t v)
+{
+    const float32x4_t lo = vdupq_n_f32(-1.0f);
+    const float32x4_t hi = vdupq_n_f32(1.0f);
+    v = vbslq_f32(vcgtq_f32(v, lo), v, lo);
+    return vbslq_f32(vcltq_f32(v, hi), v, hi);
+}
+
+// vcvtq_s32_f32 rounds toward zero, same as C conversion
+static inline int32x4_t scale_trunc_neon(const float *src, float scale)
+{
+    return vcvtq_s32_f32(vmulq_f32(clamp_neon(vld1q_f32(src)), vdupq_n_f32(scale)));
+}
+
+static void convert_f32_neon(const float *src, void *dst, unsigned long n)
+{
+    unsigned long i = 0;
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32((float*)dst + i, clamp_neon(vld1q_f32(src + i)));
+    CONVERT_TAIL(f32, float, src, dst, i, n)
+}
+
+#ifdef __aarch64__
+static void convert_i32_neon(const float *src, void *dst, unsigned long n)
+{
+    const float64x2_t scale = vdupq_n_f64(INT32_MAX);
+    unsigned long i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        float32x4_t v = clamp_neon(vld1q_f32(src + i));
+        int64x2_t lo = vcvtq_s64_f64(vmulq_f64(vcvt_f64_f32(vget_low_f32(v)), scale));
+        int64x2_t hi = vcvtq_s64_f64(vmulq_f64(vcvt_high_f64_f32(v), scale));
+        vst1q_s32((int32_t*)dst + i, vcombine_s32(vmovn_s64(lo), vmovn_s64(hi)));
+    }
+    CONVERT_TAIL(i32, int32_t, src, dst, i, n)
+}
+#endif
+
+static void convert_i16_neon(const float *src, void *dst, unsigned long n)
+{
+    unsigned long i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        int16x4_t a = vqmovn_s32(scale_trunc_neon(src + i, INT16_MAX));
+        int16x4_t b = vqmovn_s32(scale_trunc_neon(src + i + 4, INT16_MAX));
+        vst1q_s16((int16_t*)dst + i, vcombine_s16(a, b));
+    }
+    CONVERT_TAIL(i16, int16_t, src, dst, i, n)
+}
+
+static void convert_i8_neon(const float *src, void *dst, unsigned long n)
+{
+    unsigned long i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        int16x4_t a = vqmovn_s32(scale_trunc_neon(src + i, INT8_MAX));
+        int16x4_t b = vqmovn_s32(scale_trunc_neon(src + i + 4, INT8_MAX));
+        vst1_s8((int8_t*)dst + i, vqmovn_s16(vcombine_s16(a, b)));
+    }
+    CONVERT_TAIL(i8, int8_t, src, dst, i, n)
+}
+
+static void convert_u8_neon(const float *src, void *dst, unsigned long n)
+{
+    const int32x4_t bias = vdupq_n_s32(128);
+    unsigned long i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint16x4_t a = vqmovun_s32(vaddq_s32(scale_trunc_neon(src + i, INT8_MAX), bias));
+        uint16x4_t b = vqmovun_s32(vaddq_s32(scale_trunc_neon(src + i + 4, INT8_MAX), bias));
+        vst1_u8((uint8_t*)dst + i, vqmovn_u16(vcombine_u16(a, b)));
+    }
+    CONVERT_TAIL(u8, uint8_t, src, dst, i, n)
+}
+
+/* Same broadcast scheme as SSE2 for wide frames, 2/3/4 channels use the interleaving stores */
+#define DEFINE_FANOUT_NEON(bits, utype, q, vtype, x2type, x3type, x4type)                       \
+static void fanout##bits##_neon(const void *src, void *dst, unsigned long frames, int channel) \
+{                                                                                               \
+    const size_t frame_bytes = channel * sizeof(utype);                                         \
+    const unsigned long per_vec = sizeof(vtype) / sizeof(utype);                                \
+    const utype *s = (const utype*)src;                                                         \
+    utype *d = (utype*)dst;                                                                     \
+    unsigned long i = 0;                                                                        \
+                                                                                                \
+    if (frame_bytes >= sizeof(vtype))                                                           \
+    {                                                                                           \
+        const size_t last = channel - per_vec;                                                  \
+        for (; i < frames; ++i, d += channel)                                                   \
+        {                                                                                       \
+            vtype v = vdupq_n_##q(s[i]);                                                        \
+            size_t off;                                                                         \
+            for (off = 0; off < last; off += per_vec)                                           \
+                vst1q_##q(d + off, v);                                                          \
+            vst1q_##q(d + last, v);                                                             \
+        }                                                                                       \
+        return;                                                                                 \
+    }                                                                                           \
+                                                                                                \
+    for (; i + per_vec <= frames; i += per_vec, d += channel * per_vec)                         \
+    {                                                                                           \
+        vtype v = vld1q_##q(s + i);                                                             \
+        if (channel == 2)                                                                       \
+        {                                                                                       \
+            x2type x = {{v, v}};                                                                \
+            vst2q_##q(d, x);                                                                    \
+        }                                                                                       \
+        else if (channel == 3)                                                                  \
+        {                                                                                       \
+            x3type x = {{v, v, v}};                                                             \
+            vst3q_##q(d, x);                                                                    \
+        }                                                                                       \
+        else if (channel == 4)                                                                  \
+        {                                                                                       \
+            x4type x = {{v, v, v, v}};                                                          \
+            vst4q_##q(d, x);                                                                    \
+        }                                                                                       \
+        else                                                                                    \
+            break;                                                                              \
+    }                                                                                           \
+    fanout##bits##_scalar(s + i, d, frames - i, channel);                                       \
+}
+
+DEFINE_FANOUT_NEON(8, uint8_t, u8, uint8x16_t, uint8x16x2_t, uint8x16x3_t, uint8x16x4_t)
+DEFINE_FANOUT_NEON(16, uint16_t, u16, uint16x8_t, uint16x8x2_t, uint16x8x3_t, uint16x8x4_t)
+DEFINE_FANOUT_NEON(32, uint32_t, u32, uint32x4_t, uint32x4x2_t, uint32x4x3_t, uint32x4x4_t)
+
+#endif /* HAVE_NEON_SIMD */
+
+/*******************************************************
+ * Kernels combining conversion and fan-out
+ *******************************************************/
+
+#define DEFINE_SIMD_RENDER(fmt, isa, type, bits)                                                \
+static void render_##fmt##_##isa(const float *src, void *output_buf, unsigned long frames, int channel) \
+{                                                                                               \
+    type tmp[CHUNK_FRAMES];                                                                     \
+    type *out = (type*)output_buf;                                                              \
+                                                                                                \
+    if (channel == 1)                                                                           \
+    {                                                                                           \
+        convert_##fmt##_##isa(src, out, frames);                                                \
+        return;                                                                                 \
+    }                                                                                           \
+                                                                                                \
+    while (frames > 0)                                                                          \
+    {                                                                                           \
+        unsigned long n = MIN(frames, CHUNK_FRAMES);                                            \
+        convert_##fmt##_##isa(src, tmp, n);                                                     \
+        fanout##bits##_##isa(tmp, out, n, channel);                                             \
+        src += n;                                                                               \
+        out += n * channel;                                                                     \
+        frames -= n;                                                                            \
+    }                                                                                           \
+}
+
+#ifdef HAVE_X86_SIMD
+DEFINE_SIMD_RENDER(f32, sse2, float, 32)
+DEFINE_SIMD_RENDER(i32, sse2, int32_t, 32)
+DEFINE_SIMD_RENDER(i16, sse2, int16_t, 16)
+DEFINE_SIMD_RENDER(i8, sse2, int8_t, 8)
+DEFINE_SIMD_RENDER(u8, sse2, uint8_t, 8)
+DEFINE_SIMD_RENDER(f32, avx2, float, 32)
+DEFINE_SIMD_RENDER(i32, avx2, int32_t, 32)
+DEFINE_SIMD_RENDER(i16, avx2, int16_t, 16)
+DEFINE_SIMD_RENDER(i8, avx2, int8_t, 8)
+DEFINE_SIMD_RENDER(u8, avx2, uint8_t, 8)
+#endif
+
+#ifdef HAVE_NEON_SIMD
+DEFINE_SIMD_RENDER(f32, neon, float, 32)
+#ifdef __aarch64__
+DEFINE_SIMD_RENDER(i32, neon, int32_t, 32)
+#endif
+DEFINE_SIMD_RENDER(i16, neon, int16_t, 16)
+DEFINE_SIMD_RENDER(i8, neon, int8_t, 8)
+DEFINE_SIMD_RENDER(u8, neon, uint8_t, 8)
+#endif
+
+/*******************************************************
+ * Dispatch
+ *******************************************************/
+
+enum Simd_level simd_detect(void)
+{
+#if defined(HAVE_X86_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SIMD_SSE2;
+#elif defined(HAVE_NEON_SIMD) && defined(__aarch64__)
+    return SIMD_NEON; // mandatory on aarch64
+#elif defined(HAVE_NEON_SIMD)
+    if (getauxval(AT_HWCAP) & HWCAP_NEON)
+        return SIMD_NEON;
+#endif
+    return SIMD_SCALAR;
+}
+
+const char *simd_level_to_name(enum Simd_level level)
+{
+    return simd_names[level];
+}
+
+int simd_name_to_level(const char *name, enum Simd_level *level)
+{
+    unsigned i;
+    for (i = 0; i < sizeof(simd_names)/sizeof(simd_names[0]); ++i)
+    {
+        if (!strcmp(name, simd_names[i]))
+        {
+            *level = (enum Simd_level)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+Render_func render_simd(PaSampleFormat format, enum Simd_level level)
+{
+    switch (level)
+    {
+#ifdef HAVE_X86_SIMD
+        case SIMD_SSE2:
+            if (format == paFloat32) return render_f32_sse2;
+            if (format == paInt32) return render_i32_sse2;
+            if (format == paInt16) return render_i16_sse2;
+            if (format == paInt8) return render_i8_sse2;
+            if (format == paUInt8) return render_u8_sse2;
+            return NULL;
+        case SIMD_AVX2:
+            if (format == paFloat32) return render_f32_avx2;
+            if (format == paInt32) return render_i32_avx2;
+            if (format == paInt16) return render_i16_avx2;
+            if (format == paInt8) return render_i8_avx2;
+            if (format == paUInt8) return render_u8_avx2;
+            return NULL;
+#endif
+#ifdef HAVE_NEON_SIMD
+        case SIMD_NEON:
+            if (format == paFloat32) return render_f32_neon;
+#ifdef __aarch64__
+            if (format == paInt32) return render_i32_neon;
+#endif
+            if (format == paInt16) return render_i16_neon;
+            if (format == paInt8) return render_i8_neon;
+            if (format == paUInt8) return render_u8_neon;
+            return NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
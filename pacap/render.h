@@ -0,0 +1,47 @@
+/*************************************************************************
+ Description: Render kernels, which convert a block of mono float samples
+              into a device sample format and copy each sample to every
+              channel of the frame.
+
+              Every format has a portable scalar kernel, some formats also
+              have SSE2/AVX2/NEON kernels which produce bit-exact the same
+              output as the scalar one.
+ ************************************************************************/
+
+#ifndef PACAP_RENDER_H
+#define PACAP_RENDER_H
+
+#include "portaudio.h"
+
+/* convert `frames` mono float samples in `src` into `output_buf` in one specific sample format,
+ * each frame holds `channel` copies of the same sample */
+typedef void (*Render_func)(const float *src, void *output_buf, unsigned long frames, int channel);
+
+enum Simd_level
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_NEON
+};
+
+/* scalar kernels, they define the reference output of each format */
+void render_f32(const float *src, void *output_buf, unsigned long frames, int channel);
+void render_i32(const float *src, void *output_buf, unsigned long frames, int channel);
+void render_i24(const float *src, void *output_buf, unsigned long frames, int channel);
+void render_i16(const float *src, void *output_buf, unsigned long frames, int channel);
+void render_i8(const float *src, void *output_buf, unsigned long frames, int channel);
+void render_u8(const float *src, void *output_buf, unsigned long frames, int channel);
+
+// best SIMD level supported by both this build and the running CPU
+enum Simd_level simd_detect(void);
+
+const char *simd_level_to_name(enum Simd_level level);
+
+// return 0 on success, -1 if name is unknown
+int simd_name_to_level(const char *name, enum Simd_level *level);
+
+// SIMD kernel of `format` (without paNonInterleaved) at `level`, NULL if there is none
+Render_func render_simd(PaSampleFormat format, enum Simd_level level);
+
+#endif
@@ -0,0 +1,324 @@
+/*************************************************************************
+ Description: Streaming polyphase sample rate converter, see resample.h.
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "resample.h"
+
+/* phases of the most complex ratio accepted, 44.1kHz <-> 48kHz needs 160 */
+#define SRC_MAX_PHASES 2048
+
+/* rates may differ at most by this factor either way */
+#define SRC_MAX_RATIO 8
+
+static const char *src_names[SRC_QUALITY_NUM] = {"off", "low", "medium", "high"};
+
+static const struct
+{
+    unsigned taps;
+    double stopband_db;
+} src_presets[SRC_QUALITY_NUM] = {
+    {0, 0},
+    {32, 70},
+    {64, 100},
+    {128, 120},
+};
+
+/* Like the generators, kernels are GCC generic vectors compiled once for the baseline and once
+ * for AVX2. Each output frame is `taps` multiply-adds into two accumulators, so consecutive vectors
+ * don't wait on each other, and one horizontal sum. The bank is aligned, the history may not be */
+typedef float Src_vec __attribute__((vector_size(SRC_WIDTH * sizeof(float))));
+
+#define BODY static inline __attribute__((always_inline))
+
+#define LOAD_VEC(v, src) memcpy(&(v), (src), sizeof(Src_vec))
+
+BODY void dot_body(const float *restrict bank, unsigned taps, const float *restrict x, const unsigned *pos,
+                   const unsigned *phase, float *restrict out, size_t stride, unsigned long frames)
+{
+    unsigned long k;
+
+    for (k = 0; k < frames; ++k)
+    {
+        const float *restrict h = bank + (size_t)phase[k] * taps;
+        const float *restrict in = x + pos[k];
+        Src_vec acc0 = {0}, acc1 = {0};
+        unsigned t;
+
+        for (t = 0; t < taps; t += 2 * SRC_WIDTH)
+        {
+            Src_vec x0, x1;
+            LOAD_VEC(x0, in + t);
+            LOAD_VEC(x1, in + t + SRC_WIDTH);
+            acc0 += *(const Src_vec*)(h + t) * x0;
+            acc1 += *(const Src_vec*)(h + t + SRC_WIDTH) * x1;
+        }
+
+        acc0 += acc1;
+        float sum = 0;
+        int i;
+        for (i = 0; i < SRC_WIDTH; ++i)
+            sum += acc0[i];
+        out[k * stride] = sum;
+    }
+}
+
+static void resample_dot_base(const float *bank, unsigned taps, const float *x, const unsigned *pos,
+                              const unsigned *phase, float *out, size_t stride, unsigned long frames)
+{
+    dot_body(bank, taps, x, pos, phase, out, stride, frames);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void resample_dot_avx2(const float *bank, unsigned taps, const float *x, const unsigned *pos,
+                              const unsigned *phase, float *out, size_t stride, unsigned long frames)
+{
+    dot_body(bank, taps, x, pos, phase, out, stride, frames);
+}
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+static unsigned long gcd(unsigned long a, unsigned long b)
+{
+    while (b)
+    {
+        unsigned long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// zeroth order modified Bessel function of the first kind, its series converges fast for the betas used
+static double bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+    int k;
+    for (k = 1; k < 64 && term > sum * 1e-17; ++k)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/* Design the prototype low pass at `up` times the input rate with Kaiser's formulas for the window
+ * (beta from the attenuation, transition width from the attenuation and the length), and cut it into
+ * phases. Phase p holds h[p], h[p + up], ... in reverse, so it runs along the input in time order */
+static int design_bank(struct Resampler *resampler)
+{
+    unsigned up = resampler->up, taps = resampler->taps;
+    size_t length = (size_t)up * taps;
+    double high_rate = up * resampler->in_rate;
+    double attenuation = resampler->stopband_db;
+
+    double beta = attenuation > 50 ? 0.1102 * (attenuation - 8.7) :
+                  0.5842 * pow(attenuation - 21, 0.4) + 0.07886 * (attenuation - 21);
+    double transition = (attenuation - 8) / (2.285 * (length - 1)) / (2*M_PI) * high_rate;
+
+    double stop = (resampler->in_rate < resampler->out_rate ? resampler->in_rate : resampler->out_rate) / 2;
+    resampler->passband = stop - transition;
+    if (resampler->passband <= 0)
+    {
+        printf("%u taps are too few for %.0f Hz to %.0f Hz\n", taps, resampler->in_rate, resampler->out_rate);
+        return -1;
+    }
+    double cutoff = (stop + resampler->passband) / 2 / high_rate;  // in cycles per high rate sample
+
+    double *h = malloc(sizeof(double) * length);
+    if (posix_memalign((void**)&resampler->bank, sizeof(Src_vec), sizeof(float) * length) != 0)
+        resampler->bank = NULL;
+    if (h == NULL || resampler->bank == NULL)
+    {
+        printf("Failed to allocate resampler filter bank\n");
+        free(h);
+        return -1;
+    }
+
+    double center = (length - 1) / 2.0, norm = bessel_i0(beta), sum = 0;
+    size_t i;
+    for (i = 0; i < length; ++i)
+    {
+        double t = i - center;
+        double r = t / center;
+        double sinc = t == 0 ? 2 * cutoff : sin(2*M_PI * cutoff * t) / (M_PI * t);
+        h[i] = sinc * bessel_i0(beta * sqrt(1 - r * r)) / norm;
+        sum += h[i];
+    }
+
+    // every phase adds up to about 1, the gain of the zeros stuffed between input frames is made up for
+    unsigned p, t;
+    for (p = 0; p < up; ++p)
+        for (t = 0; t < taps; ++t)
+            resampler->bank[(size_t)p * taps + t] = h[p + (size_t)(taps - 1 - t) * up] * up / sum;
+
+    free(h);
+    return 0;
+}
+
+int resampler_init(struct Resampler *resampler, double in_rate, double out_rate, int channel,
+                   enum Src_quality quality, unsigned long max_out, enum Simd_level simd_level)
+{
+    memset(resampler, 0, sizeof(*resampler));
+
+    if (quality == SRC_OFF || quality >= SRC_QUALITY_NUM)
+    {
+        printf("Resampling is off\n");
+        return -1;
+    }
+    if (in_rate != floor(in_rate) || out_rate != floor(out_rate) || in_rate < 1 || out_rate < 1)
+    {
+        printf("Only whole rates can be resampled, not %g Hz to %g Hz\n", in_rate, out_rate);
+        return -1;
+    }
+    if (in_rate > SRC_MAX_RATIO * out_rate || out_rate > SRC_MAX_RATIO * in_rate)
+    {
+        printf("%.0f Hz and %.0f Hz are too far apart to resample\n", in_rate, out_rate);
+        return -1;
+    }
+
+    unsigned long common = gcd((unsigned long)in_rate, (unsigned long)out_rate);
+    if ((unsigned long)out_rate / common > SRC_MAX_PHASES)
+    {
+        printf("%.0f Hz to %.0f Hz would need %lu filter phases, at most %d are supported\n", in_rate, out_rate,
+               (unsigned long)out_rate / common, SRC_MAX_PHASES);
+        return -1;
+    }
+
+    resampler->in_rate = in_rate;
+    resampler->out_rate = out_rate;
+    resampler->up = (unsigned long)out_rate / common;
+    resampler->down = (unsigned long)in_rate / common;
+    resampler->taps = src_presets[quality].taps;
+    resampler->stopband_db = src_presets[quality].stopband_db;
+    resampler->kernel = resample_dot_base;
+#ifdef HAVE_AVX2_KERNEL
+    if (simd_level == SIMD_AVX2)
+        resampler->kernel = resample_dot_avx2;
+#endif
+    resampler->channel = channel;
+
+    // pulled: the last output frame's window starts at most this far, the history keeps less than `taps`
+    resampler->max_out = max_out;
+    resampler->max_push = (max_out - 1) * resampler->down / resampler->up;
+    resampler->max_in = (max_out * resampler->down + resampler->up - 1) / resampler->up + 1 + resampler->taps;
+    if (resampler->max_in < resampler->max_push)
+        resampler->max_in = resampler->max_push;
+    if (max_out == 0 || resampler->max_push == 0)
+    {
+        printf("%lu output frames per call are too few to resample\n", max_out);
+        return -1;
+    }
+
+    if (design_bank(resampler) != 0)
+        return -1;
+
+    resampler->history_stride = resampler->taps + resampler->max_in;
+    resampler->history = calloc((size_t)channel * resampler->history_stride, sizeof(float));
+    resampler->out_pos = malloc(sizeof(unsigned) * max_out);
+    resampler->out_phase = malloc(sizeof(unsigned) * max_out);
+    if (resampler->history == NULL || resampler->out_pos == NULL || resampler->out_phase == NULL)
+    {
+        printf("Failed to allocate resampler history\n");
+        resampler_free(resampler);
+        return -1;
+    }
+
+    // start from silence, the first output frame's window ends at the first input frame
+    resampler->avail = resampler->taps - 1;
+    return 0;
+}
+
+void resampler_free(struct Resampler *resampler)
+{
+    free(resampler->bank);
+    free(resampler->history);
+    free(resampler->out_pos);
+    free(resampler->out_phase);
+    memset(resampler, 0, sizeof(*resampler));
+}
+
+unsigned long resampler_input_frames(const struct Resampler *resampler, unsigned long out_frames)
+{
+    if (out_frames == 0)
+        return 0;
+
+    // the window of the last of the frames starts here, and has to be in the history as a whole
+    unsigned long last = resampler->pos + (resampler->phase + (out_frames - 1) * (unsigned long)resampler->down) /
+                         resampler->up;
+    unsigned long needed = last + resampler->taps;
+    return needed > resampler->avail ? needed - resampler->avail : 0;
+}
+
+unsigned long resampler_process(struct Resampler *resampler, const float *in, unsigned long in_frames,
+                                float *out, unsigned long max_out, size_t frame_stride, size_t channel_stride)
+{
+    int channel = resampler->channel;
+    size_t stride = resampler->history_stride;
+    unsigned taps = resampler->taps;
+    unsigned long f;
+    int c;
+
+    // de-interleave behind what's kept, every channel's window is contiguous
+    for (c = 0; c < channel; ++c)
+    {
+        float *history = resampler->history + c * stride + resampler->avail;
+        for (f = 0; f < in_frames; ++f)
+            history[f] = in[f * channel + c];
+    }
+    resampler->avail += in_frames;
+
+    // where every output frame's window starts and which phase it is
+    unsigned long n = 0;
+    unsigned long pos = resampler->pos;
+    unsigned phase = resampler->phase;
+    if (max_out > resampler->max_out)
+        max_out = resampler->max_out;
+    while (n < max_out && pos + taps <= resampler->avail)
+    {
+        resampler->out_pos[n] = pos;
+        resampler->out_phase[n] = phase;
+        ++n;
+        phase += resampler->down;
+        pos += phase / resampler->up;
+        phase %= resampler->up;
+    }
+
+    for (c = 0; c < channel; ++c)
+        resampler->kernel(resampler->bank, taps, resampler->history + c * stride, resampler->out_pos,
+                          resampler->out_phase, out + c * channel_stride, frame_stride, n);
+
+    // keep the history from the next window on, it is shorter than a window
+    unsigned long keep = pos < resampler->avail ? resampler->avail - pos : 0;
+    if (pos > 0)
+        for (c = 0; c < channel; ++c)
+            memmove(resampler->history + c * stride, resampler->history + c * stride + pos, sizeof(float) * keep);
+    resampler->pos = pos - (resampler->avail - keep);
+    resampler->avail = keep;
+    resampler->phase = phase;
+    return n;
+}
+
+const char *src_quality_to_name(enum Src_quality quality)
+{
+    return src_names[quality];
+}
+
+int src_name_to_quality(const char *name, enum Src_quality *quality)
+{
+    int i;
+    for (i = 0; i < SRC_QUALITY_NUM; ++i)
+    {
+        if (!strcmp(name, src_names[i]))
+        {
+            *quality = (enum Src_quality)i;
+            return 0;
+        }
+    }
+    return -1;
+}
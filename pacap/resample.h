@@ -0,0 +1,96 @@
+/*************************************************************************
+ Description: Streaming polyphase sample rate converter.
+
+              Rates are reduced to a ratio of integers up/down (44.1kHz to
+              48kHz is 160/147). A Kaiser windowed sinc low pass of up * taps
+              points, at up times the input rate, is split into up phases
+              of `taps` points when the converter is set up. Every output
+              frame is then one phase's dot product with the last `taps`
+              input frames of a channel, nothing else is computed.
+
+              Quality presets trade taps (CPU) against stopband attenuation:
+              the stopband starts at the lower Nyquist frequency, so nothing
+              aliases above the attenuation, and the passband ends where the
+              transition the taps allow begins.
+
+              The dot products are GCC generic vectors, compiled for the
+              baseline and, on x86, for AVX2, like the generators in gen.c.
+
+              Input is interleaved float, kept per channel as a history of
+              at most `taps` frames between calls, so the converter streams
+              with constant memory. It can be pulled (ask how many input
+              frames the next output frames need) or pushed (give it what
+              came in and take whatever output that makes).
+ ************************************************************************/
+
+#ifndef PACAP_RESAMPLE_H
+#define PACAP_RESAMPLE_H
+
+#include <stddef.h>
+
+#include "render.h"
+
+/* floats a kernel multiplies at once, 8 fill an AVX register */
+#define SRC_WIDTH 8
+
+enum Src_quality
+{
+    SRC_OFF,
+    SRC_LOW,        // 32 taps, 70 dB
+    SRC_MEDIUM,     // 64 taps, 100 dB
+    SRC_HIGH,       // 128 taps, 120 dB
+    SRC_QUALITY_NUM
+};
+
+// out[k * stride] = dot(bank + phase[k] * taps, x + pos[k]) for `frames` frames
+typedef void (*Resample_kernel)(const float *bank, unsigned taps, const float *x, const unsigned *pos,
+                                const unsigned *phase, float *out, size_t stride, unsigned long frames);
+
+struct Resampler
+{
+    double in_rate;
+    double out_rate;
+    unsigned up;
+    unsigned down;
+    unsigned taps;              // per phase, a multiple of 2 * SRC_WIDTH
+    double passband;            // Hz, where the response starts to fall
+    double stopband_db;
+    float *bank;                // `up` phases of `taps` points, in the order they meet the input
+    Resample_kernel kernel;
+
+    int channel;
+    float *history;             // per channel, `history_stride` frames each
+    size_t history_stride;
+    unsigned long avail;        // frames in the history of every channel
+    unsigned long pos;          // first history frame the next output frame uses
+    unsigned phase;             // of the next output frame, in [0, up)
+
+    unsigned long max_out;      // most output frames of one call
+    unsigned long max_in;       // most input frames of one call
+    unsigned long max_push;     // most input frames of one pushed call, so no output is held back
+    unsigned *out_pos;          // scratch: pos of every output frame of a call
+    unsigned *out_phase;        // scratch: phase of every output frame of a call
+};
+
+/* convert from `in_rate` to `out_rate`, both whole Hz, at most `max_out` output frames per call.
+ * return 0 on success, messages are printed on errors */
+int resampler_init(struct Resampler *resampler, double in_rate, double out_rate, int channel,
+                   enum Src_quality quality, unsigned long max_out, enum Simd_level simd_level);
+void resampler_free(struct Resampler *resampler);
+
+// input frames the next `out_frames` output frames need, at most `max_in` for at most `max_out`
+unsigned long resampler_input_frames(const struct Resampler *resampler, unsigned long out_frames);
+
+/* take `in_frames` (at most `max_in`) interleaved input frames and write at most `max_out` output frames,
+ * frame `k` of channel `c` at out[k * frame_stride + c * channel_stride]. Pulled, `in_frames` is what
+ * resampler_input_frames() said and `max_out` what was asked for; pushed, `in_frames` is at most
+ * `max_push`. return the count of output frames */
+unsigned long resampler_process(struct Resampler *resampler, const float *in, unsigned long in_frames,
+                                float *out, unsigned long max_out, size_t frame_stride, size_t channel_stride);
+
+const char *src_quality_to_name(enum Src_quality quality);
+
+// return 0 on success, -1 if name is unknown
+int src_name_to_quality(const char *name, enum Src_quality *quality);
+
+#endif
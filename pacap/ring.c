@@ -0,0 +1,117 @@
+/*************************************************************************
+ Description: Lock-free SPSC byte ring buffer, see ring.h.
+
+              `head` and `tail` are never wrapped, the position inside the
+              buffer is `index & mask`. The producer publishes data with a
+              release store of `head` which the consumer loads with acquire,
+              and the same the other way around for `tail`.
+ ************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+int ring_init(struct Ring *ring, size_t min_size)
+{
+    size_t size = 1;
+    while (size < min_size)
+        size <<= 1;
+
+    ring->buf = malloc(size);
+    if (ring->buf == NULL)
+        return -1;
+
+    // touch every page now so that the audio thread never page faults on it
+    memset(ring->buf, 0, size);
+
+    ring->size = size;
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return 0;
+}
+
+void ring_free(struct Ring *ring)
+{
+    free(ring->buf);
+    ring->buf = NULL;
+}
+
+size_t ring_read_space(struct Ring *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    return head - tail;
+}
+
+size_t ring_write_space(struct Ring *ring)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return ring->size - (head - tail);
+}
+
+size_t ring_write(struct Ring *ring, const void *data, size_t bytes)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (ring->size - (head - tail) < bytes)
+        return 0;
+
+    size_t offset = head & ring->mask;
+    size_t first = ring->size - offset;
+    if (first > bytes)
+        first = bytes;
+
+    memcpy(ring->buf + offset, data, first);
+    memcpy(ring->buf, (const char*)data + first, bytes - first);
+
+    atomic_store_explicit(&ring->head, head + bytes, memory_order_release);
+    return bytes;
+}
+
+size_t ring_peek(struct Ring *ring, const void **part1, size_t *len1, const void **part2, size_t *len2)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t avail = head - tail;
+
+    size_t offset = tail & ring->mask;
+    size_t first = ring->size - offset;
+    if (first > avail)
+        first = avail;
+
+    *part1 = ring->buf + offset;
+    *len1 = first;
+    *part2 = ring->buf;
+    *len2 = avail - first;
+    return avail;
+}
+
+void ring_consume(struct Ring *ring, size_t bytes)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + bytes, memory_order_release);
+}
+
+size_t ring_read(struct Ring *ring, void *data, size_t bytes)
+{
+    const void *part1, *part2;
+    size_t len1, len2;
+
+    if (ring_peek(ring, &part1, &len1, &part2, &len2) < bytes)
+        return 0;
+
+    if (len1 >= bytes)
+        memcpy(data, part1, bytes);
+    else
+    {
+        memcpy(data, part1, len1);
+        memcpy((char*)data + len1, part2, bytes - len1);
+    }
+
+    ring_consume(ring, bytes);
+    return bytes;
+}
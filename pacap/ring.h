@@ -0,0 +1,44 @@
+/*************************************************************************
+ Description: Lock-free single-producer/single-consumer byte ring buffer.
+
+              Exactly one thread may write and exactly one thread may read.
+              Neither side ever blocks or allocates, so the audio callback
+              can be either of them.
+ ************************************************************************/
+
+#ifndef PACAP_RING_H
+#define PACAP_RING_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+struct Ring
+{
+    char *buf;
+    size_t size;    // power of 2
+    size_t mask;
+
+    /* free running indexes, each on its own cache line to avoid false sharing */
+    _Alignas(64) atomic_size_t head;    // advanced by the producer
+    _Alignas(64) atomic_size_t tail;    // advanced by the consumer
+};
+
+// allocate (and prefault) at least `min_size` bytes, return 0 on success
+int ring_init(struct Ring *ring, size_t min_size);
+void ring_free(struct Ring *ring);
+
+size_t ring_read_space(struct Ring *ring);
+size_t ring_write_space(struct Ring *ring);
+
+// producer: write all `bytes` or nothing, return bytes written
+size_t ring_write(struct Ring *ring, const void *data, size_t bytes);
+
+/* consumer: get the readable region without copying, as at most 2 contiguous parts,
+ * return the total readable bytes. Call ring_consume() once done with them. */
+size_t ring_peek(struct Ring *ring, const void **part1, size_t *len1, const void **part2, size_t *len2);
+void ring_consume(struct Ring *ring, size_t bytes);
+
+// consumer: copy out all `bytes` or nothing, return bytes read
+size_t ring_read(struct Ring *ring, void *data, size_t bytes);
+
+#endif
@@ -0,0 +1,258 @@
+/*************************************************************************
+ Description: Real-time setup of the audio path, see rt.h.
+
+              Future mappings are only locked when the memlock limit can't
+              be hit: with MCL_FUTURE every later mmap() is charged in full
+              against RLIMIT_MEMLOCK, thread stacks included, and fails once
+              it is exceeded, so PortAudio couldn't even create its thread.
+ ************************************************************************/
+
+#define _GNU_SOURCE // pthread_setaffinity_np, sched_getcpu
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <malloc.h>
+#include <alloca.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "rt.h"
+
+/* stack faulted in: the main thread's before locking, the audio thread's in its first callback */
+#define RT_MAIN_STACK_BYTES (256 * 1024)
+#define RT_AUDIO_STACK_BYTES (64 * 1024)
+
+void rt_config_init(struct Rt_config *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->audio_cpu = -1;
+}
+
+static int has_workers(const struct Rt_config *config)
+{
+    unsigned i;
+    for (i = 0; i < RT_MAX_CPUS / 64; ++i)
+        if (config->workers[i])
+            return 1;
+    return 0;
+}
+
+int rt_is_enabled(const struct Rt_config *config)
+{
+    return config->priority > 0 || config->audio_cpu >= 0 || config->is_mlock;
+}
+
+static int parse_cpu(const char *str, char **end, long cpus)
+{
+    long cpu = strtol(str, end, 10);
+    if (*end == str || cpu < 0)
+    {
+        printf("Invalid CPU list in --cpu: %s\n", str);
+        return -1;
+    }
+    if (cpu >= cpus || cpu >= RT_MAX_CPUS)
+    {
+        printf("There is no CPU %ld, this host has %ld\n", cpu, cpus);
+        return -1;
+    }
+    return (int)cpu;
+}
+
+int rt_parse_cpus(const char *list, struct Rt_config *config)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    char *end;
+    int cpu;
+
+    memset(config->workers, 0, sizeof(config->workers));
+    if ((config->audio_cpu = parse_cpu(list, &end, cpus)) < 0)
+        return -1;
+
+    while (*end == ',')
+    {
+        int last;
+        if ((cpu = parse_cpu(end + 1, &end, cpus)) < 0)
+            return -1;
+        last = cpu;
+        if (*end == '-' && (last = parse_cpu(end + 1, &end, cpus)) < cpu)
+        {
+            if (last >= 0)
+                printf("Invalid CPU range in --cpu: %d-%d\n", cpu, last);
+            return -1;
+        }
+        for (; cpu <= last; ++cpu)
+            config->workers[cpu / 64] |= 1ULL << (cpu % 64);
+    }
+    if (*end != '\0')
+    {
+        printf("Invalid --cpu: %s\n", list);
+        return -1;
+    }
+
+    // the workers keep off the audio CPU unless it is the only one
+    if (!has_workers(config))
+    {
+        for (cpu = 0; cpu < cpus && cpu < RT_MAX_CPUS; ++cpu)
+            if (cpu != config->audio_cpu)
+                config->workers[cpu / 64] |= 1ULL << (cpu % 64);
+    }
+    return 0;
+}
+
+int rt_check_priority(int priority)
+{
+    int min = sched_get_priority_min(SCHED_FIFO), max = sched_get_priority_max(SCHED_FIFO);
+    if (priority < min || priority > max)
+    {
+        printf("SCHED_FIFO priority must be %d to %d, not %d\n", min, max, priority);
+        return -1;
+    }
+    return 0;
+}
+
+int rt_prepare(const struct Rt_config *config)
+{
+    if (has_workers(config))
+    {
+        cpu_set_t set;
+        char list[512];
+        size_t len = 0;
+        int cpu;
+
+        CPU_ZERO(&set);
+        list[0] = '\0';
+        for (cpu = 0; cpu < RT_MAX_CPUS; ++cpu)
+        {
+            if (config->workers[cpu / 64] & (1ULL << (cpu % 64)))
+            {
+                CPU_SET(cpu, &set);
+                if (len < sizeof(list))
+                    len += snprintf(list + len, sizeof(list) - len, "%s%d", len ? "," : "", cpu);
+            }
+        }
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0)
+        {
+            printf("Failed to pin worker threads to CPUs %s: %s\n", list, strerror(err));
+            return -1;
+        }
+        printf("Worker threads on CPUs %s, audio thread on CPU %d\n", list, config->audio_cpu);
+    }
+
+    // what's freed stays in the locked heap, and large buffers come from it instead of new mappings
+    if (config->is_mlock)
+    {
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_MAX, 0);
+    }
+    return 0;
+}
+
+// kB of VmLck in /proc/self/status, 0 if it can't be read
+static unsigned long locked_kb(void)
+{
+    FILE *fp = fopen("/proc/self/status", "r");
+    char line[128];
+    unsigned long kb = 0;
+
+    if (fp == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), fp))
+        if (sscanf(line, "VmLck: %lu kB", &kb) == 1)
+            break;
+    fclose(fp);
+    return kb;
+}
+
+// touch `bytes` of the calling thread's stack below the caller, so it is resident before it is needed
+static __attribute__((noinline)) void prefault_stack(size_t bytes)
+{
+    volatile char *stack = alloca(bytes);
+    size_t i;
+    for (i = 0; i < bytes; i += 4096)
+        stack[i] = 0;
+}
+
+int rt_lock_memory(struct Rt_memory *memory)
+{
+    struct rlimit limit;
+    int flags = MCL_CURRENT;
+
+    memset(memory, 0, sizeof(*memory));
+    prefault_stack(RT_MAIN_STACK_BYTES);
+
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        memory->limit_kb = limit.rlim_cur / 1024;
+    if (memory->limit_kb == 0 || geteuid() == 0)
+        flags |= MCL_FUTURE;
+
+    if (mlockall(flags) != 0)
+    {
+        printf("Failed to lock memory: %s", strerror(errno));
+        if (memory->limit_kb)
+            printf(" (memlock limit is %lu kB, raise it with \"ulimit -l\")", memory->limit_kb);
+        printf("\n");
+        return -1;
+    }
+    memory->is_locked = 1;
+    memory->is_future_locked = (flags & MCL_FUTURE) != 0;
+    memory->locked_kb = locked_kb();
+    return 0;
+}
+
+void rt_audio_thread(const struct Rt_config *config, struct Rt_thread *thread)
+{
+    thread->is_done = 1;
+
+    if (config->audio_cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(config->audio_cpu, &set);
+        thread->affinity_error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    if (config->priority > 0)
+    {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = config->priority;
+        thread->policy_error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    }
+    if (config->is_mlock)
+        prefault_stack(RT_AUDIO_STACK_BYTES);
+    thread->cpu = sched_getcpu();
+}
+
+const char *rt_describe_thread(const struct Rt_config *config, const struct Rt_thread *thread, char *buf,
+                               size_t size)
+{
+    size_t len = 0;
+
+    if (!thread->is_done)
+    {
+        snprintf(buf, size, "never called back");
+        return buf;
+    }
+
+    if (config->priority <= 0)
+        len += snprintf(buf + len, size - len, "default policy");
+    else if (thread->policy_error)
+        len += snprintf(buf + len, size - len, "SCHED_FIFO %d failed (%s)", config->priority,
+                        strerror(thread->policy_error));
+    else
+        len += snprintf(buf + len, size - len, "SCHED_FIFO %d", config->priority);
+
+    if (len < size && config->audio_cpu >= 0 && thread->affinity_error)
+        len += snprintf(buf + len, size - len, ", pinning to CPU %d failed (%s)", config->audio_cpu,
+                        strerror(thread->affinity_error));
+    else if (len < size && config->audio_cpu >= 0)
+        len += snprintf(buf + len, size - len, ", pinned to CPU %d", config->audio_cpu);
+    if (len < size)
+        snprintf(buf + len, size - len, ", ran on CPU %d", thread->cpu);
+    return buf;
+}
@@ -0,0 +1,81 @@
+/*************************************************************************
+ Description: Real-time setup of the audio path: SCHED_FIFO priority, CPU
+              pinning and locked memory.
+
+              Worker threads (capture writer, telemetry, file read-ahead,
+              control, blocking I/O, ...) are not told anything: the main
+              thread pins itself to the worker CPUs before any of them is
+              created, and they inherit its affinity. The audio thread is
+              PortAudio's, so it raises and pins itself in its first
+              callback, the only time rt_audio_thread() does any work.
+
+              Memory is locked right before the stream starts, once every
+              buffer is allocated: mlockall() faults in and locks all of
+              them and the main thread's stack. The audio thread's stack is
+              faulted in by its first callback.
+ ************************************************************************/
+
+#ifndef PACAP_RT_H
+#define PACAP_RT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CPUs above this can't be chosen */
+#define RT_MAX_CPUS 256
+
+struct Rt_config
+{
+    int priority;           // SCHED_FIFO priority of the audio thread, 0 leaves its policy alone
+    int audio_cpu;          // CPU the audio thread is pinned to, -1 leaves it alone
+    uint64_t workers[RT_MAX_CPUS / 64]; // CPUs of every other thread, none leaves them alone
+    int is_mlock;
+};
+
+/* what the audio thread's first callback did, only read once the stream is stopped */
+struct Rt_thread
+{
+    int is_done;
+    int policy_error;       // errno of pthread_setschedparam(), 0 if it is SCHED_FIFO
+    int affinity_error;     // errno of pthread_setaffinity_np(), 0 if it is pinned
+    int cpu;                // CPU the first callback ran on once pinned
+};
+
+/* what rt_lock_memory() locked */
+struct Rt_memory
+{
+    int is_locked;
+    int is_future_locked;   // mappings created later are locked too
+    unsigned long locked_kb;
+    unsigned long limit_kb; // RLIMIT_MEMLOCK, 0 if unlimited
+};
+
+void rt_config_init(struct Rt_config *config);
+
+// non-zero if any option is set, then faults and callback jitter are reported
+int rt_is_enabled(const struct Rt_config *config);
+
+/* parse --cpu=AUDIO[,WORKERS]: the audio thread's CPU, then a comma separated list of CPUs and
+ * ranges (e.g. "1-3,6") for the worker threads, every other CPU if none. return 0 on success */
+int rt_parse_cpus(const char *list, struct Rt_config *config);
+
+// check --rt-prio, return 0 if SCHED_FIFO has such a priority
+int rt_check_priority(int priority);
+
+/* called in the main thread before any other thread exists: pin it to the worker CPUs and keep
+ * freed memory in the heap if memory is going to be locked. return 0 on success */
+int rt_prepare(const struct Rt_config *config);
+
+/* called right before Pa_StartStream(): fault in the main thread's stack and lock every mapping.
+ * return 0 on success */
+int rt_lock_memory(struct Rt_memory *memory);
+
+/* called from the first callback of the audio thread: raise it to SCHED_FIFO, pin it and fault its
+ * stack in. Failures are only recorded in `thread`, the callback can't report them */
+void rt_audio_thread(const struct Rt_config *config, struct Rt_thread *thread);
+
+// one line describing the audio thread's policy, e.g. "SCHED_FIFO 80, CPU 2"
+const char *rt_describe_thread(const struct Rt_config *config, const struct Rt_thread *thread, char *buf,
+                               size_t size);
+
+#endif
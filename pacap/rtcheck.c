@@ -0,0 +1,606 @@
+/*************************************************************************
+ Description: RT-safety checker of the audio callbacks, see rtcheck.h.
+
+              The interposed functions are defined in the executable, so
+              they win over libc's for pacap and for the libraries it loads
+              (PortAudio, ALSA) alike. The allocator is reached through
+              glibc's __libc_* entry points, since dlsym() allocates, the
+              rest through dlsym(RTLD_NEXT).
+
+              A violation is recorded in a fixed table of call sites, told
+              apart by their backtrace, under a spinlock: the checker itself
+              must neither allocate nor lock anything the callback could.
+              Calls an interposed function makes on its own (printf() ends
+              in malloc() and write()) are part of the same violation.
+ ************************************************************************/
+
+#define _GNU_SOURCE // RTLD_NEXT, REG_*
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+
+#if defined(__x86_64__)
+#include <ucontext.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#define HAVE_SYSCALL_TRACE 1
+#endif
+
+#include "rtcheck.h"
+
+/* distinct call sites kept, the rest are only counted */
+#define RTCHECK_MAX_SITES 64
+
+/* frames of each backtrace, the innermost are the checker's own: record() and violation(),
+ * for a syscall also the SIGSYS handler and the signal frame */
+#define RTCHECK_FRAMES 24
+#define RTCHECK_OWN_FRAMES 2
+#define RTCHECK_OWN_SYSCALL_FRAMES 4
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+struct Site
+{
+    const char *what;       // interposed function or syscall
+    long syscall_nr;        // -1 unless it is a syscall
+    uint64_t hash;          // of all of the above and the backtrace
+    void *frames[RTCHECK_FRAMES];
+    int depth;
+    unsigned long count;
+};
+
+static struct Site sites[RTCHECK_MAX_SITES];
+static int n_sites;
+static atomic_flag sites_lock = ATOMIC_FLAG_INIT;
+
+static atomic_ulong violations;
+static atomic_ulong unkept;         // violations at sites beyond the table
+static atomic_ulong callbacks;
+static atomic_ulong trace_failures;
+
+static int is_tracing_syscalls;
+
+static __thread int callback_depth;    // > 0 while this thread runs a callback
+static __thread int is_recording;      // in an interposed function, what it calls is the same violation
+static __thread int is_traced;       // syscall user dispatch is on for this thread
+
+/* the real functions, looked up once at start, or on first use by library constructors running before */
+static int (*real_vfprintf)(FILE *, const char *, va_list);
+static int (*real_fputs)(const char *, FILE *);
+static int (*real_puts)(const char *);
+static int (*real_fputc)(int, FILE *);
+static int (*real_putc)(int, FILE *);
+static int (*real_putchar)(int);
+static size_t (*real_fwrite)(const void *, size_t, size_t, FILE *);
+static size_t (*real_fread)(void *, size_t, size_t, FILE *);
+static char *(*real_fgets)(char *, int, FILE *);
+static int (*real_fflush)(FILE *);
+static FILE *(*real_fopen)(const char *, const char *);
+static int (*real_fclose)(FILE *);
+static void (*real_perror)(const char *);
+static int (*real_mutex_lock)(pthread_mutex_t *);
+static int (*real_mutex_trylock)(pthread_mutex_t *);
+static int (*real_mutex_unlock)(pthread_mutex_t *);
+
+static void *resolve(void **real, const char *symbol)
+{
+    if (*real == NULL)
+        *real = dlsym(RTLD_NEXT, symbol);
+    return *real;
+}
+
+#define REAL(name, symbol) ((__typeof__(real_##name))resolve((void**)&real_##name, symbol))
+
+static __attribute__((noinline)) void record(const char *what, long syscall_nr)
+{
+    void *frames[RTCHECK_FRAMES];
+    int depth = backtrace(frames, RTCHECK_FRAMES);
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a over the site
+    int i;
+
+    hash = (hash ^ (uintptr_t)what) * 1099511628211ULL;
+    hash = (hash ^ (uint64_t)syscall_nr) * 1099511628211ULL;
+    for (i = 0; i < depth; ++i)
+        hash = (hash ^ (uintptr_t)frames[i]) * 1099511628211ULL;
+
+    atomic_fetch_add_explicit(&violations, 1, memory_order_relaxed);
+
+    while (atomic_flag_test_and_set_explicit(&sites_lock, memory_order_acquire))
+        ;
+    for (i = 0; i < n_sites; ++i)
+        if (sites[i].hash == hash)
+            break;
+    if (i == n_sites && n_sites < RTCHECK_MAX_SITES)
+    {
+        struct Site *site = &sites[n_sites++];
+        site->what = what;
+        site->syscall_nr = syscall_nr;
+        site->hash = hash;
+        memcpy(site->frames, frames, sizeof(void*) * depth);
+        site->depth = depth;
+    }
+    if (i < n_sites)
+        sites[i].count++;
+    else
+        atomic_fetch_add_explicit(&unkept, 1, memory_order_relaxed);
+    atomic_flag_clear_explicit(&sites_lock, memory_order_release);
+}
+
+/* record `what` if this thread is in a callback and not in an interposed function already,
+ * return 1 if it did, then violation_done() is due once the real function returned */
+static __attribute__((noinline)) int violation(const char *what, long syscall_nr)
+{
+    if (callback_depth == 0 || is_recording)
+        return 0;
+    is_recording = 1;
+    record(what, syscall_nr);
+    return 1;
+}
+
+static inline void violation_done(int is_violation)
+{
+    if (is_violation)
+        is_recording = 0;
+}
+
+/*******************************************************
+ * Interposed functions
+ *******************************************************/
+
+void *malloc(size_t size)
+{
+    int is_violation = violation("malloc", -1);
+    void *ptr = __libc_malloc(size);
+    violation_done(is_violation);
+    return ptr;
+}
+
+void *calloc(size_t n, size_t size)
+{
+    int is_violation = violation("calloc", -1);
+    void *ptr = __libc_calloc(n, size);
+    violation_done(is_violation);
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    int is_violation = violation("realloc", -1);
+    ptr = __libc_realloc(ptr, size);
+    violation_done(is_violation);
+    return ptr;
+}
+
+void free(void *ptr)
+{
+    int is_violation = ptr ? violation("free", -1) : 0;
+    __libc_free(ptr);
+    violation_done(is_violation);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    int is_violation = violation("memalign", -1);
+    void *ptr = __libc_memalign(alignment, size);
+    violation_done(is_violation);
+    return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    int is_violation = violation("aligned_alloc", -1);
+    void *ptr = __libc_memalign(alignment, size);
+    violation_done(is_violation);
+    return ptr;
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    int is_violation = violation("posix_memalign", -1);
+    void *p = __libc_memalign(alignment, size);
+    violation_done(is_violation);
+    if (p == NULL)
+        return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+
+int vfprintf(FILE *fp, const char *fmt, va_list ap)
+{
+    int is_violation = violation("vfprintf", -1);
+    int ret = REAL(vfprintf, "vfprintf")(fp, fmt, ap);
+    violation_done(is_violation);
+    return ret;
+}
+
+int vprintf(const char *fmt, va_list ap)
+{
+    int is_violation = violation("vprintf", -1);
+    int ret = REAL(vfprintf, "vfprintf")(stdout, fmt, ap);
+    violation_done(is_violation);
+    return ret;
+}
+
+int fprintf(FILE *fp, const char *fmt, ...)
+{
+    int is_violation = violation("fprintf", -1);
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = REAL(vfprintf, "vfprintf")(fp, fmt, ap);
+    va_end(ap);
+    violation_done(is_violation);
+    return ret;
+}
+
+int printf(const char *fmt, ...)
+{
+    int is_violation = violation("printf", -1);
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = REAL(vfprintf, "vfprintf")(stdout, fmt, ap);
+    va_end(ap);
+    violation_done(is_violation);
+    return ret;
+}
+
+int fputs(const char *str, FILE *fp)
+{
+    int is_violation = violation("fputs", -1);
+    int ret = REAL(fputs, "fputs")(str, fp);
+    violation_done(is_violation);
+    return ret;
+}
+
+int puts(const char *str)
+{
+    int is_violation = violation("puts", -1);
+    int ret = REAL(puts, "puts")(str);
+    violation_done(is_violation);
+    return ret;
+}
+
+int fputc(int c, FILE *fp)
+{
+    int is_violation = violation("fputc", -1);
+    int ret = REAL(fputc, "fputc")(c, fp);
+    violation_done(is_violation);
+    return ret;
+}
+
+int putc(int c, FILE *fp)
+{
+    int is_violation = violation("putc", -1);
+    int ret = REAL(putc, "putc")(c, fp);
+    violation_done(is_violation);
+    return ret;
+}
+
+int putchar(int c)
+{
+    int is_violation = violation("putchar", -1);
+    int ret = REAL(putchar, "putchar")(c);
+    violation_done(is_violation);
+    return ret;
+}
+
+size_t fwrite(const void *ptr, size_t size, size_t n, FILE *fp)
+{
+    int is_violation = violation("fwrite", -1);
+    size_t ret = REAL(fwrite, "fwrite")(ptr, size, n, fp);
+    violation_done(is_violation);
+    return ret;
+}
+
+size_t fread(void *ptr, size_t size, size_t n, FILE *fp)
+{
+    int is_violation = violation("fread", -1);
+    size_t ret = REAL(fread, "fread")(ptr, size, n, fp);
+    violation_done(is_violation);
+    return ret;
+}
+
+char *fgets(char *str, int size, FILE *fp)
+{
+    int is_violation = violation("fgets", -1);
+    char *ret = REAL(fgets, "fgets")(str, size, fp);
+    violation_done(is_violation);
+    return ret;
+}
+
+int fflush(FILE *fp)
+{
+    int is_violation = violation("fflush", -1);
+    int ret = REAL(fflush, "fflush")(fp);
+    violation_done(is_violation);
+    return ret;
+}
+
+FILE *fopen(const char *path, const char *mode)
+{
+    int is_violation = violation("fopen", -1);
+    FILE *ret = REAL(fopen, "fopen")(path, mode);
+    violation_done(is_violation);
+    return ret;
+}
+
+int fclose(FILE *fp)
+{
+    int is_violation = violation("fclose", -1);
+    int ret = REAL(fclose, "fclose")(fp);
+    violation_done(is_violation);
+    return ret;
+}
+
+void perror(const char *str)
+{
+    int is_violation = violation("perror", -1);
+    REAL(perror, "perror")(str);
+    violation_done(is_violation);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+    int is_violation = violation("pthread_mutex_lock", -1);
+    int ret = REAL(mutex_lock, "pthread_mutex_lock")(mutex);
+    violation_done(is_violation);
+    return ret;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex)
+{
+    int is_violation = violation("pthread_mutex_trylock", -1);
+    int ret = REAL(mutex_trylock, "pthread_mutex_trylock")(mutex);
+    violation_done(is_violation);
+    return ret;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+    int is_violation = violation("pthread_mutex_unlock", -1);
+    int ret = REAL(mutex_unlock, "pthread_mutex_unlock")(mutex);
+    violation_done(is_violation);
+    return ret;
+}
+
+/*******************************************************
+ * Syscall tracing
+ *
+ * Syscall user dispatch traps every syscall of a thread
+ * made outside one code range while its selector says
+ * BLOCK, which it does only while the thread calls back.
+ * The range holds raw_syscall(), which the SIGSYS handler
+ * makes the trapped syscall with, and the handler's return
+ * into the kernel. Unlike a seccomp filter it is switched
+ * off between callbacks, where glibc makes syscalls with
+ * every signal blocked (e.g. when a thread exits) and a
+ * trap would kill the process.
+ *******************************************************/
+
+#ifdef HAVE_SYSCALL_TRACE
+
+#ifndef PR_SET_SYSCALL_USER_DISPATCH
+#define PR_SET_SYSCALL_USER_DISPATCH 59
+#define PR_SYS_DISPATCH_ON 1
+#define SYSCALL_DISPATCH_FILTER_ALLOW 0
+#define SYSCALL_DISPATCH_FILTER_BLOCK 1
+#endif
+#ifndef SYS_USER_DISPATCH
+#define SYS_USER_DISPATCH 2
+#endif
+
+long rtcheck_raw_syscall(long nr, long a1, long a2, long a3, long a4, long a5, long a6);
+void rtcheck_restore_rt(void);
+extern const char rtcheck_syscall_begin[], rtcheck_syscall_end[];
+
+__asm__(".text\n"
+        "rtcheck_syscall_begin:\n"
+        ".type rtcheck_raw_syscall, @function\n"
+        "rtcheck_raw_syscall:\n"
+        "    movq %rdi, %rax\n"
+        "    movq %rsi, %rdi\n"
+        "    movq %rdx, %rsi\n"
+        "    movq %rcx, %rdx\n"
+        "    movq %r8, %r10\n"
+        "    movq %r9, %r8\n"
+        "    movq 8(%rsp), %r9\n"
+        "    syscall\n"
+        "    ret\n"
+        ".size rtcheck_raw_syscall, .-rtcheck_raw_syscall\n"
+        ".type rtcheck_restore_rt, @function\n"
+        "rtcheck_restore_rt:\n"
+        "    movq $15, %rax\n"          // rt_sigreturn
+        "    syscall\n"
+        "    ud2\n"                     // the range has to go past the syscall instruction
+        ".size rtcheck_restore_rt, .-rtcheck_restore_rt\n"
+        "rtcheck_syscall_end:\n");
+
+/* what rt_sigaction() takes, glibc's sigaction() would put its own return outside the range */
+struct Kernel_sigaction
+{
+    void (*handler)(int, siginfo_t *, void *);
+    unsigned long flags;
+    void (*restorer)(void);
+    uint64_t mask;
+};
+
+#define KERNEL_SA_RESTORER 0x04000000
+
+static __thread volatile char selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+
+static const struct
+{
+    long nr;
+    const char *name;
+} syscall_names[] = {
+    {SYS_read, "read"}, {SYS_write, "write"}, {SYS_open, "open"}, {SYS_openat, "openat"},
+    {SYS_close, "close"}, {SYS_futex, "futex"}, {SYS_mmap, "mmap"}, {SYS_munmap, "munmap"},
+    {SYS_mprotect, "mprotect"}, {SYS_madvise, "madvise"}, {SYS_brk, "brk"}, {SYS_ioctl, "ioctl"},
+    {SYS_poll, "poll"}, {SYS_ppoll, "ppoll"}, {SYS_nanosleep, "nanosleep"},
+    {SYS_clock_nanosleep, "clock_nanosleep"}, {SYS_clock_gettime, "clock_gettime"},
+    {SYS_sched_yield, "sched_yield"}, {SYS_getpid, "getpid"}, {SYS_gettid, "gettid"},
+    {SYS_sched_setscheduler, "sched_setscheduler"}, {SYS_sched_setaffinity, "sched_setaffinity"},
+    {SYS_getrusage, "getrusage"}, {SYS_sendto, "sendto"}, {SYS_recvfrom, "recvfrom"},
+    {SYS_getppid, "getppid"}, {SYS_kill, "kill"}, {SYS_tgkill, "tgkill"}, {SYS_sched_getaffinity, "sched_getaffinity"},
+};
+
+static const char *syscall_name(long nr)
+{
+    unsigned i;
+    for (i = 0; i < sizeof(syscall_names)/sizeof(syscall_names[0]); ++i)
+        if (syscall_names[i].nr == nr)
+            return syscall_names[i].name;
+    return "?";
+}
+
+static void on_sigsys(int sig, siginfo_t *info, void *context)
+{
+    greg_t *regs = ((ucontext_t*)context)->uc_mcontext.gregs;
+    long nr = info->si_syscall;
+    int saved_errno = errno;
+
+    (void)sig;
+    if (info->si_code != SYS_USER_DISPATCH)
+        return;
+
+    int is_violation = violation(syscall_name(nr), nr);
+    regs[REG_RAX] = rtcheck_raw_syscall(nr, regs[REG_RDI], regs[REG_RSI], regs[REG_RDX], regs[REG_R10],
+                                        regs[REG_R8], regs[REG_R9]);
+    violation_done(is_violation);
+    errno = saved_errno;
+}
+
+static void trace_thread(void)
+{
+    sigset_t set;
+
+    is_traced = 1;
+
+    // a blocked SIGSYS would kill the thread at its first trap
+    sigemptyset(&set);
+    sigaddset(&set, SIGSYS);
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+
+    if (prctl(PR_SET_SYSCALL_USER_DISPATCH, PR_SYS_DISPATCH_ON, (unsigned long)rtcheck_syscall_begin,
+              (unsigned long)(rtcheck_syscall_end - rtcheck_syscall_begin), &selector) != 0)
+        atomic_fetch_add(&trace_failures, 1);
+}
+
+#endif
+
+/*******************************************************
+ * Entry points
+ *******************************************************/
+
+void rtcheck_init(void)
+{
+    void *frames[1];
+    const char *env = getenv("PACAP_RTCHECK_SYSCALLS");
+
+    // backtrace() loads the unwinder on first use, that mustn't happen in a callback
+    backtrace(frames, 1);
+
+    REAL(vfprintf, "vfprintf");
+    REAL(fputs, "fputs");
+    REAL(puts, "puts");
+    REAL(fputc, "fputc");
+    REAL(putc, "putc");
+    REAL(putchar, "putchar");
+    REAL(fwrite, "fwrite");
+    REAL(fread, "fread");
+    REAL(fgets, "fgets");
+    REAL(fflush, "fflush");
+    REAL(fopen, "fopen");
+    REAL(fclose, "fclose");
+    REAL(perror, "perror");
+    REAL(mutex_lock, "pthread_mutex_lock");
+    REAL(mutex_trylock, "pthread_mutex_trylock");
+    REAL(mutex_unlock, "pthread_mutex_unlock");
+
+    if (env == NULL || !strcmp(env, "0"))
+        return;
+#ifdef HAVE_SYSCALL_TRACE
+    struct Kernel_sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.handler = on_sigsys;
+    // a syscall the handler makes outside the range traps again
+    action.flags = SA_SIGINFO | SA_NODEFER | SA_RESTART | KERNEL_SA_RESTORER;
+    action.restorer = rtcheck_restore_rt;
+    if (syscall(SYS_rt_sigaction, SIGSYS, &action, NULL, sizeof(action.mask)) != 0)
+    {
+        perror("rt-check: rt_sigaction(SIGSYS)");
+        return;
+    }
+    is_tracing_syscalls = 1;
+#else
+    printf("rt-check: syscalls can only be traced on x86-64\n");
+#endif
+}
+
+void rtcheck_enter(void)
+{
+#ifdef HAVE_SYSCALL_TRACE
+    if (is_tracing_syscalls && !is_traced)
+        trace_thread();
+#endif
+    atomic_fetch_add_explicit(&callbacks, 1, memory_order_relaxed);
+    ++callback_depth;
+#ifdef HAVE_SYSCALL_TRACE
+    selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+#endif
+}
+
+void rtcheck_leave(void)
+{
+#ifdef HAVE_SYSCALL_TRACE
+    selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+#endif
+    --callback_depth;
+}
+
+int rtcheck_report(void)
+{
+    unsigned long total = atomic_load(&violations);
+    int i;
+
+    if (total == 0 && atomic_load(&callbacks) == 0)
+        return 0;
+
+    printf("\nrt-check: %lu violations in %lu callbacks%s\n", total, atomic_load(&callbacks),
+           is_tracing_syscalls ? ", syscalls traced" : "");
+    if (atomic_load(&trace_failures))
+        printf("rt-check: syscalls couldn't be traced on %lu threads\n", atomic_load(&trace_failures));
+
+    for (i = 0; i < n_sites; ++i)
+    {
+        const struct Site *site = &sites[i];
+        int own = site->syscall_nr >= 0 ? RTCHECK_OWN_SYSCALL_FRAMES : RTCHECK_OWN_FRAMES;
+        if (site->syscall_nr >= 0)
+            printf("%lu x syscall %ld (%s)\n", site->count, site->syscall_nr, site->what);
+        else
+            printf("%lu x %s\n", site->count, site->what);
+        fflush(stdout);
+        if (site->depth > own)
+            backtrace_symbols_fd((void *const *)site->frames + own, site->depth - own, STDOUT_FILENO);
+    }
+    if (atomic_load(&unkept))
+        printf("%lu more at sites beyond the first %d\n", atomic_load(&unkept), RTCHECK_MAX_SITES);
+
+    return total ? -1 : 0;
+}
@@ -0,0 +1,48 @@
+/*************************************************************************
+ Description: RT-safety checker of the audio callbacks, a debug build.
+
+              Configured with -DPACAP_RTCHECK=ON, pacap interposes
+              malloc/free and friends, the stdio functions and pthread
+              mutexes. Called while a callback runs, between rtcheck_enter()
+              and rtcheck_leave(), they are violations: each is recorded
+              with its backtrace and counted per call site, then passed on.
+              Nothing is printed until rtcheck_report() at exit, which makes
+              pacap fail if there was any, so every subcommand (render needs
+              no device) can gate RT regressions.
+
+              With PACAP_RTCHECK_SYSCALLS=1 in the environment syscalls are
+              checked too. seccomp's log mode has no backtrace and a filter
+              can't be lifted between callbacks, so syscall user dispatch
+              (Linux 5.11) traps those a thread makes while it calls back
+              into a SIGSYS handler, which records them and then makes the
+              syscall on the thread's behalf. x86-64 only.
+
+              In a normal build all of it compiles to nothing.
+ ************************************************************************/
+
+#ifndef PACAP_RTCHECK_H
+#define PACAP_RTCHECK_H
+
+#ifdef PACAP_RTCHECK
+
+// at start of main(), before any thread exists
+void rtcheck_init(void);
+
+/* around the body of a callback, the first call on a thread installs its syscall filter.
+ * Setting up the thread (e.g. rt_audio_thread()) belongs before rtcheck_enter() */
+void rtcheck_enter(void);
+void rtcheck_leave(void);
+
+// print every violation with its backtrace, return non-zero if there was any
+int rtcheck_report(void);
+
+#else
+
+static inline void rtcheck_init(void) {}
+static inline void rtcheck_enter(void) {}
+static inline void rtcheck_leave(void) {}
+static inline int rtcheck_report(void) { return 0; }
+
+#endif
+
+#endif
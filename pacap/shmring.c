@@ -0,0 +1,202 @@
+/*************************************************************************
+ Description: Shared memory audio ring between processes, see shmring.h.
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shmring.h"
+
+/* most frames a ring holds, about 23 minutes of 8 channels of float at 48 kHz */
+#define SHM_RING_MAX_CAPACITY (1ULL << 26)
+
+size_t shm_ring_sample_size(uint32_t format)
+{
+    switch (format)
+    {
+        case SHM_RING_F32:
+        case SHM_RING_I32:
+            return 4;
+        case SHM_RING_I24:
+            return 3;
+        case SHM_RING_I16:
+            return 2;
+        case SHM_RING_U8:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void set_name(struct Shm_ring *ring, const char *name)
+{
+    snprintf(ring->name, sizeof(ring->name), "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+int shm_ring_create(struct Shm_ring *ring, const char *name, uint32_t format, int channel, double rate,
+                    uint64_t capacity)
+{
+    memset(ring, 0, sizeof(*ring));
+    set_name(ring, name);
+
+    size_t sample_size = shm_ring_sample_size(format);
+    if (sample_size == 0 || channel <= 0 || rate <= 0)
+    {
+        printf("Invalid shared memory ring format\n");
+        return -1;
+    }
+    if (capacity == 0 || capacity > SHM_RING_MAX_CAPACITY)
+    {
+        printf("A shared memory ring holds 1 to %llu frames\n", (unsigned long long)SHM_RING_MAX_CAPACITY);
+        return -1;
+    }
+    uint64_t frames = 1;
+    while (frames < capacity)
+        frames <<= 1;
+
+    ring->bytes_per_frame = sample_size * channel;
+    ring->mask = frames - 1;
+    ring->map_size = SHM_RING_HEADER_BYTES + frames * ring->bytes_per_frame;
+
+    int fd = shm_open(ring->name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        perror(ring->name);
+        return -1;
+    }
+    if (ftruncate(fd, ring->map_size) != 0)
+    {
+        perror(ring->name);
+        close(fd);
+        shm_unlink(ring->name);
+        return -1;
+    }
+    // populated, neither side faults the ring in while streaming
+    void *map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror(ring->name);
+        shm_unlink(ring->name);
+        return -1;
+    }
+
+    ring->header = map;
+    ring->data = (unsigned char*)map + SHM_RING_HEADER_BYTES;
+    ring->is_owner = 1;
+
+    struct Shm_ring_header *header = ring->header;
+    header->version = SHM_RING_VERSION;
+    header->header_bytes = SHM_RING_HEADER_BYTES;
+    header->format = format;
+    header->channel = channel;
+    header->bytes_per_frame = ring->bytes_per_frame;
+    header->rate = rate;
+    header->capacity = frames;
+    atomic_store(&header->flags, 0);
+    atomic_store(&header->head, 0);
+    atomic_store(&header->tail, 0);
+    atomic_store(&header->underruns, 0);
+    atomic_store(&header->frames_starved, 0);
+    __atomic_store_n(&header->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+uint64_t shm_ring_write_space(const struct Shm_ring *ring)
+{
+    uint64_t head = atomic_load_explicit(&ring->header->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->header->tail, memory_order_acquire);
+    return ring->mask + 1 - (head - tail);
+}
+
+uint64_t shm_ring_write(struct Shm_ring *ring, const void *frames, uint64_t count)
+{
+    uint64_t head = atomic_load_explicit(&ring->header->head, memory_order_relaxed);
+    uint64_t space = shm_ring_write_space(ring);
+    if (count > space)
+        count = space;
+
+    // at most 2 parts, up to the end of the data and from its beginning
+    uint64_t offset = head & ring->mask;
+    uint64_t first = ring->mask + 1 - offset;
+    if (first > count)
+        first = count;
+    memcpy(ring->data + offset * ring->bytes_per_frame, frames, first * ring->bytes_per_frame);
+    memcpy(ring->data, (const unsigned char*)frames + first * ring->bytes_per_frame,
+           (count - first) * ring->bytes_per_frame);
+
+    atomic_store_explicit(&ring->header->head, head + count, memory_order_release);
+    return count;
+}
+
+void shm_ring_finish(struct Shm_ring *ring)
+{
+    atomic_fetch_or_explicit(&ring->header->flags, SHM_RING_FINISHED, memory_order_release);
+}
+
+int shm_ring_open(struct Shm_ring *ring, const char *name)
+{
+    memset(ring, 0, sizeof(*ring));
+    set_name(ring, name);
+
+    int fd = shm_open(ring->name, O_RDWR, 0);
+    if (fd < 0)
+    {
+        perror(ring->name);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < SHM_RING_HEADER_BYTES)
+    {
+        printf("%s is not a shared memory ring\n", ring->name);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        perror(ring->name);
+        return -1;
+    }
+    ring->header = map;
+    ring->map_size = st.st_size;
+
+    const struct Shm_ring_header *header = ring->header;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC || header->version != SHM_RING_VERSION)
+    {
+        printf("%s is not a shared memory ring of version %d\n", ring->name, SHM_RING_VERSION);
+        shm_ring_close(ring);
+        return -1;
+    }
+    size_t sample_size = shm_ring_sample_size(header->format);
+    if (sample_size == 0 || header->channel == 0 || header->bytes_per_frame != sample_size * header->channel ||
+        header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0 || header->rate <= 0 ||
+        header->header_bytes < sizeof(*header) ||
+        header->header_bytes + header->capacity * header->bytes_per_frame > ring->map_size)
+    {
+        printf("%s has an invalid header\n", ring->name);
+        shm_ring_close(ring);
+        return -1;
+    }
+
+    ring->data = (unsigned char*)map + header->header_bytes;
+    ring->mask = header->capacity - 1;
+    ring->bytes_per_frame = header->bytes_per_frame;
+    return 0;
+}
+
+void shm_ring_close(struct Shm_ring *ring)
+{
+    if (ring->header)
+        munmap(ring->header, ring->map_size);
+    if (ring->is_owner)
+        shm_unlink(ring->name);
+    ring->header = NULL;
+    ring->data = NULL;
+}
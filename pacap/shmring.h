@@ -0,0 +1,150 @@
+/*************************************************************************
+ Description: Shared memory audio ring between processes.
+
+              A producer process creates the ring as a POSIX shared memory
+              object and writes interleaved frames into it, pacap plays
+              them with --source=shm:NAME straight from its mapping. Like
+              ring.h there is exactly one producer and one consumer, and
+              neither ever blocks, locks or makes a syscall: free running
+              frame counters in the header tell how much is written and
+              read, the consumer's callback only loads, copies out of the
+              mapping and stores.
+
+              The object is laid out as
+
+                0     struct Shm_ring_header, one page
+                4096  `capacity` frames of `channel` interleaved samples
+                      in `format`, frame i at (i % capacity)
+
+              All fields are little endian as written by the host, the
+              counters are 64 bit atomics shared by both processes. The
+              producer fills in everything but `magic` first and stores
+              `magic` last, so a consumer never sees a half written header.
+
+              This file and shmring.c are all a producer needs, they don't
+              depend on PortAudio or the rest of pacap.
+ ************************************************************************/
+
+#ifndef PACAP_SHMRING_H
+#define PACAP_SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define SHM_RING_MAGIC 0x52534150u     // "PASR"
+#define SHM_RING_VERSION 1
+#define SHM_RING_HEADER_BYTES 4096
+
+/* sample formats, the values of PortAudio's PaSampleFormat */
+#define SHM_RING_F32 0x01u
+#define SHM_RING_I32 0x02u
+#define SHM_RING_I24 0x04u  // packed, 3 bytes
+#define SHM_RING_I16 0x08u
+#define SHM_RING_U8 0x20u
+
+/* `flags` */
+#define SHM_RING_FINISHED 0x01u  // the producer wrote its last frame, the consumer stops once it is read
+
+struct Shm_ring_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_bytes;      // offset of frame 0
+    uint32_t format;            // SHM_RING_*
+    uint32_t channel;
+    uint32_t bytes_per_frame;
+    double rate;
+    uint64_t capacity;          // in frames, a power of 2
+
+    atomic_uint flags;          // SHM_RING_FINISHED, set by the producer
+
+    /* free running frame counters, each on its own cache line */
+    _Alignas(64) _Atomic uint64_t head;     // frames written, advanced by the producer
+    _Alignas(64) _Atomic uint64_t tail;     // frames read, advanced by the consumer
+
+    /* kept by the consumer, for the producer to see how it keeps up */
+    _Alignas(64) _Atomic uint64_t underruns;        // times the consumer found fewer frames than it wanted
+    _Atomic uint64_t frames_starved;                // frames it played as silence instead
+};
+
+/* one process' view of a ring */
+struct Shm_ring
+{
+    struct Shm_ring_header *header;
+    unsigned char *data;
+    uint64_t mask;              // capacity - 1
+    size_t bytes_per_frame;
+    size_t map_size;
+    char name[256];
+    int is_owner;               // created it, close unlinks it
+};
+
+// bytes of a sample of `format`, 0 if it isn't one
+size_t shm_ring_sample_size(uint32_t format);
+
+/* producer: create ring `name` ("/" is prepended if it has none) of at least `capacity` frames,
+ * replacing one of the same name. return 0 on success */
+int shm_ring_create(struct Shm_ring *ring, const char *name, uint32_t format, int channel, double rate,
+                    uint64_t capacity);
+
+// producer: frames which can be written now
+uint64_t shm_ring_write_space(const struct Shm_ring *ring);
+
+// producer: write at most `count` of `frames`, return how many were written
+uint64_t shm_ring_write(struct Shm_ring *ring, const void *frames, uint64_t count);
+
+// producer: no more frames will be written
+void shm_ring_finish(struct Shm_ring *ring);
+
+/* consumer: map an existing ring, checking its header. return 0 on success */
+int shm_ring_open(struct Shm_ring *ring, const char *name);
+
+/* unmap the ring, the producer also removes its name. The data stays until both have closed it */
+void shm_ring_close(struct Shm_ring *ring);
+
+/* consumer, in the callback: return the next frames in the mapping, at most `*count` (updated to what's
+ * readable without wrapping), NULL if there is none. Call shm_ring_advance() once they are consumed */
+static inline const void *shm_ring_peek(struct Shm_ring *ring, unsigned long *count)
+{
+    struct Shm_ring_header *header = ring->header;
+    uint64_t tail = atomic_load_explicit(&header->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+    uint64_t readable = head - tail;
+    uint64_t offset = tail & ring->mask;
+
+    if (readable == 0)
+        return NULL;
+    if (readable > ring->mask + 1 - offset)
+        readable = ring->mask + 1 - offset;
+    if (*count > readable)
+        *count = readable;
+    return ring->data + offset * ring->bytes_per_frame;
+}
+
+static inline void shm_ring_advance(struct Shm_ring *ring, unsigned long count)
+{
+    uint64_t tail = atomic_load_explicit(&ring->header->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->header->tail, tail + count, memory_order_release);
+}
+
+/* consumer, in the callback after shm_ring_peek() returned NULL: return 1 if the producer has finished,
+ * otherwise count the underrun, whose `frames` are played as silence */
+static inline int shm_ring_at_end(struct Shm_ring *ring, unsigned long frames)
+{
+    struct Shm_ring_header *header = ring->header;
+
+    if (atomic_load_explicit(&header->flags, memory_order_acquire) & SHM_RING_FINISHED)
+    {
+        // frames written before the flag was set are visible now
+        if (atomic_load_explicit(&header->head, memory_order_acquire) ==
+            atomic_load_explicit(&header->tail, memory_order_relaxed))
+            return 1;
+        return 0;
+    }
+    atomic_fetch_add_explicit(&header->underruns, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&header->frames_starved, frames, memory_order_relaxed);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,204 @@
+/*************************************************************************
+ Description: Self-test of the shared memory source, see shmtest.h.
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "shmtest.h"
+#include "shmring.h"
+#include "filesrc.h"
+
+/* sample of `frame` on `ch`, scrambled so swapped or torn samples don't look like a counter */
+static inline int32_t pattern(uint64_t frame, int channel, int ch)
+{
+    return (int32_t)((uint32_t)(frame * channel + ch) * 0x9E3779B1u);
+}
+
+// written by the producer process, read once it has exited
+struct Producer_result
+{
+    uint64_t waits;
+};
+
+static void produce(struct Shm_ring *ring, const struct Shm_test_config *config, struct Producer_result *result)
+{
+    int32_t *chunk = malloc(sizeof(int32_t) * config->chunk_frames * config->channel);
+    uint64_t frame = 0;
+    // paced, an eighth of the ring is read while the producer sleeps
+    double pause_s = config->rate > 0 ? (config->capacity / 8) / config->rate : 0;
+    struct timespec pause = {(time_t)pause_s, (long)((pause_s - (time_t)pause_s) * 1e9)};
+
+    if (chunk == NULL)
+    {
+        printf("Failed to allocate the producer's chunk\n");
+        shm_ring_finish(ring);
+        _exit(1);
+    }
+    while (frame < config->frames)
+    {
+        uint64_t count = config->frames - frame;
+        uint64_t done = 0, i;
+        int ch;
+
+        if (count > config->chunk_frames)
+            count = config->chunk_frames;
+        for (i = 0; i < count; ++i)
+            for (ch = 0; ch < config->channel; ++ch)
+                chunk[i * config->channel + ch] = pattern(frame + i, config->channel, ch);
+
+        // a full ring is waited out, the consumer never waits for the producer
+        while ((done += shm_ring_write(ring, chunk + done * config->channel, count - done)) < count)
+        {
+            ++result->waits;
+            if (config->rate > 0)
+                nanosleep(&pause, NULL);
+            else
+                sched_yield();
+        }
+        frame += count;
+    }
+    shm_ring_finish(ring);
+    free(chunk);
+    _exit(0);
+}
+
+static double elapsed(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) * 1e-9;
+}
+
+static void next_deadline(struct timespec *t, long ns)
+{
+    t->tv_nsec += ns;
+    while (t->tv_nsec >= 1000000000L)
+    {
+        t->tv_nsec -= 1000000000L;
+        ++t->tv_sec;
+    }
+}
+
+// one consumer "callback": return 1 once the producer finished and everything is read
+static int consume_block(struct File_source *source, const struct Shm_test_config *config,
+                         struct Shm_test_result *result)
+{
+    unsigned long done = 0;
+
+    while (done < config->block_frames)
+    {
+        unsigned long n = config->block_frames - done;
+        const int32_t *p = file_source_peek(source, &n);
+        if (p == NULL)
+            return file_source_at_end(source, config->block_frames - done);
+
+        unsigned long i;
+        int ch;
+        for (i = 0; i < n; ++i)
+        {
+            for (ch = 0; ch < config->channel; ++ch)
+            {
+                if (p[i * config->channel + ch] != pattern(result->frames_read + i, config->channel, ch))
+                {
+                    if (result->mismatches++ == 0)
+                        result->first_mismatch = result->frames_read + i;
+                }
+            }
+        }
+        file_source_advance(source, n);
+        result->frames_read += n;
+        done += n;
+    }
+    return 0;
+}
+
+int shm_test_run(const struct Shm_test_config *config, struct Shm_test_result *result)
+{
+    struct Shm_ring ring;
+    struct File_source source;
+    struct Producer_result *producer;
+    struct timespec start, end, deadline;
+    int ret = -1, status;
+    pid_t pid;
+
+    memset(result, 0, sizeof(*result));
+    if (config->channel <= 0 || config->block_frames == 0 || config->chunk_frames == 0)
+    {
+        printf("Invalid shmtest configuration\n");
+        return -1;
+    }
+
+    producer = mmap(NULL, sizeof(*producer), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (producer == MAP_FAILED)
+    {
+        perror("mmap");
+        return -1;
+    }
+    memset(producer, 0, sizeof(*producer));
+
+    // the ring exists before the producer starts writing and the consumer maps it
+    if (shm_ring_create(&ring, config->name, SHM_RING_I32, config->channel, config->rate > 0 ? config->rate : 48000,
+                        config->capacity) != 0)
+        goto unmap;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        goto close_ring;
+    }
+    if (pid == 0)
+        produce(&ring, config, producer);
+
+    // mapped again by name, as pacap --source=shm does
+    if (file_source_open_shm(&source, config->name) != 0)
+    {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        goto close_ring;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    deadline = start;
+    for (;;)
+    {
+        uint64_t before = result->frames_read;
+        if (consume_block(&source, config, result))
+            break;
+        ++result->blocks;
+        if (config->rate > 0)
+        {
+            next_deadline(&deadline, (long)(1e9 * config->block_frames / config->rate));
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        }
+        else if (result->frames_read - before < config->block_frames)
+            sched_yield(); // the ring ran dry, on one CPU the producer needs a turn
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result->seconds = elapsed(&start, &end);
+
+    struct File_source_stats stats;
+    file_source_get_stats(&source, &stats);
+    result->underruns = stats.shm_underruns;
+    result->frames_starved = stats.shm_frames_starved;
+    file_source_close(&source);
+
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        printf("The producer failed\n");
+    else if (result->frames_read == config->frames && result->mismatches == 0)
+        ret = 0;
+    result->producer_waits = producer->waits;
+
+close_ring:
+    shm_ring_close(&ring);
+unmap:
+    munmap(producer, sizeof(*producer));
+    return ret;
+}
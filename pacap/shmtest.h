@@ -0,0 +1,46 @@
+/*************************************************************************
+ Description: Self-test of the shared memory source for "shmtest".
+
+              A forked producer process writes a counting pattern of i32
+              samples through the producer library (shmring.h) as fast as
+              the ring takes it. The consumer maps the ring by name like
+              --source=shm does and reads it exactly as the playback
+              callback does, block by block through file_source_peek(),
+              file_source_advance() and file_source_at_end(), checking
+              every sample. Unpaced both sides run at memory speed, with
+              a rate the consumer is paced like a device. No audio
+              hardware is involved.
+ ************************************************************************/
+
+#ifndef PACAP_SHMTEST_H
+#define PACAP_SHMTEST_H
+
+#include <stdint.h>
+
+struct Shm_test_config
+{
+    const char *name;           // of the ring
+    int channel;
+    uint64_t frames;            // written by the producer in total
+    uint64_t capacity;          // of the ring, in frames
+    unsigned long block_frames; // wanted by the consumer at a time, like a callback
+    unsigned long chunk_frames; // written by the producer at a time
+    double rate;                // the consumer's pace, 0 for as fast as possible
+};
+
+struct Shm_test_result
+{
+    uint64_t frames_read;
+    uint64_t mismatches;        // samples which weren't what the producer wrote
+    uint64_t first_mismatch;    // frame of the first one
+    uint64_t blocks;            // consumer "callbacks"
+    uint64_t underruns;         // blocks the ring couldn't fill
+    uint64_t frames_starved;
+    uint64_t producer_waits;    // times the producer found the ring full
+    double seconds;             // from the first to the last block
+};
+
+/* run producer and consumer, return 0 if every frame arrived in order and intact */
+int shm_test_run(const struct Shm_test_config *config, struct Shm_test_result *result);
+
+#endif
@@ -0,0 +1,183 @@
+/*************************************************************************
+ Description: Frequency response stimuli, see stimulus.h.
+ ************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "stimulus.h"
+
+/* RMS of Kellet's filter fed with uniform white noise in [-1, 1), measured over 10^8 samples */
+#define PINK_RMS 1.763
+
+static const char *stimulus_names[] = {"none", "sweep", "stepped", "pink"};
+
+int stimulus_init(struct Stimulus *stimulus, const struct Stimulus_config *config, double rate)
+{
+    memset(stimulus, 0, sizeof(*stimulus));
+    stimulus->config = *config;
+    stimulus->rate = rate;
+    stimulus->amplitude = pow(10, config->level_db / 20);
+    stimulus->period_frames = (uint64_t)(config->period * rate + 0.5);
+    stimulus->noise = 0x9e3779b9u;
+
+    if (config->type == STIMULUS_PINK)
+        return 0;
+
+    if (config->start <= 0 || config->stop <= config->start || config->stop >= rate / 2)
+    {
+        printf("Stimulus range %g-%g Hz must be increasing, from above 0 to below Nyquist (%g Hz)\n",
+               config->start, config->stop, rate / 2);
+        return -1;
+    }
+    if (stimulus->period_frames == 0)
+    {
+        printf("Stimulus period must be longer than a frame\n");
+        return -1;
+    }
+    if (config->type == STIMULUS_STEPPED && (config->steps == 0 || stimulus->period_frames < config->steps))
+    {
+        printf("Stepped stimulus needs between 1 and one step per frame of the period\n");
+        return -1;
+    }
+
+    stimulus->sweep_l = config->period / log(config->stop / config->start);
+    stimulus->sweep_k = exp(1 / (rate * stimulus->sweep_l));
+    return 0;
+}
+
+/* sweep frames [m, m + frames) of the current period */
+static void generate_sweep(struct Stimulus *stimulus, float *buf, uint64_t m, unsigned long frames)
+{
+    double l = stimulus->sweep_l;
+    double k = stimulus->sweep_k;
+    double a = stimulus->amplitude;
+    double growth = exp(m / stimulus->rate / l);
+
+    // exact at the first frame, then stepped by the exact increment of the phase over one frame
+    double freq = stimulus->config.start * growth;
+    double phase = fmod(2*M_PI * stimulus->config.start * l * (growth - 1), 2*M_PI);
+    double step = 2*M_PI * l * (k - 1);
+    unsigned long i;
+
+    for (i = 0; i < frames; ++i)
+    {
+        buf[i] = a * sin(phase);
+        phase += step * freq;
+        freq *= k;
+    }
+}
+
+/* stepped frames [m, m + frames) of the current period, all within one step */
+static void generate_stepped(struct Stimulus *stimulus, float *buf, uint64_t m, unsigned long frames)
+{
+    double step = 2*M_PI * stimulus_frequency(stimulus, m) / stimulus->rate;
+    double phase = stimulus->phase;
+    double a = stimulus->amplitude;
+    unsigned long i;
+
+    for (i = 0; i < frames; ++i)
+    {
+        buf[i] = a * sin(phase);
+        phase += step;
+    }
+    stimulus->phase = fmod(phase, 2*M_PI);
+}
+
+static void generate_pink(struct Stimulus *stimulus, float *buf, unsigned long frames)
+{
+    double *b = stimulus->pink;
+    uint32_t x = stimulus->noise;
+    double scale = stimulus->amplitude / 4 / PINK_RMS;     // crest factor of 12 dB
+    unsigned long i;
+
+    for (i = 0; i < frames; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        double white = (int32_t)x / 2147483648.0;
+
+        b[0] = 0.99886 * b[0] + white * 0.0555179;
+        b[1] = 0.99332 * b[1] + white * 0.0750759;
+        b[2] = 0.96900 * b[2] + white * 0.1538520;
+        b[3] = 0.86650 * b[3] + white * 0.3104856;
+        b[4] = 0.55000 * b[4] + white * 0.5329522;
+        b[5] = -0.7616 * b[5] - white * 0.0168980;
+        buf[i] = scale * (b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + white * 0.5362);
+        b[6] = white * 0.115926;
+    }
+    stimulus->noise = x;
+}
+
+void stimulus_generate(struct Stimulus *stimulus, float *buf, unsigned long frames)
+{
+    if (stimulus->config.type == STIMULUS_PINK)
+    {
+        generate_pink(stimulus, buf, frames);
+        stimulus->frame += frames;
+        return;
+    }
+
+    // split at every boundary of a sweep or a step
+    while (frames > 0)
+    {
+        uint64_t m = stimulus->frame % stimulus->period_frames;
+        uint64_t end = stimulus->period_frames;
+        if (stimulus->config.type == STIMULUS_STEPPED)
+        {
+            unsigned steps = stimulus->config.steps;
+            uint64_t i = m * steps / stimulus->period_frames;
+            end = ((i + 1) * stimulus->period_frames + steps - 1) / steps;
+        }
+        unsigned long n = frames;
+        if (n > end - m)
+            n = end - m;
+
+        if (stimulus->config.type == STIMULUS_SWEEP)
+            generate_sweep(stimulus, buf, m, n);
+        else
+            generate_stepped(stimulus, buf, m, n);
+
+        stimulus->frame += n;
+        buf += n;
+        frames -= n;
+    }
+}
+
+double stimulus_frequency(const struct Stimulus *stimulus, uint64_t frame)
+{
+    const struct Stimulus_config *config = &stimulus->config;
+    if (config->type == STIMULUS_PINK || config->type == STIMULUS_NONE)
+        return 0;
+
+    uint64_t m = frame % stimulus->period_frames;
+    if (config->type == STIMULUS_SWEEP)
+        return config->start * exp(m / stimulus->rate / stimulus->sweep_l);
+
+    // step i of the period covers frames [i * period / steps, (i + 1) * period / steps)
+    uint64_t i = m * config->steps / stimulus->period_frames;
+    if (config->steps == 1)
+        return config->start;
+    return config->start * pow(config->stop / config->start, (double)i / (config->steps - 1));
+}
+
+const char *stimulus_type_to_name(enum Stimulus_type type)
+{
+    return stimulus_names[type];
+}
+
+int stimulus_name_to_type(const char *name, enum Stimulus_type *type)
+{
+    unsigned i;
+    for (i = 1; i < sizeof(stimulus_names)/sizeof(stimulus_names[0]); ++i)
+    {
+        if (!strcmp(name, stimulus_names[i]))
+        {
+            *type = (enum Stimulus_type)i;
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,77 @@
+/*************************************************************************
+ Description: Stimuli for frequency response measurements.
+
+              sweep:   exponential sine sweep from `start` to `stop` Hz in
+                       `period` seconds, then again from `start`
+              stepped: `steps` sine tones log spaced from `start` to `stop`
+                       Hz, each held for `period / steps` seconds, the
+                       phase is continuous across steps
+              pink:    pink (1/f) noise, white noise through Paul Kellet's
+                       filter
+
+              Everything is generated block by block from a few numbers of
+              state, nothing of a whole period is precomputed, so memory
+              stays the same for hour-long sweeps. Sweep frequency and phase
+              are computed in closed form from the frame count at the start
+              of every block and stepped exactly within it, so the sweep is
+              where it should be to the sample, however long it runs.
+ ************************************************************************/
+
+#ifndef PACAP_STIMULUS_H
+#define PACAP_STIMULUS_H
+
+#include <stdint.h>
+
+enum Stimulus_type
+{
+    STIMULUS_NONE,
+    STIMULUS_SWEEP,
+    STIMULUS_STEPPED,
+    STIMULUS_PINK
+};
+
+struct Stimulus_config
+{
+    enum Stimulus_type type;
+    double start;           // Hz
+    double stop;            // Hz
+    double period;          // seconds of one sweep or of all steps
+    unsigned steps;
+    double level_db;        // peak for tones, 12 dB over RMS for noise
+};
+
+struct Stimulus
+{
+    struct Stimulus_config config;
+    double rate;
+    double amplitude;
+    uint64_t frame;         // frames generated so far
+    uint64_t period_frames;
+
+    /* sweep: f(t) = start * e^(t / sweep_l), phase(t) = 2 * pi * start * sweep_l * (e^(t / sweep_l) - 1) */
+    double sweep_l;         // seconds
+    double sweep_k;         // frequency ratio of consecutive frames
+
+    /* stepped */
+    double phase;           // radian, kept in [0, 2*pi)
+
+    /* pink */
+    uint32_t noise;
+    double pink[7];
+};
+
+/* return 0 on success, messages are printed on errors */
+int stimulus_init(struct Stimulus *stimulus, const struct Stimulus_config *config, double rate);
+
+/* called from the audio callback: generate the next `frames` mono samples */
+void stimulus_generate(struct Stimulus *stimulus, float *buf, unsigned long frames);
+
+/* frequency played at `frame`, 0 for noise */
+double stimulus_frequency(const struct Stimulus *stimulus, uint64_t frame);
+
+const char *stimulus_type_to_name(enum Stimulus_type type);
+
+// return 0 on success, -1 if name is unknown
+int stimulus_name_to_type(const char *name, enum Stimulus_type *type);
+
+#endif
@@ -0,0 +1,238 @@
+/*************************************************************************
+ Description: Real-time safe stream telemetry, see telemetry.h.
+ ************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "telemetry.h"
+
+/* events the ring can hold, far more than callbacks within one report interval */
+#define EVENT_CAPACITY 8192
+
+/* at most this many xrun events are printed in detail per interval */
+#define MAX_XRUN_DETAILS 4
+
+#define XRUN_FLAGS (paOutputUnderflow|paOutputOverflow|paInputUnderflow|paInputOverflow)
+
+static const char *counter_names[TM_COUNTER_NUM] = {
+    "callbacks", "frames", "out-underflow", "out-overflow", "in-underflow", "in-overflow", "events-dropped"
+};
+
+int telemetry_init(struct Telemetry *telemetry, const char *name, double interval)
+{
+    memset(telemetry, 0, sizeof(*telemetry));
+    telemetry->name = name;
+    telemetry->interval = interval;
+
+    int i;
+    for (i = 0; i < TM_COUNTER_NUM; ++i)
+        atomic_init(&telemetry->counters[i], 0);
+
+    if (ring_init(&telemetry->events, EVENT_CAPACITY * sizeof(struct Telemetry_event)) != 0)
+        return -1;
+
+    telemetry->max_durations = telemetry->events.size / sizeof(struct Telemetry_event);
+    telemetry->durations = malloc(sizeof(uint64_t) * telemetry->max_durations);
+    if (telemetry->durations == NULL)
+    {
+        ring_free(&telemetry->events);
+        return -1;
+    }
+    return 0;
+}
+
+void telemetry_free(struct Telemetry *telemetry)
+{
+    ring_free(&telemetry->events);
+    free(telemetry->durations);
+    telemetry->durations = NULL;
+}
+
+static inline void count(struct Telemetry *telemetry, enum Telemetry_counter c, unsigned long n)
+{
+    atomic_fetch_add_explicit(&telemetry->counters[c], n, memory_order_relaxed);
+}
+
+void telemetry_record(struct Telemetry *telemetry, uint64_t begin_ns, unsigned long frames,
+                      const PaStreamCallbackTimeInfo *time_info, PaStreamCallbackFlags status_flags,
+                      int is_output)
+{
+    struct Telemetry_event event;
+
+    count(telemetry, TM_CALLBACKS, 1);
+    count(telemetry, TM_FRAMES, frames);
+    if (status_flags & paOutputUnderflow)
+        count(telemetry, TM_OUTPUT_UNDERFLOW, 1);
+    if (status_flags & paOutputOverflow)
+        count(telemetry, TM_OUTPUT_OVERFLOW, 1);
+    if (status_flags & paInputUnderflow)
+        count(telemetry, TM_INPUT_UNDERFLOW, 1);
+    if (status_flags & paInputOverflow)
+        count(telemetry, TM_INPUT_OVERFLOW, 1);
+
+    event.current_time = time_info ? time_info->currentTime : 0;
+    event.buffer_time = time_info ? (is_output ? time_info->outputBufferDacTime : time_info->inputBufferAdcTime) : 0;
+    event.frames = frames;
+    event.status_flags = status_flags;
+    event.duration_ns = telemetry_now_ns() - begin_ns;
+
+    if (ring_write(&telemetry->events, &event, sizeof(event)) != sizeof(event))
+        count(telemetry, TM_EVENTS_DROPPED, 1);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+void telemetry_print_prefix(const char *name)
+{
+    if (name)
+        printf("[%s] ", name);
+}
+
+void telemetry_vprint_line(const char *name, const char *label, const char *fmt, va_list ap)
+{
+    telemetry_print_prefix(name);
+    printf("%-20s: ", label);
+    vprintf(fmt, ap);
+    printf("\n");
+}
+
+void telemetry_print_line(const char *name, const char *label, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    telemetry_vprint_line(name, label, fmt, ap);
+    va_end(ap);
+}
+
+/* drain the events and print one summary, `prev` holds counters of the last summary */
+static void report(struct Telemetry *telemetry, unsigned long prev[TM_COUNTER_NUM], double elapsed)
+{
+    struct Telemetry_event event;
+    size_t n = 0;
+    int details = 0;
+
+    while (ring_read(&telemetry->events, &event, sizeof(event)) == sizeof(event))
+    {
+        if (n < telemetry->max_durations)
+            telemetry->durations[n++] = event.duration_ns;
+
+        if ((event.status_flags & XRUN_FLAGS) && details++ < MAX_XRUN_DETAILS)
+        {
+            telemetry_print_prefix(telemetry->name);
+            printf("xrun at stream time %.6f (buffer time %.6f):%s%s%s%s\n",
+                   event.current_time, event.buffer_time,
+                   (event.status_flags & paOutputUnderflow) ? " output underflow" : "",
+                   (event.status_flags & paOutputOverflow) ? " output overflow" : "",
+                   (event.status_flags & paInputUnderflow) ? " input underflow" : "",
+                   (event.status_flags & paInputOverflow) ? " input overflow" : "");
+        }
+    }
+
+    unsigned long now[TM_COUNTER_NUM];
+    int i;
+    for (i = 0; i < TM_COUNTER_NUM; ++i)
+        now[i] = atomic_load_explicit(&telemetry->counters[i], memory_order_relaxed);
+
+    double p50 = 0, p99 = 0, max = 0;
+    if (n > 0)
+    {
+        qsort(telemetry->durations, n, sizeof(uint64_t), cmp_u64);
+        p50 = telemetry->durations[n / 2] / 1e3;
+        p99 = telemetry->durations[(n * 99) / 100] / 1e3;
+        max = telemetry->durations[n - 1] / 1e3;
+        if (telemetry->durations[n - 1] > telemetry->total_max_ns)
+            telemetry->total_max_ns = telemetry->durations[n - 1];
+    }
+
+    telemetry_print_prefix(telemetry->name);
+    printf("%.0f cb/s, callback us p50 %.1f p99 %.1f max %.1f, cpu %.1f%%",
+           (now[TM_CALLBACKS] - prev[TM_CALLBACKS]) / elapsed, p50, p99, max,
+           100 * Pa_GetStreamCpuLoad(telemetry->stream));
+    for (i = TM_OUTPUT_UNDERFLOW; i < TM_COUNTER_NUM; ++i)
+    {
+        if (now[i] != prev[i])
+            printf(", %s %.1f/s", counter_names[i], (now[i] - prev[i]) / elapsed);
+    }
+    printf("\n");
+
+    memcpy(prev, now, sizeof(now));
+}
+
+static void *reporter_main(void *arg)
+{
+    struct Telemetry *telemetry = (struct Telemetry*)arg;
+    unsigned long prev[TM_COUNTER_NUM] = {0};
+    uint64_t last = telemetry_now_ns();
+
+    // sleep in short steps so that stopping doesn't wait a whole interval
+    const struct timespec step = {0, 50 * 1000 * 1000};
+
+    while (!atomic_load(&telemetry->is_stopping))
+    {
+        nanosleep(&step, NULL);
+
+        uint64_t now = telemetry_now_ns();
+        if (telemetry->interval > 0 && now - last >= telemetry->interval * 1e9)
+        {
+            report(telemetry, prev, (now - last) / 1e9);
+            fflush(stdout);
+            last = now;
+        }
+        else if (telemetry->interval <= 0)
+        {
+            // still keep the ring drained, only the overall max is kept
+            struct Telemetry_event event;
+            while (ring_read(&telemetry->events, &event, sizeof(event)) == sizeof(event))
+            {
+                if (event.duration_ns > telemetry->total_max_ns)
+                    telemetry->total_max_ns = event.duration_ns;
+            }
+        }
+    }
+    return NULL;
+}
+
+int telemetry_start(struct Telemetry *telemetry, PaStream *stream)
+{
+    telemetry->stream = stream;
+    if (pthread_create(&telemetry->reporter, NULL, reporter_main, telemetry) != 0)
+    {
+        printf("Failed to create telemetry reporter thread\n");
+        return -1;
+    }
+    return 0;
+}
+
+void telemetry_stop(struct Telemetry *telemetry)
+{
+    atomic_store(&telemetry->is_stopping, 1);
+    pthread_join(telemetry->reporter, NULL);
+
+    // events left since the last summary only contribute to the max
+    struct Telemetry_event event;
+    while (ring_read(&telemetry->events, &event, sizeof(event)) == sizeof(event))
+    {
+        if (event.duration_ns > telemetry->total_max_ns)
+            telemetry->total_max_ns = event.duration_ns;
+    }
+}
+
+unsigned long telemetry_get(struct Telemetry *telemetry, enum Telemetry_counter counter)
+{
+    return atomic_load(&telemetry->counters[counter]);
+}
+
+void telemetry_print_totals(struct Telemetry *telemetry)
+{
+    printf("\n");
+    int i;
+    for (i = 0; i < TM_COUNTER_NUM; ++i)
+        telemetry_print_line(telemetry->name, counter_names[i], "%lu", telemetry_get(telemetry, i));
+    telemetry_print_line(telemetry->name, "max callback us", "%.1f", telemetry->total_max_ns / 1e3);
+}
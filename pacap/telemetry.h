@@ -0,0 +1,95 @@
+/*************************************************************************
+ Description: Real-time safe stream telemetry.
+
+              The audio callback only bumps atomic counters and pushes one
+              fixed size event per callback into a lock-free ring. A reporter
+              thread drains the events and periodically prints xrun rates,
+              callback duration percentiles and PortAudio's CPU load.
+ ************************************************************************/
+
+#ifndef PACAP_TELEMETRY_H
+#define PACAP_TELEMETRY_H
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "portaudio.h"
+#include "ring.h"
+
+/* what the callback records about itself, timestamps come from PaStreamCallbackTimeInfo */
+struct Telemetry_event
+{
+    PaTime current_time;
+    PaTime buffer_time;     // outputBufferDacTime, or inputBufferAdcTime for input stream
+    uint64_t duration_ns;   // time spent in the callback
+    uint32_t frames;
+    uint32_t status_flags;
+};
+
+enum Telemetry_counter
+{
+    TM_CALLBACKS,
+    TM_FRAMES,
+    TM_OUTPUT_UNDERFLOW,
+    TM_OUTPUT_OVERFLOW,
+    TM_INPUT_UNDERFLOW,
+    TM_INPUT_OVERFLOW,
+    TM_EVENTS_DROPPED,      // events lost because the reporter fell behind
+    TM_COUNTER_NUM
+};
+
+struct Telemetry
+{
+    const char *name;           // prefix of reported lines, may be NULL
+    atomic_ulong counters[TM_COUNTER_NUM];
+    struct Ring events;
+
+    /* reporter side only */
+    PaStream *stream;
+    double interval;            // seconds between summaries, 0 means only the final one
+    pthread_t reporter;
+    atomic_int is_stopping;
+    uint64_t *durations;        // scratch for percentiles
+    size_t max_durations;
+    uint64_t total_max_ns;
+};
+
+static inline uint64_t telemetry_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// allocate the event ring, `interval` in seconds, return 0 on success
+int telemetry_init(struct Telemetry *telemetry, const char *name, double interval);
+
+// called from the audio callback when it is about to return, `begin_ns` from telemetry_now_ns() on entry
+void telemetry_record(struct Telemetry *telemetry, uint64_t begin_ns, unsigned long frames,
+                      const PaStreamCallbackTimeInfo *time_info, PaStreamCallbackFlags status_flags,
+                      int is_output);
+
+// start the reporter thread for a started `stream`
+int telemetry_start(struct Telemetry *telemetry, PaStream *stream);
+
+// stop the reporter thread, call it before the stream is closed
+void telemetry_stop(struct Telemetry *telemetry);
+
+unsigned long telemetry_get(struct Telemetry *telemetry, enum Telemetry_counter counter);
+
+void telemetry_print_totals(struct Telemetry *telemetry);
+
+// print "[name] " of a stream, nothing if `name` is NULL
+void telemetry_print_prefix(const char *name);
+
+// print one line of a summary, `label` aligned like the totals, prefixed by `name` unless NULL
+void telemetry_print_line(const char *name, const char *label, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+void telemetry_vprint_line(const char *name, const char *label, const char *fmt, va_list ap);
+
+void telemetry_free(struct Telemetry *telemetry);
+
+#endif
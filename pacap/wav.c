@@ -0,0 +1,153 @@
+/*************************************************************************
+ Description: Minimal RIFF/WAVE writer and header parser, see wav.h.
+
+              WAV stores 8 bits samples as unsigned, so i8 has no WAV
+              representation. Lengths larger than 4GB are saturated, readers
+              generally keep reading until end of file in that case.
+ ************************************************************************/
+
+#include <string.h>
+
+#include "wav.h"
+
+#define WAVE_FORMAT_PCM         1
+#define WAVE_FORMAT_IEEE_FLOAT  3
+#define WAVE_FORMAT_EXTENSIBLE  0xfffe
+
+static void put_le16(unsigned char *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put_le32(unsigned char *p, uint32_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = v >> 24;
+}
+
+int wav_format_supported(PaSampleFormat format)
+{
+    format &= ~paNonInterleaved;
+    return (format == paFloat32 || format == paInt32 || format == paInt24 ||
+            format == paInt16 || format == paUInt8) ? 0 : -1;
+}
+
+int wav_write_header(FILE *fp, PaSampleFormat format, int channel, double rate, uint64_t data_bytes)
+{
+    unsigned char h[WAV_HEADER_BYTES];
+
+    if (wav_format_supported(format) != 0)
+        return -1;
+    format &= ~paNonInterleaved;
+
+    int bytes_per_sample = Pa_GetSampleSize(format);
+    uint32_t data_len = data_bytes > UINT32_MAX - 36 ? UINT32_MAX - 36 : (uint32_t)data_bytes;
+
+    memcpy(h, "RIFF", 4);
+    put_le32(h + 4, 36 + data_len);
+    memcpy(h + 8, "WAVE", 4);
+
+    memcpy(h + 12, "fmt ", 4);
+    put_le32(h + 16, 16);
+    put_le16(h + 20, format == paFloat32 ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+    put_le16(h + 22, channel);
+    put_le32(h + 24, (uint32_t)rate);
+    put_le32(h + 28, (uint32_t)rate * channel * bytes_per_sample);
+    put_le16(h + 32, channel * bytes_per_sample);
+    put_le16(h + 34, 8 * bytes_per_sample);
+
+    memcpy(h + 36, "data", 4);
+    put_le32(h + 40, data_len);
+
+    return fwrite(h, sizeof(h), 1, fp) == 1 ? 0 : -1;
+}
+
+int wav_finalize(FILE *fp, PaSampleFormat format, int channel, double rate, uint64_t data_bytes)
+{
+    // RIFF chunks are word aligned
+    if ((data_bytes & 1) && fputc(0, fp) == EOF)
+        return -1;
+
+    if (fseek(fp, 0, SEEK_SET) != 0)
+        return -1;
+    if (wav_write_header(fp, format, channel, rate, data_bytes) != 0)
+        return -1;
+    return fseek(fp, 0, SEEK_END);
+}
+
+static uint16_t get_le16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int wav_parse_header(const void *buf, uint64_t size, uint64_t file_size, struct Wav_info *info)
+{
+    const unsigned char *p = buf;
+    int has_fmt = 0;
+    uint64_t pos = 12;
+
+    if (size < 12 || memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4))
+        return -1;
+
+    // walk the chunks until "data", "fmt " has to come before it
+    while (pos + 8 <= size)
+    {
+        const unsigned char *chunk = p + pos;
+        uint64_t len = get_le32(chunk + 4);
+
+        if (!memcmp(chunk, "fmt ", 4))
+        {
+            if (len < 16 || pos + 8 + len > size)
+                return -1;
+
+            unsigned tag = get_le16(chunk + 8);
+            unsigned bits = get_le16(chunk + 22);
+            if (tag == WAVE_FORMAT_EXTENSIBLE && len >= 40)
+                tag = get_le16(chunk + 32); // first 2 bytes of the sub format GUID
+
+            info->channel = get_le16(chunk + 10);
+            info->rate = get_le32(chunk + 12);
+
+            if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 32)
+                info->format = paFloat32;
+            else if (tag == WAVE_FORMAT_PCM && bits == 8)
+                info->format = paUInt8;
+            else if (tag == WAVE_FORMAT_PCM && bits == 16)
+                info->format = paInt16;
+            else if (tag == WAVE_FORMAT_PCM && bits == 24)
+                info->format = paInt24;
+            else if (tag == WAVE_FORMAT_PCM && bits == 32)
+                info->format = paInt32;
+            else
+                return -1;
+            if (info->channel <= 0 || info->rate <= 0)
+                return -1;
+            has_fmt = 1;
+        }
+        else if (!memcmp(chunk, "data", 4))
+        {
+            if (!has_fmt)
+                return -1;
+
+            uint64_t bytes_per_frame = (uint64_t)Pa_GetSampleSize(info->format) * info->channel;
+            info->data_offset = pos + 8;
+            // a saturated or unpatched length means "until end of file"
+            if (len == 0 || len > file_size - info->data_offset)
+                len = file_size - info->data_offset;
+            info->data_bytes = len - len % bytes_per_frame;
+            return 0;
+        }
+
+        // chunks are word aligned
+        pos += 8 + len + (len & 1);
+    }
+    return -1;
+}
@@ -0,0 +1,41 @@
+/*************************************************************************
+ Description: Minimal RIFF/WAVE writer and header parser.
+
+              The header is written with zero lengths first and patched by
+              wav_finalize() once the amount of sample data is known.
+ ************************************************************************/
+
+#ifndef PACAP_WAV_H
+#define PACAP_WAV_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "portaudio.h"
+
+#define WAV_HEADER_BYTES 44
+
+struct Wav_info
+{
+    PaSampleFormat format;
+    int channel;
+    double rate;
+    uint64_t data_offset;   // of the first sample, from the beginning of the file
+    uint64_t data_bytes;    // whole frames only, clamped to what's in the file
+};
+
+// return 0 if samples of `format` can be stored in WAV
+int wav_format_supported(PaSampleFormat format);
+
+// return 0 on success, -1 on error
+int wav_write_header(FILE *fp, PaSampleFormat format, int channel, double rate, uint64_t data_bytes);
+
+// rewrite the header with final length, file position is left at the end of file
+int wav_finalize(FILE *fp, PaSampleFormat format, int channel, double rate, uint64_t data_bytes);
+
+/* parse the header of a WAV file of `file_size` bytes whose first `size` bytes are in `buf`,
+ * PCM 8/16/24/32 bits and 32 bits float are supported, also in WAVE_FORMAT_EXTENSIBLE.
+ * return 0 on success */
+int wav_parse_header(const void *buf, uint64_t size, uint64_t file_size, struct Wav_info *info);
+
+#endif